@@ -0,0 +1,467 @@
+/* crc32fast.c -- CRC-32 selected at run time for the processor
+   part of the MiniZip project
+
+   The PCLMULQDQ folding follows Intel's "Fast CRC Computation for Generic
+   Polynomials Using PCLMULQDQ Instruction", combining uses the x^(2^n)
+   powers of zlib 1.2.12 crc32_combine. Without either instruction set the
+   slice-by-8 tables are used, or zlib itself when it is 1.2.12 or later.
+
+   This program is distributed under the terms of the same license as zlib.
+   See the accompanying LICENSE file for the full text of the license.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "zlib.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define CRC32_FAST_PCLMUL
+#  include <cpuid.h>
+#  include <immintrin.h>
+#endif
+#if defined(__GNUC__) && defined(__aarch64__)
+#  define CRC32_FAST_ARM
+#  include <arm_acle.h>
+#  if defined(__APPLE__)
+#    include <sys/sysctl.h>
+#  elif defined(__linux__)
+#    include <sys/auxv.h>
+#    ifndef HWCAP_CRC32
+#      define HWCAP_CRC32 (1 << 7)
+#    endif
+#  endif
+#endif
+
+#include "crc32fast.h"
+
+#ifndef CRC32_FAST_PARALLEL_MINSIZE
+#  define CRC32_FAST_PARALLEL_MINSIZE (2 * 1024 * 1024)
+#endif
+#ifndef CRC32_FAST_MAXTHREADS
+#  define CRC32_FAST_MAXTHREADS (16)
+#endif
+#define CRC32_FAST_COPY_CHUNK (16 * 1024)
+#define CRC32_FAST_POLY (0xedb88320)
+
+/***************************************************************************/
+
+typedef uint32_t (*crc32_fast_func)(uint32_t crc, const uint8_t *buf, uint64_t len);
+
+typedef struct crc32_fast_part_s
+{
+    const uint8_t *buf;
+    uint64_t len;
+    uint32_t crc;
+} crc32_fast_part;
+
+static pthread_once_t crc32_fast_once = PTHREAD_ONCE_INIT;
+static crc32_fast_func crc32_fast_engine = NULL;
+static uint32_t crc32_fast_table[8][256];
+static uint32_t crc32_fast_x2n_table[32];
+
+/***************************************************************************/
+
+static uint32_t crc32_fast_read32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t crc32_fast_slice8(uint32_t crc, const uint8_t *buf, uint64_t len)
+{
+    uint32_t c = ~crc;
+    uint32_t one = 0;
+    uint32_t two = 0;
+
+    while ((len > 0) && (((uintptr_t)buf & 7) != 0))
+    {
+        c = crc32_fast_table[0][(c ^ *buf++) & 0xff] ^ (c >> 8);
+        len -= 1;
+    }
+    while (len >= 8)
+    {
+        one = crc32_fast_read32(buf) ^ c;
+        two = crc32_fast_read32(buf + 4);
+        c = crc32_fast_table[7][one & 0xff] ^ crc32_fast_table[6][(one >> 8) & 0xff] ^
+            crc32_fast_table[5][(one >> 16) & 0xff] ^ crc32_fast_table[4][one >> 24] ^
+            crc32_fast_table[3][two & 0xff] ^ crc32_fast_table[2][(two >> 8) & 0xff] ^
+            crc32_fast_table[1][(two >> 16) & 0xff] ^ crc32_fast_table[0][two >> 24];
+        buf += 8;
+        len -= 8;
+    }
+    while (len > 0)
+    {
+        c = crc32_fast_table[0][(c ^ *buf++) & 0xff] ^ (c >> 8);
+        len -= 1;
+    }
+    return ~c;
+}
+
+/* Braided crc32 of zlib 1.2.12 and later is faster than slice-by-8 */
+static uint32_t crc32_fast_zlib(uint32_t crc, const uint8_t *buf, uint64_t len)
+{
+    uint32_t chunk = 0;
+
+    while (len > 0)
+    {
+        chunk = UINT32_MAX;
+        if (len < chunk)
+            chunk = (uint32_t)len;
+        crc = (uint32_t)crc32(crc, buf, chunk);
+        buf += chunk;
+        len -= chunk;
+    }
+    return crc;
+}
+
+static int crc32_fast_zlib_is_braided(void)
+{
+    int major = 0, minor = 0, revision = 0;
+
+    if (sscanf(zlibVersion(), "%d.%d.%d", &major, &minor, &revision) < 2)
+        return 0;
+    if (major != 1)
+        return major > 1;
+    if (minor != 2)
+        return minor > 2;
+    return revision >= 12;
+}
+
+#ifdef CRC32_FAST_PCLMUL
+/* Fold 64 bytes at a time into four 128 bits values, then into one, reduced to 32 bits at the end,
+   len is at least 64 and a multiple of 16. Takes and returns the crc without the final xor */
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_fast_pclmul_fold(uint32_t c, const uint8_t *buf, uint64_t len)
+{
+    static const uint64_t __attribute__((aligned(16))) k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+    static const uint64_t __attribute__((aligned(16))) k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+    static const uint64_t __attribute__((aligned(16))) k5k0[] = { 0x0163cd6124, 0x0000000000 };
+    static const uint64_t __attribute__((aligned(16))) poly[] = { 0x01db710641, 0x01f7011641 };
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)c));
+    x0 = _mm_load_si128((const __m128i *)k1k2);
+    buf += 64;
+    len -= 64;
+
+    while (len >= 64)
+    {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+        y5 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+        y6 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+        y7 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+        y8 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+        buf += 64;
+        len -= 64;
+    }
+
+    /* Fold into 128 bits */
+    x0 = _mm_load_si128((const __m128i *)k3k4);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    while (len >= 16)
+    {
+        x2 = _mm_loadu_si128((const __m128i *)buf);
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        buf += 16;
+        len -= 16;
+    }
+
+    /* Fold 128 bits to 64 bits */
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+    x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    /* Barrett reduction to 32 bits */
+    x0 = _mm_load_si128((const __m128i *)poly);
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+static uint32_t crc32_fast_pclmul(uint32_t crc, const uint8_t *buf, uint64_t len)
+{
+    uint64_t len_folded = len & ~(uint64_t)15;
+
+    if (len < 64)
+        return crc32_fast_slice8(crc, buf, len);
+
+    crc = ~crc32_fast_pclmul_fold(~crc, buf, len_folded);
+    return crc32_fast_slice8(crc, buf + len_folded, len - len_folded);
+}
+
+static int crc32_fast_has_pclmul(void)
+{
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return 0;
+    /* PCLMULQDQ and SSE4.1 */
+    return ((ecx & (1 << 1)) != 0) && ((ecx & (1 << 19)) != 0);
+}
+#endif
+
+#ifdef CRC32_FAST_ARM
+#if defined(__clang__)
+__attribute__((target("crc")))
+#else
+__attribute__((target("+crc")))
+#endif
+static uint32_t crc32_fast_arm(uint32_t crc, const uint8_t *buf, uint64_t len)
+{
+    uint32_t c = ~crc;
+    uint64_t value = 0;
+
+    while ((len > 0) && (((uintptr_t)buf & 7) != 0))
+    {
+        c = __crc32b(c, *buf++);
+        len -= 1;
+    }
+    while (len >= 8)
+    {
+        memcpy(&value, buf, 8);
+        c = __crc32d(c, value);
+        buf += 8;
+        len -= 8;
+    }
+    while (len > 0)
+    {
+        c = __crc32b(c, *buf++);
+        len -= 1;
+    }
+    return ~c;
+}
+
+static int crc32_fast_has_arm_crc(void)
+{
+#if defined(__APPLE__)
+    int value = 0;
+    size_t size = sizeof(value);
+
+    if (sysctlbyname("hw.optional.armv8_crc32", &value, &size, NULL, 0) != 0)
+        return 0;
+    return value != 0;
+#elif defined(__linux__)
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#else
+    return 0;
+#endif
+}
+#endif
+
+/***************************************************************************/
+
+static uint32_t crc32_fast_multmodp(uint32_t a, uint32_t b)
+{
+    uint32_t m = (uint32_t)1 << 31;
+    uint32_t p = 0;
+
+    for (;;)
+    {
+        if (a & m)
+        {
+            p ^= b;
+            if ((a & (m - 1)) == 0)
+                break;
+        }
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ CRC32_FAST_POLY : b >> 1;
+    }
+    return p;
+}
+
+/* Return x^(n * 2^k) modulo p(x) */
+static uint32_t crc32_fast_x2nmodp(uint64_t n, uint32_t k)
+{
+    uint32_t p = (uint32_t)1 << 31;
+
+    while (n)
+    {
+        if (n & 1)
+            p = crc32_fast_multmodp(crc32_fast_x2n_table[k & 31], p);
+        n >>= 1;
+        k += 1;
+    }
+    return p;
+}
+
+static void crc32_fast_init(void)
+{
+    uint32_t c = 0;
+    uint32_t i = 0;
+    uint32_t k = 0;
+
+    for (i = 0; i < 256; i += 1)
+    {
+        c = i;
+        for (k = 0; k < 8; k += 1)
+            c = (c & 1) ? (c >> 1) ^ CRC32_FAST_POLY : c >> 1;
+        crc32_fast_table[0][i] = c;
+    }
+    for (i = 0; i < 256; i += 1)
+    {
+        c = crc32_fast_table[0][i];
+        for (k = 1; k < 8; k += 1)
+        {
+            c = crc32_fast_table[0][c & 0xff] ^ (c >> 8);
+            crc32_fast_table[k][i] = c;
+        }
+    }
+
+    c = (uint32_t)1 << 30; /* x^1 */
+    crc32_fast_x2n_table[0] = c;
+    for (i = 1; i < 32; i += 1)
+    {
+        c = crc32_fast_multmodp(c, c);
+        crc32_fast_x2n_table[i] = c;
+    }
+
+    crc32_fast_engine = crc32_fast_slice8;
+    if (crc32_fast_zlib_is_braided())
+        crc32_fast_engine = crc32_fast_zlib;
+#ifdef CRC32_FAST_PCLMUL
+    if (crc32_fast_has_pclmul())
+        crc32_fast_engine = crc32_fast_pclmul;
+#endif
+#ifdef CRC32_FAST_ARM
+    if (crc32_fast_has_arm_crc())
+        crc32_fast_engine = crc32_fast_arm;
+#endif
+}
+
+/***************************************************************************/
+
+uint32_t crc32_fast(uint32_t crc, const void *buf, uint64_t len)
+{
+    pthread_once(&crc32_fast_once, crc32_fast_init);
+    if ((buf == NULL) || (len == 0))
+        return crc;
+    return crc32_fast_engine(crc, (const uint8_t*)buf, len);
+}
+
+uint32_t crc32_fast_copy(uint32_t crc, void *dest, const void *source, uint64_t len)
+{
+    const uint8_t *src = (const uint8_t*)source;
+    uint8_t *dst = (uint8_t*)dest;
+    uint64_t chunk = 0;
+
+    pthread_once(&crc32_fast_once, crc32_fast_init);
+
+    /* Sum each chunk right after copying it, it is still in the first level cache */
+    while (len > 0)
+    {
+        chunk = CRC32_FAST_COPY_CHUNK;
+        if (len < chunk)
+            chunk = len;
+        memcpy(dst, src, (size_t)chunk);
+        crc = crc32_fast_engine(crc, dst, chunk);
+        src += chunk;
+        dst += chunk;
+        len -= chunk;
+    }
+    return crc;
+}
+
+uint32_t crc32_fast_combine(uint32_t crc1, uint32_t crc2, uint64_t len2)
+{
+    pthread_once(&crc32_fast_once, crc32_fast_init);
+    return crc32_fast_multmodp(crc32_fast_x2nmodp(len2, 3), crc1) ^ crc2;
+}
+
+static void *crc32_fast_worker(void *arg)
+{
+    crc32_fast_part *part = (crc32_fast_part*)arg;
+    part->crc = crc32_fast_engine(part->crc, part->buf, part->len);
+    return NULL;
+}
+
+uint32_t crc32_fast_parallel(uint32_t crc, const void *buf, uint64_t len, uint32_t thread_count)
+{
+    crc32_fast_part parts[CRC32_FAST_MAXTHREADS];
+    pthread_t threads[CRC32_FAST_MAXTHREADS];
+    int started[CRC32_FAST_MAXTHREADS];
+    const uint8_t *p = (const uint8_t*)buf;
+    uint64_t part_size = 0;
+    uint32_t i = 0;
+    long online = 0;
+
+    pthread_once(&crc32_fast_once, crc32_fast_init);
+
+    if (thread_count == 0)
+    {
+        online = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = (online > 0) ? (uint32_t)online : 1;
+    }
+    if (thread_count > CRC32_FAST_MAXTHREADS)
+        thread_count = CRC32_FAST_MAXTHREADS;
+    if ((uint64_t)thread_count > len / CRC32_FAST_PARALLEL_MINSIZE)
+        thread_count = (uint32_t)(len / CRC32_FAST_PARALLEL_MINSIZE);
+    if (thread_count <= 1)
+        return crc32_fast(crc, buf, len);
+
+    part_size = len / thread_count;
+    for (i = 0; i < thread_count; i += 1)
+    {
+        parts[i].buf = p + part_size * i;
+        parts[i].len = (i == thread_count - 1) ? len - part_size * i : part_size;
+        parts[i].crc = 0;
+        started[i] = 0;
+    }
+    parts[0].crc = crc;
+
+    /* First part is summed on the calling thread, parts whose thread can not start too */
+    for (i = 1; i < thread_count; i += 1)
+        started[i] = (pthread_create(&threads[i], NULL, crc32_fast_worker, &parts[i]) == 0);
+    crc32_fast_worker(&parts[0]);
+    for (i = 1; i < thread_count; i += 1)
+    {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        else
+            crc32_fast_worker(&parts[i]);
+    }
+
+    crc = parts[0].crc;
+    for (i = 1; i < thread_count; i += 1)
+        crc = crc32_fast_combine(crc, parts[i].crc, parts[i].len);
+    return crc;
+}
@@ -0,0 +1,40 @@
+/* crc32fast.h -- CRC-32 selected at run time for the processor
+   part of the MiniZip project
+
+   This program is distributed under the terms of the same license as zlib.
+   See the accompanying LICENSE file for the full text of the license.
+*/
+
+#ifndef _CRC32FAST_H
+#define _CRC32FAST_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***************************************************************************/
+
+uint32_t crc32_fast(uint32_t crc, const void *buf, uint64_t len);
+/* Update a running crc with the bytes of buf, same result as zlib crc32. Uses the ARMv8 CRC32 instructions
+   or PCLMULQDQ folding when the processor has them, slice-by-8 tables or braided zlib otherwise */
+
+uint32_t crc32_fast_copy(uint32_t crc, void *dest, const void *source, uint64_t len);
+/* Copy len bytes of source to dest and update the running crc with them while they are in cache */
+
+uint32_t crc32_fast_combine(uint32_t crc1, uint32_t crc2, uint64_t len2);
+/* Return the crc of two blocks one after the other from the crc of each block and the length of the
+   second one, like zlib crc32_combine with 64 bits lengths */
+
+uint32_t crc32_fast_parallel(uint32_t crc, const void *buf, uint64_t len, uint32_t thread_count);
+/* Update a running crc with the bytes of buf, splitting large buffers between threads whose results are
+   put together with crc32_fast_combine. thread_count 0 uses one thread per online processor */
+
+/***************************************************************************/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CRC32FAST_H */
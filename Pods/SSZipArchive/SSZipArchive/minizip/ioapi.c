@@ -18,6 +18,8 @@
 
 #if defined unix || defined __APPLE__
 #include <sys/types.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <unistd.h>
 #endif
 
@@ -63,6 +65,83 @@ uint64_t call_ztell64(const zlib_filefunc64_32_def *pfilefunc, voidpf filestream
     return position;
 }
 
+const void* call_zmap64(const zlib_filefunc64_32_def *pfilefunc, voidpf filestream, uint64_t offset, uint64_t *size)
+{
+    *size = 0;
+    if (pfilefunc->zfile_ext.zmap64_file == NULL)
+        return NULL;
+    return (*(pfilefunc->zfile_ext.zmap64_file))(pfilefunc->zfile_func64.opaque, filestream, offset, size);
+}
+
+uint32_t call_zpread64(const zlib_filefunc64_32_def *pfilefunc, voidpf filestream, void *buf, uint32_t size, uint64_t offset)
+{
+    if (pfilefunc->zfile_ext.zpread64_file != NULL)
+        return (*(pfilefunc->zfile_ext.zpread64_file))(pfilefunc->zfile_func64.opaque, filestream, buf, size, offset);
+    /* Emulate with a seek followed by a read for backends without positional reads */
+    if (call_zseek64(pfilefunc, filestream, offset, ZLIB_FILEFUNC_SEEK_SET) != 0)
+        return 0;
+    return ZREAD64(*pfilefunc, filestream, buf, size);
+}
+
+int call_zadvise64(const zlib_filefunc64_32_def *pfilefunc, voidpf filestream, uint64_t offset, uint64_t size, int advice)
+{
+    /* Hints are only hints, backends without them have nothing to do */
+    if (pfilefunc->zfile_ext.zadvise64_file == NULL)
+        return 0;
+    return (*(pfilefunc->zfile_ext.zadvise64_file))(pfilefunc->zfile_func64.opaque, filestream, offset, size, advice);
+}
+
+int fadvise64_fd(int fd, uint64_t offset, uint64_t size, int advice)
+{
+#if defined(__APPLE__)
+    struct radvisory read_advice;
+
+    switch (advice)
+    {
+        case ZLIB_FILEFUNC_ADVISE_NORMAL:
+        case ZLIB_FILEFUNC_ADVISE_SEQUENTIAL:
+            return (fcntl(fd, F_RDAHEAD, 1) == -1) ? -1 : 0;
+        case ZLIB_FILEFUNC_ADVISE_RANDOM:
+            return (fcntl(fd, F_RDAHEAD, 0) == -1) ? -1 : 0;
+        case ZLIB_FILEFUNC_ADVISE_WILLNEED:
+            if (offset > INT64_MAX)
+                return -1;
+            /* The count of a read advisory is an int, larger ranges are hinted up to its limit */
+            if ((size == 0) || (size > INT32_MAX))
+                size = INT32_MAX;
+            read_advice.ra_offset = (off_t)offset;
+            read_advice.ra_count = (int)size;
+            return (fcntl(fd, F_RDADVISE, &read_advice) == -1) ? -1 : 0;
+        default:
+            /* Cached pages of a single file can not be dropped */
+            return 0;
+    }
+#elif (defined unix) && (defined POSIX_FADV_NORMAL)
+    int fadvice = POSIX_FADV_NORMAL;
+
+    switch (advice)
+    {
+        case ZLIB_FILEFUNC_ADVISE_SEQUENTIAL:
+            fadvice = POSIX_FADV_SEQUENTIAL;
+            break;
+        case ZLIB_FILEFUNC_ADVISE_RANDOM:
+            fadvice = POSIX_FADV_RANDOM;
+            break;
+        case ZLIB_FILEFUNC_ADVISE_WILLNEED:
+            fadvice = POSIX_FADV_WILLNEED;
+            break;
+        case ZLIB_FILEFUNC_ADVISE_DONTNEED:
+            fadvice = POSIX_FADV_DONTNEED;
+            break;
+    }
+    if ((offset > INT64_MAX) || (size > INT64_MAX))
+        return -1;
+    return (posix_fadvise(fd, (off_t)offset, (off_t)size, fadvice) == 0) ? 0 : -1;
+#else
+    return 0;
+#endif
+}
+
 void fill_zlib_filefunc64_32_def_from_filefunc32(zlib_filefunc64_32_def *p_filefunc64_32, const zlib_filefunc_def *p_filefunc32)
 {
     p_filefunc64_32->zfile_func64.zopen64_file = NULL;
@@ -77,6 +156,9 @@ void fill_zlib_filefunc64_32_def_from_filefunc32(zlib_filefunc64_32_def *p_filef
     p_filefunc64_32->zfile_func64.zclose_file = p_filefunc32->zclose_file;
     p_filefunc64_32->zfile_func64.zerror_file = p_filefunc32->zerror_file;
     p_filefunc64_32->zfile_func64.opaque = p_filefunc32->opaque;
+    p_filefunc64_32->zfile_ext.zmap64_file = NULL;
+    p_filefunc64_32->zfile_ext.zpread64_file = NULL;
+    p_filefunc64_32->zfile_ext.zadvise64_file = NULL;
     p_filefunc64_32->zseek32_file = p_filefunc32->zseek_file;
     p_filefunc64_32->ztell32_file = p_filefunc32->ztell_file;
 }
@@ -86,23 +168,27 @@ static uint32_t ZCALLBACK fread_file_func(voidpf opaque, voidpf stream, void* bu
 static uint32_t ZCALLBACK fwrite_file_func(voidpf opaque, voidpf stream, const void *buf, uint32_t size);
 static uint64_t ZCALLBACK ftell64_file_func(voidpf opaque, voidpf stream);
 static long     ZCALLBACK fseek64_file_func(voidpf opaque, voidpf stream, uint64_t offset, int origin);
+static uint32_t ZCALLBACK fpread64_file_func(voidpf opaque, voidpf stream, void *buf, uint32_t size, uint64_t offset);
+static int      ZCALLBACK fadvise64_file_func(voidpf opaque, voidpf stream, uint64_t offset, uint64_t size, int advice);
 static int      ZCALLBACK fclose_file_func(voidpf opaque, voidpf stream);
 static int      ZCALLBACK ferror_file_func(voidpf opaque, voidpf stream);
 
 typedef struct 
 {
     FILE *file;
+    int mode;
     int filenameLength;
     void *filename;
 } FILE_IOPOSIX;
 
-static voidpf file_build_ioposix(FILE *file, const char *filename)
+static voidpf file_build_ioposix(FILE *file, const char *filename, int mode)
 {
     FILE_IOPOSIX *ioposix = NULL;
     if (file == NULL)
         return NULL;
     ioposix = (FILE_IOPOSIX*)malloc(sizeof(FILE_IOPOSIX));
     ioposix->file = file;
+    ioposix->mode = mode;
     ioposix->filenameLength = (int)strlen(filename) + 1;
     ioposix->filename = (char*)malloc(ioposix->filenameLength * sizeof(char));
     strncpy((char*)ioposix->filename, filename, ioposix->filenameLength);
@@ -123,7 +209,7 @@ static voidpf ZCALLBACK fopen_file_func(ZIP_UNUSED voidpf opaque, const char *fi
     if ((filename != NULL) && (mode_fopen != NULL))
     {
         file = fopen(filename, mode_fopen);
-        return file_build_ioposix(file, filename);
+        return file_build_ioposix(file, filename, mode);
     }
     return file;
 }
@@ -142,7 +228,7 @@ static voidpf ZCALLBACK fopen64_file_func(ZIP_UNUSED voidpf opaque, const void *
     if ((filename != NULL) && (mode_fopen != NULL))
     {
         file = fopen64((const char*)filename, mode_fopen);
-        return file_build_ioposix(file, (const char*)filename);
+        return file_build_ioposix(file, (const char*)filename, mode);
     }
     return file;
 }
@@ -301,6 +387,57 @@ static long ZCALLBACK fseek64_file_func(ZIP_UNUSED voidpf opaque, voidpf stream,
     return ret;
 }
 
+static uint32_t ZCALLBACK fpread64_file_func(ZIP_UNUSED voidpf opaque, voidpf stream, void *buf, uint32_t size, uint64_t offset)
+{
+    FILE_IOPOSIX *ioposix = NULL;
+    uint32_t read = 0;
+#if defined unix || defined __APPLE__
+    ssize_t bytes_read = 0;
+    int fd = -1;
+#endif
+
+    if (stream == NULL)
+        return read;
+    ioposix = (FILE_IOPOSIX*)stream;
+#if defined unix || defined __APPLE__
+    /* Pending buffered writes must reach the descriptor before reading it directly */
+    if ((ioposix->mode & ZLIB_FILEFUNC_MODE_READWRITEFILTER) != ZLIB_FILEFUNC_MODE_READ)
+    {
+        if (fflush(ioposix->file) != 0)
+            return read;
+    }
+    fd = fileno(ioposix->file);
+    while (read < size)
+    {
+        bytes_read = pread(fd, (uint8_t*)buf + read, (size_t)(size - read), (off_t)(offset + read));
+        if (bytes_read < 0 && errno == EINTR)
+            continue;
+        if (bytes_read <= 0)
+            break;
+        read += (uint32_t)bytes_read;
+    }
+#else
+    if (fseeko64(ioposix->file, offset, SEEK_SET) != 0)
+        return read;
+    read = (uint32_t)fread(buf, 1, (size_t)size, ioposix->file);
+#endif
+    return read;
+}
+
+static int ZCALLBACK fadvise64_file_func(ZIP_UNUSED voidpf opaque, voidpf stream, uint64_t offset, uint64_t size, int advice)
+{
+    FILE_IOPOSIX *ioposix = NULL;
+
+    if (stream == NULL)
+        return -1;
+    ioposix = (FILE_IOPOSIX*)stream;
+#if defined unix || defined __APPLE__
+    return fadvise64_fd(fileno(ioposix->file), offset, size, advice);
+#else
+    return 0;
+#endif
+}
+
 static int ZCALLBACK fclose_file_func(ZIP_UNUSED voidpf opaque, voidpf stream)
 {
     FILE_IOPOSIX *ioposix = NULL;
@@ -351,3 +488,10 @@ void fill_fopen64_filefunc(zlib_filefunc64_def *pzlib_filefunc_def)
     pzlib_filefunc_def->zerror_file = ferror_file_func;
     pzlib_filefunc_def->opaque = NULL;
 }
+
+void fill_fopen64_filefunc_ext(zlib_filefunc64_ext_def *pzlib_filefunc_ext_def)
+{
+    pzlib_filefunc_ext_def->zmap64_file = NULL;
+    pzlib_filefunc_ext_def->zpread64_file = fpread64_file_func;
+    pzlib_filefunc_ext_def->zadvise64_file = fadvise64_file_func;
+}
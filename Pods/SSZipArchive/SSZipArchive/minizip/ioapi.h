@@ -64,6 +64,12 @@ extern "C" {
 #define ZLIB_FILEFUNC_MODE_EXISTING         (4)
 #define ZLIB_FILEFUNC_MODE_CREATE           (8)
 
+#define ZLIB_FILEFUNC_ADVISE_NORMAL         (0)
+#define ZLIB_FILEFUNC_ADVISE_SEQUENTIAL     (1)
+#define ZLIB_FILEFUNC_ADVISE_RANDOM         (2)
+#define ZLIB_FILEFUNC_ADVISE_WILLNEED       (3)
+#define ZLIB_FILEFUNC_ADVISE_DONTNEED       (4)
+
 #ifndef ZCALLBACK
 #  if (defined(WIN32) || defined(_WIN32) || defined (WINDOWS) || \
        defined (_WINDOWS)) && defined(CALLBACK) && defined (USEWINDOWS_CALLBACK)
@@ -101,6 +107,9 @@ typedef uint64_t (ZCALLBACK *tell64_file_func)    (voidpf opaque, voidpf stream)
 typedef long     (ZCALLBACK *seek64_file_func)    (voidpf opaque, voidpf stream, uint64_t offset, int origin);
 typedef voidpf   (ZCALLBACK *open64_file_func)    (voidpf opaque, const void *filename, int mode);
 typedef voidpf   (ZCALLBACK *opendisk64_file_func)(voidpf opaque, voidpf stream, uint32_t number_disk, int mode);
+typedef const void* (ZCALLBACK *map64_file_func)(voidpf opaque, voidpf stream, uint64_t offset, uint64_t *size);
+typedef uint32_t (ZCALLBACK *pread64_file_func)   (voidpf opaque, voidpf stream, void *buf, uint32_t size, uint64_t offset);
+typedef int      (ZCALLBACK *advise64_file_func)  (voidpf opaque, voidpf stream, uint64_t offset, uint64_t size, int advice);
 
 typedef struct zlib_filefunc64_def_s
 {
@@ -115,13 +124,30 @@ typedef struct zlib_filefunc64_def_s
     voidpf               opaque;
 } zlib_filefunc64_def;
 
+/* Optional io functions, kept out of zlib_filefunc64_def so definitions filled by hand keep working.
+   They share the opaque and streams of the zlib_filefunc64_def they go with, and are given to an opened
+   zipfile with unzSetFileFuncExt. Fill them with the fill_*_filefunc64_ext functions or set the ones not
+   provided to NULL */
+typedef struct zlib_filefunc64_ext_def_s
+{
+    map64_file_func      zmap64_file;   /* pointer to the stream contents at offset if memory mapped */
+    pread64_file_func    zpread64_file; /* read at offset without moving the stream position */
+    advise64_file_func   zadvise64_file; /* hint how a range of the stream will be used, size 0 up to the end */
+} zlib_filefunc64_ext_def;
+
 void fill_fopen_filefunc(zlib_filefunc_def *pzlib_filefunc_def);
 void fill_fopen64_filefunc(zlib_filefunc64_def *pzlib_filefunc_def);
+void fill_fopen64_filefunc_ext(zlib_filefunc64_ext_def *pzlib_filefunc_ext_def);
+
+int fadvise64_fd(int fd, uint64_t offset, uint64_t size, int advice);
+/* Give a ZLIB_FILEFUNC_ADVISE hint for a range of a file descriptor to the system, for io functions built
+   on descriptors. Hints the system does not have are ignored, return 0 if no error */
 
 /* now internal definition, only for zip.c and unzip.h */
 typedef struct zlib_filefunc64_32_def_s
 {
     zlib_filefunc64_def zfile_func64;
+    zlib_filefunc64_ext_def zfile_ext;
     open_file_func      zopen32_file;
     opendisk_file_func  zopendisk32_file;
     tell_file_func      ztell32_file;
@@ -139,6 +165,9 @@ voidpf   call_zopen64(const zlib_filefunc64_32_def *pfilefunc,const void*filenam
 voidpf   call_zopendisk64(const zlib_filefunc64_32_def *pfilefunc, voidpf filestream, uint32_t number_disk, int mode);
 long     call_zseek64(const zlib_filefunc64_32_def *pfilefunc, voidpf filestream, uint64_t offset, int origin);
 uint64_t call_ztell64(const zlib_filefunc64_32_def *pfilefunc, voidpf filestream);
+const void* call_zmap64(const zlib_filefunc64_32_def *pfilefunc, voidpf filestream, uint64_t offset, uint64_t *size);
+uint32_t call_zpread64(const zlib_filefunc64_32_def *pfilefunc, voidpf filestream, void *buf, uint32_t size, uint64_t offset);
+int      call_zadvise64(const zlib_filefunc64_32_def *pfilefunc, voidpf filestream, uint64_t offset, uint64_t size, int advice);
 
 void fill_zlib_filefunc64_32_def_from_filefunc32(zlib_filefunc64_32_def *p_filefunc64_32, const zlib_filefunc_def *p_filefunc32);
 
@@ -146,6 +175,9 @@ void fill_zlib_filefunc64_32_def_from_filefunc32(zlib_filefunc64_32_def *p_filef
 #define ZOPENDISK64(filefunc,filestream,diskn,mode) (call_zopendisk64((&(filefunc)),(filestream),(diskn),(mode)))
 #define ZTELL64(filefunc,filestream)                (call_ztell64((&(filefunc)),(filestream)))
 #define ZSEEK64(filefunc,filestream,pos,mode)       (call_zseek64((&(filefunc)),(filestream),(pos),(mode)))
+#define ZMAP64(filefunc,filestream,pos,size)        (call_zmap64((&(filefunc)),(filestream),(pos),(size)))
+#define ZPREAD64(filefunc,filestream,buf,size,pos)  (call_zpread64((&(filefunc)),(filestream),(buf),(size),(pos)))
+#define ZADVISE64(filefunc,filestream,pos,size,advice) (call_zadvise64((&(filefunc)),(filestream),(pos),(size),(advice)))
 
 #ifdef __cplusplus
 }
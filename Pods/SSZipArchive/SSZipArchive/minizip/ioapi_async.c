@@ -0,0 +1,636 @@
+/* ioapi_async.c -- IO base function header for compress/uncompress .zip
+   files using zlib + zip or unzip API
+
+   This version of ioapi gives each opened file an io thread. Files opened
+   for reading are read ahead in a queue of blocks starting where the last
+   read ended, so sequential reads of the archive find their data already
+   loaded. Files opened for writing have their writes copied into blocks
+   that the io thread writes behind in the order they were queued.
+
+   Files are read and written directly with pread and pwrite when the io
+   thread can not be started.
+
+   This program is distributed under the terms of the same license as zlib.
+   See the accompanying LICENSE file for the full text of the license.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "zlib.h"
+#include "ioapi.h"
+
+#include "ioapi_async.h"
+
+#if defined(_WIN32)
+#  define snprintf _snprintf
+#endif
+
+#ifndef IOASYNC_QUEUEDEPTH
+#  define IOASYNC_QUEUEDEPTH    (8)
+#endif
+#ifndef IOASYNC_BLOCKSIZE
+#  define IOASYNC_BLOCKSIZE     (256 * 1024)
+#endif
+
+#define IOASYNC_BLOCK_FREE      (0)     /* Unused */
+#define IOASYNC_BLOCK_FILLING   (1)     /* Receiving written data */
+#define IOASYNC_BLOCK_QUEUED    (2)     /* Waiting for the io thread */
+#define IOASYNC_BLOCK_BUSY      (3)     /* Owned by the io thread */
+#define IOASYNC_BLOCK_READY     (4)     /* Holds data read ahead */
+
+typedef struct ourasync_block_s {
+    uint8_t *data;
+    uint64_t offset;        /* Offset of the data in the file */
+    uint32_t size;          /* Bytes read or bytes to write */
+    uint64_t sequence;      /* Order the block was queued in */
+    int state;
+    int error;              /* Read failed */
+} ourasync_block_t;
+
+typedef struct ourasync_stream_s {
+    int fd;
+    int writing;            /* Opened for writing, blocks are written behind */
+    uint64_t cur_offset;    /* Current offset in the file */
+    uint64_t file_size;     /* Size of the file including data not written yet */
+    int error;              /* Last operation failed */
+    int write_error;        /* A write behind failed */
+    ourasync_block_t *blocks;
+    uint32_t block_count;
+    uint32_t block_size;
+    ourasync_block_t *filling;
+    uint64_t read_ahead_offset;
+    uint64_t sequence;
+    uint32_t pending_writes;
+    int thread_started;
+    int stop;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t io_cond;     /* Wakes the io thread */
+    pthread_cond_t done_cond;   /* Signalled when the io thread is done with a block */
+    int filename_size;
+    char *filename;
+} ourasync_stream_t;
+
+static uint32_t async_pread_all(int fd, uint8_t *buf, uint32_t size, uint64_t offset, int *error)
+{
+    uint32_t done = 0;
+    ssize_t bytes = 0;
+
+    *error = 0;
+    while (done < size)
+    {
+        bytes = pread(fd, buf + done, size - done, (off_t)(offset + done));
+        if (bytes < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            *error = 1;
+            break;
+        }
+        if (bytes == 0)
+            break;
+        done += (uint32_t)bytes;
+    }
+    return done;
+}
+
+static uint32_t async_pwrite_all(int fd, const uint8_t *buf, uint32_t size, uint64_t offset, int *error)
+{
+    uint32_t done = 0;
+    ssize_t bytes = 0;
+
+    *error = 0;
+    while (done < size)
+    {
+        bytes = pwrite(fd, buf + done, size - done, (off_t)(offset + done));
+        if (bytes < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            *error = 1;
+            break;
+        }
+        done += (uint32_t)bytes;
+    }
+    return done;
+}
+
+static void *async_io_thread(void *arg)
+{
+    ourasync_stream_t *asyncio = (ourasync_stream_t*)arg;
+    ourasync_block_t *block = NULL;
+    uint32_t i = 0;
+    uint32_t size = 0;
+    int error = 0;
+
+    pthread_mutex_lock(&asyncio->mutex);
+    for (;;)
+    {
+        /* Oldest queued block first so writes land in the order they were made */
+        block = NULL;
+        for (i = 0; i < asyncio->block_count; i += 1)
+        {
+            if (asyncio->blocks[i].state != IOASYNC_BLOCK_QUEUED)
+                continue;
+            if ((block == NULL) || (asyncio->blocks[i].sequence < block->sequence))
+                block = &asyncio->blocks[i];
+        }
+        if (block == NULL)
+        {
+            if (asyncio->stop)
+                break;
+            pthread_cond_wait(&asyncio->io_cond, &asyncio->mutex);
+            continue;
+        }
+
+        block->state = IOASYNC_BLOCK_BUSY;
+        pthread_mutex_unlock(&asyncio->mutex);
+
+        if (asyncio->writing)
+            async_pwrite_all(asyncio->fd, block->data, block->size, block->offset, &error);
+        else
+            size = async_pread_all(asyncio->fd, block->data, asyncio->block_size, block->offset, &error);
+
+        pthread_mutex_lock(&asyncio->mutex);
+        if (asyncio->writing)
+        {
+            if (error)
+                asyncio->write_error = 1;
+            asyncio->pending_writes -= 1;
+            block->state = IOASYNC_BLOCK_FREE;
+        }
+        else
+        {
+            block->size = size;
+            block->error = error;
+            block->state = IOASYNC_BLOCK_READY;
+        }
+        pthread_cond_broadcast(&asyncio->done_cond);
+    }
+    pthread_mutex_unlock(&asyncio->mutex);
+    return NULL;
+}
+
+static void async_queue_block(ourasync_stream_t *asyncio, ourasync_block_t *block)
+{
+    block->state = IOASYNC_BLOCK_QUEUED;
+    block->sequence = asyncio->sequence++;
+    if (asyncio->writing)
+        asyncio->pending_writes += 1;
+    pthread_cond_signal(&asyncio->io_cond);
+}
+
+static ourasync_block_t *async_free_block(ourasync_stream_t *asyncio)
+{
+    uint32_t i = 0;
+
+    for (i = 0; i < asyncio->block_count; i += 1)
+    {
+        if (asyncio->blocks[i].state == IOASYNC_BLOCK_FREE)
+            return &asyncio->blocks[i];
+    }
+    return NULL;
+}
+
+static void async_flush(ourasync_stream_t *asyncio)
+{
+    if (!asyncio->thread_started || !asyncio->writing)
+        return;
+
+    pthread_mutex_lock(&asyncio->mutex);
+    if (asyncio->filling != NULL)
+    {
+        if (asyncio->filling->size > 0)
+            async_queue_block(asyncio, asyncio->filling);
+        else
+            asyncio->filling->state = IOASYNC_BLOCK_FREE;
+        asyncio->filling = NULL;
+    }
+    while (asyncio->pending_writes > 0)
+        pthread_cond_wait(&asyncio->done_cond, &asyncio->mutex);
+    pthread_mutex_unlock(&asyncio->mutex);
+}
+
+static void async_read_ahead(ourasync_stream_t *asyncio, uint64_t offset)
+{
+    ourasync_block_t *block = NULL;
+    uint64_t window_end = offset + (uint64_t)asyncio->block_count * asyncio->block_size;
+    uint32_t i = 0;
+    int restart = 0;
+
+    /* Called with the mutex held. Reads that do not continue from the queue start it over */
+    restart = (asyncio->read_ahead_offset < offset) || (asyncio->read_ahead_offset > window_end);
+    for (i = 0; i < asyncio->block_count; i += 1)
+    {
+        block = &asyncio->blocks[i];
+        if ((block->state != IOASYNC_BLOCK_READY) && (block->state != IOASYNC_BLOCK_QUEUED))
+            continue;
+        if (restart || (block->offset + asyncio->block_size <= offset) || (block->offset >= window_end))
+            block->state = IOASYNC_BLOCK_FREE;
+    }
+    if (restart)
+        asyncio->read_ahead_offset = offset;
+
+    while ((asyncio->read_ahead_offset < asyncio->file_size) && (asyncio->read_ahead_offset < window_end))
+    {
+        block = async_free_block(asyncio);
+        if (block == NULL)
+            break;
+        block->offset = asyncio->read_ahead_offset;
+        block->size = 0;
+        block->error = 0;
+        async_queue_block(asyncio, block);
+        asyncio->read_ahead_offset += asyncio->block_size;
+    }
+}
+
+static uint32_t async_read_at(ourasync_stream_t *asyncio, uint8_t *buf, uint32_t size, uint64_t offset, int *error)
+{
+    ourasync_block_t *block = NULL;
+    uint64_t pos = 0;
+    uint32_t done = 0;
+    uint32_t copy = 0;
+    uint32_t i = 0;
+
+    /* Positional reads can come from several threads, so the error is returned instead of stored */
+    *error = 0;
+    if (!asyncio->thread_started || asyncio->writing)
+    {
+        async_flush(asyncio);
+        return async_pread_all(asyncio->fd, buf, size, offset, error);
+    }
+
+    pthread_mutex_lock(&asyncio->mutex);
+    while (done < size)
+    {
+        pos = offset + done;
+        block = NULL;
+        for (i = 0; i < asyncio->block_count; i += 1)
+        {
+            if ((asyncio->blocks[i].state == IOASYNC_BLOCK_FREE) ||
+                (pos < asyncio->blocks[i].offset) || (pos >= asyncio->blocks[i].offset + asyncio->block_size))
+                continue;
+            block = &asyncio->blocks[i];
+            if (block->state == IOASYNC_BLOCK_READY)
+                break;
+        }
+        if (block == NULL)
+            break;
+        if (block->state != IOASYNC_BLOCK_READY)
+        {
+            /* Look the block up again once it is loaded, it may be recycled meanwhile */
+            pthread_cond_wait(&asyncio->done_cond, &asyncio->mutex);
+            continue;
+        }
+        if ((block->error) || (pos - block->offset >= block->size))
+            break;
+
+        copy = block->size - (uint32_t)(pos - block->offset);
+        if (copy > size - done)
+            copy = size - done;
+        memcpy(buf + done, block->data + (pos - block->offset), copy);
+        done += copy;
+    }
+    pthread_mutex_unlock(&asyncio->mutex);
+
+    /* Data that was not read ahead is read directly */
+    if (done < size)
+        done += async_pread_all(asyncio->fd, buf + done, size - done, offset + done, error);
+
+    pthread_mutex_lock(&asyncio->mutex);
+    async_read_ahead(asyncio, offset + done);
+    pthread_mutex_unlock(&asyncio->mutex);
+    return done;
+}
+
+static uint32_t async_write(ourasync_stream_t *asyncio, const uint8_t *buf, uint32_t size)
+{
+    ourasync_block_t *block = NULL;
+    uint32_t done = 0;
+    uint32_t copy = 0;
+    int error = 0;
+
+    if (!asyncio->thread_started)
+    {
+        done = async_pwrite_all(asyncio->fd, buf, size, asyncio->cur_offset, &error);
+        asyncio->error = error;
+        asyncio->cur_offset += done;
+        if (asyncio->cur_offset > asyncio->file_size)
+            asyncio->file_size = asyncio->cur_offset;
+        return done;
+    }
+
+    pthread_mutex_lock(&asyncio->mutex);
+    while (done < size)
+    {
+        block = asyncio->filling;
+        if ((block != NULL) && (block->offset + block->size != asyncio->cur_offset))
+        {
+            /* Written somewhere else since, the block is complete */
+            if (block->size > 0)
+                async_queue_block(asyncio, block);
+            else
+                block->state = IOASYNC_BLOCK_FREE;
+            block = asyncio->filling = NULL;
+        }
+        if (block == NULL)
+        {
+            while ((block = async_free_block(asyncio)) == NULL)
+                pthread_cond_wait(&asyncio->done_cond, &asyncio->mutex);
+            block->state = IOASYNC_BLOCK_FILLING;
+            block->offset = asyncio->cur_offset;
+            block->size = 0;
+            asyncio->filling = block;
+        }
+
+        copy = asyncio->block_size - block->size;
+        if (copy > size - done)
+            copy = size - done;
+        memcpy(block->data + block->size, buf + done, copy);
+        block->size += copy;
+        done += copy;
+        asyncio->cur_offset += copy;
+
+        if (block->size == asyncio->block_size)
+        {
+            async_queue_block(asyncio, block);
+            asyncio->filling = NULL;
+        }
+    }
+    if (asyncio->cur_offset > asyncio->file_size)
+        asyncio->file_size = asyncio->cur_offset;
+    asyncio->error = asyncio->write_error;
+    pthread_mutex_unlock(&asyncio->mutex);
+    return done;
+}
+
+static void async_free_stream(ourasync_stream_t *asyncio)
+{
+    uint32_t i = 0;
+
+    if (asyncio->blocks != NULL)
+    {
+        for (i = 0; i < asyncio->block_count; i += 1)
+        {
+            if (asyncio->blocks[i].data != NULL)
+                free(asyncio->blocks[i].data);
+        }
+        free(asyncio->blocks);
+    }
+    if (asyncio->filename != NULL)
+        free(asyncio->filename);
+    free(asyncio);
+}
+
+voidpf ZCALLBACK fopen64_async_func(voidpf opaque, const void *filename, int mode)
+{
+    ourasync_t *options = (ourasync_t*)opaque;
+    ourasync_stream_t *asyncio = NULL;
+    struct stat file_stat;
+    uint32_t i = 0;
+    int flags = 0;
+    int fd = -1;
+
+    if (filename == NULL)
+        return NULL;
+
+    if ((mode & ZLIB_FILEFUNC_MODE_READWRITEFILTER) == ZLIB_FILEFUNC_MODE_READ)
+        flags = O_RDONLY;
+    else if (mode & ZLIB_FILEFUNC_MODE_EXISTING)
+        flags = O_RDWR;
+    else if (mode & ZLIB_FILEFUNC_MODE_CREATE)
+        flags = O_RDWR | O_CREAT | O_TRUNC;
+    else
+        return NULL;
+
+    fd = open((const char*)filename, flags, 0666);
+    if (fd == -1)
+        return NULL;
+    if ((fstat(fd, &file_stat) != 0) || (file_stat.st_size < 0))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    asyncio = (ourasync_stream_t*)malloc(sizeof(ourasync_stream_t));
+    if (asyncio == NULL)
+    {
+        close(fd);
+        return NULL;
+    }
+    memset(asyncio, 0, sizeof(ourasync_stream_t));
+    asyncio->fd = fd;
+    asyncio->writing = (flags != O_RDONLY);
+    asyncio->file_size = (uint64_t)file_stat.st_size;
+    asyncio->block_count = IOASYNC_QUEUEDEPTH;
+    asyncio->block_size = IOASYNC_BLOCKSIZE;
+    if ((options != NULL) && (options->queue_depth > 0))
+        asyncio->block_count = options->queue_depth;
+    if ((options != NULL) && (options->block_size > 0))
+        asyncio->block_size = options->block_size;
+
+    asyncio->filename_size = (int)strlen((const char*)filename) + 1;
+    asyncio->filename = (char*)malloc(asyncio->filename_size * sizeof(char));
+    if (asyncio->filename != NULL)
+        strncpy(asyncio->filename, (const char*)filename, asyncio->filename_size);
+
+    asyncio->blocks = (ourasync_block_t*)calloc(asyncio->block_count, sizeof(ourasync_block_t));
+    if (asyncio->blocks != NULL)
+    {
+        for (i = 0; i < asyncio->block_count; i += 1)
+        {
+            asyncio->blocks[i].data = (uint8_t*)malloc(asyncio->block_size);
+            if (asyncio->blocks[i].data == NULL)
+                break;
+        }
+    }
+
+    /* Without blocks or a thread the file is read and written directly */
+    if ((asyncio->blocks != NULL) && (i == asyncio->block_count))
+    {
+        pthread_mutex_init(&asyncio->mutex, NULL);
+        pthread_cond_init(&asyncio->io_cond, NULL);
+        pthread_cond_init(&asyncio->done_cond, NULL);
+        if (pthread_create(&asyncio->thread, NULL, async_io_thread, asyncio) == 0)
+        {
+            asyncio->thread_started = 1;
+        }
+        else
+        {
+            pthread_cond_destroy(&asyncio->done_cond);
+            pthread_cond_destroy(&asyncio->io_cond);
+            pthread_mutex_destroy(&asyncio->mutex);
+        }
+    }
+    return asyncio;
+}
+
+voidpf ZCALLBACK fopendisk64_async_func(voidpf opaque, voidpf stream, uint32_t number_disk, int mode)
+{
+    ourasync_stream_t *asyncio = (ourasync_stream_t*)stream;
+    char *disk_filename = NULL;
+    voidpf ret = NULL;
+    int i = 0;
+
+    if (asyncio == NULL || asyncio->filename == NULL)
+        return NULL;
+    disk_filename = (char*)malloc(asyncio->filename_size * sizeof(char));
+    if (disk_filename == NULL)
+        return NULL;
+    strncpy(disk_filename, asyncio->filename, asyncio->filename_size);
+    for (i = asyncio->filename_size - 1; i >= 0; i -= 1)
+    {
+        if (disk_filename[i] != '.')
+            continue;
+        snprintf(&disk_filename[i], asyncio->filename_size - i, ".z%02u", number_disk + 1);
+        break;
+    }
+    if (i >= 0)
+        ret = fopen64_async_func(opaque, disk_filename, mode);
+    free(disk_filename);
+    return ret;
+}
+
+uint32_t ZCALLBACK fread_async_func(ZIP_UNUSED voidpf opaque, voidpf stream, void *buf, uint32_t size)
+{
+    ourasync_stream_t *asyncio = (ourasync_stream_t*)stream;
+    uint32_t read = 0;
+    int error = 0;
+
+    read = async_read_at(asyncio, (uint8_t*)buf, size, asyncio->cur_offset, &error);
+    asyncio->error = error;
+    asyncio->cur_offset += read;
+    return read;
+}
+
+uint32_t ZCALLBACK fwrite_async_func(ZIP_UNUSED voidpf opaque, voidpf stream, const void *buf, uint32_t size)
+{
+    ourasync_stream_t *asyncio = (ourasync_stream_t*)stream;
+
+    if (!asyncio->writing)
+    {
+        asyncio->error = 1;
+        return 0;
+    }
+    return async_write(asyncio, (const uint8_t*)buf, size);
+}
+
+uint64_t ZCALLBACK ftell64_async_func(ZIP_UNUSED voidpf opaque, voidpf stream)
+{
+    ourasync_stream_t *asyncio = (ourasync_stream_t*)stream;
+    return asyncio->cur_offset;
+}
+
+long ZCALLBACK fseek64_async_func(ZIP_UNUSED voidpf opaque, voidpf stream, uint64_t offset, int origin)
+{
+    ourasync_stream_t *asyncio = (ourasync_stream_t*)stream;
+    uint64_t new_pos = 0;
+
+    /* Writes behind are positional so seeking only moves the logical offset */
+    switch (origin)
+    {
+        case ZLIB_FILEFUNC_SEEK_CUR:
+            new_pos = asyncio->cur_offset + offset;
+            break;
+        case ZLIB_FILEFUNC_SEEK_END:
+            new_pos = asyncio->file_size + offset;
+            break;
+        case ZLIB_FILEFUNC_SEEK_SET:
+            new_pos = offset;
+            break;
+        default:
+            return -1;
+    }
+
+    if ((int64_t)new_pos < 0)
+    {
+        asyncio->error = 1;
+        return -1;
+    }
+    asyncio->cur_offset = new_pos;
+    asyncio->error = 0;
+    return 0;
+}
+
+uint32_t ZCALLBACK fpread64_async_func(ZIP_UNUSED voidpf opaque, voidpf stream, void *buf, uint32_t size, uint64_t offset)
+{
+    ourasync_stream_t *asyncio = (ourasync_stream_t*)stream;
+    int error = 0;
+    /* Leaves the current offset and error untouched so clones can read concurrently */
+    return async_read_at(asyncio, (uint8_t*)buf, size, offset, &error);
+}
+
+int ZCALLBACK fadvise64_async_func(ZIP_UNUSED voidpf opaque, voidpf stream, uint64_t offset, uint64_t size, int advice)
+{
+    ourasync_stream_t *asyncio = (ourasync_stream_t*)stream;
+    return fadvise64_fd(asyncio->fd, offset, size, advice);
+}
+
+int ZCALLBACK fclose_async_func(ZIP_UNUSED voidpf opaque, voidpf stream)
+{
+    ourasync_stream_t *asyncio = (ourasync_stream_t*)stream;
+    uint32_t i = 0;
+    int ret = 0;
+
+    if (asyncio == NULL)
+        return -1;
+    if (asyncio->thread_started)
+    {
+        async_flush(asyncio);
+        pthread_mutex_lock(&asyncio->mutex);
+        asyncio->stop = 1;
+        /* Blocks read ahead are not needed anymore, only the one being read is waited for */
+        for (i = 0; (!asyncio->writing) && (i < asyncio->block_count); i += 1)
+        {
+            if (asyncio->blocks[i].state == IOASYNC_BLOCK_QUEUED)
+                asyncio->blocks[i].state = IOASYNC_BLOCK_FREE;
+        }
+        pthread_cond_signal(&asyncio->io_cond);
+        pthread_mutex_unlock(&asyncio->mutex);
+        pthread_join(asyncio->thread, NULL);
+        pthread_cond_destroy(&asyncio->done_cond);
+        pthread_cond_destroy(&asyncio->io_cond);
+        pthread_mutex_destroy(&asyncio->mutex);
+        if (asyncio->write_error)
+            ret = -1;
+    }
+    if (close(asyncio->fd) != 0)
+        ret = -1;
+    async_free_stream(asyncio);
+    return ret;
+}
+
+int ZCALLBACK ferror_async_func(ZIP_UNUSED voidpf opaque, voidpf stream)
+{
+    ourasync_stream_t *asyncio = (ourasync_stream_t*)stream;
+    return asyncio->error || asyncio->write_error;
+}
+
+void fill_async_filefunc64(zlib_filefunc64_def *pzlib_filefunc_def, ourasync_t *options)
+{
+    pzlib_filefunc_def->zopen64_file = fopen64_async_func;
+    pzlib_filefunc_def->zopendisk64_file = fopendisk64_async_func;
+    pzlib_filefunc_def->zread_file = fread_async_func;
+    pzlib_filefunc_def->zwrite_file = fwrite_async_func;
+    pzlib_filefunc_def->ztell64_file = ftell64_async_func;
+    pzlib_filefunc_def->zseek64_file = fseek64_async_func;
+    pzlib_filefunc_def->zclose_file = fclose_async_func;
+    pzlib_filefunc_def->zerror_file = ferror_async_func;
+    pzlib_filefunc_def->opaque = options;
+}
+
+void fill_async_filefunc64_ext(zlib_filefunc64_ext_def *pzlib_filefunc_ext_def)
+{
+    pzlib_filefunc_ext_def->zmap64_file = NULL;
+    pzlib_filefunc_ext_def->zpread64_file = fpread64_async_func;
+    pzlib_filefunc_ext_def->zadvise64_file = fadvise64_async_func;
+}
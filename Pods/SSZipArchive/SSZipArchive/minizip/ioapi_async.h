@@ -0,0 +1,51 @@
+/* ioapi_async.h -- IO base function header for compress/uncompress .zip
+   files using zlib + zip or unzip API
+
+   This version of ioapi reads ahead and writes behind with an io thread.
+
+   This program is distributed under the terms of the same license as zlib.
+   See the accompanying LICENSE file for the full text of the license.
+*/
+
+#ifndef _IOAPI_ASYNC_H
+#define _IOAPI_ASYNC_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "zlib.h"
+#include "ioapi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+voidpf   ZCALLBACK fopen64_async_func(voidpf opaque, const void* filename, int mode);
+voidpf   ZCALLBACK fopendisk64_async_func(voidpf opaque, voidpf stream, uint32_t number_disk, int mode);
+uint32_t ZCALLBACK fread_async_func(voidpf opaque, voidpf stream, void* buf, uint32_t size);
+uint32_t ZCALLBACK fwrite_async_func(voidpf opaque, voidpf stream, const void* buf, uint32_t size);
+uint64_t ZCALLBACK ftell64_async_func(voidpf opaque, voidpf stream);
+long     ZCALLBACK fseek64_async_func(voidpf opaque, voidpf stream, uint64_t offset, int origin);
+uint32_t ZCALLBACK fpread64_async_func(voidpf opaque, voidpf stream, void* buf, uint32_t size, uint64_t offset);
+int      ZCALLBACK fadvise64_async_func(voidpf opaque, voidpf stream, uint64_t offset, uint64_t size, int advice);
+int      ZCALLBACK fclose_async_func(voidpf opaque, voidpf stream);
+int      ZCALLBACK ferror_async_func(voidpf opaque, voidpf stream);
+
+typedef struct ourasync_s {
+    uint32_t queue_depth;   /* Number of blocks read ahead or written behind, 0 for the default */
+    uint32_t block_size;    /* Size of each block, 0 for the default */
+} ourasync_t;
+
+/* Each opened file gets an io thread. Files opened for reading are read ahead of the last read in
+   queue_depth blocks, files opened for writing have their writes copied to blocks written in order
+   behind the caller. Files are read and written directly when the thread can not be started.
+   options can be NULL for the defaults, otherwise it must stay valid while files are open */
+void fill_async_filefunc64(zlib_filefunc64_def* pzlib_filefunc_def, ourasync_t *options);
+void fill_async_filefunc64_ext(zlib_filefunc64_ext_def* pzlib_filefunc_ext_def);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -406,6 +406,47 @@ long ZCALLBACK fseek64_buf_func(voidpf opaque, voidpf stream, uint64_t offset, i
     return ret;
 }
 
+uint32_t ZCALLBACK fpread64_buf_func(voidpf opaque, voidpf stream, void *buf, uint32_t size, uint64_t offset)
+{
+    ourbuffer_t *bufio = (ourbuffer_t *)opaque;
+    ourstream_t *streamio = (ourstream_t *)stream;
+    uint64_t readbuf_offset = 0;
+
+    print_buf(opaque, stream, "pread [size %ld offset %llu pos %lld]\n", size, offset, streamio->position);
+
+    if (streamio->readbuf_len > 0)
+    {
+        readbuf_offset = streamio->position - streamio->readbuf_len;
+        if ((offset >= readbuf_offset) && (offset + size <= streamio->position))
+        {
+            /* Positional reads can come from several threads, the stream statistics are left alone */
+            memcpy(buf, streamio->readbuf + (offset - readbuf_offset), size);
+            return size;
+        }
+    }
+
+    /* Write out anything pending so the underlying stream sees it, the read buffer is left alone */
+    if (streamio->writebuf_len > 0)
+    {
+        if (fflush_buf(opaque, stream) < 0)
+            return 0;
+    }
+
+    return bufio->filefunc64_ext.zpread64_file(bufio->filefunc64.opaque, streamio->stream, buf, size, offset);
+}
+
+int ZCALLBACK fadvise64_buf_func(voidpf opaque, voidpf stream, uint64_t offset, uint64_t size, int advice)
+{
+    ourbuffer_t *bufio = (ourbuffer_t *)opaque;
+    ourstream_t *streamio = (ourstream_t *)stream;
+
+    print_buf(opaque, stream, "advise [size %llu offset %llu advice %d]\n", size, offset, advice);
+
+    if (bufio->filefunc64_ext.zadvise64_file == NULL)
+        return 0;
+    return bufio->filefunc64_ext.zadvise64_file(bufio->filefunc64.opaque, streamio->stream, offset, size, advice);
+}
+
 int ZCALLBACK fclose_buf_func(voidpf opaque, voidpf stream)
 {
     ourbuffer_t *bufio = (ourbuffer_t *)opaque;
@@ -459,3 +500,18 @@ void fill_buffer_filefunc64(zlib_filefunc64_def *pzlib_filefunc_def, ourbuffer_t
     pzlib_filefunc_def->zerror_file = ferror_buf_func;
     pzlib_filefunc_def->opaque = ourbuf;
 }
+
+void fill_buffer_filefunc64_ext(zlib_filefunc64_ext_def *pzlib_filefunc_ext_def, ourbuffer_t *ourbuf,
+    const zlib_filefunc64_ext_def *pzlib_filefunc_ext_def_buffered)
+{
+    if (pzlib_filefunc_ext_def_buffered != NULL)
+        ourbuf->filefunc64_ext = *pzlib_filefunc_ext_def_buffered;
+    else
+        memset(&ourbuf->filefunc64_ext, 0, sizeof(ourbuf->filefunc64_ext));
+    pzlib_filefunc_ext_def->zmap64_file = NULL;
+    /* Without positional reads underneath, reads at an offset would move the one shared stream */
+    pzlib_filefunc_ext_def->zpread64_file = NULL;
+    if (ourbuf->filefunc64_ext.zpread64_file != NULL)
+        pzlib_filefunc_ext_def->zpread64_file = fpread64_buf_func;
+    pzlib_filefunc_ext_def->zadvise64_file = fadvise64_buf_func;
+}
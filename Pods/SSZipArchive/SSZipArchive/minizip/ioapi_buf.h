@@ -34,16 +34,24 @@ long     ZCALLBACK ftell_buf_func(voidpf opaque, voidpf stream);
 uint64_t ZCALLBACK ftell64_buf_func(voidpf opaque, voidpf stream);
 long     ZCALLBACK fseek_buf_func(voidpf opaque, voidpf stream, uint32_t offset, int origin);
 long     ZCALLBACK fseek64_buf_func(voidpf opaque, voidpf stream, uint64_t offset, int origin);
+uint32_t ZCALLBACK fpread64_buf_func(voidpf opaque, voidpf stream, void* buf, uint32_t size, uint64_t offset);
+int      ZCALLBACK fadvise64_buf_func(voidpf opaque, voidpf stream, uint64_t offset, uint64_t size, int advice);
 int      ZCALLBACK fclose_buf_func(voidpf opaque,voidpf stream);
 int      ZCALLBACK ferror_buf_func(voidpf opaque,voidpf stream);
 
 typedef struct ourbuffer_s {
   zlib_filefunc_def   filefunc;
   zlib_filefunc64_def filefunc64;
+  zlib_filefunc64_ext_def filefunc64_ext; /* set by fill_buffer_filefunc64_ext */
 } ourbuffer_t;
 
 void fill_buffer_filefunc(zlib_filefunc_def* pzlib_filefunc_def, ourbuffer_t *ourbuf);
 void fill_buffer_filefunc64(zlib_filefunc64_def* pzlib_filefunc_def, ourbuffer_t *ourbuf);
+/* Positional reads and hints go through the buffer to the optional functions of filefunc64 given in
+   pzlib_filefunc_ext_def_buffered, which can be NULL when it has none. Positional reads are only
+   provided when filefunc64 has them */
+void fill_buffer_filefunc64_ext(zlib_filefunc64_ext_def* pzlib_filefunc_ext_def, ourbuffer_t *ourbuf,
+    const zlib_filefunc64_ext_def *pzlib_filefunc_ext_def_buffered);
 
 #ifdef __cplusplus
 }
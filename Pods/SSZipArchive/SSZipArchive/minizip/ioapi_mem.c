@@ -153,6 +153,47 @@ int ZCALLBACK ferror_mem_func(ZIP_UNUSED voidpf opaque, ZIP_UNUSED voidpf stream
     return 0;
 }
 
+voidpf ZCALLBACK fopen64_mem_func(voidpf opaque, const void *filename, int mode)
+{
+    return fopen_mem_func(opaque, (const char *)filename, mode);
+}
+
+uint64_t ZCALLBACK ftell64_mem_func(voidpf opaque, voidpf stream)
+{
+    return (uint64_t)ftell_mem_func(opaque, stream);
+}
+
+long ZCALLBACK fseek64_mem_func(voidpf opaque, voidpf stream, uint64_t offset, int origin)
+{
+    if (offset > UINT32_MAX)
+        return 1; /* Failed to seek that far */
+    return fseek_mem_func(opaque, stream, (uint32_t)offset, origin);
+}
+
+const void* ZCALLBACK fmap64_mem_func(ZIP_UNUSED voidpf opaque, voidpf stream, uint64_t offset, uint64_t *size)
+{
+    ourmemory_t *mem = (ourmemory_t *)stream;
+
+    *size = 0;
+    if ((mem->base == NULL) || (offset >= mem->limit))
+        return NULL;
+    *size = mem->limit - offset;
+    return mem->base + offset;
+}
+
+uint32_t ZCALLBACK fpread64_mem_func(ZIP_UNUSED voidpf opaque, voidpf stream, void *buf, uint32_t size, uint64_t offset)
+{
+    ourmemory_t *mem = (ourmemory_t *)stream;
+
+    if (offset >= mem->limit)
+        return 0;
+    if (size > mem->limit - offset)
+        size = (uint32_t)(mem->limit - offset);
+
+    memcpy(buf, mem->base + offset, size);
+    return size;
+}
+
 void fill_memory_filefunc(zlib_filefunc_def *pzlib_filefunc_def, ourmemory_t *ourmem)
 {
     pzlib_filefunc_def->zopen_file = fopen_mem_func;
@@ -165,3 +206,23 @@ void fill_memory_filefunc(zlib_filefunc_def *pzlib_filefunc_def, ourmemory_t *ou
     pzlib_filefunc_def->zerror_file = ferror_mem_func;
     pzlib_filefunc_def->opaque = ourmem;
 }
+
+void fill_memory_filefunc64(zlib_filefunc64_def *pzlib_filefunc_def, ourmemory_t *ourmem)
+{
+    pzlib_filefunc_def->zopen64_file = fopen64_mem_func;
+    pzlib_filefunc_def->zopendisk64_file = fopendisk_mem_func;
+    pzlib_filefunc_def->zread_file = fread_mem_func;
+    pzlib_filefunc_def->zwrite_file = fwrite_mem_func;
+    pzlib_filefunc_def->ztell64_file = ftell64_mem_func;
+    pzlib_filefunc_def->zseek64_file = fseek64_mem_func;
+    pzlib_filefunc_def->zclose_file = fclose_mem_func;
+    pzlib_filefunc_def->zerror_file = ferror_mem_func;
+    pzlib_filefunc_def->opaque = ourmem;
+}
+
+void fill_memory_filefunc64_ext(zlib_filefunc64_ext_def *pzlib_filefunc_ext_def)
+{
+    pzlib_filefunc_ext_def->zmap64_file = fmap64_mem_func;
+    pzlib_filefunc_ext_def->zpread64_file = fpread64_mem_func;
+    pzlib_filefunc_ext_def->zadvise64_file = NULL;
+}
@@ -35,6 +35,12 @@ long     ZCALLBACK fseek_mem_func(voidpf opaque, voidpf stream, uint32_t offset,
 int      ZCALLBACK fclose_mem_func(voidpf opaque, voidpf stream);
 int      ZCALLBACK ferror_mem_func(voidpf opaque, voidpf stream);
 
+voidpf      ZCALLBACK fopen64_mem_func(voidpf opaque, const void* filename, int mode);
+uint64_t    ZCALLBACK ftell64_mem_func(voidpf opaque, voidpf stream);
+long        ZCALLBACK fseek64_mem_func(voidpf opaque, voidpf stream, uint64_t offset, int origin);
+const void* ZCALLBACK fmap64_mem_func(voidpf opaque, voidpf stream, uint64_t offset, uint64_t *size);
+uint32_t    ZCALLBACK fpread64_mem_func(voidpf opaque, voidpf stream, void* buf, uint32_t size, uint64_t offset);
+
 typedef struct ourmemory_s {
     char *base;          /* Base of the region of memory we're using */
     uint32_t size;       /* Size of the region of memory we're using */
@@ -44,6 +50,8 @@ typedef struct ourmemory_s {
 } ourmemory_t;
 
 void fill_memory_filefunc(zlib_filefunc_def* pzlib_filefunc_def, ourmemory_t *ourmem);
+void fill_memory_filefunc64(zlib_filefunc64_def* pzlib_filefunc_def, ourmemory_t *ourmem);
+void fill_memory_filefunc64_ext(zlib_filefunc64_ext_def* pzlib_filefunc_ext_def);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,284 @@
+/* ioapi_mmap.c -- IO base function header for compress/uncompress .zip
+   files using zlib + zip or unzip API
+
+   This version of ioapi maps the whole file read only in memory when it is
+   opened. Reads are copies out of the mapping and fmap64_mmap_func gives
+   unzip direct access to the mapping so it can decompress from it without
+   copying the compressed data first.
+
+   This program is distributed under the terms of the same license as zlib.
+   See the accompanying LICENSE file for the full text of the license.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "zlib.h"
+#include "ioapi.h"
+
+#include "ioapi_mmap.h"
+
+#if defined(_WIN32)
+#  define snprintf _snprintf
+#endif
+
+typedef struct ourmmap_s {
+    uint8_t *base;          /* Base of the mapping, NULL for an empty file */
+    uint64_t size;          /* Size of the file */
+    uint64_t cur_offset;    /* Current offset in the file */
+    int error;              /* Last operation failed */
+    int filename_size;
+    char *filename;
+} ourmmap_t;
+
+voidpf ZCALLBACK fopen64_mmap_func(ZIP_UNUSED voidpf opaque, const void *filename, int mode)
+{
+    ourmmap_t *mmapio = NULL;
+    struct stat file_stat;
+    void *base = NULL;
+    int fd = -1;
+
+    if (filename == NULL)
+        return NULL;
+    if ((mode & ZLIB_FILEFUNC_MODE_READWRITEFILTER) != ZLIB_FILEFUNC_MODE_READ)
+        return NULL;
+
+    fd = open((const char*)filename, O_RDONLY);
+    if (fd == -1)
+        return NULL;
+    if ((fstat(fd, &file_stat) != 0) || (file_stat.st_size < 0) || ((uint64_t)file_stat.st_size > (size_t)-1))
+    {
+        close(fd);
+        return NULL;
+    }
+    if (file_stat.st_size > 0)
+    {
+        base = mmap(NULL, (size_t)file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED)
+        {
+            close(fd);
+            return NULL;
+        }
+    }
+    /* The mapping stays valid after the descriptor is closed */
+    close(fd);
+
+    mmapio = (ourmmap_t*)malloc(sizeof(ourmmap_t));
+    if (mmapio == NULL)
+    {
+        if (base != NULL)
+            munmap(base, (size_t)file_stat.st_size);
+        return NULL;
+    }
+    mmapio->base = (uint8_t*)base;
+    mmapio->size = (uint64_t)file_stat.st_size;
+    mmapio->cur_offset = 0;
+    mmapio->error = 0;
+    mmapio->filename_size = (int)strlen((const char*)filename) + 1;
+    mmapio->filename = (char*)malloc(mmapio->filename_size * sizeof(char));
+    if (mmapio->filename != NULL)
+        strncpy(mmapio->filename, (const char*)filename, mmapio->filename_size);
+    return mmapio;
+}
+
+voidpf ZCALLBACK fopendisk64_mmap_func(voidpf opaque, voidpf stream, uint32_t number_disk, int mode)
+{
+    ourmmap_t *mmapio = (ourmmap_t*)stream;
+    char *disk_filename = NULL;
+    voidpf ret = NULL;
+    int i = 0;
+
+    if (mmapio == NULL || mmapio->filename == NULL)
+        return NULL;
+    disk_filename = (char*)malloc(mmapio->filename_size * sizeof(char));
+    if (disk_filename == NULL)
+        return NULL;
+    strncpy(disk_filename, mmapio->filename, mmapio->filename_size);
+    for (i = mmapio->filename_size - 1; i >= 0; i -= 1)
+    {
+        if (disk_filename[i] != '.')
+            continue;
+        snprintf(&disk_filename[i], mmapio->filename_size - i, ".z%02u", number_disk + 1);
+        break;
+    }
+    if (i >= 0)
+        ret = fopen64_mmap_func(opaque, disk_filename, mode);
+    free(disk_filename);
+    return ret;
+}
+
+uint32_t ZCALLBACK fread_mmap_func(ZIP_UNUSED voidpf opaque, voidpf stream, void *buf, uint32_t size)
+{
+    ourmmap_t *mmapio = (ourmmap_t*)stream;
+
+    if (mmapio->cur_offset >= mmapio->size)
+        return 0;
+    if (size > mmapio->size - mmapio->cur_offset)
+        size = (uint32_t)(mmapio->size - mmapio->cur_offset);
+
+    memcpy(buf, mmapio->base + mmapio->cur_offset, size);
+    mmapio->cur_offset += size;
+    mmapio->error = 0;
+    return size;
+}
+
+uint32_t ZCALLBACK fwrite_mmap_func(ZIP_UNUSED voidpf opaque, voidpf stream, ZIP_UNUSED const void *buf, ZIP_UNUSED uint32_t size)
+{
+    ourmmap_t *mmapio = (ourmmap_t*)stream;
+    /* Mapping is read only */
+    mmapio->error = 1;
+    return 0;
+}
+
+uint64_t ZCALLBACK ftell64_mmap_func(ZIP_UNUSED voidpf opaque, voidpf stream)
+{
+    ourmmap_t *mmapio = (ourmmap_t*)stream;
+    return mmapio->cur_offset;
+}
+
+long ZCALLBACK fseek64_mmap_func(ZIP_UNUSED voidpf opaque, voidpf stream, uint64_t offset, int origin)
+{
+    ourmmap_t *mmapio = (ourmmap_t*)stream;
+    uint64_t new_pos = 0;
+
+    switch (origin)
+    {
+        case ZLIB_FILEFUNC_SEEK_CUR:
+            new_pos = mmapio->cur_offset + offset;
+            break;
+        case ZLIB_FILEFUNC_SEEK_END:
+            new_pos = mmapio->size + offset;
+            break;
+        case ZLIB_FILEFUNC_SEEK_SET:
+            new_pos = offset;
+            break;
+        default:
+            return -1;
+    }
+
+    if (new_pos > mmapio->size)
+    {
+        mmapio->error = 1;
+        return -1;
+    }
+    mmapio->cur_offset = new_pos;
+    mmapio->error = 0;
+    return 0;
+}
+
+uint32_t ZCALLBACK fpread64_mmap_func(ZIP_UNUSED voidpf opaque, voidpf stream, void *buf, uint32_t size, uint64_t offset)
+{
+    ourmmap_t *mmapio = (ourmmap_t*)stream;
+
+    if (offset >= mmapio->size)
+        return 0;
+    if (size > mmapio->size - offset)
+        size = (uint32_t)(mmapio->size - offset);
+
+    /* Leaves the stream untouched so clones can read concurrently */
+    memcpy(buf, mmapio->base + offset, size);
+    return size;
+}
+
+int ZCALLBACK fclose_mmap_func(ZIP_UNUSED voidpf opaque, voidpf stream)
+{
+    ourmmap_t *mmapio = (ourmmap_t*)stream;
+    int ret = 0;
+
+    if (mmapio == NULL)
+        return -1;
+    if (mmapio->base != NULL)
+        ret = munmap(mmapio->base, (size_t)mmapio->size);
+    if (mmapio->filename != NULL)
+        free(mmapio->filename);
+    free(mmapio);
+    return ret;
+}
+
+int ZCALLBACK ferror_mmap_func(ZIP_UNUSED voidpf opaque, voidpf stream)
+{
+    ourmmap_t *mmapio = (ourmmap_t*)stream;
+    return mmapio->error;
+}
+
+int ZCALLBACK fadvise64_mmap_func(ZIP_UNUSED voidpf opaque, voidpf stream, uint64_t offset, uint64_t size, int advice)
+{
+    ourmmap_t *mmapio = (ourmmap_t*)stream;
+    uint64_t page_size = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t start = 0;
+    uint64_t end = 0;
+    int madvice = MADV_NORMAL;
+
+    if ((mmapio->base == NULL) || (offset >= mmapio->size))
+        return 0;
+    if ((size == 0) || (size > mmapio->size - offset))
+        size = mmapio->size - offset;
+
+    switch (advice)
+    {
+        case ZLIB_FILEFUNC_ADVISE_SEQUENTIAL:
+            madvice = MADV_SEQUENTIAL;
+            break;
+        case ZLIB_FILEFUNC_ADVISE_RANDOM:
+            madvice = MADV_RANDOM;
+            break;
+        case ZLIB_FILEFUNC_ADVISE_WILLNEED:
+            madvice = MADV_WILLNEED;
+            break;
+        case ZLIB_FILEFUNC_ADVISE_DONTNEED:
+            madvice = MADV_DONTNEED;
+            break;
+    }
+
+    /* Pages partly outside the range are hinted too, except when dropping them */
+    start = offset - (offset % page_size);
+    end = offset + size;
+    if (madvice == MADV_DONTNEED)
+    {
+        start = offset + (page_size - 1);
+        start -= start % page_size;
+        if (end < mmapio->size)
+            end -= end % page_size;
+        if (end <= start)
+            return 0;
+    }
+    return madvise(mmapio->base + start, (size_t)(end - start), madvice);
+}
+
+const void* ZCALLBACK fmap64_mmap_func(ZIP_UNUSED voidpf opaque, voidpf stream, uint64_t offset, uint64_t *size)
+{
+    ourmmap_t *mmapio = (ourmmap_t*)stream;
+
+    *size = 0;
+    if ((mmapio->base == NULL) || (offset >= mmapio->size))
+        return NULL;
+    *size = mmapio->size - offset;
+    return mmapio->base + offset;
+}
+
+void fill_mmap_filefunc64(zlib_filefunc64_def *pzlib_filefunc_def)
+{
+    pzlib_filefunc_def->zopen64_file = fopen64_mmap_func;
+    pzlib_filefunc_def->zopendisk64_file = fopendisk64_mmap_func;
+    pzlib_filefunc_def->zread_file = fread_mmap_func;
+    pzlib_filefunc_def->zwrite_file = fwrite_mmap_func;
+    pzlib_filefunc_def->ztell64_file = ftell64_mmap_func;
+    pzlib_filefunc_def->zseek64_file = fseek64_mmap_func;
+    pzlib_filefunc_def->zclose_file = fclose_mmap_func;
+    pzlib_filefunc_def->zerror_file = ferror_mmap_func;
+    pzlib_filefunc_def->opaque = NULL;
+}
+
+void fill_mmap_filefunc64_ext(zlib_filefunc64_ext_def *pzlib_filefunc_ext_def)
+{
+    pzlib_filefunc_ext_def->zmap64_file = fmap64_mmap_func;
+    pzlib_filefunc_ext_def->zpread64_file = fpread64_mmap_func;
+    pzlib_filefunc_ext_def->zadvise64_file = fadvise64_mmap_func;
+}
@@ -0,0 +1,45 @@
+/* ioapi_mmap.h -- IO base function header for compress/uncompress .zip
+   files using zlib + zip or unzip API
+
+   This version of ioapi is designed to read files mapped in memory.
+
+   This program is distributed under the terms of the same license as zlib.
+   See the accompanying LICENSE file for the full text of the license.
+*/
+
+#ifndef _IOAPI_MMAP_H
+#define _IOAPI_MMAP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "zlib.h"
+#include "ioapi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+voidpf      ZCALLBACK fopen64_mmap_func(voidpf opaque, const void* filename, int mode);
+voidpf      ZCALLBACK fopendisk64_mmap_func(voidpf opaque, voidpf stream, uint32_t number_disk, int mode);
+uint32_t    ZCALLBACK fread_mmap_func(voidpf opaque, voidpf stream, void* buf, uint32_t size);
+uint32_t    ZCALLBACK fwrite_mmap_func(voidpf opaque, voidpf stream, const void* buf, uint32_t size);
+uint64_t    ZCALLBACK ftell64_mmap_func(voidpf opaque, voidpf stream);
+long        ZCALLBACK fseek64_mmap_func(voidpf opaque, voidpf stream, uint64_t offset, int origin);
+uint32_t    ZCALLBACK fpread64_mmap_func(voidpf opaque, voidpf stream, void* buf, uint32_t size, uint64_t offset);
+int         ZCALLBACK fclose_mmap_func(voidpf opaque, voidpf stream);
+int         ZCALLBACK ferror_mmap_func(voidpf opaque, voidpf stream);
+int         ZCALLBACK fadvise64_mmap_func(voidpf opaque, voidpf stream, uint64_t offset, uint64_t size, int advice);
+const void* ZCALLBACK fmap64_mmap_func(voidpf opaque, voidpf stream, uint64_t offset, uint64_t *size);
+
+/* The whole file is mapped read only when opened, writing is not supported */
+void fill_mmap_filefunc64(zlib_filefunc64_def* pzlib_filefunc_def);
+/* Reads straight from the mapping, see unzSetFileFuncExt */
+void fill_mmap_filefunc64_ext(zlib_filefunc64_ext_def* pzlib_filefunc_ext_def);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
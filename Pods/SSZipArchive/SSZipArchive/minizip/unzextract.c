@@ -0,0 +1,574 @@
+/* unzextract.c -- Extract all files of a .zip using several threads
+   part of the MiniZip project
+
+   This program is distributed under the terms of the same license as zlib.
+   See the accompanying LICENSE file for the full text of the license.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "zlib.h"
+#include "unzip.h"
+#include "minishared.h"
+
+#include "unzextract.h"
+
+#ifndef UNZEXTRACT_BUFSIZE
+#  define UNZEXTRACT_BUFSIZE (1024 * 1024)
+#endif
+#ifndef UNZEXTRACT_MAXTHREADS
+#  define UNZEXTRACT_MAXTHREADS (64)
+#endif
+
+#ifndef ALLOC
+#  define ALLOC(size) (malloc(size))
+#endif
+#ifndef TRYFREE
+#  define TRYFREE(p) {if (p) free(p);}
+#endif
+
+/***************************************************************************/
+
+typedef struct unz_extract_task_s
+{
+    unz64_file_pos pos;                 /* position of the file in the central directory */
+    uint64_t number_entry;              /* number of the file in the central directory */
+    uint64_t uncompressed_size;         /* size used to order the files */
+} unz_extract_task;
+
+typedef struct unz_extract_s
+{
+    pthread_mutex_t mutex;              /* protects everything below */
+    const char *destination;            /* NULL to only verify the files */
+    const unz_extract_options *options;
+    unz_verify_result *results;         /* one for each file, written by the worker that verified it */
+
+    unz_extract_task *tasks;
+    uint64_t task_count;
+    uint64_t next_task;
+
+    uint64_t bytes_done;
+    uint64_t bytes_total;
+    uint64_t files_done;
+
+    uint64_t error_entry;               /* lowest number of a file that failed, UINT64_MAX if none */
+    int error;
+} unz_extract;
+
+typedef struct unz_extract_worker_s
+{
+    unz_extract *extract;
+    unzFile file;                       /* handle only used by this worker */
+    int is_clone;
+    pthread_t thread;
+    uint8_t *buf;
+    char *path;                         /* destination followed by the name of the current file */
+    size_t destination_len;
+} unz_extract_worker;
+
+/***************************************************************************/
+
+static int unzExtractCompareTasks(const void *a, const void *b)
+{
+    const unz_extract_task *task_a = (const unz_extract_task*)a;
+    const unz_extract_task *task_b = (const unz_extract_task*)b;
+
+    /* Largest first, ties in central directory order */
+    if (task_a->uncompressed_size != task_b->uncompressed_size)
+        return (task_a->uncompressed_size > task_b->uncompressed_size) ? -1 : 1;
+    if (task_a->number_entry != task_b->number_entry)
+        return (task_a->number_entry < task_b->number_entry) ? -1 : 1;
+    return 0;
+}
+
+static int unzExtractIsSafePath(const char *filename)
+{
+    const char *p = filename;
+
+    if ((*p == '/') || (*p == '\\'))
+        return 0;
+    while (*p != 0)
+    {
+        if ((p[0] == '.') && (p[1] == '.') && ((p[2] == 0) || (p[2] == '/') || (p[2] == '\\')))
+            return 0;
+        while ((*p != 0) && (*p != '/') && (*p != '\\'))
+            p += 1;
+        while ((*p == '/') || (*p == '\\'))
+            p += 1;
+    }
+    return 1;
+}
+
+/* Creates the directory and its parents without printing anything, returns 0 or the errno */
+static int unzExtractMakeDir(const char *path)
+{
+    struct stat path_stat;
+    char *buffer = NULL;
+    char *p = NULL;
+    char hold = 0;
+    size_t len = strlen(path);
+    int err = 0;
+
+    if (len == 0)
+        return 0;
+    if (MKDIR(path) == 0)
+        return 0;
+    if ((errno == EEXIST) && (stat(path, &path_stat) == 0) && (S_ISDIR(path_stat.st_mode)))
+        return 0;
+
+    buffer = (char*)ALLOC(len + 1);
+    if (buffer == NULL)
+        return ENOMEM;
+    memcpy(buffer, path, len + 1);
+
+    /* Other workers can create the same parents at the same time, existing directories are fine */
+    p = buffer + 1;
+    while (err == 0)
+    {
+        while ((*p != 0) && (*p != '/') && (*p != '\\'))
+            p += 1;
+        hold = *p;
+        *p = 0;
+        if (MKDIR(buffer) != 0)
+        {
+            err = errno;
+            if ((err == EEXIST) && (stat(buffer, &path_stat) == 0) && (S_ISDIR(path_stat.st_mode)))
+                err = 0;
+            else if (err == EEXIST)
+                err = ENOTDIR;
+        }
+        *p = hold;
+        while ((*p == '/') || (*p == '\\'))
+            p += 1;
+        if (*p == 0)
+            break;
+    }
+
+    TRYFREE(buffer);
+    if (err != 0)
+        errno = err;
+    return err;
+}
+
+static void unzExtractAddProgress(unz_extract *extract, uint64_t bytes, uint64_t files)
+{
+    pthread_mutex_lock(&extract->mutex);
+    extract->bytes_done += bytes;
+    extract->files_done += files;
+    if (extract->options->progress != NULL)
+        extract->options->progress(extract->bytes_done, extract->bytes_total,
+            extract->files_done, extract->task_count, extract->options->user_data);
+    pthread_mutex_unlock(&extract->mutex);
+}
+
+static int unzExtractCurrentFile(unz_extract_worker *worker)
+{
+    unz_extract *extract = worker->extract;
+    unz_file_info64 file_info;
+    FILE *fout = NULL;
+    char *filename = worker->path + worker->destination_len;
+    char *last_separator = NULL;
+    uint64_t bytes_left = 0;
+    uint32_t filename_len = 0;
+    int bytes_read = 0;
+    int err = UNZ_OK;
+    int err_close = UNZ_OK;
+
+    err = unzGetCurrentFileInfo64(worker->file, &file_info, filename, UINT16_MAX, NULL, 0, NULL, 0);
+    if (err != UNZ_OK)
+        return err;
+    /* Names of the maximum size are not terminated */
+    filename[file_info.size_filename] = 0;
+    if ((file_info.size_filename == 0) || (!unzExtractIsSafePath(filename)))
+        return UNZ_BADZIPFILE;
+
+    filename_len = file_info.size_filename;
+    if ((filename[filename_len - 1] == '/') || (filename[filename_len - 1] == '\\'))
+    {
+        if (unzExtractMakeDir(worker->path) != 0)
+            return UNZ_ERRNO;
+        unzExtractAddProgress(extract, 0, 1);
+        return UNZ_OK;
+    }
+
+    last_separator = strrchr(filename, '/');
+    if (last_separator != NULL)
+    {
+        *last_separator = 0;
+        if (unzExtractMakeDir(worker->path) != 0)
+            err = UNZ_ERRNO;
+        *last_separator = '/';
+        if (err != UNZ_OK)
+            return err;
+    }
+
+    if ((!extract->options->overwrite) && (check_file_exists(worker->path)))
+    {
+        unzExtractAddProgress(extract, file_info.uncompressed_size, 1);
+        return UNZ_OK;
+    }
+
+    /* The file can be open when opening it fails, like with a bad password */
+    err = unzOpenCurrentFilePassword(worker->file, extract->options->password);
+    if (err != UNZ_OK)
+    {
+        unzCloseCurrentFile(worker->file);
+        return err;
+    }
+
+    fout = fopen64(worker->path, "wb");
+    if (fout == NULL)
+        err = UNZ_ERRNO;
+
+    bytes_left = file_info.uncompressed_size;
+    while (err == UNZ_OK)
+    {
+        bytes_read = unzReadCurrentFile(worker->file, worker->buf, UNZEXTRACT_BUFSIZE);
+        if (bytes_read < 0)
+        {
+            err = bytes_read;
+            break;
+        }
+        if (bytes_read == 0)
+            break;
+        if (fwrite(worker->buf, 1, (size_t)bytes_read, fout) != (size_t)bytes_read)
+        {
+            err = UNZ_ERRNO;
+            break;
+        }
+        if ((uint64_t)bytes_read > bytes_left)
+            bytes_left = bytes_read;
+        bytes_left -= bytes_read;
+        unzExtractAddProgress(extract, (uint64_t)bytes_read, 0);
+    }
+
+    if ((fout != NULL) && (fclose(fout) != 0) && (err == UNZ_OK))
+        err = UNZ_ERRNO;
+
+    err_close = unzCloseCurrentFile(worker->file);
+    if (err == UNZ_OK)
+        err = err_close;
+
+    if (err == UNZ_OK)
+    {
+        change_file_date(worker->path, file_info.dos_date);
+        /* Keep the total consistent when the central directory size was wrong */
+        unzExtractAddProgress(extract, bytes_left, 1);
+    }
+    return err;
+}
+
+static int unzVerifyCurrentFile(unz_extract_worker *worker, unz_verify_result *result)
+{
+    unz_extract *extract = worker->extract;
+    unz_file_info64 file_info;
+    uint64_t bytes_left = 0;
+    int bytes_read = 0;
+    int err = UNZ_OK;
+    int err_close = UNZ_OK;
+
+    memset(&file_info, 0, sizeof(file_info));
+    err = unzGetCurrentFileInfo64(worker->file, &file_info, NULL, 0, NULL, 0, NULL, 0);
+    if (err == UNZ_OK)
+        err = unzCheckCurrentFileHeaders(worker->file);
+    /* The file can be open when opening it fails, like with a bad password */
+    if (err == UNZ_OK)
+    {
+        err = unzOpenCurrentFilePassword(worker->file, extract->options->password);
+        if (err != UNZ_OK)
+            unzCloseCurrentFile(worker->file);
+    }
+    if (err != UNZ_OK)
+    {
+        unzExtractAddProgress(extract, file_info.uncompressed_size, 1);
+        return err;
+    }
+
+    /* The crc and the AES authentication code are checked when the file is closed after reading all of it */
+    bytes_left = file_info.uncompressed_size;
+    for (;;)
+    {
+        bytes_read = unzReadCurrentFile(worker->file, worker->buf, UNZEXTRACT_BUFSIZE);
+        if (bytes_read <= 0)
+            break;
+        result->bytes_read += bytes_read;
+        if ((uint64_t)bytes_read > bytes_left)
+            bytes_left = bytes_read;
+        bytes_left -= bytes_read;
+        unzExtractAddProgress(extract, (uint64_t)bytes_read, 0);
+    }
+    if (bytes_read < 0)
+        err = bytes_read;
+
+    err_close = unzCloseCurrentFile(worker->file);
+    if (err == UNZ_OK)
+        err = err_close;
+    if ((err == UNZ_OK) && (result->bytes_read != file_info.uncompressed_size))
+        err = UNZ_BADZIPFILE;
+
+    unzExtractAddProgress(extract, bytes_left, 1);
+    return err;
+}
+
+static void *unzExtractWorker(void *arg)
+{
+    unz_extract_worker *worker = (unz_extract_worker*)arg;
+    unz_extract *extract = worker->extract;
+    unz_extract_task *task = NULL;
+    unz_verify_result result;
+    int err = UNZ_OK;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&extract->mutex);
+        task = NULL;
+        while (extract->next_task < extract->task_count)
+        {
+            task = &extract->tasks[extract->next_task];
+            extract->next_task += 1;
+            /* Files after one that failed can not change the result, unless every file is verified */
+            if ((extract->destination == NULL) || (task->number_entry < extract->error_entry))
+                break;
+            task = NULL;
+        }
+        pthread_mutex_unlock(&extract->mutex);
+
+        if (task == NULL)
+            break;
+
+        memset(&result, 0, sizeof(result));
+        err = unzGoToFilePos64(worker->file, &task->pos);
+        if ((err == UNZ_OK) && (extract->destination == NULL))
+            err = unzVerifyCurrentFile(worker, &result);
+        else if (err == UNZ_OK)
+            err = unzExtractCurrentFile(worker);
+        if (extract->results != NULL)
+        {
+            result.error = err;
+            extract->results[task->number_entry] = result;
+        }
+        if (err != UNZ_OK)
+        {
+            pthread_mutex_lock(&extract->mutex);
+            if (task->number_entry < extract->error_entry)
+            {
+                extract->error_entry = task->number_entry;
+                extract->error = err;
+            }
+            pthread_mutex_unlock(&extract->mutex);
+        }
+    }
+    return NULL;
+}
+
+static uint32_t unzExtractThreadCount(const unz_extract_options *options, uint64_t task_count)
+{
+    uint32_t thread_count = options->thread_count;
+    long online = 0;
+
+    if (thread_count == 0)
+    {
+        online = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = (online > 0) ? (uint32_t)online : 1;
+    }
+    if (thread_count > UNZEXTRACT_MAXTHREADS)
+        thread_count = UNZEXTRACT_MAXTHREADS;
+    if ((uint64_t)thread_count > task_count)
+        thread_count = (uint32_t)task_count;
+    if (thread_count == 0)
+        thread_count = 1;
+    return thread_count;
+}
+
+/***************************************************************************/
+
+/* Extract the files into destination, or verify them when it is NULL */
+static int unzExtractRun(unzFile file, const char *destination, const unz_extract_options *options,
+    unz_verify_result *results, uint64_t *error_entry)
+{
+    unz_extract_options default_options;
+    unz_extract extract;
+    unz_extract_worker workers[UNZEXTRACT_MAXTHREADS];
+    unz_global_info64 global_info;
+    unz_file_info64 file_info;
+    uint32_t thread_count = 0;
+    uint32_t started = 0;
+    uint32_t i = 0;
+    size_t destination_len = 0;
+    int err = UNZ_OK;
+
+    if (error_entry != NULL)
+        *error_entry = UINT64_MAX;
+    if (file == NULL)
+        return UNZ_PARAMERROR;
+    if (options == NULL)
+    {
+        memset(&default_options, 0, sizeof(default_options));
+        options = &default_options;
+    }
+
+    err = unzGetGlobalInfo64(file, &global_info);
+    if (err != UNZ_OK)
+        return err;
+
+    /* Files in the root of the zipfile go straight into the destination, which may not exist yet */
+    if ((destination != NULL) && (unzExtractMakeDir(destination) != 0))
+        return UNZ_ERRNO;
+
+    memset(&extract, 0, sizeof(extract));
+    memset(workers, 0, sizeof(workers));
+    extract.destination = destination;
+    extract.options = options;
+    extract.results = results;
+    extract.error_entry = UINT64_MAX;
+
+    if (global_info.number_entry > 0)
+    {
+        extract.tasks = (unz_extract_task*)ALLOC((size_t)global_info.number_entry * sizeof(unz_extract_task));
+        if (extract.tasks == NULL)
+            return UNZ_INTERNALERROR;
+    }
+
+    /* Collect the files once so the workers only need to jump to them */
+    err = unzGoToFirstFile(file);
+    while (err == UNZ_OK)
+    {
+        if (extract.task_count >= global_info.number_entry)
+        {
+            err = UNZ_BADZIPFILE;
+            break;
+        }
+        err = unzGetCurrentFileInfo64(file, &file_info, NULL, 0, NULL, 0, NULL, 0);
+        if (err == UNZ_OK)
+            err = unzGetFilePos64(file, &extract.tasks[extract.task_count].pos);
+        if (err != UNZ_OK)
+            break;
+        extract.tasks[extract.task_count].number_entry = extract.task_count;
+        extract.tasks[extract.task_count].uncompressed_size = file_info.uncompressed_size;
+        extract.bytes_total += file_info.uncompressed_size;
+        extract.task_count += 1;
+        err = unzGoToNextFile(file);
+    }
+    if (err == UNZ_END_OF_LIST_OF_FILE)
+        err = UNZ_OK;
+    if (err != UNZ_OK)
+    {
+        TRYFREE(extract.tasks);
+        return err;
+    }
+    if (extract.task_count == 0)
+    {
+        TRYFREE(extract.tasks);
+        return UNZ_OK;
+    }
+
+    qsort(extract.tasks, (size_t)extract.task_count, sizeof(unz_extract_task), unzExtractCompareTasks);
+
+    if (pthread_mutex_init(&extract.mutex, NULL) != 0)
+    {
+        TRYFREE(extract.tasks);
+        return UNZ_INTERNALERROR;
+    }
+
+    if (destination != NULL)
+        destination_len = strlen(destination);
+    thread_count = unzExtractThreadCount(options, extract.task_count);
+
+    for (i = 0; i < thread_count; i += 1)
+    {
+        workers[i].extract = &extract;
+        workers[i].destination_len = destination_len + 1;
+        workers[i].buf = (uint8_t*)ALLOC(UNZEXTRACT_BUFSIZE);
+        if (destination != NULL)
+            workers[i].path = (char*)ALLOC(destination_len + 1 + UINT16_MAX + 1);
+        if ((workers[i].buf == NULL) || ((destination != NULL) && (workers[i].path == NULL)))
+        {
+            /* Carry on with the threads already running */
+            if (i == 0)
+                err = UNZ_INTERNALERROR;
+            break;
+        }
+        if (destination != NULL)
+        {
+            memcpy(workers[i].path, destination, destination_len);
+            workers[i].path[destination_len] = '/';
+        }
+
+        /* A single worker reads with the handle of the caller */
+        if (thread_count == 1)
+        {
+            workers[i].file = file;
+            break;
+        }
+        workers[i].file = unzOpenClone(file);
+        if (workers[i].file == NULL)
+        {
+            if (i == 0)
+                workers[i].file = file;
+            break;
+        }
+        workers[i].is_clone = 1;
+        if (pthread_create(&workers[i].thread, NULL, unzExtractWorker, &workers[i]) != 0)
+        {
+            unzClose(workers[i].file);
+            workers[i].file = NULL;
+            workers[i].is_clone = 0;
+            if (i == 0)
+                workers[i].file = file;
+            break;
+        }
+        started += 1;
+    }
+
+    /* Extract on the calling thread when no thread could be started */
+    if ((err == UNZ_OK) && (started == 0))
+        unzExtractWorker(&workers[0]);
+
+    for (i = 0; i < started; i += 1)
+        pthread_join(workers[i].thread, NULL);
+
+    for (i = 0; i < thread_count; i += 1)
+    {
+        if (workers[i].is_clone)
+            unzClose(workers[i].file);
+        TRYFREE(workers[i].buf);
+        TRYFREE(workers[i].path);
+    }
+
+    pthread_mutex_destroy(&extract.mutex);
+    TRYFREE(extract.tasks);
+
+    if (err != UNZ_OK)
+        return err;
+    if (error_entry != NULL)
+        *error_entry = extract.error_entry;
+    return extract.error;
+}
+
+extern int ZEXPORT unzExtractAll(unzFile file, const char *destination, const unz_extract_options *options,
+    uint64_t *error_entry)
+{
+    if (destination == NULL)
+    {
+        if (error_entry != NULL)
+            *error_entry = UINT64_MAX;
+        return UNZ_PARAMERROR;
+    }
+    return unzExtractRun(file, destination, options, NULL, error_entry);
+}
+
+extern int ZEXPORT unzVerifyAll(unzFile file, const unz_extract_options *options, unz_verify_result *results,
+    uint64_t *error_entry)
+{
+    return unzExtractRun(file, NULL, options, results, error_entry);
+}
@@ -0,0 +1,72 @@
+/* unzextract.h -- Extract all files of a .zip using several threads
+   part of the MiniZip project
+
+   This program is distributed under the terms of the same license as zlib.
+   See the accompanying LICENSE file for the full text of the license.
+*/
+
+#ifndef _UNZEXTRACT_H
+#define _UNZEXTRACT_H
+
+#include <stdint.h>
+
+#include "unzip.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***************************************************************************/
+
+typedef void (*unzExtractProgressFunction)(uint64_t bytes_done, uint64_t bytes_total,
+    uint64_t files_done, uint64_t files_total, void *user_data);
+
+typedef struct unz_extract_options_s
+{
+    uint32_t thread_count;              /* number of worker threads, 0 for one per online processor */
+    const char *password;               /* password for encrypted files or NULL */
+    int overwrite;                      /* replace files that already exist in the destination */
+    unzExtractProgressFunction progress; /* called as files are written, one call at a time, or NULL */
+    void *user_data;                    /* passed to progress */
+} unz_extract_options;
+
+typedef struct unz_verify_result_s
+{
+    int error;                          /* UNZ_OK if the file is intact, otherwise the error found */
+    uint64_t bytes_read;                /* number of uncompressed bytes read */
+} unz_verify_result;
+
+/***************************************************************************/
+
+extern int ZEXPORT unzExtractAll(unzFile file, const char *destination, const unz_extract_options *options,
+    uint64_t *error_entry);
+/* Extract every file of the ZipFile into the destination directory. Files are handed to the worker threads
+   largest first so a single big file does not leave the other threads idle at the end. Each thread reads
+   with its own handle from unzOpenClone, files are extracted one after the other on the calling thread
+   when the ZipFile cannot be cloned.
+
+   options can be NULL for the defaults. The current file of the ZipFile is undefined afterwards.
+
+   return UNZ_OK if there is no error, otherwise the error of the file with the lowest number in the
+   central directory that failed, whose number is stored in error_entry if it is not NULL */
+
+extern int ZEXPORT unzVerifyAll(unzFile file, const unz_extract_options *options, unz_verify_result *results,
+    uint64_t *error_entry);
+/* Check every file of the ZipFile without writing anything, using the worker threads of unzExtractAll.
+   The local header of each file must agree with the central directory (see unzCheckCurrentFileHeaders),
+   its data must decompress to the uncompressed size and match its crc and AES authentication code.
+   Unlike unzExtractAll every file is checked after one fails. overwrite is not used.
+
+   results can be NULL, otherwise it receives the result of each file at its number in the central
+   directory and must have room for the number of entries in the global info.
+
+   return UNZ_OK if every file is intact, otherwise the error of the file with the lowest number in the
+   central directory that failed, whose number is stored in error_entry if it is not NULL */
+
+/***************************************************************************/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _UNZEXTRACT_H */
@@ -23,8 +23,16 @@
 #include <string.h>
 #include <errno.h>
 
+#include <pthread.h>
+
+#if defined unix || defined __APPLE__
+#  include <sys/types.h>
+#  include <sys/stat.h>
+#endif
+
 #include "zlib.h"
 #include "unzip.h"
+#include "crc32fast.h"
 
 #ifdef HAVE_AES
 #  define AES_METHOD          (99)
@@ -55,10 +63,28 @@
 #define SIZECENTRALDIRITEM          (0x2e)
 #define SIZECENTRALHEADERLOCATOR    (0x14)
 #define SIZEZIPLOCALHEADER          (0x1e)
-
-#ifndef BUFREADCOMMENT
-#  define BUFREADCOMMENT            (0x400)
-#endif
+#define SIZEDATADESCRIPTOR64        (0x18)
+#define SIZECENTRALDIREND           (0x16)
+#define SIZECENTRALDIREND64         (0x38)
+
+#define SEEKINDEXMAGIC              (0x58444953)
+#define SIZESEEKINDEXHEADER         (0x24)
+#define SIZESEEKPOINTHEADER         (0x13)
+
+/* Lookup index: header, padding that puts what follows on 8 bytes in the zipfile, entries laid out like
+   unz_entry64_internal, name hash slots and sorted file numbers, all little endian, then a locator with the size
+   of the whole index so it can be found in front of the central directory. Its tables are used in place */
+#define LOOKUPINDEXMAGIC            (0x58495a4d)
+#define LOOKUPLOCATORMAGIC          (0x4c495a4d)
+#define LOOKUPINDEXVERSION          (2)
+#define SIZELOOKUPINDEXHEADER       (0x40)
+#define SIZELOOKUPINDEXENTRY        (0x48)
+#define SIZELOOKUPLOCATOR           (0x10)
+
+/* End of the zipfile read at once, the end of central directory record with the longest comment and
+   the zip64 locator and record before it */
+#define SIZEZIPTAIL                 (UINT16_MAX + SIZECENTRALDIREND + SIZECENTRALHEADERLOCATOR + \
+                                     SIZECENTRALDIREND64)
 
 #ifndef UNZ_BUFSIZE
 #  define UNZ_BUFSIZE               (UINT16_MAX)
@@ -66,6 +92,15 @@
 #ifndef UNZ_MAXFILENAMEINZIP
 #  define UNZ_MAXFILENAMEINZIP      (256)
 #endif
+#ifndef UNZ_SEEKWINDOWSIZE
+#  define UNZ_SEEKWINDOWSIZE        (32768)
+#endif
+#ifndef UNZ_READPOOLSIZE
+#  define UNZ_READPOOLSIZE          (16)
+#endif
+#ifndef UNZ_PREFETCHCOUNT
+#  define UNZ_PREFETCHCOUNT         (4)
+#endif
 
 #ifndef ALLOC
 #  define ALLOC(size) (malloc(size))
@@ -88,10 +123,60 @@ typedef struct unz_file_info64_internal_s
 #endif
 } unz_file_info64_internal;
 
+/* unz_entry64_internal contain the decoded central directory header of a file, one per file in zipfile. It is
+   laid out like an entry of the lookup index so the entries of an index can be used in place */
+typedef struct unz_entry64_internal_s
+{
+    uint64_t pos_in_central_dir;        /* pos of the central header, same origin as unz64_internal */
+    uint64_t compressed_size;           /* resolved with zip64 extra field */
+    uint64_t uncompressed_size;         /* resolved with zip64 extra field */
+    uint64_t offset_curfile;            /* relative offset of local header, resolved with zip64 extra field */
+    uint32_t dos_date;
+    uint32_t crc;
+    uint32_t external_fa;
+    uint32_t disk_num_start;
+    uint16_t version;
+    uint16_t version_needed;
+    uint16_t flag;
+    uint16_t compression_method;
+    uint16_t size_filename;
+    uint16_t size_file_extra;
+    uint16_t size_file_comment;
+    uint16_t internal_fa;
+    uint16_t size_file_extra_internal;
+    uint16_t aes_compression_method;    /* only set with HAVE_AES, kept so the layout does not change */
+    uint8_t  aes_encryption_mode;
+    uint8_t  aes_version;
+    uint16_t reserved;
+} unz_entry64_internal;
+
+/* Fails to compile when the entry table is not laid out like the entries of a lookup index */
+typedef char unz_entry64_internal_size_check[(sizeof(unz_entry64_internal) == SIZELOOKUPINDEXENTRY) ? 1 : -1];
+
+/* unz_seek_point_s contain the inflate state at a deflate block boundary of a file */
+typedef struct unz_seek_point_s
+{
+    uint64_t uncompressed_pos;          /* position in the uncompressed data */
+    uint64_t compressed_pos;            /* position in the compressed data of the first byte not fully used */
+    uint8_t  bits;                      /* number of bits of the byte before compressed_pos not used yet */
+    uint16_t window_size;               /* size of window, less than UNZ_SEEKWINDOWSIZE near the start */
+    uint8_t *window;                    /* uncompressed data before uncompressed_pos */
+} unz_seek_point;
+
+/* unz_seek_index_s contain the seek points of a deflated file, ordered by position */
+typedef struct unz_seek_index_s
+{
+    uint64_t spacing;                   /* minimum uncompressed bytes between points */
+    uint64_t number_point;
+    uint64_t size_points;               /* number of points allocated */
+    unz_seek_point *points;
+} unz_seek_index;
+
 /* file_in_zip_read_info_s contain internal information about a file in zipfile */
 typedef struct
 {
     uint8_t *read_buffer;               /* internal buffer for compressed data */
+    uint32_t read_buffer_size;          /* size of read_buffer */
     z_stream stream;                    /* zLib stream structure for inflate */
 #ifdef HAVE_BZIP2
     bz_stream bstream;                  /* bzLib stream structure for bziped */
@@ -103,7 +188,11 @@ typedef struct
     fcrypt_ctx aes_ctx;
 #endif
     uint64_t pos_in_zipfile;            /* position in byte on the zipfile, for fseek */
+    uint64_t offset_data;               /* position of the file data after the local header */
     uint8_t  stream_initialised;        /* flag set if stream structure is initialised */
+    uint8_t  inflate_initialised;       /* stream holds an inflate state kept between files */
+    uint8_t  crc32_unchecked;           /* data was skipped by seeking, crc32 can not be checked */
+    unz_seek_index *seek_index;         /* seek index that gets the points found while reading */
 
     uint64_t offset_local_extrafield;   /* offset of the local extra field */
     uint16_t size_local_extrafield;     /* size of the local extra field */
@@ -123,6 +212,15 @@ typedef struct
     int      raw;
 } file_in_zip64_read_info_s;
 
+/* unz_read_pool_s keeps the read states of closed zipfiles for the handles that share it */
+typedef struct unz_read_pool_s
+{
+    pthread_mutex_t mutex;
+    file_in_zip64_read_info_s **states;
+    uint32_t number_state;
+    uint32_t max_state;
+} unz_read_pool;
+
 /* unz64_s contain internal information about the zipfile */
 typedef struct
 {
@@ -142,6 +240,32 @@ typedef struct
     uint64_t size_central_dir;          /* size of the central directory */
     uint64_t offset_central_dir;        /* offset of start of central directory with
                                            respect to the starting disk number */
+    uint8_t *central_dir;               /* copy of the central directory, read once at open or when first
+                                           needed when the tables come from a lookup index */
+    unz_entry64_internal *entries;      /* decoded central directory, gi.number_entry items */
+    uint64_t *name_hash;                /* open addressing table of file number + 1, built on first lookup */
+    uint64_t name_hash_mask;            /* number of slots in name_hash - 1 */
+    uint64_t *name_sorted;              /* file numbers in file name byte order, built on first use */
+    int      tables_in_index;           /* entries, name_hash and name_sorted point into a lookup index */
+    uint8_t *lookup_index;              /* lookup index read into memory, NULL when mapped or not used */
+    voidpf   lookup_index_stream;       /* stream of the lookup index file kept open while it is mapped */
+    uint32_t read_buffer_size;          /* size of the compressed data buffer of each opened file */
+    unz_seek_index **seek_indexes;      /* seek index of each file, NULL until one is recorded */
+    uint64_t seek_index_spacing;        /* spacing of the seek indexes recorded, 0 to not record them */
+    int      is_clone;                  /* central directory and stream with it belong to another handle */
+    unzDecompressFunction decompress;   /* decompress a whole deflated file in unzReadEntryToBuffer */
+    void    *decompress_user_data;
+    uint8_t *entry_buffer;              /* compressed data of the last file read by unzReadEntryToBuffer */
+    uint64_t entry_buffer_size;
+    file_in_zip64_read_info_s *read_info_cache;
+                                        /* read state of the last file closed, reused by the next one */
+    unz_read_pool *read_pool;           /* where the read state goes when the zipfile is closed, or NULL */
+    uint32_t prefetch_count;            /* files after the opened one advised as needed, 0 for no hints */
+    int      prefetch_drop;             /* advise the data of files read to the end as not needed */
+    int      prefetch_pattern;          /* access pattern of the files opened, ZLIB_FILEFUNC_ADVISE_* */
+    int      prefetch_advice;           /* access pattern last advised for the stream */
+    uint64_t prefetch_last_file;        /* number of the last file opened + 1, 0 before the first one */
+    uint64_t prefetch_next_file;        /* first file whose data was not advised yet */
 
     unz_file_info64 cur_file_info;      /* public info about the current file in zip*/
     unz_file_info64_internal cur_file_info_internal;
@@ -155,147 +279,129 @@ typedef struct
 #endif
 } unz64_internal;
 
-/* Read a byte from a gz_stream; Return EOF for end of file. */
-static int unzReadUInt8(const zlib_filefunc64_32_def *pzlib_filefunc_def, voidpf filestream, uint8_t *value)
+static uint64_t unzReadValueFromMemory(const uint8_t *src, uint32_t len)
 {
-    uint8_t c = 0;
-    if (ZREAD64(*pzlib_filefunc_def, filestream, &c, 1) == 1)
+    uint64_t x = 0;
+    uint32_t n = len;
+
+    while (n > 0)
     {
-        *value = (uint8_t)c;
-        return UNZ_OK;
+        n -= 1;
+        x = (x << 8) | src[n];
     }
-    *value = 0;
-    if (ZERROR64(*pzlib_filefunc_def, filestream))
-        return UNZ_ERRNO;
-    return UNZ_EOF;
-}
-
-static int unzReadUInt16(const zlib_filefunc64_32_def *pzlib_filefunc_def, voidpf filestream, uint16_t *value)
-{
-    uint16_t x;
-    uint8_t c = 0;
-    int err = UNZ_OK;
-
-    err = unzReadUInt8(pzlib_filefunc_def, filestream, &c);
-    x = (uint16_t)c;
-    if (err == UNZ_OK)
-        err = unzReadUInt8(pzlib_filefunc_def, filestream, &c);
-    x |= ((uint16_t)c) << 8;
-
-    if (err == UNZ_OK)
-        *value = x;
-    else
-        *value = 0;
-    return err;
+    return x;
 }
 
-static int unzReadUInt32(const zlib_filefunc64_32_def *pzlib_filefunc_def, voidpf filestream, uint32_t *value)
+static uint64_t unzReadValueFromMemoryAndMove(const uint8_t **src_ptr, uint32_t len)
 {
-    uint32_t x = 0;
-    uint8_t c = 0;
-    int err = UNZ_OK;
-
-    err = unzReadUInt8(pzlib_filefunc_def, filestream, &c);
-    x = (uint32_t)c;
-    if (err == UNZ_OK)
-        err = unzReadUInt8(pzlib_filefunc_def, filestream, &c);
-    x |= ((uint32_t)c) << 8;
-    if (err == UNZ_OK)
-        err = unzReadUInt8(pzlib_filefunc_def, filestream, &c);
-    x |= ((uint32_t)c) << 16;
-    if (err == UNZ_OK)
-        err = unzReadUInt8(pzlib_filefunc_def, filestream, &c);
-    x += ((uint32_t)c) << 24;
-
-    if (err == UNZ_OK)
-        *value = x;
-    else
-        *value = 0;
-    return err;
+    uint64_t x = unzReadValueFromMemory(*src_ptr, len);
+    *src_ptr += len;
+    return x;
 }
 
-static int unzReadUInt64(const zlib_filefunc64_32_def *pzlib_filefunc_def, voidpf filestream, uint64_t *value)
+static void unzWriteValueToMemoryAndMove(uint8_t **dest_ptr, uint64_t x, uint32_t len)
 {
-    uint64_t x = 0;
-    uint8_t i = 0;
-    int err = UNZ_OK;
-
-    err = unzReadUInt8(pzlib_filefunc_def, filestream, &i);
-    x = (uint64_t)i;
-    if (err == UNZ_OK)
-        err = unzReadUInt8(pzlib_filefunc_def, filestream, &i);
-    x |= ((uint64_t)i) << 8;
-    if (err == UNZ_OK)
-        err = unzReadUInt8(pzlib_filefunc_def, filestream, &i);
-    x |= ((uint64_t)i) << 16;
-    if (err == UNZ_OK)
-        err = unzReadUInt8(pzlib_filefunc_def, filestream, &i);
-    x |= ((uint64_t)i) << 24;
-    if (err == UNZ_OK)
-        err = unzReadUInt8(pzlib_filefunc_def, filestream, &i);
-    x |= ((uint64_t)i) << 32;
-    if (err == UNZ_OK)
-        err = unzReadUInt8(pzlib_filefunc_def, filestream, &i);
-    x |= ((uint64_t)i) << 40;
-    if (err == UNZ_OK)
-        err = unzReadUInt8(pzlib_filefunc_def, filestream, &i);
-    x |= ((uint64_t)i) << 48;
-    if (err == UNZ_OK)
-        err = unzReadUInt8(pzlib_filefunc_def, filestream, &i);
-    x |= ((uint64_t)i) << 56;
+    uint32_t n = 0;
 
-    if (err == UNZ_OK)
-        *value = x;
-    else
-        *value = 0;
-    return err;
+    for (n = 0; n < len; n++)
+    {
+        (*dest_ptr)[n] = (uint8_t)(x & 0xff);
+        x >>= 8;
+    }
+    *dest_ptr += len;
 }
 
-/* Locate the Central directory of a zip file (at the end, just before the global comment) */
-static int unzSearchCentralDir(const zlib_filefunc64_32_def *pzlib_filefunc_def, uint64_t *pos_found, voidpf filestream)
+/* Read the end of the zipfile in one io, it has the end of central directory record, the zip64 locator and
+   record before it and for small zipfiles all of the central directory */
+static int unzReadTail(const zlib_filefunc64_32_def *pzlib_filefunc_def, voidpf filestream, uint8_t **tail,
+    uint64_t *tail_pos, uint32_t *tail_size)
 {
-    uint8_t buf[BUFREADCOMMENT + 4];
     uint64_t file_size = 0;
-    uint64_t back_read = 4;
-    uint64_t max_back = UINT16_MAX; /* maximum size of global comment */
-    uint32_t read_size = 0;
-    uint64_t read_pos = 0;
-    uint32_t i = 0;
-    *pos_found = 0;
+    uint32_t size = SIZEZIPTAIL;
+
+    *tail = NULL;
+    *tail_pos = 0;
+    *tail_size = 0;
 
     if (ZSEEK64(*pzlib_filefunc_def, filestream, 0, ZLIB_FILEFUNC_SEEK_END) != 0)
         return UNZ_ERRNO;
-
     file_size = ZTELL64(*pzlib_filefunc_def, filestream);
+    if ((file_size == UINT64_MAX) || (file_size < SIZECENTRALDIREND))
+        return UNZ_ERRNO;
+    if (size > file_size)
+        size = (uint32_t)file_size;
 
-    if (max_back > file_size)
-        max_back = file_size;
+    *tail = (uint8_t*)ALLOC(size);
+    if (*tail == NULL)
+        return UNZ_INTERNALERROR;
+    if (ZPREAD64(*pzlib_filefunc_def, filestream, *tail, size, file_size - size) != size)
+    {
+        TRYFREE(*tail);
+        *tail = NULL;
+        return UNZ_ERRNO;
+    }
+    *tail_pos = file_size - size;
+    *tail_size = size;
+    return UNZ_OK;
+}
 
-    while (back_read < max_back)
+/* Copy bytes of the zipfile from the tail when they are in it, read them otherwise */
+static int unzReadWithTail(const zlib_filefunc64_32_def *pzlib_filefunc_def, voidpf filestream, const uint8_t *tail,
+    uint64_t tail_pos, uint32_t tail_size, uint8_t *buf, uint32_t size, uint64_t offset)
+{
+    if ((tail != NULL) && (offset >= tail_pos) && (size <= tail_size) && (offset - tail_pos <= tail_size - size))
     {
-        if (back_read + BUFREADCOMMENT > max_back)
-            back_read = max_back;
-        else
-            back_read += BUFREADCOMMENT;
+        memcpy(buf, tail + (offset - tail_pos), size);
+        return UNZ_OK;
+    }
+    if (ZPREAD64(*pzlib_filefunc_def, filestream, buf, size, offset) != size)
+        return UNZ_ERRNO;
+    return UNZ_OK;
+}
 
-        read_pos = file_size - back_read;
-        read_size = ((BUFREADCOMMENT + 4) < (file_size - read_pos)) ?
-                     (BUFREADCOMMENT + 4) : (uint32_t)(file_size - read_pos);
+/* Locate the Central directory of a zip file (at the end, just before the global comment). The tail is
+   scanned backwards 8 bytes at a time for the first byte of the signature, only the words that have it
+   are checked byte by byte */
+static int unzSearchCentralDir(const uint8_t *tail, uint64_t tail_pos, uint32_t tail_size, uint64_t *pos_found)
+{
+    uint64_t word = 0;
+    uint64_t match = 0;
+    uint32_t end = 0;
+    uint32_t start = 0;
+    uint32_t i = 0;
 
-        if (ZSEEK64(*pzlib_filefunc_def, filestream, read_pos, ZLIB_FILEFUNC_SEEK_SET) != 0)
-            break;
-        if (ZREAD64(*pzlib_filefunc_def, filestream, buf, read_size) != read_size)
-            break;
+    *pos_found = 0;
+    if (tail_size < SIZECENTRALDIREND)
+        return UNZ_ERRNO;
 
-        for (i = read_size - 3; (i--) > 0;)
-            if (((*(buf+i)) == (ENDHEADERMAGIC & 0xff)) &&
-                ((*(buf+i+1)) == (ENDHEADERMAGIC >> 8 & 0xff)) &&
-                ((*(buf+i+2)) == (ENDHEADERMAGIC >> 16 & 0xff)) &&
-                ((*(buf+i+3)) == (ENDHEADERMAGIC >> 24 & 0xff)))
+    /* Positions before end have room for the record after them */
+    end = tail_size - SIZECENTRALDIREND + 1;
+    while (end > 0)
+    {
+        start = 0;
+        if (end >= 8)
+        {
+            start = end - 8;
+            memcpy(&word, tail + start, 8);
+            /* Bytes equal to the first byte of the signature become zero and set their high bit in match,
+               a byte above one of them can set it as well so matches are checked below */
+            word ^= 0x0101010101010101ULL * (ENDHEADERMAGIC & 0xff);
+            match = (word - 0x0101010101010101ULL) & ~word & 0x8080808080808080ULL;
+            if (match == 0)
+            {
+                end = start;
+                continue;
+            }
+        }
+        for (i = end; (i--) > start;)
+        {
+            if (unzReadValueFromMemory(tail + i, 4) == ENDHEADERMAGIC)
             {
-                *pos_found = read_pos+i;
+                *pos_found = tail_pos + i;
                 return UNZ_OK;
             }
+        }
+        end = start;
     }
 
     return UNZ_ERRNO;
@@ -303,1699 +409,4926 @@ static int unzSearchCentralDir(const zlib_filefunc64_32_def *pzlib_filefunc_def,
 
 /* Locate the Central directory 64 of a zipfile (at the end, just before the global comment) */
 static int unzSearchCentralDir64(const zlib_filefunc64_32_def *pzlib_filefunc_def, uint64_t *offset, voidpf filestream,
-    const uint64_t endcentraloffset)
+    const uint64_t endcentraloffset, const uint8_t *tail, uint64_t tail_pos, uint32_t tail_size)
 {
-    uint32_t value32 = 0;
+    uint8_t buf[SIZECENTRALHEADERLOCATOR];
     *offset = 0;
 
-    /* Zip64 end of central directory locator */
-    if (ZSEEK64(*pzlib_filefunc_def, filestream, endcentraloffset - SIZECENTRALHEADERLOCATOR, ZLIB_FILEFUNC_SEEK_SET) != 0)
+    if (endcentraloffset < SIZECENTRALHEADERLOCATOR)
         return UNZ_ERRNO;
 
-    /* Read locator signature */
-    if (unzReadUInt32(pzlib_filefunc_def, filestream, &value32) != UNZ_OK)
-        return UNZ_ERRNO;
-    if (value32 != ZIP64ENDLOCHEADERMAGIC)
-        return UNZ_ERRNO;
-    /* Number of the disk with the start of the zip64 end of  central directory */
-    if (unzReadUInt32(pzlib_filefunc_def, filestream, &value32) != UNZ_OK)
-        return UNZ_ERRNO;
-    /* Relative offset of the zip64 end of central directory record */
-    if (unzReadUInt64(pzlib_filefunc_def, filestream, offset) != UNZ_OK)
-        return UNZ_ERRNO;
-    /* Total number of disks */
-    if (unzReadUInt32(pzlib_filefunc_def, filestream, &value32) != UNZ_OK)
+    /* Zip64 end of central directory locator */
+    if (unzReadWithTail(pzlib_filefunc_def, filestream, tail, tail_pos, tail_size, buf, SIZECENTRALHEADERLOCATOR,
+            endcentraloffset - SIZECENTRALHEADERLOCATOR) != UNZ_OK)
         return UNZ_ERRNO;
-    /* Goto end of central directory record */
-    if (ZSEEK64(*pzlib_filefunc_def, filestream, *offset, ZLIB_FILEFUNC_SEEK_SET) != 0)
+
+    /* Locator signature */
+    if (unzReadValueFromMemory(buf, 4) != ZIP64ENDLOCHEADERMAGIC)
         return UNZ_ERRNO;
-     /* The signature */
-    if (unzReadUInt32(pzlib_filefunc_def, filestream, &value32) != UNZ_OK)
+    /* Relative offset of the zip64 end of central directory record, after the number of the disk
+       with its start, followed by the total number of disks */
+    *offset = unzReadValueFromMemory(buf + 8, 8);
+
+    /* The signature of the zip64 end of central directory record */
+    if (unzReadWithTail(pzlib_filefunc_def, filestream, tail, tail_pos, tail_size, buf, 4, *offset) != UNZ_OK)
         return UNZ_ERRNO;
-    if (value32 != ZIP64ENDHEADERMAGIC)
+    if (unzReadValueFromMemory(buf, 4) != ZIP64ENDHEADERMAGIC)
         return UNZ_ERRNO;
 
     return UNZ_OK;
 }
 
-static unzFile unzOpenInternal(const void *path, zlib_filefunc64_32_def *pzlib_filefunc64_32_def)
+/* Decode a central directory header from memory, store in *pheader_size the size of the whole header */
+static int unzDecodeCentralDirHeader(const uint8_t *buf, uint64_t buf_size, unz_entry64_internal *entry,
+    uint32_t *pheader_size)
 {
-    unz64_internal us;
-    unz64_internal *s = NULL;
-    uint64_t central_pos = 0;
-    uint64_t central_pos64 = 0;
-    uint64_t number_entry_CD = 0;
-    uint16_t value16 = 0;
-    uint32_t value32 = 0;
-    uint64_t value64 = 0;
-    voidpf filestream = NULL;
-    int err = UNZ_OK;
-    int err64 = UNZ_OK;
+    const uint8_t *p = buf;
+    const uint8_t *extra = NULL;
+    uint32_t extra_pos = 0;
+    uint16_t extra_header_id = 0;
+    uint16_t extra_data_size = 0;
+    uint16_t extra_data_pos = 0;
 
-    us.filestream = NULL;
-    us.filestream_with_CD = NULL;
-    us.z_filefunc.zseek32_file = NULL;
-    us.z_filefunc.ztell32_file = NULL;
+    *pheader_size = 0;
 
-    if (pzlib_filefunc64_32_def == NULL)
-        fill_fopen64_filefunc(&us.z_filefunc.zfile_func64);
-    else
-        us.z_filefunc = *pzlib_filefunc64_32_def;
+    if (buf_size < SIZECENTRALDIRITEM)
+        return UNZ_BADZIPFILE;
+    if (unzReadValueFromMemoryAndMove(&p, 4) != CENTRALHEADERMAGIC)
+        return UNZ_BADZIPFILE;
 
-    us.filestream = ZOPEN64(us.z_filefunc, path, ZLIB_FILEFUNC_MODE_READ | ZLIB_FILEFUNC_MODE_EXISTING);
+    entry->version = (uint16_t)unzReadValueFromMemoryAndMove(&p, 2);
+    entry->version_needed = (uint16_t)unzReadValueFromMemoryAndMove(&p, 2);
+    entry->flag = (uint16_t)unzReadValueFromMemoryAndMove(&p, 2);
+    entry->compression_method = (uint16_t)unzReadValueFromMemoryAndMove(&p, 2);
+    entry->dos_date = (uint32_t)unzReadValueFromMemoryAndMove(&p, 4);
+    entry->crc = (uint32_t)unzReadValueFromMemoryAndMove(&p, 4);
+    entry->compressed_size = unzReadValueFromMemoryAndMove(&p, 4);
+    entry->uncompressed_size = unzReadValueFromMemoryAndMove(&p, 4);
+    entry->size_filename = (uint16_t)unzReadValueFromMemoryAndMove(&p, 2);
+    entry->size_file_extra = (uint16_t)unzReadValueFromMemoryAndMove(&p, 2);
+    entry->size_file_comment = (uint16_t)unzReadValueFromMemoryAndMove(&p, 2);
+    entry->disk_num_start = (uint32_t)unzReadValueFromMemoryAndMove(&p, 2);
+    entry->internal_fa = (uint16_t)unzReadValueFromMemoryAndMove(&p, 2);
+    entry->external_fa = (uint32_t)unzReadValueFromMemoryAndMove(&p, 4);
+    /* Relative offset of local header */
+    entry->offset_curfile = unzReadValueFromMemoryAndMove(&p, 4);
+    entry->size_file_extra_internal = 0;
+#ifdef HAVE_AES
+    entry->aes_compression_method = 0;
+    entry->aes_encryption_mode = 0;
+    entry->aes_version = 0;
+#endif
 
-    if (us.filestream == NULL)
-        return NULL;
+    if (buf_size < (uint64_t)SIZECENTRALDIRITEM + entry->size_filename + entry->size_file_extra + entry->size_file_comment)
+        return UNZ_BADZIPFILE;
 
-    us.filestream_with_CD = us.filestream;
-    us.is_zip64 = 0;
+    extra = buf + SIZECENTRALDIRITEM + entry->size_filename;
 
-    /* Search for end of central directory header */
-    err = unzSearchCentralDir(&us.z_filefunc, &central_pos, us.filestream);
-    if (err == UNZ_OK)
+    while (extra_pos + 4 <= entry->size_file_extra)
     {
-        if (ZSEEK64(us.z_filefunc, us.filestream, central_pos, ZLIB_FILEFUNC_SEEK_SET) != 0)
-            err = UNZ_ERRNO;
-
-        /* The signature, already checked */
-        if (unzReadUInt32(&us.z_filefunc, us.filestream, &value32) != UNZ_OK)
-            err = UNZ_ERRNO;
-        /* Number of this disk */
-        if (unzReadUInt16(&us.z_filefunc, us.filestream, &value16) != UNZ_OK)
-            err = UNZ_ERRNO;
-        us.number_disk = value16;
-        /* Number of the disk with the start of the central directory */
-        if (unzReadUInt16(&us.z_filefunc, us.filestream, &value16) != UNZ_OK)
-            err = UNZ_ERRNO;
-        us.gi.number_disk_with_CD = value16;
-        /* Total number of entries in the central directory on this disk */
-        if (unzReadUInt16(&us.z_filefunc, us.filestream, &value16) != UNZ_OK)
-            err = UNZ_ERRNO;
-        us.gi.number_entry = value16;
-        /* Total number of entries in the central directory */
-        if (unzReadUInt16(&us.z_filefunc, us.filestream, &value16) != UNZ_OK)
-            err = UNZ_ERRNO;
-        number_entry_CD = value16;
-        if (number_entry_CD != us.gi.number_entry)
-            err = UNZ_BADZIPFILE;
-        /* Size of the central directory */
-        if (unzReadUInt32(&us.z_filefunc, us.filestream, &value32) != UNZ_OK)
-            err = UNZ_ERRNO;
-        us.size_central_dir = value32;
-        /* Offset of start of central directory with respect to the starting disk number */
-        if (unzReadUInt32(&us.z_filefunc, us.filestream, &value32) != UNZ_OK)
-            err = UNZ_ERRNO;
-        us.offset_central_dir = value32;
-        /* Zipfile comment length */
-        if (unzReadUInt16(&us.z_filefunc, us.filestream, &us.gi.size_comment) != UNZ_OK)
-            err = UNZ_ERRNO;
+        p = extra + extra_pos;
+        extra_header_id = (uint16_t)unzReadValueFromMemoryAndMove(&p, 2);
+        extra_data_size = (uint16_t)unzReadValueFromMemoryAndMove(&p, 2);
 
-        if (err == UNZ_OK)
+        if (extra_pos + 4 + extra_data_size > entry->size_file_extra)
+            return UNZ_BADZIPFILE;
+
+        /* ZIP64 extra fields */
+        if (extra_header_id == 0x0001)
         {
-            /* Search for Zip64 end of central directory header */
-            err64 = unzSearchCentralDir64(&us.z_filefunc, &central_pos64, us.filestream, central_pos);
-            if (err64 == UNZ_OK)
-            {
-                central_pos = central_pos64;
-                us.is_zip64 = 1;
+            /* Subtract size of ZIP64 field, since ZIP64 is handled internally */
+            entry->size_file_extra_internal += 2 + 2 + extra_data_size;
 
-                if (ZSEEK64(us.z_filefunc, us.filestream, central_pos, ZLIB_FILEFUNC_SEEK_SET) != 0)
-                    err = UNZ_ERRNO;
-
-                /* the signature, already checked */
-                if (unzReadUInt32(&us.z_filefunc, us.filestream, &value32) != UNZ_OK)
-                    err = UNZ_ERRNO;
-                /* size of zip64 end of central directory record */
-                if (unzReadUInt64(&us.z_filefunc, us.filestream, &value64) != UNZ_OK)
-                    err = UNZ_ERRNO;
-                /* version made by */
-                if (unzReadUInt16(&us.z_filefunc, us.filestream, &value16) != UNZ_OK)
-                    err = UNZ_ERRNO;
-                /* version needed to extract */
-                if (unzReadUInt16(&us.z_filefunc, us.filestream, &value16) != UNZ_OK)
-                    err = UNZ_ERRNO;
-                /* number of this disk */
-                if (unzReadUInt32(&us.z_filefunc, us.filestream, &us.number_disk) != UNZ_OK)
-                    err = UNZ_ERRNO;
-                /* number of the disk with the start of the central directory */
-                if (unzReadUInt32(&us.z_filefunc, us.filestream, &us.gi.number_disk_with_CD) != UNZ_OK)
-                    err = UNZ_ERRNO;
-                /* total number of entries in the central directory on this disk */
-                if (unzReadUInt64(&us.z_filefunc, us.filestream, &us.gi.number_entry) != UNZ_OK)
-                    err = UNZ_ERRNO;
-                /* total number of entries in the central directory */
-                if (unzReadUInt64(&us.z_filefunc, us.filestream, &number_entry_CD) != UNZ_OK)
-                    err = UNZ_ERRNO;
-                if (number_entry_CD != us.gi.number_entry)
-                    err = UNZ_BADZIPFILE;
-                /* size of the central directory */
-                if (unzReadUInt64(&us.z_filefunc, us.filestream, &us.size_central_dir) != UNZ_OK)
-                    err = UNZ_ERRNO;
-                /* offset of start of central directory with respect to the starting disk number */
-                if (unzReadUInt64(&us.z_filefunc, us.filestream, &us.offset_central_dir) != UNZ_OK)
-                    err = UNZ_ERRNO;
+            extra_data_pos = 0;
+            if (entry->uncompressed_size == UINT32_MAX)
+            {
+                if (extra_data_pos + 8 > extra_data_size)
+                    return UNZ_BADZIPFILE;
+                entry->uncompressed_size = unzReadValueFromMemoryAndMove(&p, 8);
+                extra_data_pos += 8;
+            }
+            if (entry->compressed_size == UINT32_MAX)
+            {
+                if (extra_data_pos + 8 > extra_data_size)
+                    return UNZ_BADZIPFILE;
+                entry->compressed_size = unzReadValueFromMemoryAndMove(&p, 8);
+                extra_data_pos += 8;
+            }
+            if (entry->offset_curfile == UINT32_MAX)
+            {
+                /* Relative Header offset */
+                if (extra_data_pos + 8 > extra_data_size)
+                    return UNZ_BADZIPFILE;
+                entry->offset_curfile = unzReadValueFromMemoryAndMove(&p, 8);
+                extra_data_pos += 8;
+            }
+            if (entry->disk_num_start == UINT16_MAX)
+            {
+                /* Disk Start Number */
+                if (extra_data_pos + 4 > extra_data_size)
+                    return UNZ_BADZIPFILE;
+                entry->disk_num_start = (uint32_t)unzReadValueFromMemoryAndMove(&p, 4);
+                extra_data_pos += 4;
             }
-            else if ((us.size_central_dir == UINT16_MAX) || (us.offset_central_dir == UINT32_MAX))
-                err = UNZ_BADZIPFILE;
         }
+#ifdef HAVE_AES
+        /* AES header */
+        else if (extra_header_id == 0x9901)
+        {
+            /* Subtract size of AES field, since AES is handled internally */
+            entry->size_file_extra_internal += 2 + 2 + extra_data_size;
+
+            if (extra_data_size < 7)
+                return UNZ_BADZIPFILE;
+            /* Verify version info, support AE-1 and AE-2 */
+            entry->aes_version = (uint8_t)unzReadValueFromMemoryAndMove(&p, 2);
+            if (entry->aes_version != 1 && entry->aes_version != 2)
+                return UNZ_ERRNO;
+            if ((p[0] != 'A') || (p[1] != 'E'))
+                return UNZ_ERRNO;
+            p += 2;
+            /* Get AES encryption strength and actual compression method */
+            entry->aes_encryption_mode = (uint8_t)unzReadValueFromMemoryAndMove(&p, 1);
+            entry->aes_compression_method = (uint16_t)unzReadValueFromMemoryAndMove(&p, 2);
+        }
+#endif
+
+        extra_pos += 2 + 2 + extra_data_size;
     }
-    else
-        err = UNZ_ERRNO;
 
-    if ((err == UNZ_OK) && (central_pos < us.offset_central_dir + us.size_central_dir))
-        err = UNZ_BADZIPFILE;
+    *pheader_size = SIZECENTRALDIRITEM + entry->size_filename + entry->size_file_extra + entry->size_file_comment;
+    return UNZ_OK;
+}
 
-    if (err != UNZ_OK)
+/* Decode every header of the central directory read in s into the entry table */
+static int unzDecodeCentralDir(unz64_internal *s)
+{
+    unz_entry64_internal *entries = NULL;
+    uint64_t number_entry_max = 0;
+    uint64_t number_entry = 0;
+    uint64_t pos = 0;
+    uint32_t header_size = 0;
+
+    /* Every header takes at least SIZECENTRALDIRITEM bytes, the entry count of the end of central
+       directory record can't be trusted without zip64 since it overflows at 2^16 files */
+    number_entry_max = s->size_central_dir / SIZECENTRALDIRITEM;
+    if ((s->is_zip64) && (s->gi.number_entry < number_entry_max))
+        number_entry_max = s->gi.number_entry;
+    if (number_entry_max > (size_t)-1 / sizeof(unz_entry64_internal))
+        return UNZ_INTERNALERROR;
+
+    if (number_entry_max > 0)
     {
-        ZCLOSE64(us.z_filefunc, us.filestream);
-        return NULL;
+        entries = (unz_entry64_internal*)ALLOC((size_t)number_entry_max * sizeof(unz_entry64_internal));
+        if (entries == NULL)
+            return UNZ_INTERNALERROR;
     }
 
-    if (us.gi.number_disk_with_CD == 0)
+    /* Stop at the first header that doesn't decode, workaround incorrect count #184 */
+    while ((number_entry < number_entry_max) && (pos < s->size_central_dir))
     {
-        /* If there is only one disk open another stream so we don't have to seek between the CD
-           and the file headers constantly */
-        filestream = ZOPEN64(us.z_filefunc, path, ZLIB_FILEFUNC_MODE_READ | ZLIB_FILEFUNC_MODE_EXISTING);
-        if (filestream != NULL)
-            us.filestream = filestream;
+        if (unzDecodeCentralDirHeader(s->central_dir + pos, s->size_central_dir - pos,
+                &entries[number_entry], &header_size) != UNZ_OK)
+            break;
+        entries[number_entry].pos_in_central_dir = s->offset_central_dir + pos;
+        pos += header_size;
+        number_entry += 1;
     }
 
-    /* Hack for zip files that have no respect for zip64
-    if ((central_pos > 0xffffffff) && (us.offset_central_dir < 0xffffffff))
-        us.offset_central_dir = central_pos - us.size_central_dir;*/
+    s->entries = entries;
+    s->gi.number_entry = number_entry;
+    return UNZ_OK;
+}
 
-    us.byte_before_the_zipfile = central_pos - (us.offset_central_dir + us.size_central_dir);
-    us.central_pos = central_pos;
-    us.pfile_in_zip_read = NULL;
+static uint64_t unzLookupIndexSize(uint64_t number_entry, uint64_t slot_count, uint32_t pad)
+{
+    return SIZELOOKUPINDEXHEADER + pad + number_entry * SIZELOOKUPINDEXENTRY + (slot_count + number_entry) * 8 +
+        SIZELOOKUPLOCATOR;
+}
 
-    s = (unz64_internal*)ALLOC(sizeof(unz64_internal));
-    if (s != NULL)
-    {
-        *s = us;
-        if (err64 != UNZ_OK)
-            // workaround incorrect count #184
-            s->gi.number_entry = unzCountEntries(s);
-        
-        unzGoToFirstFile((unzFile)s);
-    }
-    return (unzFile)s;
+/* Point the entry table, name hash and sorted order into a lookup index instead of decoding the central directory.
+   Only the header is checked, the tables are checked by unzCheckLookupIndex once the central directory is read.
+   return UNZ_BADZIPFILE if the index was not made for s or can not be used in place */
+static int unzLoadLookupIndex(unz64_internal *s, const uint8_t *index, uint64_t index_size, uint64_t zip_size,
+    uint64_t zip_mtime)
+{
+    const uint16_t byte_order = 1;
+    const uint8_t *p = index;
+    uint64_t number_entry = 0;
+    uint64_t slot_count = 0;
+    uint64_t value = 0;
+    uint32_t pad = 0;
+    int err = UNZ_OK;
+
+    if (index_size < SIZELOOKUPINDEXHEADER + SIZELOOKUPLOCATOR)
+        return UNZ_BADZIPFILE;
+    /* The tables are little endian and are not converted */
+    if (*(const uint8_t*)&byte_order != 1)
+        return UNZ_BADZIPFILE;
+    if (unzReadValueFromMemoryAndMove(&p, 4) != LOOKUPINDEXMAGIC)
+        return UNZ_BADZIPFILE;
+    if (unzReadValueFromMemoryAndMove(&p, 2) != LOOKUPINDEXVERSION)
+        err = UNZ_BADZIPFILE;
+    if (unzReadValueFromMemoryAndMove(&p, 2) != SIZELOOKUPINDEXENTRY)
+        err = UNZ_BADZIPFILE;
+    number_entry = unzReadValueFromMemoryAndMove(&p, 8);
+    if (unzReadValueFromMemoryAndMove(&p, 8) != s->offset_central_dir)
+        err = UNZ_BADZIPFILE;
+    if (unzReadValueFromMemoryAndMove(&p, 8) != s->size_central_dir)
+        err = UNZ_BADZIPFILE;
+    slot_count = unzReadValueFromMemoryAndMove(&p, 8);
+    /* Size and modification time key an index kept beside the zipfile, they are 0 when not known */
+    value = unzReadValueFromMemoryAndMove(&p, 8);
+    if ((value != 0) && (zip_size != 0) && (value != zip_size))
+        err = UNZ_BADZIPFILE;
+    value = unzReadValueFromMemoryAndMove(&p, 8);
+    if ((value != 0) && (zip_mtime != 0) && (value != zip_mtime))
+        err = UNZ_BADZIPFILE;
+    pad = (uint32_t)unzReadValueFromMemoryAndMove(&p, 4);
+    if (unzReadValueFromMemoryAndMove(&p, 4) != crc32_fast(0, index, SIZELOOKUPINDEXHEADER - 4))
+        err = UNZ_BADZIPFILE;
+
+    /* The hash needs a free slot to end probes */
+    if ((number_entry > s->size_central_dir / SIZECENTRALDIRITEM) || (slot_count <= number_entry) ||
+        ((slot_count & (slot_count - 1)) != 0) || (slot_count > index_size / 8) || (pad >= 8))
+        err = UNZ_BADZIPFILE;
+    if ((err == UNZ_OK) && (index_size != unzLookupIndexSize(number_entry, slot_count, pad)))
+        err = UNZ_BADZIPFILE;
+    /* The padding aligns the tables in the zipfile, they are not when the zipfile was moved in another file */
+    if ((err == UNZ_OK) && (((uintptr_t)(index + SIZELOOKUPINDEXHEADER + pad) & 7) != 0))
+        err = UNZ_BADZIPFILE;
+    if (err != UNZ_OK)
+        return err;
+
+    p = index + SIZELOOKUPINDEXHEADER + pad;
+    s->entries = (unz_entry64_internal*)p;
+    s->gi.number_entry = number_entry;
+    s->name_hash = (uint64_t*)(p + number_entry * SIZELOOKUPINDEXENTRY);
+    s->name_hash_mask = slot_count - 1;
+    s->name_sorted = s->name_hash + slot_count;
+    s->tables_in_index = 1;
+    return UNZ_OK;
 }
 
-extern unzFile ZEXPORT unzOpen2(const char *path, zlib_filefunc_def *pzlib_filefunc32_def)
+/* Check the tables taken from a lookup index against the central directory just read */
+static int unzCheckLookupIndex(const unz64_internal *s)
 {
-    if (pzlib_filefunc32_def != NULL)
+    const unz_entry64_internal *entry = NULL;
+    const uint8_t *header = NULL;
+    uint64_t slot_count = s->name_hash_mask + 1;
+    uint64_t slots_free = 0;
+    uint64_t pos = 0;
+    uint64_t i = 0;
+
+    for (i = 0; i < s->gi.number_entry; i += 1)
     {
-        zlib_filefunc64_32_def zlib_filefunc64_32_def_fill;
-        fill_zlib_filefunc64_32_def_from_filefunc32(&zlib_filefunc64_32_def_fill, pzlib_filefunc32_def);
-        return unzOpenInternal(path, &zlib_filefunc64_32_def_fill);
+        entry = &s->entries[i];
+        pos = entry->pos_in_central_dir - s->offset_central_dir;
+        if ((entry->pos_in_central_dir < s->offset_central_dir) || (pos > s->size_central_dir) ||
+            (s->size_central_dir - pos < (uint64_t)SIZECENTRALDIRITEM + entry->size_filename +
+                entry->size_file_extra + entry->size_file_comment))
+            return UNZ_BADZIPFILE;
+        /* Signature, then the sizes of the file name, extra field and comment */
+        header = s->central_dir + pos;
+        if ((unzReadValueFromMemory(header, 4) != CENTRALHEADERMAGIC) ||
+            (unzReadValueFromMemory(header + 28, 2) != entry->size_filename) ||
+            (unzReadValueFromMemory(header + 30, 2) != entry->size_file_extra) ||
+            (unzReadValueFromMemory(header + 32, 2) != entry->size_file_comment))
+            return UNZ_BADZIPFILE;
     }
-    return unzOpenInternal(path, NULL);
+    for (i = 0; i < slot_count; i += 1)
+    {
+        if (s->name_hash[i] > s->gi.number_entry)
+            return UNZ_BADZIPFILE;
+        if (s->name_hash[i] == 0)
+            slots_free += 1;
+    }
+    /* Probes only end at a free slot */
+    if (slots_free == 0)
+        return UNZ_BADZIPFILE;
+    for (i = 0; i < s->gi.number_entry; i += 1)
+    {
+        if (s->name_sorted[i] >= s->gi.number_entry)
+            return UNZ_BADZIPFILE;
+    }
+    return UNZ_OK;
 }
 
-extern unzFile ZEXPORT unzOpen2_64(const void *path, zlib_filefunc64_def *pzlib_filefunc_def)
+/* Read the central directory in one pass, its end is often in the tail already read */
+static int unzReadCentralDirData(unz64_internal *s, const uint8_t *tail, uint64_t tail_pos, uint32_t tail_size)
 {
-    if (pzlib_filefunc_def != NULL)
+    uint64_t bytes_read = 0;
+    uint64_t bytes_in_tail = 0;
+    uint64_t central_dir_start = 0;
+    uint64_t central_dir_end = 0;
+    uint32_t bytes_to_read = 0;
+
+    s->central_dir = (uint8_t*)ALLOC((size_t)s->size_central_dir);
+    if (s->central_dir == NULL)
+        return UNZ_INTERNALERROR;
+
+    central_dir_start = s->offset_central_dir + s->byte_before_the_zipfile;
+    central_dir_end = central_dir_start + s->size_central_dir;
+    if ((tail != NULL) && (central_dir_end > tail_pos) && (central_dir_end - tail_pos <= tail_size))
     {
-        zlib_filefunc64_32_def zlib_filefunc64_32_def_fill;
-        zlib_filefunc64_32_def_fill.zfile_func64 = *pzlib_filefunc_def;
-        zlib_filefunc64_32_def_fill.ztell32_file = NULL;
-        zlib_filefunc64_32_def_fill.zseek32_file = NULL;
-        return unzOpenInternal(path, &zlib_filefunc64_32_def_fill);
+        bytes_in_tail = central_dir_end - tail_pos;
+        if (bytes_in_tail > s->size_central_dir)
+            bytes_in_tail = s->size_central_dir;
+        memcpy(s->central_dir + s->size_central_dir - bytes_in_tail, tail + (central_dir_end - tail_pos) - bytes_in_tail,
+            (size_t)bytes_in_tail);
     }
-    return unzOpenInternal(path, NULL);
-}
 
-extern unzFile ZEXPORT unzOpen(const char *path)
-{
-    return unzOpenInternal(path, NULL);
-}
+    while (bytes_read < s->size_central_dir - bytes_in_tail)
+    {
+        bytes_to_read = UINT32_MAX;
+        if (s->size_central_dir - bytes_in_tail - bytes_read < bytes_to_read)
+            bytes_to_read = (uint32_t)(s->size_central_dir - bytes_in_tail - bytes_read);
+        if (ZPREAD64(s->z_filefunc, s->filestream_with_CD, s->central_dir + bytes_read, bytes_to_read,
+                central_dir_start + bytes_read) != bytes_to_read)
+            bytes_read = UINT64_MAX;
+        else
+            bytes_read += bytes_to_read;
+    }
 
-extern unzFile ZEXPORT unzOpen64(const void *path)
-{
-    return unzOpenInternal(path, NULL);
+    if (bytes_read != s->size_central_dir - bytes_in_tail)
+    {
+        TRYFREE(s->central_dir);
+        s->central_dir = NULL;
+        return UNZ_ERRNO;
+    }
+    return UNZ_OK;
 }
 
-extern int ZEXPORT unzClose(unzFile file)
+/* Read the central directory when file names, extra fields or comments are needed for the first time after
+   the tables were taken from a lookup index */
+static int unzLoadCentralDir(unz64_internal *s)
 {
-    unz64_internal *s;
-    if (file == NULL)
-        return UNZ_PARAMERROR;
-    s = (unz64_internal*)file;
+    int err = UNZ_OK;
 
-    if (s->pfile_in_zip_read != NULL)
-        unzCloseCurrentFile(file);
+    if ((s->central_dir != NULL) || (s->size_central_dir == 0))
+        return UNZ_OK;
 
-    if ((s->filestream != NULL) && (s->filestream != s->filestream_with_CD))
-        ZCLOSE64(s->z_filefunc, s->filestream);
-    if (s->filestream_with_CD != NULL)
-        ZCLOSE64(s->z_filefunc, s->filestream_with_CD);
+    err = unzReadCentralDirData(s, NULL, 0, 0);
+    if ((err == UNZ_OK) && (s->tables_in_index))
+        err = unzCheckLookupIndex(s);
+    if ((err != UNZ_OK) && (s->central_dir != NULL))
+    {
+        TRYFREE(s->central_dir);
+        s->central_dir = NULL;
+    }
+    return err;
+}
 
-    s->filestream = NULL;
-    s->filestream_with_CD = NULL;
-    TRYFREE(s);
-    return UNZ_OK;
+/* Take the entry table, name hash and sorted order from the lookup index given, or the one written in front of
+   the central directory, when it was made for the zipfile. The central directory is then only read when it is
+   needed. Otherwise read the central directory and decode every header into the entry table, so moving between
+   files and querying their info does not need any further io */
+static int unzReadCentralDir(unz64_internal *s, const uint8_t *tail, uint64_t tail_pos, uint32_t tail_size,
+    const uint8_t *index, uint64_t index_size, uint64_t zip_mtime)
+{
+    uint8_t locator[SIZELOOKUPLOCATOR];
+    const uint8_t *p = NULL;
+    uint64_t bytes_mapped = 0;
+    uint64_t central_dir_start = 0;
+    uint64_t index_pos = 0;
+    uint64_t zip_size = 0;
+    int err = UNZ_OK;
+
+    s->central_dir = NULL;
+    s->entries = NULL;
+
+    if ((s->size_central_dir == 0) || (s->gi.number_entry == 0 && s->is_zip64))
+    {
+        s->gi.number_entry = 0;
+        return UNZ_OK;
+    }
+    if (s->size_central_dir > (size_t)-1)
+        return UNZ_INTERNALERROR;
+
+    central_dir_start = s->offset_central_dir + s->byte_before_the_zipfile;
+    if ((index == NULL) && (s->gi.number_disk_with_CD == 0) &&
+        (central_dir_start >= SIZELOOKUPINDEXHEADER + SIZELOOKUPLOCATOR) &&
+        (unzReadWithTail(&s->z_filefunc, s->filestream_with_CD, tail, tail_pos, tail_size, locator,
+            SIZELOOKUPLOCATOR, central_dir_start - SIZELOOKUPLOCATOR) == UNZ_OK))
+    {
+        p = locator;
+        if (unzReadValueFromMemoryAndMove(&p, 4) == LOOKUPLOCATORMAGIC)
+        {
+            p += 4;
+            index_size = unzReadValueFromMemoryAndMove(&p, 8);
+            if ((index_size >= SIZELOOKUPINDEXHEADER + SIZELOOKUPLOCATOR) && (index_size <= central_dir_start) &&
+                (index_size <= UINT32_MAX))
+            {
+                /* Mapped when the io functions can, otherwise read at once with its tables aligned as in the file */
+                index_pos = central_dir_start - index_size;
+                index = (const uint8_t*)ZMAP64(s->z_filefunc, s->filestream_with_CD, index_pos, &bytes_mapped);
+                if ((index != NULL) && (bytes_mapped < index_size))
+                    index = NULL;
+                if (index == NULL)
+                {
+                    s->lookup_index = (uint8_t*)ALLOC((size_t)index_size + 8);
+                    if ((s->lookup_index != NULL) && (unzReadWithTail(&s->z_filefunc, s->filestream_with_CD, tail,
+                            tail_pos, tail_size, s->lookup_index + (index_pos & 7), (uint32_t)index_size,
+                            index_pos) == UNZ_OK))
+                        index = s->lookup_index + (index_pos & 7);
+                }
+            }
+        }
+    }
+
+    if (index != NULL)
+    {
+        if (tail != NULL)
+            zip_size = tail_pos + tail_size;
+        if (unzLoadLookupIndex(s, index, index_size, zip_size, zip_mtime) == UNZ_OK)
+            return UNZ_OK;
+    }
+    TRYFREE(s->lookup_index);
+    s->lookup_index = NULL;
+    if (s->lookup_index_stream != NULL)
+        ZCLOSE64(s->z_filefunc, s->lookup_index_stream);
+    s->lookup_index_stream = NULL;
+
+    err = unzReadCentralDirData(s, tail, tail_pos, tail_size);
+    if (err == UNZ_OK)
+        err = unzDecodeCentralDir(s);
+    if ((err != UNZ_OK) && (s->central_dir != NULL))
+    {
+        TRYFREE(s->central_dir);
+        s->central_dir = NULL;
+    }
+    return err;
 }
 
-/* Goto to the next available disk for spanned archives */
-static int unzGoToNextDisk(unzFile file)
+static void unzFreeReadInfo(file_in_zip64_read_info_s *read_info)
 {
-    unz64_internal *s;
-    uint32_t number_disk_next = 0;
+    if (read_info == NULL)
+        return;
+    if (read_info->inflate_initialised)
+        inflateEnd(&read_info->stream);
+    TRYFREE(read_info->read_buffer);
+    TRYFREE(read_info);
+}
 
-    s = (unz64_internal*)file;
-    if (s == NULL)
-        return UNZ_PARAMERROR;
-    number_disk_next = s->number_disk;
+/* Give a read state to the pool, it is freed when there is no pool or no room left in it */
+static void unzPutReadInfoInPool(unz_read_pool *pool, file_in_zip64_read_info_s *read_info)
+{
+    if (read_info == NULL)
+        return;
+    if (pool != NULL)
+    {
+        pthread_mutex_lock(&pool->mutex);
+        if (pool->number_state < pool->max_state)
+        {
+            pool->states[pool->number_state] = read_info;
+            pool->number_state += 1;
+            read_info = NULL;
+        }
+        pthread_mutex_unlock(&pool->mutex);
+    }
+    unzFreeReadInfo(read_info);
+}
 
-    if ((s->pfile_in_zip_read != NULL) && (s->pfile_in_zip_read->rest_read_uncompressed > 0))
-        /* We are currently reading a file and we need the next sequential disk */
-        number_disk_next += 1;
-    else
-        /* Goto the disk for the current file */
-        number_disk_next = s->cur_file_info.disk_num_start;
+/* Get a read state for a file, the one of the last file closed, one from the pool or a new one.
+   Its read buffer has the size of the zipfile and its stream is an inflate state reset if need_inflate */
+static file_in_zip64_read_info_s *unzGetReadInfo(unz64_internal *s, int need_inflate)
+{
+    file_in_zip64_read_info_s *read_info = s->read_info_cache;
+    unz_read_pool *pool = s->read_pool;
+    int err = Z_OK;
 
-    if (number_disk_next != s->number_disk)
+    s->read_info_cache = NULL;
+    if ((read_info == NULL) && (pool != NULL))
     {
-        /* Switch disks */
-        if ((s->filestream != NULL) && (s->filestream != s->filestream_with_CD))
-            ZCLOSE64(s->z_filefunc, s->filestream);
+        pthread_mutex_lock(&pool->mutex);
+        if (pool->number_state > 0)
+        {
+            pool->number_state -= 1;
+            read_info = pool->states[pool->number_state];
+        }
+        pthread_mutex_unlock(&pool->mutex);
+    }
+    if (read_info == NULL)
+    {
+        read_info = (file_in_zip64_read_info_s*)ALLOC(sizeof(file_in_zip64_read_info_s));
+        if (read_info == NULL)
+            return NULL;
+        memset(read_info, 0, sizeof(file_in_zip64_read_info_s));
+    }
 
-        if (number_disk_next == s->gi.number_disk_with_CD)
+    if (read_info->read_buffer_size != s->read_buffer_size)
+    {
+        TRYFREE(read_info->read_buffer);
+        read_info->read_buffer_size = s->read_buffer_size;
+        read_info->read_buffer = (uint8_t*)ALLOC(read_info->read_buffer_size);
+        if (read_info->read_buffer == NULL)
         {
-            s->filestream = s->filestream_with_CD;
+            unzFreeReadInfo(read_info);
+            return NULL;
         }
+    }
+
+    if (need_inflate)
+    {
+        if (read_info->inflate_initialised)
+            err = inflateReset(&read_info->stream);
         else
         {
-            s->filestream = ZOPENDISK64(s->z_filefunc, s->filestream_with_CD, number_disk_next,
-                ZLIB_FILEFUNC_MODE_READ | ZLIB_FILEFUNC_MODE_EXISTING);
+            /* The state can move to another handle through the pool, it does not point to this one */
+            read_info->stream.zalloc = (alloc_func)0;
+            read_info->stream.zfree = (free_func)0;
+            read_info->stream.opaque = (voidpf)0;
+            read_info->stream.next_in = NULL;
+            read_info->stream.avail_in = 0;
+            err = inflateInit2(&read_info->stream, -MAX_WBITS);
+            if (err == Z_OK)
+                read_info->inflate_initialised = 1;
+        }
+        if (err != Z_OK)
+        {
+            unzFreeReadInfo(read_info);
+            return NULL;
         }
+    }
+    return read_info;
+}
 
-        if (s->filestream == NULL)
-            return UNZ_ERRNO;
+/* Keep the read state of a closed file for the next one */
+static void unzReleaseReadInfo(unz64_internal *s, file_in_zip64_read_info_s *read_info)
+{
+    if (s->read_info_cache == NULL)
+        s->read_info_cache = read_info;
+    else
+        unzPutReadInfoInPool(s->read_pool, read_info);
+}
 
-        s->number_disk = number_disk_next;
-    }
+extern unzReadPool ZEXPORT unzCreateReadPool(uint32_t max_states)
+{
+    unz_read_pool *pool = NULL;
 
-    return UNZ_OK;
+    if (max_states == 0)
+        max_states = UNZ_READPOOLSIZE;
+
+    pool = (unz_read_pool*)ALLOC(sizeof(unz_read_pool));
+    if (pool == NULL)
+        return NULL;
+    pool->states = (file_in_zip64_read_info_s**)ALLOC(max_states * sizeof(file_in_zip64_read_info_s*));
+    if (pool->states == NULL)
+    {
+        TRYFREE(pool);
+        return NULL;
+    }
+    if (pthread_mutex_init(&pool->mutex, NULL) != 0)
+    {
+        TRYFREE(pool->states);
+        TRYFREE(pool);
+        return NULL;
+    }
+    pool->number_state = 0;
+    pool->max_state = max_states;
+    return (unzReadPool)pool;
 }
 
-extern int ZEXPORT unzGetGlobalInfo(unzFile file, unz_global_info* pglobal_info32)
+extern int ZEXPORT unzDeleteReadPool(unzReadPool read_pool)
 {
-    unz64_internal *s = NULL;
-    if (file == NULL)
+    unz_read_pool *pool = NULL;
+    uint32_t i = 0;
+
+    if (read_pool == NULL)
         return UNZ_PARAMERROR;
-    s = (unz64_internal*)file;
+    pool = (unz_read_pool*)read_pool;
 
-    pglobal_info32->number_entry = (uint32_t)s->gi.number_entry;
-    pglobal_info32->size_comment = s->gi.size_comment;
-    pglobal_info32->number_disk_with_CD = s->gi.number_disk_with_CD;
+    for (i = 0; i < pool->number_state; i += 1)
+        unzFreeReadInfo(pool->states[i]);
+    pthread_mutex_destroy(&pool->mutex);
+    TRYFREE(pool->states);
+    TRYFREE(pool);
     return UNZ_OK;
 }
 
-extern int ZEXPORT unzGetGlobalInfo64(unzFile file, unz_global_info64 *pglobal_info)
+extern int ZEXPORT unzSetReadPool(unzFile file, unzReadPool read_pool)
 {
     unz64_internal *s = NULL;
+
     if (file == NULL)
         return UNZ_PARAMERROR;
     s = (unz64_internal*)file;
-    *pglobal_info = s->gi;
+    s->read_pool = (unz_read_pool*)read_pool;
     return UNZ_OK;
 }
 
-extern int ZEXPORT unzGetGlobalComment(unzFile file, char *comment, uint16_t comment_size)
+/* Modification time of the zipfile in seconds, 0 when it can not be known */
+static uint64_t unzGetModifiedTime(const void *path)
 {
-    unz64_internal *s = NULL;
-    uint16_t bytes_to_read = comment_size;
-    if (file == NULL)
-        return (int)UNZ_PARAMERROR;
-    s = (unz64_internal*)file;
-
-    if (bytes_to_read > s->gi.size_comment)
-        bytes_to_read = s->gi.size_comment;
-
-    if (ZSEEK64(s->z_filefunc, s->filestream_with_CD, s->central_pos + 22, ZLIB_FILEFUNC_SEEK_SET) != 0)
-        return UNZ_ERRNO;
-
-    if (bytes_to_read > 0)
-    {
-        *comment = 0;
-        if (ZREAD64(s->z_filefunc, s->filestream_with_CD, comment, bytes_to_read) != bytes_to_read)
-            return UNZ_ERRNO;
-    }
-
-    if ((comment != NULL) && (comment_size > s->gi.size_comment))
-        *(comment + s->gi.size_comment) = 0;
+#if defined unix || defined __APPLE__
+    struct stat path_stat;
 
-    return (int)bytes_to_read;
+    if (stat((const char*)path, &path_stat) == 0)
+        return (uint64_t)path_stat.st_mtime;
+#endif
+    return 0;
 }
 
-static int unzGetCurrentFileInfoField(unzFile file, uint32_t *seek, void *field, uint16_t field_size, uint16_t size_file_field, int null_terminated_field)
+/* Map a lookup index kept in its own file with the io functions of the zipfile, its stream is left open while
+   mapped. When it can not be mapped it is read into a buffer that must be freed and *index_stream is NULL */
+static const uint8_t *unzReadLookupIndexFile(unz64_internal *s, const void *index_path, voidpf *index_stream,
+    uint64_t *index_size)
 {
-    unz64_internal *s = NULL;
-    uint32_t bytes_to_read = 0;
-    int err = UNZ_OK;
+    const uint8_t *index = NULL;
+    uint8_t *index_buffer = NULL;
+    uint64_t bytes_mapped = 0;
+    uint64_t size = 0;
 
-    if (file == NULL)
-        return (int)UNZ_PARAMERROR;
-    s = (unz64_internal*)file;
+    *index_stream = NULL;
+    *index_size = 0;
 
-    /* Read field */
-    if (field != NULL)
+    *index_stream = ZOPEN64(s->z_filefunc, index_path, ZLIB_FILEFUNC_MODE_READ | ZLIB_FILEFUNC_MODE_EXISTING);
+    if (*index_stream == NULL)
+        return NULL;
+    if (ZSEEK64(s->z_filefunc, *index_stream, 0, ZLIB_FILEFUNC_SEEK_END) == 0)
+        size = ZTELL64(s->z_filefunc, *index_stream);
+    if ((size >= SIZELOOKUPINDEXHEADER + SIZELOOKUPLOCATOR) && (size <= UINT32_MAX))
     {
-        if (size_file_field < field_size)
-        {
-            if (null_terminated_field)
-                *((char *)field+size_file_field) = 0;
-
-            bytes_to_read = size_file_field;
-        }
-        else
-            bytes_to_read = field_size;
-        
-        if (*seek != 0)
+        index = (const uint8_t*)ZMAP64(s->z_filefunc, *index_stream, 0, &bytes_mapped);
+        if ((index != NULL) && (bytes_mapped >= size))
         {
-            if (ZSEEK64(s->z_filefunc, s->filestream_with_CD, *seek, ZLIB_FILEFUNC_SEEK_CUR) == 0)
-                *seek = 0;
-            else
-                err = UNZ_ERRNO;
+            *index_size = size;
+            return index;
         }
-        
-        if ((size_file_field > 0) && (field_size > 0))
+        index_buffer = (uint8_t*)ALLOC((size_t)size);
+        if ((index_buffer != NULL) && (ZPREAD64(s->z_filefunc, *index_stream, index_buffer, (uint32_t)size, 0) != size))
         {
-            if (ZREAD64(s->z_filefunc, s->filestream_with_CD, field, bytes_to_read) != bytes_to_read)
-                err = UNZ_ERRNO;
+            TRYFREE(index_buffer);
+            index_buffer = NULL;
         }
-        *seek += size_file_field - bytes_to_read;
-    }
-    else
-    {
-        *seek += size_file_field;
     }
-
-    return err;
+    ZCLOSE64(s->z_filefunc, *index_stream);
+    *index_stream = NULL;
+    if (index_buffer != NULL)
+        *index_size = size;
+    return index_buffer;
 }
 
-/* Get info about the current file in the zipfile, with internal only info */
-static int unzGetCurrentFileInfoInternal(unzFile file, unz_file_info64 *pfile_info,
-    unz_file_info64_internal *pfile_info_internal, char *filename, uint16_t filename_size, void *extrafield,
-    uint16_t extrafield_size, char *comment, uint16_t comment_size)
+static unzFile unzOpenInternal(const void *path, zlib_filefunc64_32_def *pzlib_filefunc64_32_def,
+    uint32_t read_buffer_size, const void *index_path)
 {
+    unz64_internal us;
     unz64_internal *s = NULL;
-    unz_file_info64 file_info;
-    unz_file_info64_internal file_info_internal;
-    uint32_t magic = 0;
-    uint64_t current_pos = 0;
-    uint32_t seek = 0;
-    uint32_t extra_pos = 0;
-    uint16_t extra_header_id = 0;
-    uint16_t extra_data_size = 0;
-    uint16_t value16 = 0;
-    uint32_t value32 = 0;
-    uint64_t value64 = 0;
+    uint64_t central_pos = 0;
+    uint64_t central_pos64 = 0;
+    uint64_t number_entry_CD = 0;
+    uint8_t buf[SIZECENTRALDIREND64];
+    uint8_t *tail = NULL;
+    uint64_t tail_pos = 0;
+    uint32_t tail_size = 0;
+    const uint8_t *index = NULL;
+    uint64_t index_size = 0;
+    uint64_t zip_mtime = 0;
+    const uint8_t *p = NULL;
+    voidpf filestream = NULL;
     int err = UNZ_OK;
+    int err64 = UNZ_OK;
 
-    if (file == NULL)
-        return UNZ_PARAMERROR;
-    s = (unz64_internal*)file;
-
-    if (ZSEEK64(s->z_filefunc, s->filestream_with_CD,
-            s->pos_in_central_dir + s->byte_before_the_zipfile, ZLIB_FILEFUNC_SEEK_SET) != 0)
-        err = UNZ_ERRNO;
+    us.filestream = NULL;
+    us.filestream_with_CD = NULL;
+    us.z_filefunc.zseek32_file = NULL;
+    us.z_filefunc.ztell32_file = NULL;
 
-    /* Check the magic */
-    if (err == UNZ_OK)
+    if (pzlib_filefunc64_32_def == NULL)
     {
-        if (unzReadUInt32(&s->z_filefunc, s->filestream_with_CD, &magic) != UNZ_OK)
-            err = UNZ_ERRNO;
-        else if (magic != CENTRALHEADERMAGIC)
-            err = UNZ_BADZIPFILE;
+        fill_fopen64_filefunc(&us.z_filefunc.zfile_func64);
+        fill_fopen64_filefunc_ext(&us.z_filefunc.zfile_ext);
     }
+    else
+        us.z_filefunc = *pzlib_filefunc64_32_def;
 
-    /* Read central directory header */
-    if (unzReadUInt16(&s->z_filefunc, s->filestream_with_CD, &file_info.version) != UNZ_OK)
-        err = UNZ_ERRNO;
-    if (unzReadUInt16(&s->z_filefunc, s->filestream_with_CD, &file_info.version_needed) != UNZ_OK)
-        err = UNZ_ERRNO;
-    if (unzReadUInt16(&s->z_filefunc, s->filestream_with_CD, &file_info.flag) != UNZ_OK)
-        err = UNZ_ERRNO;
-    if (unzReadUInt16(&s->z_filefunc, s->filestream_with_CD, &file_info.compression_method) != UNZ_OK)
-        err = UNZ_ERRNO;
-    if (unzReadUInt32(&s->z_filefunc, s->filestream_with_CD, &file_info.dos_date) != UNZ_OK)
-        err = UNZ_ERRNO;
-    if (unzReadUInt32(&s->z_filefunc, s->filestream_with_CD, &file_info.crc) != UNZ_OK)
-        err = UNZ_ERRNO;
-    if (unzReadUInt32(&s->z_filefunc, s->filestream_with_CD, &value32) != UNZ_OK)
-        err = UNZ_ERRNO;
-    file_info.compressed_size = value32;
-    if (unzReadUInt32(&s->z_filefunc, s->filestream_with_CD, &value32) != UNZ_OK)
-        err = UNZ_ERRNO;
-    file_info.uncompressed_size = value32;
-    if (unzReadUInt16(&s->z_filefunc, s->filestream_with_CD, &file_info.size_filename) != UNZ_OK)
-        err = UNZ_ERRNO;
-    if (unzReadUInt16(&s->z_filefunc, s->filestream_with_CD, &file_info.size_file_extra) != UNZ_OK)
-        err = UNZ_ERRNO;
-    if (unzReadUInt16(&s->z_filefunc, s->filestream_with_CD, &file_info.size_file_comment) != UNZ_OK)
-        err = UNZ_ERRNO;
-    if (unzReadUInt16(&s->z_filefunc, s->filestream_with_CD, &value16) != UNZ_OK)
-        err = UNZ_ERRNO;
-    file_info.disk_num_start = value16;
-    if (unzReadUInt16(&s->z_filefunc, s->filestream_with_CD, &file_info.internal_fa) != UNZ_OK)
-        err = UNZ_ERRNO;
-    if (unzReadUInt32(&s->z_filefunc, s->filestream_with_CD, &file_info.external_fa) != UNZ_OK)
-        err = UNZ_ERRNO;
-    /* Relative offset of local header */
-    if (unzReadUInt32(&s->z_filefunc, s->filestream_with_CD, &value32) != UNZ_OK)
-        err = UNZ_ERRNO;
+    us.filestream = ZOPEN64(us.z_filefunc, path, ZLIB_FILEFUNC_MODE_READ | ZLIB_FILEFUNC_MODE_EXISTING);
 
-    file_info.size_file_extra_internal = 0;
-    file_info.disk_offset = value32;
-    file_info_internal.offset_curfile = value32;
-#ifdef HAVE_AES
-    file_info_internal.aes_compression_method = 0;
-    file_info_internal.aes_encryption_mode = 0;
-    file_info_internal.aes_version = 0;
-#endif
+    if (us.filestream == NULL)
+        return NULL;
 
-    if (err == UNZ_OK)
-        err = unzGetCurrentFileInfoField(file, &seek, filename, filename_size, file_info.size_filename, 1);
+    us.filestream_with_CD = us.filestream;
+    us.is_zip64 = 0;
 
-    /* Read extrafield */
+    /* Search for end of central directory header */
+    err = unzReadTail(&us.z_filefunc, us.filestream, &tail, &tail_pos, &tail_size);
+    if (err == UNZ_OK)
+        err = unzSearchCentralDir(tail, tail_pos, tail_size, &central_pos);
     if (err == UNZ_OK)
-        err = unzGetCurrentFileInfoField(file, &seek, extrafield, extrafield_size, file_info.size_file_extra, 0);
-
-    if ((err == UNZ_OK) && (file_info.size_file_extra != 0))
     {
-        if (seek != 0)
+        err = unzReadWithTail(&us.z_filefunc, us.filestream, tail, tail_pos, tail_size, buf, SIZECENTRALDIREND,
+            central_pos);
+
+        if (err == UNZ_OK)
         {
-            if (ZSEEK64(s->z_filefunc, s->filestream_with_CD, seek, ZLIB_FILEFUNC_SEEK_CUR) == 0)
-                seek = 0;
-            else
-                err = UNZ_ERRNO;
+            /* The signature, already checked */
+            p = buf + 4;
+            /* Number of this disk */
+            us.number_disk = (uint32_t)unzReadValueFromMemoryAndMove(&p, 2);
+            /* Number of the disk with the start of the central directory */
+            us.gi.number_disk_with_CD = (uint32_t)unzReadValueFromMemoryAndMove(&p, 2);
+            /* Total number of entries in the central directory on this disk */
+            us.gi.number_entry = unzReadValueFromMemoryAndMove(&p, 2);
+            /* Total number of entries in the central directory */
+            number_entry_CD = unzReadValueFromMemoryAndMove(&p, 2);
+            if (number_entry_CD != us.gi.number_entry)
+                err = UNZ_BADZIPFILE;
+            /* Size of the central directory */
+            us.size_central_dir = unzReadValueFromMemoryAndMove(&p, 4);
+            /* Offset of start of central directory with respect to the starting disk number */
+            us.offset_central_dir = unzReadValueFromMemoryAndMove(&p, 4);
+            /* Zipfile comment length */
+            us.gi.size_comment = (uint16_t)unzReadValueFromMemoryAndMove(&p, 2);
         }
 
-        /* We are going to parse the extra field so we need to move back */
-        current_pos = ZTELL64(s->z_filefunc, s->filestream_with_CD);
-        if (current_pos < file_info.size_file_extra)
-            err = UNZ_ERRNO;
-        current_pos -= file_info.size_file_extra;
-        if (ZSEEK64(s->z_filefunc, s->filestream_with_CD, current_pos, ZLIB_FILEFUNC_SEEK_SET) != 0)
-            err = UNZ_ERRNO;
-
-        while ((err != UNZ_ERRNO) && (extra_pos < file_info.size_file_extra))
+        if (err == UNZ_OK)
         {
-            if (unzReadUInt16(&s->z_filefunc, s->filestream_with_CD, &extra_header_id) != UNZ_OK)
-                err = UNZ_ERRNO;
-            if (unzReadUInt16(&s->z_filefunc, s->filestream_with_CD, &extra_data_size) != UNZ_OK)
-                err = UNZ_ERRNO;
-
-            /* ZIP64 extra fields */
-            if (extra_header_id == 0x0001)
+            /* Search for Zip64 end of central directory header */
+            err64 = unzSearchCentralDir64(&us.z_filefunc, &central_pos64, us.filestream, central_pos,
+                tail, tail_pos, tail_size);
+            if (err64 == UNZ_OK)
             {
-                /* Subtract size of ZIP64 field, since ZIP64 is handled internally */
-                file_info.size_file_extra_internal += 2 + 2 + extra_data_size;
+                central_pos = central_pos64;
+                us.is_zip64 = 1;
 
-                if (file_info.uncompressed_size == UINT32_MAX)
-                {
-                    if (unzReadUInt64(&s->z_filefunc, s->filestream_with_CD, &file_info.uncompressed_size) != UNZ_OK)
-                        err = UNZ_ERRNO;
-                }
-                if (file_info.compressed_size == UINT32_MAX)
-                {
-                    if (unzReadUInt64(&s->z_filefunc, s->filestream_with_CD, &file_info.compressed_size) != UNZ_OK)
-                        err = UNZ_ERRNO;
-                }
-                if (file_info_internal.offset_curfile == UINT32_MAX)
-                {
-                    /* Relative Header offset */
-                    if (unzReadUInt64(&s->z_filefunc, s->filestream_with_CD, &value64) != UNZ_OK)
-                        err = UNZ_ERRNO;
-                    file_info_internal.offset_curfile = value64;
-                    file_info.disk_offset = value64;
-                }
-                if (file_info.disk_num_start == UINT32_MAX)
+                err = unzReadWithTail(&us.z_filefunc, us.filestream, tail, tail_pos, tail_size, buf,
+                    SIZECENTRALDIREND64, central_pos);
+
+                if (err == UNZ_OK)
                 {
-                    /* Disk Start Number */
-                    if (unzReadUInt32(&s->z_filefunc, s->filestream_with_CD, &file_info.disk_num_start) != UNZ_OK)
-                        err = UNZ_ERRNO;
+                    /* The signature, already checked, size of zip64 end of central directory record,
+                       version made by and version needed to extract */
+                    p = buf + 16;
+                    /* Number of this disk */
+                    us.number_disk = (uint32_t)unzReadValueFromMemoryAndMove(&p, 4);
+                    /* Number of the disk with the start of the central directory */
+                    us.gi.number_disk_with_CD = (uint32_t)unzReadValueFromMemoryAndMove(&p, 4);
+                    /* Total number of entries in the central directory on this disk */
+                    us.gi.number_entry = unzReadValueFromMemoryAndMove(&p, 8);
+                    /* Total number of entries in the central directory */
+                    number_entry_CD = unzReadValueFromMemoryAndMove(&p, 8);
+                    if (number_entry_CD != us.gi.number_entry)
+                        err = UNZ_BADZIPFILE;
+                    /* Size of the central directory */
+                    us.size_central_dir = unzReadValueFromMemoryAndMove(&p, 8);
+                    /* Offset of start of central directory with respect to the starting disk number */
+                    us.offset_central_dir = unzReadValueFromMemoryAndMove(&p, 8);
                 }
             }
-#ifdef HAVE_AES
-            /* AES header */
-            else if (extra_header_id == 0x9901)
-            {
-                uint8_t value8 = 0;
-
-                /* Subtract size of AES field, since AES is handled internally */
-                file_info.size_file_extra_internal += 2 + 2 + extra_data_size;
-
-                /* Verify version info */
-                if (unzReadUInt16(&s->z_filefunc, s->filestream_with_CD, &value16) != UNZ_OK)
-                    err = UNZ_ERRNO;
-                /* Support AE-1 and AE-2 */
-                if (value16 != 1 && value16 != 2)
-                    err = UNZ_ERRNO;
-                file_info_internal.aes_version = value16;
-                if (unzReadUInt8(&s->z_filefunc, s->filestream_with_CD, &value8) != UNZ_OK)
-                    err = UNZ_ERRNO;
-                if ((char)value8 != 'A')
-                    err = UNZ_ERRNO;
-                if (unzReadUInt8(&s->z_filefunc, s->filestream_with_CD, &value8) != UNZ_OK)
-                    err = UNZ_ERRNO;
-                if ((char)value8 != 'E')
-                    err = UNZ_ERRNO;
-                /* Get AES encryption strength and actual compression method */
-                if (unzReadUInt8(&s->z_filefunc, s->filestream_with_CD, &value8) != UNZ_OK)
-                    err = UNZ_ERRNO;
-                file_info_internal.aes_encryption_mode = value8;
-                if (unzReadUInt16(&s->z_filefunc, s->filestream_with_CD, &value16) != UNZ_OK)
-                    err = UNZ_ERRNO;
-                file_info_internal.aes_compression_method = value16;
-            }
-#endif
-            else
-            {
-                if (ZSEEK64(s->z_filefunc, s->filestream_with_CD,extra_data_size, ZLIB_FILEFUNC_SEEK_CUR) != 0)
-                    err = UNZ_ERRNO;
-            }
-
-            extra_pos += 2 + 2 + extra_data_size;
+            else if ((us.size_central_dir == UINT16_MAX) || (us.offset_central_dir == UINT32_MAX))
+                err = UNZ_BADZIPFILE;
         }
     }
-
-    if (file_info.disk_num_start == s->gi.number_disk_with_CD)
-        file_info_internal.byte_before_the_zipfile = s->byte_before_the_zipfile;
     else
-        file_info_internal.byte_before_the_zipfile = 0;
-
-    if (err == UNZ_OK)
-        err = unzGetCurrentFileInfoField(file, &seek, comment, comment_size, file_info.size_file_comment, 1);
+        err = UNZ_ERRNO;
 
-    if ((err == UNZ_OK) && (pfile_info != NULL))
-        *pfile_info = file_info;
-    if ((err == UNZ_OK) && (pfile_info_internal != NULL))
-        *pfile_info_internal = file_info_internal;
+    if ((err == UNZ_OK) && (central_pos < us.offset_central_dir + us.size_central_dir))
+        err = UNZ_BADZIPFILE;
 
-    return err;
-}
+    if (err != UNZ_OK)
+    {
+        TRYFREE(tail);
+        ZCLOSE64(us.z_filefunc, us.filestream);
+        return NULL;
+    }
 
-extern int ZEXPORT unzGetCurrentFileInfo(unzFile file, unz_file_info *pfile_info, char *filename,
-    uint16_t filename_size, void *extrafield, uint16_t extrafield_size, char *comment, uint16_t comment_size)
-{
-    unz_file_info64 file_info64;
-    int err = UNZ_OK;
-
-    err = unzGetCurrentFileInfoInternal(file, &file_info64, NULL, filename, filename_size,
-                extrafield, extrafield_size, comment, comment_size);
-
-    if ((err == UNZ_OK) && (pfile_info != NULL))
+    if ((us.gi.number_disk_with_CD == 0) && (us.z_filefunc.zfile_ext.zpread64_file == NULL))
     {
-        pfile_info->version = file_info64.version;
-        pfile_info->version_needed = file_info64.version_needed;
-        pfile_info->flag = file_info64.flag;
-        pfile_info->compression_method = file_info64.compression_method;
-        pfile_info->dos_date = file_info64.dos_date;
-        pfile_info->crc = file_info64.crc;
+        /* If there is only one disk open another stream so we don't have to seek between the CD
+           and the file headers constantly, not needed when reads are positional */
+        filestream = ZOPEN64(us.z_filefunc, path, ZLIB_FILEFUNC_MODE_READ | ZLIB_FILEFUNC_MODE_EXISTING);
+        if (filestream != NULL)
+            us.filestream = filestream;
+    }
 
-        pfile_info->size_filename = file_info64.size_filename;
-        pfile_info->size_file_extra = file_info64.size_file_extra - file_info64.size_file_extra_internal;
-        pfile_info->size_file_comment = file_info64.size_file_comment;
+    /* Hack for zip files that have no respect for zip64
+    if ((central_pos > 0xffffffff) && (us.offset_central_dir < 0xffffffff))
+        us.offset_central_dir = central_pos - us.size_central_dir;*/
 
-        pfile_info->disk_num_start = (uint16_t)file_info64.disk_num_start;
-        pfile_info->internal_fa = file_info64.internal_fa;
-        pfile_info->external_fa = file_info64.external_fa;
+    us.byte_before_the_zipfile = central_pos - (us.offset_central_dir + us.size_central_dir);
+    us.central_pos = central_pos;
+    us.pfile_in_zip_read = NULL;
+    us.name_hash = NULL;
+    us.name_hash_mask = 0;
+    us.name_sorted = NULL;
+    us.tables_in_index = 0;
+    us.lookup_index = NULL;
+    us.lookup_index_stream = NULL;
+    us.seek_indexes = NULL;
+    us.seek_index_spacing = 0;
+    us.is_clone = 0;
+    us.decompress = NULL;
+    us.decompress_user_data = NULL;
+    us.entry_buffer = NULL;
+    us.entry_buffer_size = 0;
+    us.read_info_cache = NULL;
+    us.read_pool = NULL;
+    us.prefetch_count = UNZ_PREFETCHCOUNT;
+    us.prefetch_drop = 1;
+    us.prefetch_pattern = ZLIB_FILEFUNC_ADVISE_NORMAL;
+    us.prefetch_advice = ZLIB_FILEFUNC_ADVISE_NORMAL;
+    us.prefetch_last_file = 0;
+    us.prefetch_next_file = 0;
+    us.read_buffer_size = read_buffer_size;
+    if (us.read_buffer_size == 0)
+        us.read_buffer_size = UNZ_BUFSIZE;
 
-        pfile_info->compressed_size = (uint32_t)file_info64.compressed_size;
-        pfile_info->uncompressed_size = (uint32_t)file_info64.uncompressed_size;
+    s = (unz64_internal*)ALLOC(sizeof(unz64_internal));
+    if (s != NULL)
+    {
+        *s = us;
+        if (index_path != NULL)
+        {
+            /* The handle keeps the index its tables point into */
+            index = unzReadLookupIndexFile(s, index_path, &s->lookup_index_stream, &index_size);
+            if (s->lookup_index_stream == NULL)
+                s->lookup_index = (uint8_t*)index;
+            zip_mtime = unzGetModifiedTime(path);
+        }
+        err = unzReadCentralDir(s, tail, tail_pos, tail_size, index, index_size, zip_mtime);
+        TRYFREE(tail);
+        if (err != UNZ_OK)
+        {
+            unzClose((unzFile)s);
+            return NULL;
+        }
+
+        unzGoToFirstFile((unzFile)s);
     }
-    return err;
+    else
+    {
+        TRYFREE(tail);
+        if (us.filestream != us.filestream_with_CD)
+            ZCLOSE64(us.z_filefunc, us.filestream);
+        ZCLOSE64(us.z_filefunc, us.filestream_with_CD);
+    }
+    return (unzFile)s;
 }
 
-extern int ZEXPORT unzGetCurrentFileInfo64(unzFile file, unz_file_info64 * pfile_info, char *filename,
-    uint16_t filename_size, void *extrafield, uint16_t extrafield_size, char *comment, uint16_t comment_size)
+extern unzFile ZEXPORT unzOpen2(const char *path, zlib_filefunc_def *pzlib_filefunc32_def)
 {
-    return unzGetCurrentFileInfoInternal(file, pfile_info, NULL, filename, filename_size,
-        extrafield, extrafield_size, comment,comment_size);
+    if (pzlib_filefunc32_def != NULL)
+    {
+        zlib_filefunc64_32_def zlib_filefunc64_32_def_fill;
+        fill_zlib_filefunc64_32_def_from_filefunc32(&zlib_filefunc64_32_def_fill, pzlib_filefunc32_def);
+        return unzOpenInternal(path, &zlib_filefunc64_32_def_fill, 0, NULL);
+    }
+    return unzOpenInternal(path, NULL, 0, NULL);
 }
 
-/* Read the local header of the current zipfile. Check the coherency of the local header and info in the
-   end of central directory about this file store in *piSizeVar the size of extra info in local header
-   (filename and size of extra field data) */
-static int unzCheckCurrentFileCoherencyHeader(unz64_internal *s, uint32_t *psize_variable, uint64_t *poffset_local_extrafield,
-    uint16_t *psize_local_extrafield)
+extern unzFile ZEXPORT unzOpen2_64(const void *path, zlib_filefunc64_def *pzlib_filefunc_def)
 {
-    uint32_t magic = 0;
-    uint16_t value16 = 0;
-    uint32_t value32 = 0;
-    uint32_t flags = 0;
-    uint16_t size_filename = 0;
-    uint16_t size_extra_field = 0;
-    uint16_t compression_method = 0;
-    int err = UNZ_OK;
-
-    if (psize_variable == NULL)
-        return UNZ_PARAMERROR;
-    *psize_variable = 0;
-    if (poffset_local_extrafield == NULL)
-        return UNZ_PARAMERROR;
-    *poffset_local_extrafield = 0;
-    if (psize_local_extrafield == NULL)
-        return UNZ_PARAMERROR;
-    *psize_local_extrafield = 0;
-
-    err = unzGoToNextDisk((unzFile)s);
-    if (err != UNZ_OK)
-        return err;
-
-    if (ZSEEK64(s->z_filefunc, s->filestream, s->cur_file_info_internal.offset_curfile +
-        s->cur_file_info_internal.byte_before_the_zipfile, ZLIB_FILEFUNC_SEEK_SET) != 0)
-        return UNZ_ERRNO;
-
-    if (err == UNZ_OK)
+    if (pzlib_filefunc_def != NULL)
     {
-        if (unzReadUInt32(&s->z_filefunc, s->filestream, &magic) != UNZ_OK)
-            err = UNZ_ERRNO;
-        else if (magic != LOCALHEADERMAGIC)
-            err = UNZ_BADZIPFILE;
+        zlib_filefunc64_32_def zlib_filefunc64_32_def_fill;
+        zlib_filefunc64_32_def_fill.zfile_func64 = *pzlib_filefunc_def;
+        memset(&zlib_filefunc64_32_def_fill.zfile_ext, 0, sizeof(zlib_filefunc64_32_def_fill.zfile_ext));
+        zlib_filefunc64_32_def_fill.ztell32_file = NULL;
+        zlib_filefunc64_32_def_fill.zseek32_file = NULL;
+        return unzOpenInternal(path, &zlib_filefunc64_32_def_fill, 0, NULL);
     }
+    return unzOpenInternal(path, NULL, 0, NULL);
+}
 
-    if (unzReadUInt16(&s->z_filefunc, s->filestream, &value16) != UNZ_OK)
-        err = UNZ_ERRNO;
-    if (unzReadUInt16(&s->z_filefunc, s->filestream, &value16) != UNZ_OK)
-        err = UNZ_ERRNO;
-    flags = value16;
-    if (unzReadUInt16(&s->z_filefunc, s->filestream, &value16) != UNZ_OK)
-        err = UNZ_ERRNO;
-    else if ((err == UNZ_OK) && (value16 != s->cur_file_info.compression_method))
-        err = UNZ_BADZIPFILE;
-
-    compression_method = s->cur_file_info.compression_method;
-#ifdef HAVE_AES
-    if (compression_method == AES_METHOD)
-        compression_method = s->cur_file_info_internal.aes_compression_method;
-#endif
-
-    if ((err == UNZ_OK) && (compression_method != 0) && (compression_method != Z_DEFLATED))
+extern unzFile ZEXPORT unzOpen3(const void *path, zlib_filefunc64_def *pzlib_filefunc_def, uint32_t read_buffer_size)
+{
+    if (pzlib_filefunc_def != NULL)
     {
-#ifdef HAVE_BZIP2
-        if (compression_method != Z_BZIP2ED)
-#endif
-            err = UNZ_BADZIPFILE;
+        zlib_filefunc64_32_def zlib_filefunc64_32_def_fill;
+        zlib_filefunc64_32_def_fill.zfile_func64 = *pzlib_filefunc_def;
+        memset(&zlib_filefunc64_32_def_fill.zfile_ext, 0, sizeof(zlib_filefunc64_32_def_fill.zfile_ext));
+        zlib_filefunc64_32_def_fill.ztell32_file = NULL;
+        zlib_filefunc64_32_def_fill.zseek32_file = NULL;
+        return unzOpenInternal(path, &zlib_filefunc64_32_def_fill, read_buffer_size, NULL);
     }
+    return unzOpenInternal(path, NULL, read_buffer_size, NULL);
+}
 
-    if (unzReadUInt32(&s->z_filefunc, s->filestream, &value32) != UNZ_OK) /* date/time */
-        err = UNZ_ERRNO;
-    if (unzReadUInt32(&s->z_filefunc, s->filestream, &value32) != UNZ_OK) /* crc */
-        err = UNZ_ERRNO;
-    else if ((err == UNZ_OK) && (value32 != s->cur_file_info.crc) && ((flags & 8) == 0))
-        err = UNZ_BADZIPFILE;
-    if (unzReadUInt32(&s->z_filefunc, s->filestream, &value32) != UNZ_OK) /* size compr */
-        err = UNZ_ERRNO;
-    else if ((value32 != UINT32_MAX) && (err == UNZ_OK) && (value32 != s->cur_file_info.compressed_size) && ((flags & 8) == 0))
-        err = UNZ_BADZIPFILE;
-    if (unzReadUInt32(&s->z_filefunc, s->filestream, &value32) != UNZ_OK) /* size uncompr */
-        err = UNZ_ERRNO;
-    else if ((value32 != UINT32_MAX) && (err == UNZ_OK) && (value32 != s->cur_file_info.uncompressed_size) && ((flags & 8) == 0))
-        err = UNZ_BADZIPFILE;
-    if (unzReadUInt16(&s->z_filefunc, s->filestream, &size_filename) != UNZ_OK)
-        err = UNZ_ERRNO;
-
-    *psize_variable += size_filename;
-
-    if (unzReadUInt16(&s->z_filefunc, s->filestream, &size_extra_field) != UNZ_OK)
-        err = UNZ_ERRNO;
+extern unzFile ZEXPORT unzOpenWithLookupIndex(const void *path, zlib_filefunc64_def *pzlib_filefunc_def,
+    const void *index_path)
+{
+    if (index_path == NULL)
+        return NULL;
+    if (pzlib_filefunc_def != NULL)
+    {
+        zlib_filefunc64_32_def zlib_filefunc64_32_def_fill;
+        zlib_filefunc64_32_def_fill.zfile_func64 = *pzlib_filefunc_def;
+        memset(&zlib_filefunc64_32_def_fill.zfile_ext, 0, sizeof(zlib_filefunc64_32_def_fill.zfile_ext));
+        zlib_filefunc64_32_def_fill.ztell32_file = NULL;
+        zlib_filefunc64_32_def_fill.zseek32_file = NULL;
+        return unzOpenInternal(path, &zlib_filefunc64_32_def_fill, 0, index_path);
+    }
+    return unzOpenInternal(path, NULL, 0, index_path);
+}
 
-    *poffset_local_extrafield = s->cur_file_info_internal.offset_curfile + SIZEZIPLOCALHEADER + size_filename;
-    *psize_local_extrafield = size_extra_field;
-    *psize_variable += size_extra_field;
+extern unzFile ZEXPORT unzOpen(const char *path)
+{
+    return unzOpenInternal(path, NULL, 0, NULL);
+}
 
-    return err;
+extern unzFile ZEXPORT unzOpen64(const void *path)
+{
+    return unzOpenInternal(path, NULL, 0, NULL);
 }
 
-extern uint64_t ZEXPORT unzCountEntries(const unzFile file)
+static void unzFreeSeekIndex(unz_seek_index *index)
 {
-    if (file == NULL)
-        return 0;
-    
-    unz64_internal s = *(unz64_internal*)file;
-    
-    s.pos_in_central_dir = s.offset_central_dir;
-    s.num_file = 0;
-    while (UNZ_OK == unzGetCurrentFileInfoInternal(&s,
-                                                   &s.cur_file_info,
-                                                   &s.cur_file_info_internal,
-                                                   NULL, 0, NULL, 0, NULL, 0))
-    {
-        s.pos_in_central_dir += SIZECENTRALDIRITEM
-        + s.cur_file_info.size_filename
-        + s.cur_file_info.size_file_extra
-        + s.cur_file_info.size_file_comment;
-        s.num_file += 1;
-    }
-    return s.num_file;
+    uint64_t i = 0;
+
+    if (index == NULL)
+        return;
+    for (i = 0; i < index->number_point; i += 1)
+        TRYFREE(index->points[i].window);
+    TRYFREE(index->points);
+    TRYFREE(index);
 }
 
-/*
-  Open for reading data the current file in the zipfile.
-  If there is no error and the file is opened, the return value is UNZ_OK.
-*/
-extern int ZEXPORT unzOpenCurrentFile3(unzFile file, int *method, int *level, int raw, const char *password)
+extern int ZEXPORT unzClose(unzFile file)
 {
-    unz64_internal *s = NULL;
-    file_in_zip64_read_info_s *pfile_in_zip_read_info = NULL;
-    uint16_t compression_method = 0;
-    uint64_t offset_local_extrafield = 0;
-    uint16_t size_local_extrafield = 0;
-    uint32_t size_variable = 0;
-    int err = UNZ_OK;
-#ifndef NOUNCRYPT
-    char source[12];
-#else
-    if (password != NULL)
-        return UNZ_PARAMERROR;
-#endif
+    unz64_internal *s;
+    uint64_t i = 0;
     if (file == NULL)
         return UNZ_PARAMERROR;
     s = (unz64_internal*)file;
-    if (!s->current_file_ok)
-        return UNZ_PARAMERROR;
 
     if (s->pfile_in_zip_read != NULL)
         unzCloseCurrentFile(file);
 
-    if (unzCheckCurrentFileCoherencyHeader(s, &size_variable, &offset_local_extrafield, &size_local_extrafield) != UNZ_OK)
-        return UNZ_BADZIPFILE;
-    
-    compression_method = s->cur_file_info.compression_method;
-#ifdef HAVE_AES
-    if (compression_method == AES_METHOD)
-    {
-        compression_method = s->cur_file_info_internal.aes_compression_method;
-        if (password == NULL)
-        {
-            return UNZ_PARAMERROR;
-        }
-    }
-#endif
-
-    if (method != NULL)
-        *method = compression_method;
+    if ((s->filestream != NULL) && (s->filestream != s->filestream_with_CD))
+        ZCLOSE64(s->z_filefunc, s->filestream);
+    if ((s->filestream_with_CD != NULL) && (!s->is_clone))
+        ZCLOSE64(s->z_filefunc, s->filestream_with_CD);
 
-    if (level != NULL)
+    s->filestream = NULL;
+    s->filestream_with_CD = NULL;
+    if (!s->tables_in_index)
     {
-        *level = 6;
-        switch (s->cur_file_info.flag & 0x06)
-        {
-          case 6 : *level = 1; break;
-          case 4 : *level = 2; break;
-          case 2 : *level = 9; break;
-        }
+        TRYFREE(s->name_hash);
+        TRYFREE(s->name_sorted);
     }
-
-    if ((compression_method != 0) && (compression_method != Z_DEFLATED))
+    TRYFREE(s->entry_buffer);
+    unzPutReadInfoInPool(s->read_pool, s->read_info_cache);
+    if (s->seek_indexes != NULL)
     {
-#ifdef HAVE_BZIP2
-        if (compression_method != Z_BZIP2ED)
-#endif
-        {
-            return UNZ_BADZIPFILE;
-        }
+        for (i = 0; i < s->gi.number_entry; i += 1)
+            unzFreeSeekIndex(s->seek_indexes[i]);
+        TRYFREE(s->seek_indexes);
     }
-    
-    pfile_in_zip_read_info = (file_in_zip64_read_info_s*)ALLOC(sizeof(file_in_zip64_read_info_s));
-    if (pfile_in_zip_read_info == NULL)
-        return UNZ_INTERNALERROR;
-
-    pfile_in_zip_read_info->read_buffer = (uint8_t*)ALLOC(UNZ_BUFSIZE);
-    if (pfile_in_zip_read_info->read_buffer == NULL)
+    if (!s->is_clone)
     {
-        TRYFREE(pfile_in_zip_read_info);
-        return UNZ_INTERNALERROR;
+        if (!s->tables_in_index)
+            TRYFREE(s->entries);
+        TRYFREE(s->central_dir);
+        TRYFREE(s->lookup_index);
+        if (s->lookup_index_stream != NULL)
+            ZCLOSE64(s->z_filefunc, s->lookup_index_stream);
     }
-    
-    pfile_in_zip_read_info->stream_initialised = 0;
+    TRYFREE(s);
+    return UNZ_OK;
+}
 
-    pfile_in_zip_read_info->filestream = s->filestream;
-    pfile_in_zip_read_info->z_filefunc = s->z_filefunc;
+extern int ZEXPORT unzSetFileFuncExt(unzFile file, const zlib_filefunc64_ext_def *pzlib_filefunc_ext_def)
+{
+    unz64_internal *s = NULL;
+    if (file == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+    if (s->pfile_in_zip_read != NULL)
+        return UNZ_PARAMERROR;
+    if (pzlib_filefunc_ext_def != NULL)
+        s->z_filefunc.zfile_ext = *pzlib_filefunc_ext_def;
+    else
+        memset(&s->z_filefunc.zfile_ext, 0, sizeof(s->z_filefunc.zfile_ext));
+    return UNZ_OK;
+}
 
-    pfile_in_zip_read_info->raw = raw;
-    pfile_in_zip_read_info->crc32 = 0;
-    pfile_in_zip_read_info->crc32_expected = s->cur_file_info.crc;
-    pfile_in_zip_read_info->total_out_64 = 0;
-    pfile_in_zip_read_info->compression_method = compression_method;
-    
-    pfile_in_zip_read_info->offset_local_extrafield = offset_local_extrafield;
-    pfile_in_zip_read_info->size_local_extrafield = size_local_extrafield;
-    pfile_in_zip_read_info->pos_local_extrafield = 0;
+extern unzFile ZEXPORT unzOpenClone(unzFile file)
+{
+    unz64_internal *s = NULL;
+    unz64_internal *clone = NULL;
 
-    pfile_in_zip_read_info->rest_read_compressed = s->cur_file_info.compressed_size;
-    pfile_in_zip_read_info->rest_read_uncompressed = s->cur_file_info.uncompressed_size;
-    pfile_in_zip_read_info->byte_before_the_zipfile = 0;
+    if (file == NULL)
+        return NULL;
+    s = (unz64_internal*)file;
 
-    if (s->number_disk == s->gi.number_disk_with_CD)
-        pfile_in_zip_read_info->byte_before_the_zipfile = s->byte_before_the_zipfile;
-        
-    pfile_in_zip_read_info->pos_in_zipfile = s->cur_file_info_internal.offset_curfile + SIZEZIPLOCALHEADER + size_variable;
+    /* Clones share the stream with the central directory, reads on it must not depend on its position */
+    if (s->z_filefunc.zfile_ext.zpread64_file == NULL)
+        return NULL;
+    if (s->gi.number_disk_with_CD != 0)
+        return NULL;
+    /* Clones share the central directory, it is read now if it was not needed yet */
+    if (unzLoadCentralDir(s) != UNZ_OK)
+        return NULL;
 
-    pfile_in_zip_read_info->stream.zalloc = (alloc_func)0;
-    pfile_in_zip_read_info->stream.zfree = (free_func)0;
-    pfile_in_zip_read_info->stream.opaque = (voidpf)s;
-    pfile_in_zip_read_info->stream.total_out = 0;
-    pfile_in_zip_read_info->stream.total_in = 0;
-    pfile_in_zip_read_info->stream.next_in = NULL;
-    pfile_in_zip_read_info->stream.avail_in = 0;
+    clone = (unz64_internal*)ALLOC(sizeof(unz64_internal));
+    if (clone == NULL)
+        return NULL;
 
-    if (!raw)
+    *clone = *s;
+    clone->is_clone = 1;
+    clone->filestream = s->filestream_with_CD;
+    clone->number_disk = s->gi.number_disk_with_CD;
+    clone->pfile_in_zip_read = NULL;
+    /* Lookup tables are built lazily, each handle builds its own unless they are in the lookup index */
+    if (!s->tables_in_index)
     {
-        if (compression_method == Z_BZIP2ED)
-        {
-#ifdef HAVE_BZIP2
-            pfile_in_zip_read_info->bstream.bzalloc = (void *(*) (void *, int, int))0;
-            pfile_in_zip_read_info->bstream.bzfree = (free_func)0;
-            pfile_in_zip_read_info->bstream.opaque = (voidpf)0;
-            pfile_in_zip_read_info->bstream.state = (voidpf)0;
-
-            err = BZ2_bzDecompressInit(&pfile_in_zip_read_info->bstream, 0, 0);
-            if (err == Z_OK)
-            {
-                pfile_in_zip_read_info->stream_initialised = Z_BZIP2ED;
-            }
-            else
-            {
-                TRYFREE(pfile_in_zip_read_info);
-                return err;
-            }
-#else
-            pfile_in_zip_read_info->raw = 1;
-#endif
-        }
-        else if (compression_method == Z_DEFLATED)
-        {
-#ifdef HAVE_APPLE_COMPRESSION
-            err = compression_stream_init(&pfile_in_zip_read_info->astream, COMPRESSION_STREAM_DECODE, COMPRESSION_ZLIB);
-            if (err == COMPRESSION_STATUS_ERROR)
-                err = UNZ_INTERNALERROR;
-            else
-                err = Z_OK;
-#else
-            err = inflateInit2(&pfile_in_zip_read_info->stream, -MAX_WBITS);
-#endif
-            if (err == Z_OK)
-            {
-                pfile_in_zip_read_info->stream_initialised = Z_DEFLATED;
-            }
-            else
-            {
-                TRYFREE(pfile_in_zip_read_info);
-                return err;
-            }
-            /* windowBits is passed < 0 to tell that there is no zlib header.
-             * Note that in this case inflate *requires* an extra "dummy" byte
-             * after the compressed stream in order to complete decompression and
-             * return Z_STREAM_END.
-             * In unzip, i don't wait absolutely Z_STREAM_END because I known the
-             * size of both compressed and uncompressed data
-             */
-        }
+        clone->name_hash = NULL;
+        clone->name_hash_mask = 0;
+        clone->name_sorted = NULL;
     }
+    clone->seek_indexes = NULL;
+    clone->entry_buffer = NULL;
+    clone->entry_buffer_size = 0;
+    clone->read_info_cache = NULL;
+    clone->prefetch_pattern = ZLIB_FILEFUNC_ADVISE_NORMAL;
+    clone->prefetch_last_file = 0;
+    clone->prefetch_next_file = 0;
+
+    unzGoToFirstFile((unzFile)clone);
+    return (unzFile)clone;
+}
 
-    s->pfile_in_zip_read = pfile_in_zip_read_info;
-
-#ifndef NOUNCRYPT
-    s->pcrc_32_tab = NULL;
-
-    if ((password != NULL) && ((s->cur_file_info.flag & 1) != 0))
-    {
-        if (ZSEEK64(s->z_filefunc, s->filestream,
-                  s->pfile_in_zip_read->pos_in_zipfile + s->pfile_in_zip_read->byte_before_the_zipfile,
-                  ZLIB_FILEFUNC_SEEK_SET) != 0)
-            return UNZ_INTERNALERROR;
-#ifdef HAVE_AES
-        if (s->cur_file_info.compression_method == AES_METHOD)
-        {
-            unsigned char passverify_archive[AES_PWVERIFYSIZE];
-            unsigned char passverify_password[AES_PWVERIFYSIZE];
-            unsigned char salt_value[AES_MAXSALTLENGTH];
-            uint32_t salt_length = 0;
-
-            if ((s->cur_file_info_internal.aes_encryption_mode < 1) ||
-                (s->cur_file_info_internal.aes_encryption_mode > 3))
-                return UNZ_INTERNALERROR;
-
-            salt_length = SALT_LENGTH(s->cur_file_info_internal.aes_encryption_mode);
-
-            if (ZREAD64(s->z_filefunc, s->filestream, salt_value, salt_length) != salt_length)
-                return UNZ_INTERNALERROR;
-            if (ZREAD64(s->z_filefunc, s->filestream, passverify_archive, AES_PWVERIFYSIZE) != AES_PWVERIFYSIZE)
-                return UNZ_INTERNALERROR;
+/* Goto to the next available disk for spanned archives */
+static int unzGoToNextDisk(unzFile file)
+{
+    unz64_internal *s;
+    uint32_t number_disk_next = 0;
 
-            fcrypt_init(s->cur_file_info_internal.aes_encryption_mode, (uint8_t *)password,
-                (uint32_t)strlen(password), salt_value, passverify_password, &s->pfile_in_zip_read->aes_ctx);
+    s = (unz64_internal*)file;
+    if (s == NULL)
+        return UNZ_PARAMERROR;
+    number_disk_next = s->number_disk;
 
-            if (memcmp(passverify_archive, passverify_password, AES_PWVERIFYSIZE) != 0)
-                return UNZ_BADPASSWORD;
+    if ((s->pfile_in_zip_read != NULL) && (s->pfile_in_zip_read->rest_read_uncompressed > 0))
+        /* We are currently reading a file and we need the next sequential disk */
+        number_disk_next += 1;
+    else
+        /* Goto the disk for the current file */
+        number_disk_next = s->cur_file_info.disk_num_start;
 
-            s->pfile_in_zip_read->rest_read_compressed -= salt_length + AES_PWVERIFYSIZE;
-            s->pfile_in_zip_read->rest_read_compressed -= AES_AUTHCODESIZE;
+    if (number_disk_next != s->number_disk)
+    {
+        /* Switch disks */
+        if ((s->filestream != NULL) && (s->filestream != s->filestream_with_CD))
+            ZCLOSE64(s->z_filefunc, s->filestream);
 
-            s->pfile_in_zip_read->pos_in_zipfile += salt_length + AES_PWVERIFYSIZE;
+        if (number_disk_next == s->gi.number_disk_with_CD)
+        {
+            s->filestream = s->filestream_with_CD;
         }
         else
-#endif
         {
-            int i;
-            s->pcrc_32_tab = (const z_crc_t*)get_crc_table();
-            init_keys(password, s->keys, s->pcrc_32_tab);
-
-            if (ZREAD64(s->z_filefunc, s->filestream, source, 12) < 12)
-                return UNZ_INTERNALERROR;
+            s->filestream = ZOPENDISK64(s->z_filefunc, s->filestream_with_CD, number_disk_next,
+                ZLIB_FILEFUNC_MODE_READ | ZLIB_FILEFUNC_MODE_EXISTING);
+        }
 
-            for (i = 0; i < 12; i++)
-                zdecode(s->keys, s->pcrc_32_tab, source[i]);
+        if (s->filestream == NULL)
+            return UNZ_ERRNO;
 
-            s->pfile_in_zip_read->rest_read_compressed -= 12;
-            s->pfile_in_zip_read->pos_in_zipfile += 12;
-        }
+        s->number_disk = number_disk_next;
     }
-#endif
 
     return UNZ_OK;
 }
 
-extern int ZEXPORT unzOpenCurrentFile(unzFile file)
+extern int ZEXPORT unzGetGlobalInfo(unzFile file, unz_global_info* pglobal_info32)
 {
-    return unzOpenCurrentFile3(file, NULL, NULL, 0, NULL);
+    unz64_internal *s = NULL;
+    if (file == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+
+    pglobal_info32->number_entry = (uint32_t)s->gi.number_entry;
+    pglobal_info32->size_comment = s->gi.size_comment;
+    pglobal_info32->number_disk_with_CD = s->gi.number_disk_with_CD;
+    return UNZ_OK;
 }
 
-extern int ZEXPORT unzOpenCurrentFilePassword(unzFile file, const char *password)
+extern int ZEXPORT unzGetGlobalInfo64(unzFile file, unz_global_info64 *pglobal_info)
 {
-    return unzOpenCurrentFile3(file, NULL, NULL, 0, password);
+    unz64_internal *s = NULL;
+    if (file == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+    *pglobal_info = s->gi;
+    return UNZ_OK;
 }
 
-extern int ZEXPORT unzOpenCurrentFile2(unzFile file, int *method, int *level, int raw)
+extern int ZEXPORT unzGetGlobalComment(unzFile file, char *comment, uint16_t comment_size)
 {
-    return unzOpenCurrentFile3(file, method, level, raw, NULL);
+    unz64_internal *s = NULL;
+    uint16_t bytes_to_read = comment_size;
+    if (file == NULL)
+        return (int)UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+
+    if (bytes_to_read > s->gi.size_comment)
+        bytes_to_read = s->gi.size_comment;
+
+    if (bytes_to_read > 0)
+    {
+        *comment = 0;
+        if (ZPREAD64(s->z_filefunc, s->filestream_with_CD, comment, bytes_to_read,
+                s->central_pos + SIZECENTRALDIREND) != bytes_to_read)
+            return UNZ_ERRNO;
+    }
+
+    if ((comment != NULL) && (comment_size > s->gi.size_comment))
+        *(comment + s->gi.size_comment) = 0;
+
+    return (int)bytes_to_read;
 }
 
-/* Read bytes from the current file.
-   buf contain buffer where data must be copied
-   len the size of buf.
+static void unzGetCurrentFileInfoField(void *field, uint16_t field_size, const uint8_t *src, uint16_t size_file_field,
+    int null_terminated_field)
+{
+    uint16_t bytes_to_copy = 0;
 
-   return the number of byte copied if some bytes are copied
-   return 0 if the end of file was reached
-   return <0 with error code if there is an error (UNZ_ERRNO for IO error, or zLib error for uncompress error) */
-extern int ZEXPORT unzReadCurrentFile(unzFile file, voidp buf, uint32_t len)
+    if (field == NULL)
+        return;
+
+    if (size_file_field < field_size)
+    {
+        if (null_terminated_field)
+            *((char *)field+size_file_field) = 0;
+
+        bytes_to_copy = size_file_field;
+    }
+    else
+        bytes_to_copy = field_size;
+
+    if (bytes_to_copy > 0)
+        memcpy(field, src, bytes_to_copy);
+}
+
+/* Get info about the current file in the zipfile, with internal only info */
+static int unzGetCurrentFileInfoInternal(unzFile file, unz_file_info64 *pfile_info,
+    unz_file_info64_internal *pfile_info_internal, char *filename, uint16_t filename_size, void *extrafield,
+    uint16_t extrafield_size, char *comment, uint16_t comment_size)
 {
     unz64_internal *s = NULL;
-    uint32_t read = 0;
+    const unz_entry64_internal *entry = NULL;
+    const uint8_t *header = NULL;
     int err = UNZ_OK;
 
     if (file == NULL)
         return UNZ_PARAMERROR;
     s = (unz64_internal*)file;
-
-    if (s->pfile_in_zip_read == NULL)
-        return UNZ_PARAMERROR;
-    if (s->pfile_in_zip_read->read_buffer == NULL)
-        return UNZ_END_OF_LIST_OF_FILE;
-    if (len == 0)
-        return 0;
-    if (len > UINT16_MAX)
+    if (s->num_file >= s->gi.number_entry)
         return UNZ_PARAMERROR;
 
-    s->pfile_in_zip_read->stream.next_out = (uint8_t*)buf;
-    s->pfile_in_zip_read->stream.avail_out = (uint16_t)len;
+    entry = &s->entries[s->num_file];
 
-    if ((s->pfile_in_zip_read->compression_method == 0) || (s->pfile_in_zip_read->raw))
+    if (pfile_info != NULL)
     {
-        if (len > s->pfile_in_zip_read->rest_read_compressed + s->pfile_in_zip_read->stream.avail_in)
-            s->pfile_in_zip_read->stream.avail_out = (uint16_t)s->pfile_in_zip_read->rest_read_compressed +
-            s->pfile_in_zip_read->stream.avail_in;
+        pfile_info->version = entry->version;
+        pfile_info->version_needed = entry->version_needed;
+        pfile_info->flag = entry->flag;
+        pfile_info->compression_method = entry->compression_method;
+        pfile_info->dos_date = entry->dos_date;
+        pfile_info->crc = entry->crc;
+        pfile_info->compressed_size = entry->compressed_size;
+        pfile_info->uncompressed_size = entry->uncompressed_size;
+        pfile_info->size_filename = entry->size_filename;
+        pfile_info->size_file_extra = entry->size_file_extra;
+        pfile_info->size_file_comment = entry->size_file_comment;
+        pfile_info->disk_num_start = entry->disk_num_start;
+        pfile_info->internal_fa = entry->internal_fa;
+        pfile_info->external_fa = entry->external_fa;
+        pfile_info->disk_offset = entry->offset_curfile;
+        pfile_info->size_file_extra_internal = entry->size_file_extra_internal;
     }
-
-    do
+    if (pfile_info_internal != NULL)
     {
-        if (s->pfile_in_zip_read->stream.avail_in == 0)
-        {
-            uint32_t bytes_to_read = UNZ_BUFSIZE;
-            uint32_t bytes_not_read = 0;
-            uint32_t bytes_read = 0;
-            uint32_t total_bytes_read = 0;
+        pfile_info_internal->offset_curfile = entry->offset_curfile;
+        if (entry->disk_num_start == s->gi.number_disk_with_CD)
+            pfile_info_internal->byte_before_the_zipfile = s->byte_before_the_zipfile;
+        else
+            pfile_info_internal->byte_before_the_zipfile = 0;
+#ifdef HAVE_AES
+        pfile_info_internal->aes_encryption_mode = entry->aes_encryption_mode;
+        pfile_info_internal->aes_compression_method = entry->aes_compression_method;
+        pfile_info_internal->aes_version = entry->aes_version;
+#endif
+    }
 
-            if (s->pfile_in_zip_read->stream.next_in != NULL)
-                bytes_not_read = (uint32_t)(s->pfile_in_zip_read->read_buffer + UNZ_BUFSIZE -
-                    s->pfile_in_zip_read->stream.next_in);
-            bytes_to_read -= bytes_not_read;
-            if (bytes_not_read > 0)
-                memcpy(s->pfile_in_zip_read->read_buffer, s->pfile_in_zip_read->stream.next_in, bytes_not_read);
-            if (s->pfile_in_zip_read->rest_read_compressed < bytes_to_read)
-                bytes_to_read = (uint16_t)s->pfile_in_zip_read->rest_read_compressed;
+    if ((filename == NULL) && (extrafield == NULL) && (comment == NULL))
+        return UNZ_OK;
+    err = unzLoadCentralDir(s);
+    if (err != UNZ_OK)
+        return err;
 
-            while (total_bytes_read != bytes_to_read)
-            {
-                if (ZSEEK64(s->pfile_in_zip_read->z_filefunc, s->pfile_in_zip_read->filestream,
-                        s->pfile_in_zip_read->pos_in_zipfile + s->pfile_in_zip_read->byte_before_the_zipfile,
-                        ZLIB_FILEFUNC_SEEK_SET) != 0)
-                    return UNZ_ERRNO;
+    header = s->central_dir + (entry->pos_in_central_dir - s->offset_central_dir) + SIZECENTRALDIRITEM;
+    unzGetCurrentFileInfoField(filename, filename_size, header, entry->size_filename, 1);
+    header += entry->size_filename;
+    unzGetCurrentFileInfoField(extrafield, extrafield_size, header, entry->size_file_extra, 0);
+    header += entry->size_file_extra;
+    unzGetCurrentFileInfoField(comment, comment_size, header, entry->size_file_comment, 1);
 
-                bytes_read = ZREAD64(s->pfile_in_zip_read->z_filefunc, s->pfile_in_zip_read->filestream,
-                          s->pfile_in_zip_read->read_buffer + bytes_not_read + total_bytes_read,
-                          bytes_to_read - total_bytes_read);
+    return UNZ_OK;
+}
 
-                total_bytes_read += bytes_read;
-                s->pfile_in_zip_read->pos_in_zipfile += bytes_read;
+extern int ZEXPORT unzGetCurrentFileInfo(unzFile file, unz_file_info *pfile_info, char *filename,
+    uint16_t filename_size, void *extrafield, uint16_t extrafield_size, char *comment, uint16_t comment_size)
+{
+    unz_file_info64 file_info64;
+    int err = UNZ_OK;
 
-                if (bytes_read == 0)
-                {
-                    if (ZERROR64(s->pfile_in_zip_read->z_filefunc, s->pfile_in_zip_read->filestream))
-                        return UNZ_ERRNO;
+    err = unzGetCurrentFileInfoInternal(file, &file_info64, NULL, filename, filename_size,
+                extrafield, extrafield_size, comment, comment_size);
 
-                    err = unzGoToNextDisk(file);
-                    if (err != UNZ_OK)
-                        return err;
+    if ((err == UNZ_OK) && (pfile_info != NULL))
+    {
+        pfile_info->version = file_info64.version;
+        pfile_info->version_needed = file_info64.version_needed;
+        pfile_info->flag = file_info64.flag;
+        pfile_info->compression_method = file_info64.compression_method;
+        pfile_info->dos_date = file_info64.dos_date;
+        pfile_info->crc = file_info64.crc;
 
-                    s->pfile_in_zip_read->pos_in_zipfile = 0;
-                    s->pfile_in_zip_read->filestream = s->filestream;
-                }
-            }
+        pfile_info->size_filename = file_info64.size_filename;
+        pfile_info->size_file_extra = file_info64.size_file_extra - file_info64.size_file_extra_internal;
+        pfile_info->size_file_comment = file_info64.size_file_comment;
 
-#ifndef NOUNCRYPT
-            if ((s->cur_file_info.flag & 1) != 0)
-            {
+        pfile_info->disk_num_start = (uint16_t)file_info64.disk_num_start;
+        pfile_info->internal_fa = file_info64.internal_fa;
+        pfile_info->external_fa = file_info64.external_fa;
+
+        pfile_info->compressed_size = (uint32_t)file_info64.compressed_size;
+        pfile_info->uncompressed_size = (uint32_t)file_info64.uncompressed_size;
+    }
+    return err;
+}
+
+extern int ZEXPORT unzGetCurrentFileInfo64(unzFile file, unz_file_info64 * pfile_info, char *filename,
+    uint16_t filename_size, void *extrafield, uint16_t extrafield_size, char *comment, uint16_t comment_size)
+{
+    return unzGetCurrentFileInfoInternal(file, pfile_info, NULL, filename, filename_size,
+        extrafield, extrafield_size, comment,comment_size);
+}
+
+extern int ZEXPORT unzGetAllFileInfo64(unzFile file, uint64_t first, uint64_t count, unz_entry_info64 *entries,
+    char *strings, uint64_t strings_size, uint64_t *strings_needed)
+{
+    unz64_internal *s = NULL;
+    const unz_entry64_internal *entry = NULL;
+    const uint8_t *header = NULL;
+    unz_entry_info64 *info = NULL;
+    uint64_t strings_pos = 0;
+    uint64_t i = 0;
+    int err = UNZ_OK;
+
+    if (file == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+    if (first > s->gi.number_entry)
+        return UNZ_PARAMERROR;
+    if (count > s->gi.number_entry - first)
+        count = s->gi.number_entry - first;
+
+    /* Names and extra fields are copied one after the other, each name is null terminated */
+    for (i = first; i < first + count; i += 1)
+        strings_pos += (uint64_t)s->entries[i].size_filename + 1 + s->entries[i].size_file_extra;
+    if (strings_needed != NULL)
+        *strings_needed = strings_pos;
+    if (entries == NULL)
+        return UNZ_OK;
+    if ((strings == NULL) || (strings_size < strings_pos))
+        return UNZ_PARAMERROR;
+    err = unzLoadCentralDir(s);
+    if (err != UNZ_OK)
+        return err;
+
+    strings_pos = 0;
+    for (i = 0; i < count; i += 1)
+    {
+        entry = &s->entries[first + i];
+        header = s->central_dir + (entry->pos_in_central_dir - s->offset_central_dir) + SIZECENTRALDIRITEM;
+        info = &entries[i];
+
+        info->compressed_size = entry->compressed_size;
+        info->uncompressed_size = entry->uncompressed_size;
+        info->disk_offset = entry->offset_curfile;
+        info->dos_date = entry->dos_date;
+        info->crc = entry->crc;
+        info->external_fa = entry->external_fa;
+        info->disk_num_start = entry->disk_num_start;
+        info->version = entry->version;
+        info->flag = entry->flag;
+        info->compression_method = entry->compression_method;
+        info->size_filename = entry->size_filename;
+        info->size_file_extra = entry->size_file_extra;
+        info->internal_fa = entry->internal_fa;
+
+        info->filename = strings + strings_pos;
+        memcpy(strings + strings_pos, header, entry->size_filename);
+        strings_pos += entry->size_filename;
+        strings[strings_pos] = 0;
+        strings_pos += 1;
+
+        info->extrafield = NULL;
+        if (entry->size_file_extra > 0)
+        {
+            info->extrafield = (const uint8_t*)strings + strings_pos;
+            memcpy(strings + strings_pos, header + entry->size_filename, entry->size_file_extra);
+            strings_pos += entry->size_file_extra;
+        }
+    }
+    return UNZ_OK;
+}
+
+/* Check the coherency of the local header in buf with the info in the central directory about the current
+   file, store in *psize_variable the size of extra info in local header (filename and size of extra field data) */
+static int unzCheckLocalHeader(unz64_internal *s, const uint8_t *buf, uint32_t *psize_variable,
+    uint64_t *poffset_local_extrafield, uint16_t *psize_local_extrafield)
+{
+    const uint8_t *p = NULL;
+    uint16_t value16 = 0;
+    uint32_t value32 = 0;
+    uint32_t flags = 0;
+    uint16_t size_filename = 0;
+    uint16_t size_extra_field = 0;
+    uint16_t compression_method = 0;
+    int err = UNZ_OK;
+
+    p = buf;
+    if (unzReadValueFromMemoryAndMove(&p, 4) != LOCALHEADERMAGIC)
+        err = UNZ_BADZIPFILE;
+
+    p += 2; /* version needed to extract */
+    flags = (uint32_t)unzReadValueFromMemoryAndMove(&p, 2);
+    value16 = (uint16_t)unzReadValueFromMemoryAndMove(&p, 2);
+    if ((err == UNZ_OK) && (value16 != s->cur_file_info.compression_method))
+        err = UNZ_BADZIPFILE;
+
+    compression_method = s->cur_file_info.compression_method;
 #ifdef HAVE_AES
-                if (s->cur_file_info.compression_method == AES_METHOD)
-                {
-                    fcrypt_decrypt(s->pfile_in_zip_read->read_buffer, bytes_to_read, &s->pfile_in_zip_read->aes_ctx);
-                }
-                else
+    if (compression_method == AES_METHOD)
+        compression_method = s->cur_file_info_internal.aes_compression_method;
 #endif
-                if (s->pcrc_32_tab != NULL)
-                {
-                    uint32_t i = 0;
 
-                    for (i = 0; i < total_bytes_read; i++)
-                      s->pfile_in_zip_read->read_buffer[i] =
-                          zdecode(s->keys, s->pcrc_32_tab, s->pfile_in_zip_read->read_buffer[i]);
-                }
-            }
+    if ((err == UNZ_OK) && (compression_method != 0) && (compression_method != Z_DEFLATED))
+    {
+#ifdef HAVE_BZIP2
+        if (compression_method != Z_BZIP2ED)
 #endif
+            err = UNZ_BADZIPFILE;
+    }
 
-            s->pfile_in_zip_read->rest_read_compressed -= total_bytes_read;
-            s->pfile_in_zip_read->stream.next_in = (uint8_t*)s->pfile_in_zip_read->read_buffer;
-            s->pfile_in_zip_read->stream.avail_in = (uint16_t)(bytes_not_read + total_bytes_read);
-        }
+    p += 4; /* date/time */
+    value32 = (uint32_t)unzReadValueFromMemoryAndMove(&p, 4); /* crc */
+    if ((err == UNZ_OK) && (value32 != s->cur_file_info.crc) && ((flags & 8) == 0))
+        err = UNZ_BADZIPFILE;
+    value32 = (uint32_t)unzReadValueFromMemoryAndMove(&p, 4); /* size compr */
+    if ((value32 != UINT32_MAX) && (err == UNZ_OK) && (value32 != s->cur_file_info.compressed_size) && ((flags & 8) == 0))
+        err = UNZ_BADZIPFILE;
+    value32 = (uint32_t)unzReadValueFromMemoryAndMove(&p, 4); /* size uncompr */
+    if ((value32 != UINT32_MAX) && (err == UNZ_OK) && (value32 != s->cur_file_info.uncompressed_size) && ((flags & 8) == 0))
+        err = UNZ_BADZIPFILE;
+    size_filename = (uint16_t)unzReadValueFromMemoryAndMove(&p, 2);
 
-        if ((s->pfile_in_zip_read->compression_method == 0) || (s->pfile_in_zip_read->raw))
+    *psize_variable += size_filename;
+
+    size_extra_field = (uint16_t)unzReadValueFromMemoryAndMove(&p, 2);
+
+    *poffset_local_extrafield = s->cur_file_info_internal.offset_curfile + SIZEZIPLOCALHEADER + size_filename;
+    *psize_local_extrafield = size_extra_field;
+    *psize_variable += size_extra_field;
+
+    return err;
+}
+
+/* Read the local header of the current zipfile. Check the coherency of the local header and info in the
+   end of central directory about this file store in *piSizeVar the size of extra info in local header
+   (filename and size of extra field data) */
+static int unzCheckCurrentFileCoherencyHeader(unz64_internal *s, uint32_t *psize_variable, uint64_t *poffset_local_extrafield,
+    uint16_t *psize_local_extrafield)
+{
+    uint8_t buf[SIZEZIPLOCALHEADER];
+    int err = UNZ_OK;
+
+    if (psize_variable == NULL)
+        return UNZ_PARAMERROR;
+    *psize_variable = 0;
+    if (poffset_local_extrafield == NULL)
+        return UNZ_PARAMERROR;
+    *poffset_local_extrafield = 0;
+    if (psize_local_extrafield == NULL)
+        return UNZ_PARAMERROR;
+    *psize_local_extrafield = 0;
+
+    err = unzGoToNextDisk((unzFile)s);
+    if (err != UNZ_OK)
+        return err;
+
+    if (ZPREAD64(s->z_filefunc, s->filestream, buf, SIZEZIPLOCALHEADER, s->cur_file_info_internal.offset_curfile +
+        s->cur_file_info_internal.byte_before_the_zipfile) != SIZEZIPLOCALHEADER)
+        return UNZ_ERRNO;
+
+    return unzCheckLocalHeader(s, buf, psize_variable, poffset_local_extrafield, psize_local_extrafield);
+}
+
+extern uint64_t ZEXPORT unzCountEntries(const unzFile file)
+{
+    unz64_internal *s = NULL;
+    if (file == NULL)
+        return 0;
+    s = (unz64_internal*)file;
+    return s->gi.number_entry;
+}
+
+extern int ZEXPORT unzSetPrefetch(unzFile file, uint32_t file_count, int drop_read)
+{
+    unz64_internal *s = NULL;
+    if (file == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+    s->prefetch_count = file_count;
+    s->prefetch_drop = drop_read;
+    if (file_count == 0)
+        s->prefetch_pattern = ZLIB_FILEFUNC_ADVISE_NORMAL;
+    s->prefetch_next_file = 0;
+    return UNZ_OK;
+}
+
+static void unzAdviseFileData(unz64_internal *s, uint64_t num_file, int advice)
+{
+    const unz_entry64_internal *entry = &s->entries[num_file];
+    uint64_t offset = entry->offset_curfile + s->byte_before_the_zipfile;
+    /* The local extra field can be larger than the central one, and a data descriptor can follow */
+    uint64_t size = SIZEZIPLOCALHEADER + entry->size_filename + entry->size_file_extra + entry->compressed_size + 24;
+
+    ZADVISE64(s->z_filefunc, s->filestream, offset, size, advice);
+}
+
+static void unzPrefetch(unz64_internal *s)
+{
+    uint64_t num_file = s->num_file;
+    uint64_t last_file = 0;
+    int pattern = ZLIB_FILEFUNC_ADVISE_RANDOM;
+
+    if ((s->prefetch_count == 0) || (s->entries == NULL) || (s->gi.number_disk_with_CD != 0))
+        return;
+    if (num_file == s->prefetch_last_file)
+        pattern = ZLIB_FILEFUNC_ADVISE_SEQUENTIAL;
+    s->prefetch_last_file = num_file + 1;
+    s->prefetch_pattern = pattern;
+
+    /* Clones share the stream, its access pattern is left to the handle that owns it */
+    if ((!s->is_clone) && (s->prefetch_advice != pattern))
+    {
+        ZADVISE64(s->z_filefunc, s->filestream, 0, 0, pattern);
+        s->prefetch_advice = pattern;
+    }
+
+    if (pattern == ZLIB_FILEFUNC_ADVISE_RANDOM)
+    {
+        unzAdviseFileData(s, num_file, ZLIB_FILEFUNC_ADVISE_WILLNEED);
+        s->prefetch_next_file = 0;
+        return;
+    }
+
+    /* Files already advised by the files opened before are not advised again */
+    last_file = num_file + 1 + s->prefetch_count;
+    if (last_file > s->gi.number_entry)
+        last_file = s->gi.number_entry;
+    if ((s->prefetch_next_file <= num_file) || (s->prefetch_next_file > last_file))
+        s->prefetch_next_file = num_file;
+    while (s->prefetch_next_file < last_file)
+    {
+        unzAdviseFileData(s, s->prefetch_next_file, ZLIB_FILEFUNC_ADVISE_WILLNEED);
+        s->prefetch_next_file += 1;
+    }
+}
+
+static void unzDropFileData(unz64_internal *s, uint64_t offset, uint64_t size)
+{
+    /* Files read in order are not read again */
+    if ((s->prefetch_drop) && (s->prefetch_pattern == ZLIB_FILEFUNC_ADVISE_SEQUENTIAL))
+        ZADVISE64(s->z_filefunc, s->filestream, offset, size, ZLIB_FILEFUNC_ADVISE_DONTNEED);
+}
+
+/*
+  Open for reading data the current file in the zipfile.
+  If there is no error and the file is opened, the return value is UNZ_OK.
+*/
+static unz_seek_index *unzGetFileSeekIndex(unz64_internal *s, uint64_t spacing)
+{
+    unz_seek_index *index = NULL;
+
+    if ((s->seek_indexes != NULL) && (s->seek_indexes[s->num_file] != NULL))
+        return s->seek_indexes[s->num_file];
+    if (spacing == 0)
+        return NULL;
+
+    if (s->seek_indexes == NULL)
+    {
+        s->seek_indexes = (unz_seek_index**)ALLOC((size_t)s->gi.number_entry * sizeof(unz_seek_index*));
+        if (s->seek_indexes == NULL)
+            return NULL;
+        memset(s->seek_indexes, 0, (size_t)s->gi.number_entry * sizeof(unz_seek_index*));
+    }
+
+    index = (unz_seek_index*)ALLOC(sizeof(unz_seek_index));
+    if (index == NULL)
+        return NULL;
+    index->spacing = spacing;
+    index->number_point = 0;
+    index->size_points = 0;
+    index->points = NULL;
+
+    s->seek_indexes[s->num_file] = index;
+    return index;
+}
+
+#ifndef HAVE_APPLE_COMPRESSION
+static void unzAddSeekPoint(file_in_zip64_read_info_s *pfile_in_zip_read_info)
+{
+    unz_seek_index *index = pfile_in_zip_read_info->seek_index;
+    unz_seek_point *point = NULL;
+    unz_seek_point *points = NULL;
+    uint64_t last_pos = 0;
+    uint64_t size_points = 0;
+    uInt window_size = 0;
+
+    /* Only at the end of a block that is not the last one */
+    if (((pfile_in_zip_read_info->stream.data_type & 128) == 0) || ((pfile_in_zip_read_info->stream.data_type & 64) != 0))
+        return;
+    if (index->number_point > 0)
+        last_pos = index->points[index->number_point - 1].uncompressed_pos;
+    if (pfile_in_zip_read_info->total_out_64 < last_pos + index->spacing)
+        return;
+
+    if (index->number_point == index->size_points)
+    {
+        size_points = (index->size_points == 0) ? 8 : index->size_points * 2;
+        points = (unz_seek_point*)ALLOC((size_t)size_points * sizeof(unz_seek_point));
+        if (points == NULL)
+            return;
+        if (index->number_point > 0)
+            memcpy(points, index->points, (size_t)index->number_point * sizeof(unz_seek_point));
+        TRYFREE(index->points);
+        index->points = points;
+        index->size_points = size_points;
+    }
+
+    point = &index->points[index->number_point];
+    point->window = (uint8_t*)ALLOC(UNZ_SEEKWINDOWSIZE);
+    if (point->window == NULL)
+        return;
+    if (inflateGetDictionary(&pfile_in_zip_read_info->stream, point->window, &window_size) != Z_OK)
+    {
+        TRYFREE(point->window);
+        return;
+    }
+
+    point->uncompressed_pos = pfile_in_zip_read_info->total_out_64;
+    point->compressed_pos = pfile_in_zip_read_info->pos_in_zipfile - pfile_in_zip_read_info->stream.avail_in -
+        pfile_in_zip_read_info->offset_data;
+    point->bits = (uint8_t)(pfile_in_zip_read_info->stream.data_type & 7);
+    point->window_size = (uint16_t)window_size;
+    index->number_point += 1;
+}
+#endif
+
+extern int ZEXPORT unzOpenCurrentFile3(unzFile file, int *method, int *level, int raw, const char *password)
+{
+    unz64_internal *s = NULL;
+    file_in_zip64_read_info_s *pfile_in_zip_read_info = NULL;
+    uint16_t compression_method = 0;
+    uint64_t offset_local_extrafield = 0;
+    uint16_t size_local_extrafield = 0;
+    uint32_t size_variable = 0;
+    int need_inflate = 0;
+    int err = UNZ_OK;
+#ifndef NOUNCRYPT
+    char source[12];
+#else
+    if (password != NULL)
+        return UNZ_PARAMERROR;
+#endif
+    if (file == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+    if (!s->current_file_ok)
+        return UNZ_PARAMERROR;
+
+    if (s->pfile_in_zip_read != NULL)
+        unzCloseCurrentFile(file);
+
+    unzPrefetch(s);
+
+    if (unzCheckCurrentFileCoherencyHeader(s, &size_variable, &offset_local_extrafield, &size_local_extrafield) != UNZ_OK)
+        return UNZ_BADZIPFILE;
+    
+    compression_method = s->cur_file_info.compression_method;
+#ifdef HAVE_AES
+    if (compression_method == AES_METHOD)
+    {
+        compression_method = s->cur_file_info_internal.aes_compression_method;
+        if (password == NULL)
         {
-            uint32_t i = 0;
-            uint32_t copy = 0;
+            return UNZ_PARAMERROR;
+        }
+    }
+#endif
 
-            if ((s->pfile_in_zip_read->stream.avail_in == 0) &&
-                (s->pfile_in_zip_read->rest_read_compressed == 0))
-                return (read == 0) ? UNZ_EOF : read;
+    if (method != NULL)
+        *method = compression_method;
 
-            if (s->pfile_in_zip_read->stream.avail_out < s->pfile_in_zip_read->stream.avail_in)
-                copy = s->pfile_in_zip_read->stream.avail_out;
-            else
-                copy = s->pfile_in_zip_read->stream.avail_in;
+    if (level != NULL)
+    {
+        *level = 6;
+        switch (s->cur_file_info.flag & 0x06)
+        {
+          case 6 : *level = 1; break;
+          case 4 : *level = 2; break;
+          case 2 : *level = 9; break;
+        }
+    }
 
-            for (i = 0; i < copy; i++)
-                *(s->pfile_in_zip_read->stream.next_out + i) =
-                        *(s->pfile_in_zip_read->stream.next_in + i);
+    if ((compression_method != 0) && (compression_method != Z_DEFLATED))
+    {
+#ifdef HAVE_BZIP2
+        if (compression_method != Z_BZIP2ED)
+#endif
+        {
+            return UNZ_BADZIPFILE;
+        }
+    }
+    
+#ifndef HAVE_APPLE_COMPRESSION
+    need_inflate = ((!raw) && (compression_method == Z_DEFLATED));
+#endif
+    /* The read buffer and inflate state of the last file closed are reused */
+    pfile_in_zip_read_info = unzGetReadInfo(s, need_inflate);
+    if (pfile_in_zip_read_info == NULL)
+        return UNZ_INTERNALERROR;
 
-            s->pfile_in_zip_read->total_out_64 = s->pfile_in_zip_read->total_out_64 + copy;
-            s->pfile_in_zip_read->rest_read_uncompressed -= copy;
-            s->pfile_in_zip_read->crc32 = (uint32_t)crc32(s->pfile_in_zip_read->crc32,
-                                s->pfile_in_zip_read->stream.next_out, copy);
+    pfile_in_zip_read_info->stream_initialised = 0;
 
-            s->pfile_in_zip_read->stream.avail_in -= copy;
-            s->pfile_in_zip_read->stream.avail_out -= copy;
-            s->pfile_in_zip_read->stream.next_out += copy;
-            s->pfile_in_zip_read->stream.next_in += copy;
-            s->pfile_in_zip_read->stream.total_out += copy;
+    pfile_in_zip_read_info->filestream = s->filestream;
+    pfile_in_zip_read_info->z_filefunc = s->z_filefunc;
+
+    pfile_in_zip_read_info->raw = raw;
+    pfile_in_zip_read_info->crc32 = 0;
+    pfile_in_zip_read_info->crc32_expected = s->cur_file_info.crc;
+    pfile_in_zip_read_info->total_out_64 = 0;
+    pfile_in_zip_read_info->compression_method = compression_method;
+    
+    pfile_in_zip_read_info->offset_local_extrafield = offset_local_extrafield;
+    pfile_in_zip_read_info->size_local_extrafield = size_local_extrafield;
+    pfile_in_zip_read_info->pos_local_extrafield = 0;
+
+    pfile_in_zip_read_info->rest_read_compressed = s->cur_file_info.compressed_size;
+    pfile_in_zip_read_info->rest_read_uncompressed = s->cur_file_info.uncompressed_size;
+    pfile_in_zip_read_info->byte_before_the_zipfile = 0;
+
+    if (s->number_disk == s->gi.number_disk_with_CD)
+        pfile_in_zip_read_info->byte_before_the_zipfile = s->byte_before_the_zipfile;
+        
+    pfile_in_zip_read_info->pos_in_zipfile = s->cur_file_info_internal.offset_curfile + SIZEZIPLOCALHEADER + size_variable;
+    pfile_in_zip_read_info->offset_data = pfile_in_zip_read_info->pos_in_zipfile;
+    pfile_in_zip_read_info->crc32_unchecked = 0;
+    pfile_in_zip_read_info->seek_index = NULL;
+
+    pfile_in_zip_read_info->stream.total_out = 0;
+    pfile_in_zip_read_info->stream.total_in = 0;
+    pfile_in_zip_read_info->stream.next_in = NULL;
+    pfile_in_zip_read_info->stream.avail_in = 0;
+
+    if (!raw)
+    {
+        if (compression_method == Z_BZIP2ED)
+        {
+#ifdef HAVE_BZIP2
+            pfile_in_zip_read_info->bstream.bzalloc = (void *(*) (void *, int, int))0;
+            pfile_in_zip_read_info->bstream.bzfree = (free_func)0;
+            pfile_in_zip_read_info->bstream.opaque = (voidpf)0;
+            pfile_in_zip_read_info->bstream.state = (voidpf)0;
+
+            err = BZ2_bzDecompressInit(&pfile_in_zip_read_info->bstream, 0, 0);
+            if (err == Z_OK)
+            {
+                pfile_in_zip_read_info->stream_initialised = Z_BZIP2ED;
+            }
+            else
+            {
+                unzReleaseReadInfo(s, pfile_in_zip_read_info);
+                return err;
+            }
+#else
+            pfile_in_zip_read_info->raw = 1;
+#endif
+        }
+        else if (compression_method == Z_DEFLATED)
+        {
+#ifdef HAVE_APPLE_COMPRESSION
+            err = compression_stream_init(&pfile_in_zip_read_info->astream, COMPRESSION_STREAM_DECODE, COMPRESSION_ZLIB);
+            if (err == COMPRESSION_STATUS_ERROR)
+                err = UNZ_INTERNALERROR;
+            else
+                err = Z_OK;
+#endif
+            if (err == Z_OK)
+            {
+                pfile_in_zip_read_info->stream_initialised = Z_DEFLATED;
+            }
+            else
+            {
+                unzReleaseReadInfo(s, pfile_in_zip_read_info);
+                return err;
+            }
+            /* windowBits is passed < 0 to tell that there is no zlib header.
+             * Note that in this case inflate *requires* an extra "dummy" byte
+             * after the compressed stream in order to complete decompression and
+             * return Z_STREAM_END.
+             * In unzip, i don't wait absolutely Z_STREAM_END because I known the
+             * size of both compressed and uncompressed data
+             */
+        }
+    }
+
+#ifndef HAVE_APPLE_COMPRESSION
+    /* Points of the seek index are found at block boundaries while reading, decryption can not resume there */
+    if ((pfile_in_zip_read_info->stream_initialised == Z_DEFLATED) && ((s->cur_file_info.flag & 1) == 0) &&
+        (s->gi.number_disk_with_CD == 0))
+        pfile_in_zip_read_info->seek_index = unzGetFileSeekIndex(s, s->seek_index_spacing);
+#endif
+
+    s->pfile_in_zip_read = pfile_in_zip_read_info;
+
+#ifndef NOUNCRYPT
+    s->pcrc_32_tab = NULL;
+
+    if ((password != NULL) && ((s->cur_file_info.flag & 1) != 0))
+    {
+        uint64_t pos_in_zipfile = s->pfile_in_zip_read->pos_in_zipfile + s->pfile_in_zip_read->byte_before_the_zipfile;
+#ifdef HAVE_AES
+        if (s->cur_file_info.compression_method == AES_METHOD)
+        {
+            unsigned char passverify_archive[AES_PWVERIFYSIZE];
+            unsigned char passverify_password[AES_PWVERIFYSIZE];
+            unsigned char salt_value[AES_MAXSALTLENGTH];
+            uint32_t salt_length = 0;
+
+            if ((s->cur_file_info_internal.aes_encryption_mode < 1) ||
+                (s->cur_file_info_internal.aes_encryption_mode > 3))
+                return UNZ_INTERNALERROR;
+
+            salt_length = SALT_LENGTH(s->cur_file_info_internal.aes_encryption_mode);
+
+            if (ZPREAD64(s->z_filefunc, s->filestream, salt_value, salt_length, pos_in_zipfile) != salt_length)
+                return UNZ_INTERNALERROR;
+            if (ZPREAD64(s->z_filefunc, s->filestream, passverify_archive, AES_PWVERIFYSIZE,
+                    pos_in_zipfile + salt_length) != AES_PWVERIFYSIZE)
+                return UNZ_INTERNALERROR;
+
+            fcrypt_init(s->cur_file_info_internal.aes_encryption_mode, (uint8_t *)password,
+                (uint32_t)strlen(password), salt_value, passverify_password, &s->pfile_in_zip_read->aes_ctx);
+
+            if (memcmp(passverify_archive, passverify_password, AES_PWVERIFYSIZE) != 0)
+                return UNZ_BADPASSWORD;
+
+            s->pfile_in_zip_read->rest_read_compressed -= salt_length + AES_PWVERIFYSIZE;
+            s->pfile_in_zip_read->rest_read_compressed -= AES_AUTHCODESIZE;
+
+            s->pfile_in_zip_read->pos_in_zipfile += salt_length + AES_PWVERIFYSIZE;
+        }
+        else
+#endif
+        {
+            int i;
+            s->pcrc_32_tab = (const z_crc_t*)get_crc_table();
+            init_keys(password, s->keys, s->pcrc_32_tab);
+
+            if (ZPREAD64(s->z_filefunc, s->filestream, source, 12, pos_in_zipfile) < 12)
+                return UNZ_INTERNALERROR;
+
+            for (i = 0; i < 12; i++)
+                zdecode(s->keys, s->pcrc_32_tab, source[i]);
+
+            s->pfile_in_zip_read->rest_read_compressed -= 12;
+            s->pfile_in_zip_read->pos_in_zipfile += 12;
+        }
+    }
+#endif
+
+    return UNZ_OK;
+}
+
+extern int ZEXPORT unzOpenCurrentFile(unzFile file)
+{
+    return unzOpenCurrentFile3(file, NULL, NULL, 0, NULL);
+}
+
+extern int ZEXPORT unzOpenCurrentFilePassword(unzFile file, const char *password)
+{
+    return unzOpenCurrentFile3(file, NULL, NULL, 0, password);
+}
+
+extern int ZEXPORT unzOpenCurrentFile2(unzFile file, int *method, int *level, int raw)
+{
+    return unzOpenCurrentFile3(file, method, level, raw, NULL);
+}
+
+/* Read bytes from the current file.
+   buf contain buffer where data must be copied
+   len the size of buf.
+
+   return the number of byte copied if some bytes are copied
+   return 0 if the end of file was reached
+   return <0 with error code if there is an error (UNZ_ERRNO for IO error, or zLib error for uncompress error) */
+extern int ZEXPORT unzReadCurrentFile(unzFile file, voidp buf, uint32_t len)
+{
+    unz64_internal *s = NULL;
+    uint32_t read = 0;
+    int err = UNZ_OK;
+
+    if (file == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+
+    if (s->pfile_in_zip_read == NULL)
+        return UNZ_PARAMERROR;
+    if (s->pfile_in_zip_read->read_buffer == NULL)
+        return UNZ_END_OF_LIST_OF_FILE;
+    if (len == 0)
+        return 0;
+    /* Number of bytes read must fit in the return value */
+    if (len > INT32_MAX)
+        len = INT32_MAX;
+
+    s->pfile_in_zip_read->stream.next_out = (uint8_t*)buf;
+    s->pfile_in_zip_read->stream.avail_out = len;
+
+    if ((s->pfile_in_zip_read->compression_method == 0) || (s->pfile_in_zip_read->raw))
+    {
+        if (len > s->pfile_in_zip_read->rest_read_compressed + s->pfile_in_zip_read->stream.avail_in)
+            s->pfile_in_zip_read->stream.avail_out = (uint32_t)(s->pfile_in_zip_read->rest_read_compressed +
+            s->pfile_in_zip_read->stream.avail_in);
+    }
+
+    do
+    {
+        if ((s->pfile_in_zip_read->stream.avail_in == 0) && (s->pfile_in_zip_read->rest_read_compressed > 0) &&
+            ((s->pfile_in_zip_read->compression_method == 0) || (s->pfile_in_zip_read->raw)) &&
+            ((s->cur_file_info.flag & 1) == 0) &&
+            (s->pfile_in_zip_read->stream.avail_out >= s->pfile_in_zip_read->read_buffer_size))
+        {
+            /* Large read of stored data, read straight into the caller's buffer */
+            uint32_t bytes_to_read = s->pfile_in_zip_read->stream.avail_out;
+            uint32_t bytes_read = 0;
+
+            if (s->pfile_in_zip_read->rest_read_compressed < bytes_to_read)
+                bytes_to_read = (uint32_t)s->pfile_in_zip_read->rest_read_compressed;
+
+            bytes_read = ZPREAD64(s->pfile_in_zip_read->z_filefunc, s->pfile_in_zip_read->filestream,
+                      s->pfile_in_zip_read->stream.next_out, bytes_to_read,
+                      s->pfile_in_zip_read->pos_in_zipfile + s->pfile_in_zip_read->byte_before_the_zipfile);
+
+            if (bytes_read == 0)
+            {
+                if (ZERROR64(s->pfile_in_zip_read->z_filefunc, s->pfile_in_zip_read->filestream))
+                    return UNZ_ERRNO;
+
+                err = unzGoToNextDisk(file);
+                if (err != UNZ_OK)
+                    return err;
+
+                s->pfile_in_zip_read->pos_in_zipfile = 0;
+                s->pfile_in_zip_read->filestream = s->filestream;
+                continue;
+            }
+
+            s->pfile_in_zip_read->pos_in_zipfile += bytes_read;
+            s->pfile_in_zip_read->rest_read_compressed -= bytes_read;
+            s->pfile_in_zip_read->total_out_64 += bytes_read;
+            s->pfile_in_zip_read->rest_read_uncompressed -= bytes_read;
+            s->pfile_in_zip_read->crc32 = crc32_fast(s->pfile_in_zip_read->crc32,
+                                s->pfile_in_zip_read->stream.next_out, bytes_read);
+
+            s->pfile_in_zip_read->stream.avail_out -= bytes_read;
+            s->pfile_in_zip_read->stream.next_out += bytes_read;
+            s->pfile_in_zip_read->stream.total_out += bytes_read;
+
+            read += bytes_read;
+            continue;
+        }
+
+        if ((s->pfile_in_zip_read->stream.avail_in == 0) && (s->pfile_in_zip_read->rest_read_compressed > 0) &&
+            ((s->cur_file_info.flag & 1) == 0) && (s->pfile_in_zip_read->z_filefunc.zfile_ext.zmap64_file != NULL))
+        {
+            /* Stream is memory mapped, decompress straight from the mapping */
+            const uint8_t *mapped = NULL;
+            uint64_t bytes_mapped = 0;
+
+            mapped = (const uint8_t*)ZMAP64(s->pfile_in_zip_read->z_filefunc, s->pfile_in_zip_read->filestream,
+                s->pfile_in_zip_read->pos_in_zipfile + s->pfile_in_zip_read->byte_before_the_zipfile, &bytes_mapped);
+
+            if (bytes_mapped > s->pfile_in_zip_read->rest_read_compressed)
+                bytes_mapped = s->pfile_in_zip_read->rest_read_compressed;
+            if (bytes_mapped > UINT32_MAX)
+                bytes_mapped = UINT32_MAX;
+
+            if ((mapped != NULL) && (bytes_mapped > 0))
+            {
+                s->pfile_in_zip_read->pos_in_zipfile += bytes_mapped;
+                s->pfile_in_zip_read->rest_read_compressed -= bytes_mapped;
+                s->pfile_in_zip_read->stream.next_in = (uint8_t*)mapped;
+                s->pfile_in_zip_read->stream.avail_in = (uint32_t)bytes_mapped;
+            }
+        }
+
+        if (s->pfile_in_zip_read->stream.avail_in == 0)
+        {
+            uint32_t bytes_to_read = s->pfile_in_zip_read->read_buffer_size;
+            uint32_t bytes_read = 0;
+            uint32_t total_bytes_read = 0;
+
+            if (s->pfile_in_zip_read->rest_read_compressed < bytes_to_read)
+                bytes_to_read = (uint32_t)s->pfile_in_zip_read->rest_read_compressed;
+
+            while (total_bytes_read != bytes_to_read)
+            {
+                bytes_read = ZPREAD64(s->pfile_in_zip_read->z_filefunc, s->pfile_in_zip_read->filestream,
+                          s->pfile_in_zip_read->read_buffer + total_bytes_read,
+                          bytes_to_read - total_bytes_read,
+                          s->pfile_in_zip_read->pos_in_zipfile + s->pfile_in_zip_read->byte_before_the_zipfile);
+
+                total_bytes_read += bytes_read;
+                s->pfile_in_zip_read->pos_in_zipfile += bytes_read;
+
+                if (bytes_read == 0)
+                {
+                    if (ZERROR64(s->pfile_in_zip_read->z_filefunc, s->pfile_in_zip_read->filestream))
+                        return UNZ_ERRNO;
+
+                    err = unzGoToNextDisk(file);
+                    if (err != UNZ_OK)
+                        return err;
+
+                    s->pfile_in_zip_read->pos_in_zipfile = 0;
+                    s->pfile_in_zip_read->filestream = s->filestream;
+                }
+            }
+
+#ifndef NOUNCRYPT
+            if ((s->cur_file_info.flag & 1) != 0)
+            {
+#ifdef HAVE_AES
+                if (s->cur_file_info.compression_method == AES_METHOD)
+                {
+                    fcrypt_decrypt(s->pfile_in_zip_read->read_buffer, bytes_to_read, &s->pfile_in_zip_read->aes_ctx);
+                }
+                else
+#endif
+                if (s->pcrc_32_tab != NULL)
+                {
+                    uint32_t i = 0;
+
+                    for (i = 0; i < total_bytes_read; i++)
+                      s->pfile_in_zip_read->read_buffer[i] =
+                          zdecode(s->keys, s->pcrc_32_tab, s->pfile_in_zip_read->read_buffer[i]);
+                }
+            }
+#endif
+
+            s->pfile_in_zip_read->rest_read_compressed -= total_bytes_read;
+            s->pfile_in_zip_read->stream.next_in = (uint8_t*)s->pfile_in_zip_read->read_buffer;
+            s->pfile_in_zip_read->stream.avail_in = total_bytes_read;
+        }
+
+        if ((s->pfile_in_zip_read->compression_method == 0) || (s->pfile_in_zip_read->raw))
+        {
+            uint32_t copy = 0;
+
+            if ((s->pfile_in_zip_read->stream.avail_in == 0) &&
+                (s->pfile_in_zip_read->rest_read_compressed == 0))
+                return (read == 0) ? UNZ_EOF : read;
+
+            if (s->pfile_in_zip_read->stream.avail_out < s->pfile_in_zip_read->stream.avail_in)
+                copy = s->pfile_in_zip_read->stream.avail_out;
+            else
+                copy = s->pfile_in_zip_read->stream.avail_in;
+
+            s->pfile_in_zip_read->crc32 = crc32_fast_copy(s->pfile_in_zip_read->crc32,
+                                s->pfile_in_zip_read->stream.next_out, s->pfile_in_zip_read->stream.next_in, copy);
+
+            s->pfile_in_zip_read->total_out_64 = s->pfile_in_zip_read->total_out_64 + copy;
+            s->pfile_in_zip_read->rest_read_uncompressed -= copy;
+
+            s->pfile_in_zip_read->stream.avail_in -= copy;
+            s->pfile_in_zip_read->stream.avail_out -= copy;
+            s->pfile_in_zip_read->stream.next_out += copy;
+            s->pfile_in_zip_read->stream.next_in += copy;
+            s->pfile_in_zip_read->stream.total_out += copy;
+
+            read += copy;
+        }
+        else if (s->pfile_in_zip_read->compression_method == Z_BZIP2ED)
+        {
+#ifdef HAVE_BZIP2
+            uint64_t total_out_before = 0;
+            uint64_t total_out_after = 0;
+            uint64_t out_bytes = 0;
+            const uint8_t *buf_before = NULL;
+
+            s->pfile_in_zip_read->bstream.next_in        = (char*)s->pfile_in_zip_read->stream.next_in;
+            s->pfile_in_zip_read->bstream.avail_in       = s->pfile_in_zip_read->stream.avail_in;
+            s->pfile_in_zip_read->bstream.total_in_lo32  = (uint32_t)s->pfile_in_zip_read->stream.total_in;
+            s->pfile_in_zip_read->bstream.total_in_hi32  = s->pfile_in_zip_read->stream.total_in >> 32;
+            
+            s->pfile_in_zip_read->bstream.next_out       = (char*)s->pfile_in_zip_read->stream.next_out;
+            s->pfile_in_zip_read->bstream.avail_out      = s->pfile_in_zip_read->stream.avail_out;
+            s->pfile_in_zip_read->bstream.total_out_lo32 = (uint32_t)s->pfile_in_zip_read->stream.total_out;
+            s->pfile_in_zip_read->bstream.total_out_hi32 = s->pfile_in_zip_read->stream.total_out >> 32;
+
+            total_out_before = s->pfile_in_zip_read->bstream.total_out_lo32 + 
+                (((uint32_t)s->pfile_in_zip_read->bstream.total_out_hi32) << 32);
+            buf_before = (const uint8_t*)s->pfile_in_zip_read->bstream.next_out;
+
+            err = BZ2_bzDecompress(&s->pfile_in_zip_read->bstream);
+
+            total_out_after = s->pfile_in_zip_read->bstream.total_out_lo32 + 
+                (((uint32_t)s->pfile_in_zip_read->bstream.total_out_hi32) << 32);
+
+            out_bytes = total_out_after - total_out_before;
+
+            s->pfile_in_zip_read->total_out_64 = s->pfile_in_zip_read->total_out_64 + out_bytes;
+            s->pfile_in_zip_read->rest_read_uncompressed -= out_bytes;
+            s->pfile_in_zip_read->crc32 = crc32_fast(s->pfile_in_zip_read->crc32, buf_before, out_bytes);
+
+            read += (uint32_t)out_bytes;
+
+            s->pfile_in_zip_read->stream.next_in   = (uint8_t*)s->pfile_in_zip_read->bstream.next_in;
+            s->pfile_in_zip_read->stream.avail_in  = s->pfile_in_zip_read->bstream.avail_in;
+            s->pfile_in_zip_read->stream.total_in  = s->pfile_in_zip_read->bstream.total_in_lo32;
+            s->pfile_in_zip_read->stream.next_out  = (uint8_t*)s->pfile_in_zip_read->bstream.next_out;
+            s->pfile_in_zip_read->stream.avail_out = s->pfile_in_zip_read->bstream.avail_out;
+            s->pfile_in_zip_read->stream.total_out = s->pfile_in_zip_read->bstream.total_out_lo32;
+
+            if (err == BZ_STREAM_END)
+                return (read == 0) ? UNZ_EOF : read;
+            if (err != BZ_OK)
+                break;
+#endif
+        }
+#ifdef HAVE_APPLE_COMPRESSION
+        else
+        {
+            uint64_t total_out_before = 0;
+            uint64_t total_out_after = 0;
+            uint64_t out_bytes = 0;
+            const uint8_t *buf_before = NULL;
+
+            s->pfile_in_zip_read->astream.src_ptr = s->pfile_in_zip_read->stream.next_in;
+            s->pfile_in_zip_read->astream.src_size = s->pfile_in_zip_read->stream.avail_in;
+            s->pfile_in_zip_read->astream.dst_ptr = s->pfile_in_zip_read->stream.next_out;
+            s->pfile_in_zip_read->astream.dst_size = len;
+
+            total_out_before = s->pfile_in_zip_read->stream.total_out;
+            buf_before = s->pfile_in_zip_read->stream.next_out;
+
+            compression_status status;
+            compression_stream_flags flags;
+
+            if (s->pfile_in_zip_read->stream.avail_in == 0)
+            {
+                flags = COMPRESSION_STREAM_FINALIZE;
+            }
+
+            status = compression_stream_process(&s->pfile_in_zip_read->astream, flags);
+
+            total_out_after = len - s->pfile_in_zip_read->astream.dst_size;
+            out_bytes = total_out_after - total_out_before;
+
+            s->pfile_in_zip_read->total_out_64 += out_bytes;
+            s->pfile_in_zip_read->rest_read_uncompressed -= out_bytes;
+            s->pfile_in_zip_read->crc32 =
+                crc32_fast(s->pfile_in_zip_read->crc32, buf_before, out_bytes);
+
+            read += (uint32_t)out_bytes;
+
+            s->pfile_in_zip_read->stream.next_in = s->pfile_in_zip_read->astream.src_ptr;
+            s->pfile_in_zip_read->stream.avail_in = s->pfile_in_zip_read->astream.src_size;
+            s->pfile_in_zip_read->stream.next_out = s->pfile_in_zip_read->astream.dst_ptr;
+            s->pfile_in_zip_read->stream.avail_out = s->pfile_in_zip_read->astream.dst_size;
+
+            if (status == COMPRESSION_STATUS_END)
+                return (read == 0) ? UNZ_EOF : read;
+            if (status == COMPRESSION_STATUS_ERROR)
+                return Z_DATA_ERROR;
+            return read;
+        }
+#else
+        else
+        {
+            uint64_t total_out_before = 0;
+            uint64_t total_out_after = 0;
+            uint64_t out_bytes = 0;
+            const uint8_t *buf_before = NULL;
+            int flush = Z_SYNC_FLUSH;
+
+            /* Stop at the end of each block so seek points can be added */
+            if (s->pfile_in_zip_read->seek_index != NULL)
+                flush = Z_BLOCK;
+
+            total_out_before = s->pfile_in_zip_read->stream.total_out;
+            buf_before = s->pfile_in_zip_read->stream.next_out;
+
+            /*
+            if ((pfile_in_zip_read_info->rest_read_uncompressed ==
+                     pfile_in_zip_read_info->stream.avail_out) &&
+                (pfile_in_zip_read_info->rest_read_compressed == 0))
+                flush = Z_FINISH;
+            */
+            err = inflate(&s->pfile_in_zip_read->stream, flush);
+
+            if ((err >= 0) && (s->pfile_in_zip_read->stream.msg != NULL))
+                err = Z_DATA_ERROR;
+
+            total_out_after = s->pfile_in_zip_read->stream.total_out;
+            out_bytes = total_out_after - total_out_before;
+
+            s->pfile_in_zip_read->total_out_64 += out_bytes;
+            s->pfile_in_zip_read->rest_read_uncompressed -= out_bytes;
+            s->pfile_in_zip_read->crc32 =
+                crc32_fast(s->pfile_in_zip_read->crc32, buf_before, out_bytes);
+
+            read += (uint32_t)out_bytes;
+
+            if (err == Z_STREAM_END)
+                return (read == 0) ? UNZ_EOF : read;
+            if (err != Z_OK)
+                break;
+
+            if (s->pfile_in_zip_read->seek_index != NULL)
+                unzAddSeekPoint(s->pfile_in_zip_read);
+        }
+#endif
+    }
+    while (s->pfile_in_zip_read->stream.avail_out > 0);
+
+    if (err == Z_OK)
+        return read;
+    return err;
+}
+
+extern int ZEXPORT unzReadCurrentFile64(unzFile file, voidp buf, uint64_t len, uint64_t *bytes_read)
+{
+    uint64_t total_bytes_read = 0;
+    uint32_t bytes_to_read = 0;
+    int read = 0;
+
+    if (bytes_read != NULL)
+        *bytes_read = 0;
+    if ((file == NULL) || (bytes_read == NULL))
+        return UNZ_PARAMERROR;
+
+    while (total_bytes_read < len)
+    {
+        bytes_to_read = INT32_MAX;
+        if (len - total_bytes_read < bytes_to_read)
+            bytes_to_read = (uint32_t)(len - total_bytes_read);
+
+        read = unzReadCurrentFile(file, (uint8_t*)buf + total_bytes_read, bytes_to_read);
+        if (read < 0)
+            return read;
+        if (read == 0)
+            break;
+
+        total_bytes_read += (uint32_t)read;
+        *bytes_read = total_bytes_read;
+    }
+
+    return UNZ_OK;
+}
+
+extern int ZEXPORT unzGetLocalExtrafield(unzFile file, voidp buf, uint32_t len)
+{
+    unz64_internal *s = NULL;
+    uint64_t size_to_read = 0;
+    uint32_t read_now = 0;
+
+    if (file == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+    if (s->pfile_in_zip_read == NULL)
+        return UNZ_PARAMERROR;
+
+    size_to_read = s->pfile_in_zip_read->size_local_extrafield - s->pfile_in_zip_read->pos_local_extrafield;
+
+    if (buf == NULL)
+        return (int)size_to_read;
+
+    if (len > size_to_read)
+        read_now = (uint32_t)size_to_read;
+    else
+        read_now = len;
+
+    if (read_now == 0)
+        return 0;
+
+    if (ZPREAD64(s->pfile_in_zip_read->z_filefunc, s->pfile_in_zip_read->filestream, buf, read_now,
+        s->pfile_in_zip_read->offset_local_extrafield + s->pfile_in_zip_read->pos_local_extrafield) != read_now)
+        return UNZ_ERRNO;
+
+    return (int)read_now;
+}
+
+extern int ZEXPORT unzGetCurrentFileSpan(unzFile file, uint64_t *offset, uint64_t *length, const void **data)
+{
+    unz64_internal *s = NULL;
+    const void *mapped = NULL;
+    uint64_t offset_local_extrafield = 0;
+    uint64_t bytes_mapped = 0;
+    uint16_t size_local_extrafield = 0;
+    uint32_t size_variable = 0;
+
+    if (file == NULL || offset == NULL || length == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+    if (data != NULL)
+        *data = NULL;
+    if (!s->current_file_ok)
+        return UNZ_PARAMERROR;
+    if ((s->cur_file_info.compression_method != 0) || ((s->cur_file_info.flag & 1) != 0))
+        return UNZ_PARAMERROR;
+    if (s->gi.number_disk_with_CD != 0)
+        return UNZ_PARAMERROR;
+
+    if (s->pfile_in_zip_read != NULL)
+        unzCloseCurrentFile(file);
+
+    if (unzCheckCurrentFileCoherencyHeader(s, &size_variable, &offset_local_extrafield, &size_local_extrafield) != UNZ_OK)
+        return UNZ_BADZIPFILE;
+
+    *offset = s->cur_file_info_internal.offset_curfile + SIZEZIPLOCALHEADER + size_variable +
+        s->cur_file_info_internal.byte_before_the_zipfile;
+    *length = s->cur_file_info.compressed_size;
+
+    if (data != NULL)
+    {
+        mapped = ZMAP64(s->z_filefunc, s->filestream, *offset, &bytes_mapped);
+        if ((mapped != NULL) && (bytes_mapped >= *length))
+            *data = mapped;
+    }
+    return UNZ_OK;
+}
+
+extern int ZEXPORT unzCheckCurrentFileHeaders(unzFile file)
+{
+    unz64_internal *s = NULL;
+    uint8_t buf[256];
+    const uint8_t *central_filename = NULL;
+    const uint8_t *p = NULL;
+    uint64_t offset_local_extrafield = 0;
+    uint64_t offset = 0;
+    uint32_t size_variable = 0;
+    uint32_t size_filename = 0;
+    uint32_t bytes_to_read = 0;
+    uint32_t bytes_read = 0;
+    uint32_t size_magic = 0;
+    uint32_t size_len = 0;
+    uint32_t i = 0;
+    uint16_t size_local_extrafield = 0;
+    int with_magic = 0;
+    int err = UNZ_OK;
+
+    if (file == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+    if (!s->current_file_ok)
+        return UNZ_PARAMERROR;
+    err = unzLoadCentralDir(s);
+    if (err != UNZ_OK)
+        return err;
+
+    /* A file still open would be taken for a read going on to the next disk */
+    if (s->pfile_in_zip_read != NULL)
+        unzCloseCurrentFile(file);
+
+    err = unzCheckCurrentFileCoherencyHeader(s, &size_variable, &offset_local_extrafield, &size_local_extrafield);
+    if (err != UNZ_OK)
+        return err;
+
+    size_filename = size_variable - size_local_extrafield;
+    if (size_filename != s->cur_file_info.size_filename)
+        return UNZ_BADZIPFILE;
+
+    /* The local file name is compared a piece at a time with the one in the central directory */
+    central_filename = s->central_dir + (s->pos_in_central_dir - s->offset_central_dir) + SIZECENTRALDIRITEM;
+    offset = s->cur_file_info_internal.offset_curfile + s->cur_file_info_internal.byte_before_the_zipfile +
+        SIZEZIPLOCALHEADER;
+    for (i = 0; i < size_filename; i += bytes_to_read)
+    {
+        bytes_to_read = size_filename - i;
+        if (bytes_to_read > sizeof(buf))
+            bytes_to_read = sizeof(buf);
+        if (ZPREAD64(s->z_filefunc, s->filestream, buf, bytes_to_read, offset + i) != bytes_to_read)
+            return UNZ_ERRNO;
+        if (memcmp(buf, central_filename + i, bytes_to_read) != 0)
+            return UNZ_BADZIPFILE;
+    }
+
+    if ((s->cur_file_info.flag & 8) == 0)
+        return UNZ_OK;
+
+    /* The data descriptor follows the data, its signature is optional and its sizes use 8 bytes with zip64 */
+    offset += size_variable + s->cur_file_info.compressed_size;
+    bytes_read = ZPREAD64(s->z_filefunc, s->filestream, buf, SIZEDATADESCRIPTOR64, offset);
+    for (with_magic = 1; with_magic >= 0; with_magic -= 1)
+    {
+        size_magic = (with_magic) ? 4 : 0;
+        p = buf + size_magic;
+        if (with_magic && ((bytes_read < 4) || (unzReadValueFromMemory(buf, 4) != DISKHEADERMAGIC)))
+            continue;
+        for (size_len = 4; size_len <= 8; size_len += 4)
+        {
+            if ((bytes_read >= size_magic + 4 + size_len * 2) &&
+                (unzReadValueFromMemory(p, 4) == s->cur_file_info.crc) &&
+                (unzReadValueFromMemory(p + 4, size_len) == s->cur_file_info.compressed_size) &&
+                (unzReadValueFromMemory(p + 4 + size_len, size_len) == s->cur_file_info.uncompressed_size))
+                return UNZ_OK;
+        }
+    }
+    return UNZ_BADZIPFILE;
+}
+
+/* Inflate a whole deflated file in one call, default of unzSetDecompressFunction. Without libcompression
+   user_data is the z_stream of a read state, with an inflate state reset for the file */
+static int unzDecompressBuffer(void *dest, uint64_t dest_size, const void *source, uint64_t source_size,
+    uint64_t *dest_written, void *user_data)
+{
+#ifdef HAVE_APPLE_COMPRESSION
+    size_t bytes_written = 0;
+
+    if ((dest_size > (size_t)-1) || (source_size > (size_t)-1))
+        return UNZ_INTERNALERROR;
+    /* COMPRESSION_ZLIB is raw deflate, a result shorter than expected is caught by the crc */
+    bytes_written = compression_decode_buffer((uint8_t*)dest, (size_t)dest_size, (const uint8_t*)source,
+        (size_t)source_size, NULL, COMPRESSION_ZLIB);
+    if ((bytes_written == 0) && (dest_size > 0))
+        return Z_DATA_ERROR;
+    *dest_written = bytes_written;
+    return UNZ_OK;
+#else
+    z_stream *stream = (z_stream*)user_data;
+    uint64_t total_in = 0;
+    uint64_t total_out = 0;
+    uint32_t chunk = 0;
+    int err = Z_OK;
+
+    stream->avail_in = 0;
+    stream->avail_out = 0;
+
+    /* Sizes of z_stream are 32 bits, a single inflate call is enough below 4 GB */
+    while (err == Z_OK)
+    {
+        if (stream->avail_in == 0)
+        {
+            chunk = UINT32_MAX;
+            if (source_size - total_in < chunk)
+                chunk = (uint32_t)(source_size - total_in);
+            stream->next_in = (Bytef*)source + total_in;
+            stream->avail_in = chunk;
+            total_in += chunk;
+        }
+        if (stream->avail_out == 0)
+        {
+            chunk = UINT32_MAX;
+            if (dest_size - total_out < chunk)
+                chunk = (uint32_t)(dest_size - total_out);
+            stream->next_out = (Bytef*)dest + total_out;
+            stream->avail_out = chunk;
+            total_out += chunk;
+        }
+        err = inflate(stream, Z_FINISH);
+        if ((err == Z_BUF_ERROR) && (stream->avail_in == 0) && (total_in < source_size))
+            err = Z_OK;
+        else if ((err == Z_BUF_ERROR) && (stream->avail_out == 0) && (total_out < dest_size))
+            err = Z_OK;
+    }
+    *dest_written = total_out - stream->avail_out;
+
+    if (err != Z_STREAM_END)
+        return Z_DATA_ERROR;
+    return UNZ_OK;
+#endif
+}
+
+extern int ZEXPORT unzSetDecompressFunction(unzFile file, unzDecompressFunction decompress, void *user_data)
+{
+    unz64_internal *s = NULL;
+    if (file == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+    s->decompress = decompress;
+    s->decompress_user_data = user_data;
+    return UNZ_OK;
+}
+
+/* Read size bytes at offset of the current disk in calls of at most UINT32_MAX bytes, return the bytes read */
+static uint64_t unzReadAtOffset(unz64_internal *s, uint8_t *buf, uint64_t size, uint64_t offset)
+{
+    uint64_t pos = 0;
+    uint32_t bytes_to_read = 0;
+    uint32_t bytes_read = 0;
+
+    while (pos < size)
+    {
+        bytes_to_read = UINT32_MAX;
+        if (size - pos < bytes_to_read)
+            bytes_to_read = (uint32_t)(size - pos);
+        bytes_read = ZPREAD64(s->z_filefunc, s->filestream, buf + pos, bytes_to_read, offset + pos);
+        pos += bytes_read;
+        if (bytes_read != bytes_to_read)
+            break;
+    }
+    return pos;
+}
+
+extern int ZEXPORT unzReadEntryToBuffer(unzFile file, const char *password, void *buf, uint64_t buf_size,
+    uint64_t *bytes_read)
+{
+    unz64_internal *s = NULL;
+#ifndef HAVE_APPLE_COMPRESSION
+    file_in_zip64_read_info_s *read_info = NULL;
+#endif
+    const uint8_t *source = NULL;
+    uint8_t *entry_buffer = NULL;
+    uint64_t offset_local_extrafield = 0;
+    uint64_t offset_header = 0;
+    uint64_t compressed_size = 0;
+    uint64_t uncompressed_size = 0;
+    uint64_t bytes_available = 0;
+    uint64_t size_needed = 0;
+    uint32_t crc = 0;
+    int crc_done = 0;
+    uint16_t size_local_extrafield = 0;
+    uint32_t size_variable = 0;
+    int err = UNZ_OK;
+
+    if (bytes_read != NULL)
+        *bytes_read = 0;
+    if ((file == NULL) || (bytes_read == NULL) || ((buf == NULL) && (buf_size > 0)))
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+    if (!s->current_file_ok)
+        return UNZ_PARAMERROR;
+
+    compressed_size = s->cur_file_info.compressed_size;
+    uncompressed_size = s->cur_file_info.uncompressed_size;
+    if (buf_size < uncompressed_size)
+        return UNZ_PARAMERROR;
+
+    /* Encrypted, other methods and spanned zipfiles go through the streaming read */
+    if (((s->cur_file_info.flag & 1) != 0) || (s->gi.number_disk_with_CD != 0) ||
+        ((s->cur_file_info.compression_method != 0) && (s->cur_file_info.compression_method != Z_DEFLATED)))
+    {
+        err = unzOpenCurrentFilePassword(file, password);
+        if (err == UNZ_OK)
+            err = unzReadCurrentFile64(file, buf, uncompressed_size, bytes_read);
+        if ((err == UNZ_OK) && (*bytes_read != uncompressed_size))
+            err = UNZ_BADZIPFILE;
+        if (err == UNZ_OK)
+            return unzCloseCurrentFile(file);
+        if (s->pfile_in_zip_read != NULL)
+            unzCloseCurrentFile(file);
+        *bytes_read = 0;
+        return err;
+    }
+
+    if (s->pfile_in_zip_read != NULL)
+        unzCloseCurrentFile(file);
+    if ((s->cur_file_info.compression_method == 0) && (compressed_size != uncompressed_size))
+        return UNZ_BADZIPFILE;
+    unzPrefetch(s);
+    if (compressed_size > (size_t)-1 - SIZEZIPLOCALHEADER - UINT16_MAX * 2)
+        return UNZ_INTERNALERROR;
+
+    /* Local header and data are used in place when the zipfile is mapped */
+    offset_header = s->cur_file_info_internal.offset_curfile + s->cur_file_info_internal.byte_before_the_zipfile;
+    source = (const uint8_t*)ZMAP64(s->z_filefunc, s->filestream, offset_header, &bytes_available);
+    if ((source != NULL) && (bytes_available < SIZEZIPLOCALHEADER))
+        source = NULL;
+
+    if ((source == NULL) && (s->cur_file_info.compression_method == 0))
+    {
+        /* Stored data is read straight into buf */
+        if (unzCheckCurrentFileCoherencyHeader(s, &size_variable, &offset_local_extrafield, &size_local_extrafield) != UNZ_OK)
+            return UNZ_BADZIPFILE;
+        if (unzReadAtOffset(s, (uint8_t*)buf, compressed_size, offset_header + SIZEZIPLOCALHEADER + size_variable) != compressed_size)
+            return UNZ_ERRNO;
+    }
+    else
+    {
+        if (source == NULL)
+        {
+            /* Read the local header with the data in one io, its variable part is usually the size of the one
+               in the central directory */
+            size_needed = SIZEZIPLOCALHEADER + s->cur_file_info.size_filename + s->cur_file_info.size_file_extra +
+                compressed_size;
+            if (s->entry_buffer_size < size_needed)
+            {
+                TRYFREE(s->entry_buffer);
+                s->entry_buffer_size = 0;
+                s->entry_buffer = (uint8_t*)ALLOC((size_t)size_needed);
+                if (s->entry_buffer == NULL)
+                    return UNZ_INTERNALERROR;
+                s->entry_buffer_size = size_needed;
+            }
+            entry_buffer = s->entry_buffer;
+            bytes_available = unzReadAtOffset(s, entry_buffer, size_needed, offset_header);
+            if (bytes_available < SIZEZIPLOCALHEADER)
+                return UNZ_ERRNO;
+            source = entry_buffer;
+        }
+
+        if (unzCheckLocalHeader(s, source, &size_variable, &offset_local_extrafield, &size_local_extrafield) != UNZ_OK)
+            return UNZ_BADZIPFILE;
+
+        size_needed = SIZEZIPLOCALHEADER + size_variable + compressed_size;
+        if ((bytes_available < size_needed) && (entry_buffer != NULL))
+        {
+            /* Local extra field is larger than the central one */
+            entry_buffer = (uint8_t*)ALLOC((size_t)size_needed);
+            if (entry_buffer == NULL)
+                return UNZ_INTERNALERROR;
+            memcpy(entry_buffer, s->entry_buffer, (size_t)bytes_available);
+            TRYFREE(s->entry_buffer);
+            s->entry_buffer = entry_buffer;
+            s->entry_buffer_size = size_needed;
+            bytes_available += unzReadAtOffset(s, entry_buffer + bytes_available, size_needed - bytes_available,
+                offset_header + bytes_available);
+            source = entry_buffer;
+        }
+        if (bytes_available < size_needed)
+            return UNZ_ERRNO;
+        source += SIZEZIPLOCALHEADER + size_variable;
+
+        if (s->cur_file_info.compression_method == 0)
+        {
+            crc = crc32_fast_copy(crc, buf, source, compressed_size);
+            crc_done = 1;
+        }
+    }
+
+    if (s->cur_file_info.compression_method == 0)
+        *bytes_read = compressed_size;
+    else
+    {
+        if (s->decompress != NULL)
+            err = s->decompress(buf, uncompressed_size, source, compressed_size, bytes_read, s->decompress_user_data);
+        else
+        {
+#ifndef HAVE_APPLE_COMPRESSION
+            /* Inflate with the state kept by the zipfile between files */
+            read_info = unzGetReadInfo(s, 1);
+            if (read_info == NULL)
+                return UNZ_INTERNALERROR;
+            err = unzDecompressBuffer(buf, uncompressed_size, source, compressed_size, bytes_read, &read_info->stream);
+            unzReleaseReadInfo(s, read_info);
+#else
+            err = unzDecompressBuffer(buf, uncompressed_size, source, compressed_size, bytes_read, NULL);
+#endif
+        }
+        if (err != UNZ_OK)
+        {
+            *bytes_read = 0;
+            return err;
+        }
+        if (*bytes_read != uncompressed_size)
+            return UNZ_BADZIPFILE;
+    }
+    unzDropFileData(s, offset_header, SIZEZIPLOCALHEADER + size_variable + compressed_size);
+
+    /* AE-2 does not store the crc but is always encrypted, so it does not get here */
+    if (!crc_done)
+        crc = crc32_fast_parallel(crc, buf, uncompressed_size, 0);
+    if (crc != s->cur_file_info.crc)
+        return UNZ_CRCERROR;
+    return UNZ_OK;
+}
+
+extern int ZEXPORT unzCloseCurrentFile(unzFile file)
+{
+    unz64_internal *s = NULL;
+    file_in_zip64_read_info_s *pfile_in_zip_read_info = NULL;
+    int err = UNZ_OK;
+
+    if (file == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+    pfile_in_zip_read_info = s->pfile_in_zip_read;
+    if (pfile_in_zip_read_info == NULL)
+        return UNZ_PARAMERROR;
+
+#ifdef HAVE_AES
+    if (s->cur_file_info.compression_method == AES_METHOD)
+    {
+        unsigned char authcode[AES_AUTHCODESIZE];
+        unsigned char rauthcode[AES_AUTHCODESIZE];
+
+        if (ZPREAD64(s->z_filefunc, s->filestream, authcode, AES_AUTHCODESIZE,
+                pfile_in_zip_read_info->pos_in_zipfile + pfile_in_zip_read_info->byte_before_the_zipfile) != AES_AUTHCODESIZE)
+            return UNZ_ERRNO;
+
+        if (fcrypt_end(rauthcode, &s->pfile_in_zip_read->aes_ctx) != AES_AUTHCODESIZE)
+            err = UNZ_CRCERROR;
+        if (memcmp(authcode, rauthcode, AES_AUTHCODESIZE) != 0)
+            err = UNZ_CRCERROR;
+    }
+    /* AES zip version AE-1 will expect a valid crc as well */
+    if ((s->cur_file_info.compression_method != AES_METHOD) ||
+        (s->cur_file_info_internal.aes_version == 0x0001))
+#endif
+    {
+        if ((pfile_in_zip_read_info->rest_read_uncompressed == 0) &&
+            (!pfile_in_zip_read_info->raw) && (!pfile_in_zip_read_info->crc32_unchecked))
+        {
+            if (pfile_in_zip_read_info->crc32 != pfile_in_zip_read_info->crc32_expected)
+                err = UNZ_CRCERROR;
+        }
+    }
+
+#ifdef HAVE_APPLE_COMPRESSION
+    if (pfile_in_zip_read_info->stream_initialised == Z_DEFLATED)
+    {
+        if (compression_stream_destroy)
+            compression_stream_destroy(&pfile_in_zip_read_info->astream);
+    }
+#endif
+#ifdef HAVE_BZIP2
+    if (pfile_in_zip_read_info->stream_initialised == Z_BZIP2ED)
+        BZ2_bzDecompressEnd(&pfile_in_zip_read_info->bstream);
+#endif
+
+    if (pfile_in_zip_read_info->rest_read_compressed == 0)
+    {
+        unzDropFileData(s, s->cur_file_info_internal.offset_curfile + pfile_in_zip_read_info->byte_before_the_zipfile,
+            pfile_in_zip_read_info->pos_in_zipfile - s->cur_file_info_internal.offset_curfile);
+    }
+
+    /* The inflate state is kept with the read buffer and reset when the next file is opened */
+    pfile_in_zip_read_info->stream_initialised = 0;
+    unzReleaseReadInfo(s, pfile_in_zip_read_info);
+
+    s->pfile_in_zip_read = NULL;
+
+    return err;
+}
+
+extern int ZEXPORT unzGoToFirstFile2(unzFile file, unz_file_info64 *pfile_info, char *filename,
+    uint16_t filename_size, void *extrafield, uint16_t extrafield_size, char *comment, uint16_t comment_size)
+{
+    unz64_internal *s = NULL;
+    int err = UNZ_OK;
+
+    if (file == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+
+    if (s->gi.number_entry == 0)
+        return UNZ_END_OF_LIST_OF_FILE;
+
+    s->pos_in_central_dir = s->offset_central_dir;
+    s->num_file = 0;
+
+    err = unzGetCurrentFileInfoInternal(file, &s->cur_file_info, &s->cur_file_info_internal,
+            filename, filename_size, extrafield, extrafield_size, comment,comment_size);
+
+    s->current_file_ok = (err == UNZ_OK);
+    if ((err == UNZ_OK) && (pfile_info != NULL))
+        memcpy(pfile_info, &s->cur_file_info, sizeof(unz_file_info64));
+
+    return err;
+}
+
+extern int ZEXPORT unzGoToFirstFile(unzFile file)
+{
+    return unzGoToFirstFile2(file, NULL, NULL, 0, NULL, 0, NULL, 0);
+}
+
+extern int ZEXPORT unzGoToNextFile2(unzFile file, unz_file_info64 *pfile_info, char *filename,
+    uint16_t filename_size, void *extrafield, uint16_t extrafield_size, char *comment, uint16_t comment_size)
+{
+    unz64_internal *s = NULL;
+    int err = UNZ_OK;
+
+    if (file == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+
+    if (!s->current_file_ok)
+        return UNZ_END_OF_LIST_OF_FILE;
+    if (s->num_file+1 >= s->gi.number_entry)
+        return UNZ_END_OF_LIST_OF_FILE;
+
+    s->num_file += 1;
+    s->pos_in_central_dir = s->entries[s->num_file].pos_in_central_dir;
+
+    err = unzGetCurrentFileInfoInternal(file, &s->cur_file_info, &s->cur_file_info_internal,
+            filename, filename_size, extrafield,extrafield_size, comment, comment_size);
+
+    s->current_file_ok = (err == UNZ_OK);
+    if ((err == UNZ_OK) && (pfile_info != NULL))
+        memcpy(pfile_info, &s->cur_file_info, sizeof(unz_file_info64));
+
+    return err;
+}
+
+extern int ZEXPORT unzGoToNextFile(unzFile file)
+{
+    return unzGoToNextFile2(file, NULL, NULL, 0, NULL, 0, NULL, 0);
+}
+
+#define UNZ_FOLD_CASE(c) ((((c) >= 'A') && ((c) <= 'Z')) ? ((c) + ('a' - 'A')) : (c))
+
+/* Hash of the file name with ascii case folded so the same index serves both case sensitivities */
+static uint64_t unzHashFileName(const uint8_t *filename, uint64_t size_filename)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    uint64_t i = 0;
+
+    for (i = 0; i < size_filename; i += 1)
+    {
+        hash ^= (uint8_t)UNZ_FOLD_CASE(filename[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int unzCompareFileName(const uint8_t *filename1, uint16_t size_filename1, const char *filename2,
+    uint64_t size_filename2, int case_sensitivity)
+{
+    uint16_t i = 0;
+
+    if (size_filename1 != size_filename2)
+        return 1;
+    if (case_sensitivity != UNZ_CASE_INSENSITIVE)
+        return memcmp(filename1, filename2, size_filename1);
+    for (i = 0; i < size_filename1; i += 1)
+    {
+        if (UNZ_FOLD_CASE(filename1[i]) != UNZ_FOLD_CASE((uint8_t)filename2[i]))
+            return 1;
+    }
+    return 0;
+}
+
+static const uint8_t *unzGetEntryFileName(const unz64_internal *s, uint64_t num_file)
+{
+    return s->central_dir + (s->entries[num_file].pos_in_central_dir - s->offset_central_dir) + SIZECENTRALDIRITEM;
+}
+
+/* Build the file name hash index, linear probing with at most half of the slots used */
+static int unzBuildNameHash(unz64_internal *s)
+{
+    uint64_t slot_count = 16;
+    uint64_t slot = 0;
+    uint64_t i = 0;
+
+    while (slot_count < s->gi.number_entry * 2)
+        slot_count *= 2;
+    if (slot_count > (size_t)-1 / sizeof(uint64_t))
+        return UNZ_INTERNALERROR;
+
+    s->name_hash = (uint64_t*)ALLOC((size_t)slot_count * sizeof(uint64_t));
+    if (s->name_hash == NULL)
+        return UNZ_INTERNALERROR;
+    memset(s->name_hash, 0, (size_t)slot_count * sizeof(uint64_t));
+    s->name_hash_mask = slot_count - 1;
+
+    /* Files are inserted in central directory order so duplicate names resolve to the first one */
+    for (i = 0; i < s->gi.number_entry; i += 1)
+    {
+        slot = unzHashFileName(unzGetEntryFileName(s, i), s->entries[i].size_filename) & s->name_hash_mask;
+        while (s->name_hash[slot] != 0)
+            slot = (slot + 1) & s->name_hash_mask;
+        s->name_hash[slot] = i + 1;
+    }
+    return UNZ_OK;
+}
+
+/* Make file number num_file the current file */
+static int unzGoToFile(unz64_internal *s, uint64_t num_file)
+{
+    int err = UNZ_OK;
+
+    s->num_file = num_file;
+    s->pos_in_central_dir = s->entries[num_file].pos_in_central_dir;
+
+    err = unzGetCurrentFileInfoInternal((unzFile)s, &s->cur_file_info, &s->cur_file_info_internal,
+            NULL, 0, NULL, 0, NULL, 0);
+    s->current_file_ok = (err == UNZ_OK);
+    return err;
+}
+
+extern int ZEXPORT unzLocateFile2(unzFile file, const char *filename, int case_sensitivity)
+{
+    unz64_internal *s = NULL;
+    uint64_t size_filename = 0;
+    uint64_t num_file = 0;
+    uint64_t slot = 0;
+    int err = UNZ_OK;
+
+    if (file == NULL || filename == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+    if (!s->current_file_ok)
+        return UNZ_END_OF_LIST_OF_FILE;
+    err = unzLoadCentralDir(s);
+    if (err != UNZ_OK)
+        return err;
+
+    size_filename = strlen(filename);
+    if (size_filename > UINT16_MAX)
+        return UNZ_END_OF_LIST_OF_FILE;
+
+    if (s->name_hash == NULL)
+    {
+        if (unzBuildNameHash(s) != UNZ_OK)
+        {
+            /* Not enough memory for the index, compare the names one by one */
+            for (num_file = 0; num_file < s->gi.number_entry; num_file += 1)
+            {
+                if (unzCompareFileName(unzGetEntryFileName(s, num_file), s->entries[num_file].size_filename,
+                        filename, size_filename, case_sensitivity) == 0)
+                    return unzGoToFile(s, num_file);
+            }
+            return UNZ_END_OF_LIST_OF_FILE;
+        }
+    }
+
+    slot = unzHashFileName((const uint8_t*)filename, size_filename) & s->name_hash_mask;
+    while (s->name_hash[slot] != 0)
+    {
+        num_file = s->name_hash[slot] - 1;
+        if (unzCompareFileName(unzGetEntryFileName(s, num_file), s->entries[num_file].size_filename,
+                filename, size_filename, case_sensitivity) == 0)
+            return unzGoToFile(s, num_file);
+        slot = (slot + 1) & s->name_hash_mask;
+    }
+
+    return UNZ_END_OF_LIST_OF_FILE;
+}
+
+extern int ZEXPORT unzLocateFile(unzFile file, const char *filename, unzFileNameComparer filename_compare_func)
+{
+    unz64_internal *s = NULL;
+    uint64_t num_file = 0;
+    char current_filename[UNZ_MAXFILENAMEINZIP+1];
+    int err = UNZ_OK;
+
+    if (file == NULL)
+        return UNZ_PARAMERROR;
+    if (filename_compare_func == NULL)
+        return unzLocateFile2(file, filename, UNZ_CASE_SENSITIVE);
+    if (strlen(filename) >= UNZ_MAXFILENAMEINZIP)
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+    if (!s->current_file_ok)
+        return UNZ_END_OF_LIST_OF_FILE;
+    err = unzLoadCentralDir(s);
+    if (err != UNZ_OK)
+        return err;
+
+    /* Custom comparison can't use the hash index, walk the entry table without changing the current file */
+    for (num_file = 0; num_file < s->gi.number_entry; num_file += 1)
+    {
+        unzGetCurrentFileInfoField(current_filename, sizeof(current_filename)-1, unzGetEntryFileName(s, num_file),
+            s->entries[num_file].size_filename, 1);
+        current_filename[sizeof(current_filename)-1] = 0;
+
+        err = filename_compare_func(file, current_filename, filename);
+        if (err == 0)
+            return unzGoToFile(s, num_file);
+    }
+
+    return UNZ_END_OF_LIST_OF_FILE;
+}
+
+/* Compare the file name of num_file with the first size_prefix bytes of prefix, a file name that
+   starts with prefix compares equal */
+static int unzCompareFileNamePrefix(const unz64_internal *s, uint64_t num_file, const char *prefix,
+    uint64_t size_prefix)
+{
+    uint16_t size_filename = s->entries[num_file].size_filename;
+    int cmp = 0;
+
+    if (size_filename < size_prefix)
+    {
+        cmp = memcmp(unzGetEntryFileName(s, num_file), prefix, size_filename);
+        return (cmp != 0) ? cmp : -1;
+    }
+    return memcmp(unzGetEntryFileName(s, num_file), prefix, (size_t)size_prefix);
+}
+
+static int unzCompareEntryFileNames(const unz64_internal *s, uint64_t num_file1, uint64_t num_file2)
+{
+    uint16_t size_filename1 = s->entries[num_file1].size_filename;
+    uint16_t size_filename2 = s->entries[num_file2].size_filename;
+    int cmp = 0;
+
+    cmp = memcmp(unzGetEntryFileName(s, num_file1), unzGetEntryFileName(s, num_file2),
+        (size_filename1 < size_filename2) ? size_filename1 : size_filename2);
+    if (cmp != 0)
+        return cmp;
+    if (size_filename1 != size_filename2)
+        return (size_filename1 < size_filename2) ? -1 : 1;
+    /* Keep central directory order between duplicate names */
+    return (num_file1 < num_file2) ? -1 : 1;
+}
+
+/* Sort the file names with a bottom-up merge sort of the file numbers */
+static int unzBuildNameSorted(unz64_internal *s)
+{
+    uint64_t *sorted = NULL;
+    uint64_t *merged = NULL;
+    uint64_t *swap = NULL;
+    uint64_t width = 0;
+    uint64_t left = 0;
+    uint64_t middle = 0;
+    uint64_t right = 0;
+    uint64_t i = 0;
+    uint64_t j = 0;
+    uint64_t k = 0;
+    uint64_t n = s->gi.number_entry;
+
+    if (n > (size_t)-1 / sizeof(uint64_t) / 2)
+        return UNZ_INTERNALERROR;
+
+    sorted = (uint64_t*)ALLOC((size_t)(n + 1) * sizeof(uint64_t));
+    merged = (uint64_t*)ALLOC((size_t)(n + 1) * sizeof(uint64_t));
+    if (sorted == NULL || merged == NULL)
+    {
+        TRYFREE(sorted);
+        TRYFREE(merged);
+        return UNZ_INTERNALERROR;
+    }
+
+    for (i = 0; i < n; i += 1)
+        sorted[i] = i;
+
+    for (width = 1; width < n; width *= 2)
+    {
+        for (left = 0; left < n; left += width * 2)
+        {
+            middle = (left + width < n) ? left + width : n;
+            right = (middle + width < n) ? middle + width : n;
+
+            i = left;
+            j = middle;
+            k = left;
+            while (i < middle && j < right)
+            {
+                if (unzCompareEntryFileNames(s, sorted[i], sorted[j]) < 0)
+                    merged[k++] = sorted[i++];
+                else
+                    merged[k++] = sorted[j++];
+            }
+            while (i < middle)
+                merged[k++] = sorted[i++];
+            while (j < right)
+                merged[k++] = sorted[j++];
+        }
+
+        swap = sorted;
+        sorted = merged;
+        merged = swap;
+    }
+
+    TRYFREE(merged);
+    s->name_sorted = sorted;
+    return UNZ_OK;
+}
+
+/* Find the first position in [low, high) of the sorted table where the file name compares above prefix,
+   or at or above it if or_equal is zero */
+static uint64_t unzSearchNameSorted(const unz64_internal *s, uint64_t low, uint64_t high, const char *prefix,
+    uint64_t size_prefix, int or_equal)
+{
+    uint64_t middle = 0;
+    int cmp = 0;
+
+    while (low < high)
+    {
+        middle = low + (high - low) / 2;
+        cmp = unzCompareFileNamePrefix(s, s->name_sorted[middle], prefix, size_prefix);
+        if ((cmp < 0) || (or_equal && cmp == 0))
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+extern int ZEXPORT unzLocatePrefix(unzFile file, const char *prefix, uint64_t *first, uint64_t *count)
+{
+    unz64_internal *s = NULL;
+    uint64_t size_prefix = 0;
+    uint64_t last = 0;
+    int err = UNZ_OK;
+
+    if (file == NULL || prefix == NULL || first == NULL || count == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+
+    err = unzLoadCentralDir(s);
+    if (err != UNZ_OK)
+        return err;
+    if ((s->name_sorted == NULL) && (unzBuildNameSorted(s) != UNZ_OK))
+        return UNZ_INTERNALERROR;
+
+    size_prefix = strlen(prefix);
+    *first = unzSearchNameSorted(s, 0, s->gi.number_entry, prefix, size_prefix, 0);
+    last = unzSearchNameSorted(s, *first, s->gi.number_entry, prefix, size_prefix, 1);
+    *count = last - *first;
+    return UNZ_OK;
+}
+
+extern int ZEXPORT unzGoToSortedFile(unzFile file, uint64_t sorted_pos)
+{
+    unz64_internal *s = NULL;
+
+    if (file == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+
+    if ((s->name_sorted == NULL) && (unzBuildNameSorted(s) != UNZ_OK))
+        return UNZ_INTERNALERROR;
+    if (sorted_pos >= s->gi.number_entry)
+        return UNZ_PARAMERROR;
+    /* The sorted order of a lookup index is only checked with the central directory */
+    if (s->name_sorted[sorted_pos] >= s->gi.number_entry)
+        return UNZ_BADZIPFILE;
+
+    return unzGoToFile(s, s->name_sorted[sorted_pos]);
+}
+
+extern int ZEXPORT unzListDirectory(unzFile file, const char *directory, unzChildIteratorFunction func, void *user_data)
+{
+    unz64_internal *s = NULL;
+    const char *name = NULL;
+    const char *slash = NULL;
+    uint64_t size_directory = 0;
+    uint64_t sorted_pos = 0;
+    uint64_t first = 0;
+    uint64_t count = 0;
+    uint64_t last = 0;
+    uint16_t size_name = 0;
+    int err = UNZ_OK;
+
+    if (file == NULL || directory == NULL || func == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+
+    err = unzLocatePrefix(file, directory, &first, &count);
+    size_directory = strlen(directory);
+    last = first + count;
+    sorted_pos = first;
+
+    while ((err == UNZ_OK) && (sorted_pos < last))
+    {
+        name = (const char*)unzGetEntryFileName(s, s->name_sorted[sorted_pos]) + size_directory;
+        size_name = (uint16_t)(s->entries[s->name_sorted[sorted_pos]].size_filename - size_directory);
+
+        /* Skip the entry of the directory itself */
+        if (size_name == 0)
+        {
+            sorted_pos += 1;
+            continue;
+        }
+
+        slash = (const char*)memchr(name, '/', size_name);
+        if (slash != NULL)
+            size_name = (uint16_t)(slash - name + 1);
+
+        err = func(file, name, size_name, sorted_pos, user_data);
+
+        /* Jump over everything inside a subdirectory */
+        if (slash != NULL)
+            sorted_pos = unzSearchNameSorted(s, sorted_pos, last, name - size_directory, size_directory + size_name, 1);
+        else
+            sorted_pos += 1;
+    }
+
+    return err;
+}
+
+/* Build the name hash and sorted order kept in a lookup index when they were not needed yet */
+static int unzPrepareLookupIndex(unz64_internal *s)
+{
+    int err = UNZ_OK;
+
+    err = unzLoadCentralDir(s);
+    if (err != UNZ_OK)
+        return err;
+    if ((s->name_hash == NULL) && (unzBuildNameHash(s) != UNZ_OK))
+        return UNZ_INTERNALERROR;
+    if ((s->name_sorted == NULL) && (unzBuildNameSorted(s) != UNZ_OK))
+        return UNZ_INTERNALERROR;
+    return UNZ_OK;
+}
+
+/* Write the lookup index of s to buf, which holds unzLookupIndexSize bytes */
+static void unzWriteLookupIndex(const unz64_internal *s, uint32_t pad, uint64_t zip_size, uint64_t zip_mtime,
+    uint8_t *buf)
+{
+    const unz_entry64_internal *entry = NULL;
+    uint64_t slot_count = s->name_hash_mask + 1;
+    uint64_t index_size = unzLookupIndexSize(s->gi.number_entry, slot_count, pad);
+    uint8_t *p = buf;
+    uint64_t i = 0;
+
+    unzWriteValueToMemoryAndMove(&p, LOOKUPINDEXMAGIC, 4);
+    unzWriteValueToMemoryAndMove(&p, LOOKUPINDEXVERSION, 2);
+    unzWriteValueToMemoryAndMove(&p, SIZELOOKUPINDEXENTRY, 2);
+    unzWriteValueToMemoryAndMove(&p, s->gi.number_entry, 8);
+    unzWriteValueToMemoryAndMove(&p, s->offset_central_dir, 8);
+    unzWriteValueToMemoryAndMove(&p, s->size_central_dir, 8);
+    unzWriteValueToMemoryAndMove(&p, slot_count, 8);
+    unzWriteValueToMemoryAndMove(&p, zip_size, 8);
+    unzWriteValueToMemoryAndMove(&p, zip_mtime, 8);
+    unzWriteValueToMemoryAndMove(&p, pad, 4);
+    unzWriteValueToMemoryAndMove(&p, crc32_fast(0, buf, SIZELOOKUPINDEXHEADER - 4), 4);
+    memset(p, 0, pad);
+    p += pad;
+
+    for (i = 0; i < s->gi.number_entry; i += 1)
+    {
+        entry = &s->entries[i];
+        unzWriteValueToMemoryAndMove(&p, entry->pos_in_central_dir, 8);
+        unzWriteValueToMemoryAndMove(&p, entry->compressed_size, 8);
+        unzWriteValueToMemoryAndMove(&p, entry->uncompressed_size, 8);
+        unzWriteValueToMemoryAndMove(&p, entry->offset_curfile, 8);
+        unzWriteValueToMemoryAndMove(&p, entry->dos_date, 4);
+        unzWriteValueToMemoryAndMove(&p, entry->crc, 4);
+        unzWriteValueToMemoryAndMove(&p, entry->external_fa, 4);
+        unzWriteValueToMemoryAndMove(&p, entry->disk_num_start, 4);
+        unzWriteValueToMemoryAndMove(&p, entry->version, 2);
+        unzWriteValueToMemoryAndMove(&p, entry->version_needed, 2);
+        unzWriteValueToMemoryAndMove(&p, entry->flag, 2);
+        unzWriteValueToMemoryAndMove(&p, entry->compression_method, 2);
+        unzWriteValueToMemoryAndMove(&p, entry->size_filename, 2);
+        unzWriteValueToMemoryAndMove(&p, entry->size_file_extra, 2);
+        unzWriteValueToMemoryAndMove(&p, entry->size_file_comment, 2);
+        unzWriteValueToMemoryAndMove(&p, entry->internal_fa, 2);
+        unzWriteValueToMemoryAndMove(&p, entry->size_file_extra_internal, 2);
+#ifdef HAVE_AES
+        unzWriteValueToMemoryAndMove(&p, entry->aes_compression_method, 2);
+        unzWriteValueToMemoryAndMove(&p, entry->aes_encryption_mode, 1);
+        unzWriteValueToMemoryAndMove(&p, entry->aes_version, 1);
+#else
+        unzWriteValueToMemoryAndMove(&p, 0, 4);
+#endif
+        unzWriteValueToMemoryAndMove(&p, 0, 2);
+    }
+    for (i = 0; i < slot_count; i += 1)
+        unzWriteValueToMemoryAndMove(&p, s->name_hash[i], 8);
+    for (i = 0; i < s->gi.number_entry; i += 1)
+        unzWriteValueToMemoryAndMove(&p, s->name_sorted[i], 8);
+
+    unzWriteValueToMemoryAndMove(&p, LOOKUPLOCATORMAGIC, 4);
+    unzWriteValueToMemoryAndMove(&p, 0, 4);
+    unzWriteValueToMemoryAndMove(&p, index_size, 8);
+}
+
+extern int ZEXPORT unzBuildLookupIndex(const void *central_dir, uint64_t size_central_dir,
+    uint64_t offset_index, void *buf, uint64_t buf_size, uint64_t *index_size)
+{
+    unz64_internal s;
+    uint64_t i = 0;
+    uint32_t pad = 0;
+    int err = UNZ_OK;
+
+    if (central_dir == NULL || index_size == NULL)
+        return UNZ_PARAMERROR;
+    if (size_central_dir > (size_t)-1)
+        return UNZ_INTERNALERROR;
+
+    memset(&s, 0, sizeof(s));
+    s.central_dir = (uint8_t*)central_dir;
+    s.size_central_dir = size_central_dir;
+
+    /* The tables start on 8 bytes in the zipfile so they can be used in place when it is mapped */
+    pad = (uint32_t)((8 - (offset_index & 7)) & 7);
+    err = unzDecodeCentralDir(&s);
+    if (err == UNZ_OK)
+        err = unzPrepareLookupIndex(&s);
+    if (err == UNZ_OK)
+    {
+        *index_size = unzLookupIndexSize(s.gi.number_entry, s.name_hash_mask + 1, pad);
+        if (*index_size > UINT32_MAX)
+            err = UNZ_INTERNALERROR;
+        else if ((buf != NULL) && (buf_size < *index_size))
+            err = UNZ_PARAMERROR;
+        else if (buf != NULL)
+        {
+            /* The central directory follows the index */
+            s.offset_central_dir = offset_index + *index_size;
+            for (i = 0; i < s.gi.number_entry; i += 1)
+                s.entries[i].pos_in_central_dir += s.offset_central_dir;
+            unzWriteLookupIndex(&s, pad, 0, 0, (uint8_t*)buf);
+        }
+    }
+
+    TRYFREE(s.entries);
+    TRYFREE(s.name_hash);
+    TRYFREE(s.name_sorted);
+    return err;
+}
+
+extern int ZEXPORT unzSaveLookupIndex(unzFile file, const void *path, const void *index_path)
+{
+    unz64_internal *s = NULL;
+    zlib_filefunc64_32_def index_filefunc;
+    voidpf index_stream = NULL;
+    uint8_t *buf = NULL;
+    uint64_t index_size = 0;
+    uint64_t zip_size = 0;
+    int err = UNZ_OK;
+
+    if (file == NULL || path == NULL || index_path == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+    if (s->is_clone)
+        return UNZ_PARAMERROR;
+
+    err = unzPrepareLookupIndex(s);
+    if (err != UNZ_OK)
+        return err;
+    index_size = unzLookupIndexSize(s->gi.number_entry, s->name_hash_mask + 1, 0);
+    if (index_size > UINT32_MAX)
+        return UNZ_INTERNALERROR;
+
+    if (ZSEEK64(s->z_filefunc, s->filestream_with_CD, 0, ZLIB_FILEFUNC_SEEK_END) != 0)
+        return UNZ_ERRNO;
+    zip_size = ZTELL64(s->z_filefunc, s->filestream_with_CD);
+
+    buf = (uint8_t*)ALLOC((size_t)index_size);
+    if (buf == NULL)
+        return UNZ_INTERNALERROR;
+    unzWriteLookupIndex(s, 0, zip_size, unzGetModifiedTime(path), buf);
+
+    /* The io functions of the zipfile may not write, like the mapped ones */
+    fill_fopen64_filefunc(&index_filefunc.zfile_func64);
+    fill_fopen64_filefunc_ext(&index_filefunc.zfile_ext);
+    index_filefunc.ztell32_file = NULL;
+    index_filefunc.zseek32_file = NULL;
+
+    index_stream = ZOPEN64(index_filefunc, index_path,
+        ZLIB_FILEFUNC_MODE_READ | ZLIB_FILEFUNC_MODE_WRITE | ZLIB_FILEFUNC_MODE_CREATE);
+    if (index_stream == NULL)
+        err = UNZ_ERRNO;
+    if ((err == UNZ_OK) && (ZWRITE64(index_filefunc, index_stream, buf, (uint32_t)index_size) != index_size))
+        err = UNZ_ERRNO;
+    if ((index_stream != NULL) && (ZCLOSE64(index_filefunc, index_stream) != 0) && (err == UNZ_OK))
+        err = UNZ_ERRNO;
+
+    TRYFREE(buf);
+    return err;
+}
+
+/* Find the file whose central header starts at pos, the entry table is in central directory order */
+static int unzLookupEntryAtPos(const unz64_internal *s, uint64_t pos, uint64_t *num_file)
+{
+    uint64_t low = 0;
+    uint64_t high = s->gi.number_entry;
+    uint64_t middle = 0;
+
+    while (low < high)
+    {
+        middle = low + (high - low) / 2;
+        if (s->entries[middle].pos_in_central_dir < pos)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    if ((low == s->gi.number_entry) || (s->entries[low].pos_in_central_dir != pos))
+        return UNZ_BADZIPFILE;
+
+    *num_file = low;
+    return UNZ_OK;
+}
+
+extern int ZEXPORT unzGetFilePos(unzFile file, unz_file_pos *file_pos)
+{
+    unz64_file_pos file_pos64;
+    int err = unzGetFilePos64(file, &file_pos64);
+    if (err == UNZ_OK)
+    {
+        file_pos->pos_in_zip_directory = (uint32_t)file_pos64.pos_in_zip_directory;
+        file_pos->num_of_file = (uint32_t)file_pos64.num_of_file;
+    }
+    return err;
+}
+
+extern int ZEXPORT unzGoToFilePos(unzFile file, unz_file_pos *file_pos)
+{
+    unz64_file_pos file_pos64;
+    if (file_pos == NULL)
+        return UNZ_PARAMERROR;
+    file_pos64.pos_in_zip_directory = file_pos->pos_in_zip_directory;
+    file_pos64.num_of_file = file_pos->num_of_file;
+    return unzGoToFilePos64(file, &file_pos64);
+}
+
+extern int ZEXPORT unzGetFilePos64(unzFile file, unz64_file_pos *file_pos)
+{
+    unz64_internal *s = NULL;
+
+    if (file == NULL || file_pos == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+    if (!s->current_file_ok)
+        return UNZ_END_OF_LIST_OF_FILE;
+
+    file_pos->pos_in_zip_directory  = s->pos_in_central_dir;
+    file_pos->num_of_file = s->num_file;
+    return UNZ_OK;
+}
+
+extern int ZEXPORT unzGoToFilePos64(unzFile file, const unz64_file_pos *file_pos)
+{
+    unz64_internal *s = NULL;
+    int err = UNZ_OK;
+
+    if (file == NULL || file_pos == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+
+    /* Jump to the right spot, trust the file number only if it agrees with the position */
+    if ((file_pos->num_of_file < s->gi.number_entry) &&
+        (s->entries[file_pos->num_of_file].pos_in_central_dir == file_pos->pos_in_zip_directory))
+        s->num_file = file_pos->num_of_file;
+    else
+        err = unzLookupEntryAtPos(s, file_pos->pos_in_zip_directory, &s->num_file);
+
+    /* Set the current file */
+    if (err == UNZ_OK)
+    {
+        s->pos_in_central_dir = file_pos->pos_in_zip_directory;
+        err = unzGetCurrentFileInfoInternal(file, &s->cur_file_info, &s->cur_file_info_internal, NULL, 0, NULL, 0, NULL, 0);
+    }
+    /* Return results */
+    s->current_file_ok = (err == UNZ_OK);
+    return err;
+}
+
+extern int32_t ZEXPORT unzGetOffset(unzFile file)
+{
+    uint64_t offset64 = 0;
+
+    if (file == NULL)
+        return UNZ_PARAMERROR;
+    offset64 = unzGetOffset64(file);
+    return (int32_t)offset64;
+}
+
+extern int64_t ZEXPORT unzGetOffset64(unzFile file)
+{
+    unz64_internal *s = NULL;
+
+    if (file == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+    if (!s->current_file_ok)
+        return 0;
+    if (s->gi.number_entry != 0 && s->gi.number_entry != UINT16_MAX)
+    {
+        if (s->num_file == s->gi.number_entry)
+            return 0;
+    }
+    return s->pos_in_central_dir;
+}
+
+extern int ZEXPORT unzSetOffset(unzFile file, uint32_t pos)
+{
+    return unzSetOffset64(file, pos);
+}
+
+extern int ZEXPORT unzSetOffset64(unzFile file, uint64_t pos)
+{
+    unz64_internal *s = NULL;
+    int err = UNZ_OK;
+
+    if (file == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+
+    err = unzLookupEntryAtPos(s, pos, &s->num_file);
+    if (err == UNZ_OK)
+    {
+        s->pos_in_central_dir = pos;
+        err = unzGetCurrentFileInfoInternal(file, &s->cur_file_info, &s->cur_file_info_internal, NULL, 0, NULL, 0, NULL, 0);
+    }
+
+    s->current_file_ok = (err == UNZ_OK);
+    return err;
+}
+
+extern int32_t ZEXPORT unzTell(unzFile file)
+{
+    unz64_internal *s = NULL;
+    if (file == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+    if (s->pfile_in_zip_read == NULL)
+        return UNZ_PARAMERROR;
+    return (int32_t)s->pfile_in_zip_read->stream.total_out;
+}
+
+extern int64_t ZEXPORT unzTell64(unzFile file)
+{
+    unz64_internal *s = NULL;
+    if (file == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+    if (s->pfile_in_zip_read == NULL)
+        return UNZ_PARAMERROR;
+    return s->pfile_in_zip_read->total_out_64;
+}
+
+extern int ZEXPORT unzSeek(unzFile file, uint32_t offset, int origin)
+{
+    return unzSeek64(file, offset, origin);
+}
+
+static int unzSeekInflate(unz64_internal *s, uint64_t position)
+{
+#ifdef HAVE_APPLE_COMPRESSION
+    return UNZ_ERRNO;
+#else
+    file_in_zip64_read_info_s *pfile_in_zip_read_info = s->pfile_in_zip_read;
+    unz_seek_index *index = pfile_in_zip_read_info->seek_index;
+    unz_seek_point *point = NULL;
+    uint8_t *buf = NULL;
+    uint64_t low = 0;
+    uint64_t high = 0;
+    uint64_t middle = 0;
+    uint32_t bytes_to_read = 0;
+    uint8_t value = 0;
+    int read = 0;
+    int err = UNZ_OK;
+
+    /* Closest point before the position */
+    if ((index != NULL) && (index->number_point > 0))
+    {
+        high = index->number_point;
+        while (low < high)
+        {
+            middle = low + (high - low) / 2;
+            if (index->points[middle].uncompressed_pos <= position)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        if (low > 0)
+            point = &index->points[low - 1];
+    }
+
+    /* Restart decompression when going back or when a point is closer than the current position */
+    if ((position < pfile_in_zip_read_info->total_out_64) ||
+        ((point != NULL) && (point->uncompressed_pos > pfile_in_zip_read_info->total_out_64)))
+    {
+        if ((s->cur_file_info.flag & 1) != 0)
+            return UNZ_ERRNO;
+        if (inflateReset(&pfile_in_zip_read_info->stream) != Z_OK)
+            return UNZ_INTERNALERROR;
+
+        pfile_in_zip_read_info->pos_in_zipfile = pfile_in_zip_read_info->offset_data;
+        pfile_in_zip_read_info->rest_read_compressed = s->cur_file_info.compressed_size;
+        pfile_in_zip_read_info->rest_read_uncompressed = s->cur_file_info.uncompressed_size;
+        pfile_in_zip_read_info->total_out_64 = 0;
+
+        if (point != NULL)
+        {
+            if (point->bits != 0)
+            {
+                if (ZPREAD64(pfile_in_zip_read_info->z_filefunc, pfile_in_zip_read_info->filestream, &value, 1,
+                        pfile_in_zip_read_info->offset_data + point->compressed_pos - 1 +
+                        pfile_in_zip_read_info->byte_before_the_zipfile) != 1)
+                    return UNZ_ERRNO;
+                inflatePrime(&pfile_in_zip_read_info->stream, point->bits, value >> (8 - point->bits));
+            }
+            inflateSetDictionary(&pfile_in_zip_read_info->stream, point->window, point->window_size);
+
+            pfile_in_zip_read_info->pos_in_zipfile += point->compressed_pos;
+            pfile_in_zip_read_info->rest_read_compressed -= point->compressed_pos;
+            pfile_in_zip_read_info->rest_read_uncompressed -= point->uncompressed_pos;
+            pfile_in_zip_read_info->total_out_64 = point->uncompressed_pos;
+            pfile_in_zip_read_info->crc32_unchecked = 1;
+        }
+        else
+        {
+            pfile_in_zip_read_info->crc32 = 0;
+            pfile_in_zip_read_info->crc32_unchecked = 0;
+        }
+
+        pfile_in_zip_read_info->stream.next_in = NULL;
+        pfile_in_zip_read_info->stream.avail_in = 0;
+    }
+
+    if (position == pfile_in_zip_read_info->total_out_64)
+        return UNZ_OK;
+
+    /* Decompress up to the position, points found on the way are added to the index */
+    buf = (uint8_t*)ALLOC(UNZ_BUFSIZE);
+    if (buf == NULL)
+        return UNZ_INTERNALERROR;
+    while ((err == UNZ_OK) && (pfile_in_zip_read_info->total_out_64 < position))
+    {
+        bytes_to_read = UNZ_BUFSIZE;
+        if (position - pfile_in_zip_read_info->total_out_64 < bytes_to_read)
+            bytes_to_read = (uint32_t)(position - pfile_in_zip_read_info->total_out_64);
+        read = unzReadCurrentFile((unzFile)s, buf, bytes_to_read);
+        if (read < 0)
+            err = read;
+        else if (read == 0)
+            err = UNZ_BADZIPFILE;
+    }
+    TRYFREE(buf);
+    return err;
+#endif
+}
+
+extern int ZEXPORT unzSeek64(unzFile file, uint64_t offset, int origin)
+{
+    unz64_internal *s = NULL;
+    uint64_t position = 0;
+    uint64_t size = 0;
+
+    if (file == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+
+    if (s->pfile_in_zip_read == NULL)
+        return UNZ_ERRNO;
+    if (s->pfile_in_zip_read->compression_method == 0)
+        size = s->cur_file_info.compressed_size;
+    else if (s->pfile_in_zip_read->stream_initialised == Z_DEFLATED)
+        size = s->cur_file_info.uncompressed_size;
+    else
+        return UNZ_ERRNO;
+
+    if (origin == SEEK_SET)
+        position = offset;
+    else if (origin == SEEK_CUR)
+        position = s->pfile_in_zip_read->total_out_64 + offset;
+    else if (origin == SEEK_END)
+        position = size + offset;
+    else
+        return UNZ_PARAMERROR;
 
-            read += copy;
-        }
-        else if (s->pfile_in_zip_read->compression_method == Z_BZIP2ED)
-        {
-#ifdef HAVE_BZIP2
-            uint64_t total_out_before = 0;
-            uint64_t total_out_after = 0;
-            uint64_t out_bytes = 0;
-            const uint8_t *buf_before = NULL;
+    if (position > size)
+        return UNZ_PARAMERROR;
 
-            s->pfile_in_zip_read->bstream.next_in        = (char*)s->pfile_in_zip_read->stream.next_in;
-            s->pfile_in_zip_read->bstream.avail_in       = s->pfile_in_zip_read->stream.avail_in;
-            s->pfile_in_zip_read->bstream.total_in_lo32  = (uint32_t)s->pfile_in_zip_read->stream.total_in;
-            s->pfile_in_zip_read->bstream.total_in_hi32  = s->pfile_in_zip_read->stream.total_in >> 32;
-            
-            s->pfile_in_zip_read->bstream.next_out       = (char*)s->pfile_in_zip_read->stream.next_out;
-            s->pfile_in_zip_read->bstream.avail_out      = s->pfile_in_zip_read->stream.avail_out;
-            s->pfile_in_zip_read->bstream.total_out_lo32 = (uint32_t)s->pfile_in_zip_read->stream.total_out;
-            s->pfile_in_zip_read->bstream.total_out_hi32 = s->pfile_in_zip_read->stream.total_out >> 32;
+    if (s->pfile_in_zip_read->compression_method != 0)
+        return unzSeekInflate(s, position);
 
-            total_out_before = s->pfile_in_zip_read->bstream.total_out_lo32 + 
-                (((uint32_t)s->pfile_in_zip_read->bstream.total_out_hi32) << 32);
-            buf_before = (const uint8_t*)s->pfile_in_zip_read->bstream.next_out;
+    if ((position >= s->pfile_in_zip_read->total_out_64) &&
+        (position - s->pfile_in_zip_read->total_out_64 <= s->pfile_in_zip_read->stream.avail_in))
+    {
+        /* Position is within the data already read */
+        s->pfile_in_zip_read->stream.next_in += position - s->pfile_in_zip_read->total_out_64;
+        s->pfile_in_zip_read->stream.avail_in -= (uint32_t)(position - s->pfile_in_zip_read->total_out_64);
+    }
+    else
+    {
+        /* Decryption can not resume at another position */
+        if ((s->cur_file_info.flag & 1) != 0)
+            return UNZ_ERRNO;
 
-            err = BZ2_bzDecompress(&s->pfile_in_zip_read->bstream);
+        s->pfile_in_zip_read->stream.avail_in = 0;
+        s->pfile_in_zip_read->stream.next_in = 0;
 
-            total_out_after = s->pfile_in_zip_read->bstream.total_out_lo32 + 
-                (((uint32_t)s->pfile_in_zip_read->bstream.total_out_hi32) << 32);
+        s->pfile_in_zip_read->pos_in_zipfile = s->pfile_in_zip_read->offset_data + position;
+        s->pfile_in_zip_read->rest_read_compressed = s->cur_file_info.compressed_size - position;
+    }
 
-            out_bytes = total_out_after - total_out_before;
+    if (position != s->pfile_in_zip_read->total_out_64)
+        s->pfile_in_zip_read->crc32_unchecked = 1;
+    s->pfile_in_zip_read->rest_read_uncompressed = s->cur_file_info.compressed_size - position;
+    s->pfile_in_zip_read->stream.total_out = (uint32_t)position;
+    s->pfile_in_zip_read->total_out_64 = position;
 
-            s->pfile_in_zip_read->total_out_64 = s->pfile_in_zip_read->total_out_64 + out_bytes;
-            s->pfile_in_zip_read->rest_read_uncompressed -= out_bytes;
-            s->pfile_in_zip_read->crc32 = crc32(s->pfile_in_zip_read->crc32, buf_before, (uint32_t)out_bytes);
+    return UNZ_OK;
+}
 
-            read += (uint32_t)out_bytes;
+extern int ZEXPORT unzEndOfFile(unzFile file)
+{
+    unz64_internal *s = NULL;
+    if (file == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+    if (s->pfile_in_zip_read == NULL)
+        return UNZ_PARAMERROR;
+    if (s->pfile_in_zip_read->rest_read_uncompressed == 0)
+        return 1;
+    return 0;
+}
 
-            s->pfile_in_zip_read->stream.next_in   = (uint8_t*)s->pfile_in_zip_read->bstream.next_in;
-            s->pfile_in_zip_read->stream.avail_in  = s->pfile_in_zip_read->bstream.avail_in;
-            s->pfile_in_zip_read->stream.total_in  = s->pfile_in_zip_read->bstream.total_in_lo32;
-            s->pfile_in_zip_read->stream.next_out  = (uint8_t*)s->pfile_in_zip_read->bstream.next_out;
-            s->pfile_in_zip_read->stream.avail_out = s->pfile_in_zip_read->bstream.avail_out;
-            s->pfile_in_zip_read->stream.total_out = s->pfile_in_zip_read->bstream.total_out_lo32;
+extern int ZEXPORT unzSetSeekIndexSpacing(unzFile file, uint64_t spacing)
+{
+    unz64_internal *s = NULL;
+    if (file == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+    s->seek_index_spacing = spacing;
+    return UNZ_OK;
+}
 
-            if (err == BZ_STREAM_END)
-                return (read == 0) ? UNZ_EOF : read;
-            if (err != BZ_OK)
-                break;
-#endif
-        }
-#ifdef HAVE_APPLE_COMPRESSION
-        else
-        {
-            uint64_t total_out_before = 0;
-            uint64_t total_out_after = 0;
-            uint64_t out_bytes = 0;
-            const uint8_t *buf_before = NULL;
+extern int ZEXPORT unzGetSeekIndex(unzFile file, void *buf, uint64_t buf_size, uint64_t *index_size)
+{
+    unz64_internal *s = NULL;
+    unz_seek_index *index = NULL;
+    unz_seek_point *point = NULL;
+    uint8_t *p = NULL;
+    uint64_t size = SIZESEEKINDEXHEADER;
+    uint64_t i = 0;
+
+    if (index_size != NULL)
+        *index_size = 0;
+    if ((file == NULL) || (index_size == NULL))
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+    if (!s->current_file_ok)
+        return UNZ_PARAMERROR;
 
-            s->pfile_in_zip_read->astream.src_ptr = s->pfile_in_zip_read->stream.next_in;
-            s->pfile_in_zip_read->astream.src_size = s->pfile_in_zip_read->stream.avail_in;
-            s->pfile_in_zip_read->astream.dst_ptr = s->pfile_in_zip_read->stream.next_out;
-            s->pfile_in_zip_read->astream.dst_size = len;
+    index = unzGetFileSeekIndex(s, 0);
+    if ((index == NULL) || (index->number_point > UINT32_MAX))
+        return UNZ_PARAMERROR;
 
-            total_out_before = s->pfile_in_zip_read->stream.total_out;
-            buf_before = s->pfile_in_zip_read->stream.next_out;
+    for (i = 0; i < index->number_point; i += 1)
+        size += SIZESEEKPOINTHEADER + index->points[i].window_size;
+    *index_size = size;
+    if (buf == NULL)
+        return UNZ_OK;
+    if (buf_size < size)
+        return UNZ_PARAMERROR;
 
-            compression_status status;
-            compression_stream_flags flags;
+    p = (uint8_t*)buf;
+    unzWriteValueToMemoryAndMove(&p, SEEKINDEXMAGIC, 4);
+    unzWriteValueToMemoryAndMove(&p, s->cur_file_info.crc, 4);
+    unzWriteValueToMemoryAndMove(&p, s->cur_file_info.compressed_size, 8);
+    unzWriteValueToMemoryAndMove(&p, s->cur_file_info.uncompressed_size, 8);
+    unzWriteValueToMemoryAndMove(&p, index->spacing, 8);
+    unzWriteValueToMemoryAndMove(&p, index->number_point, 4);
 
-            if (s->pfile_in_zip_read->stream.avail_in == 0)
-            {
-                flags = COMPRESSION_STREAM_FINALIZE;
-            }
+    for (i = 0; i < index->number_point; i += 1)
+    {
+        point = &index->points[i];
+        unzWriteValueToMemoryAndMove(&p, point->uncompressed_pos, 8);
+        unzWriteValueToMemoryAndMove(&p, point->compressed_pos, 8);
+        unzWriteValueToMemoryAndMove(&p, point->bits, 1);
+        unzWriteValueToMemoryAndMove(&p, point->window_size, 2);
+        memcpy(p, point->window, point->window_size);
+        p += point->window_size;
+    }
+    return UNZ_OK;
+}
 
-            status = compression_stream_process(&s->pfile_in_zip_read->astream, flags);
+extern int ZEXPORT unzSetSeekIndex(unzFile file, const void *buf, uint64_t buf_size)
+{
+    unz64_internal *s = NULL;
+    unz_seek_index *index = NULL;
+    unz_seek_point *points = NULL;
+    unz_seek_point *point = NULL;
+    const uint8_t *p = (const uint8_t*)buf;
+    const uint8_t *end = (const uint8_t*)buf + buf_size;
+    uint64_t spacing = 0;
+    uint64_t number_point = 0;
+    uint64_t last_pos = 0;
+    uint64_t i = 0;
+    int err = UNZ_OK;
 
-            total_out_after = len - s->pfile_in_zip_read->astream.dst_size;
-            out_bytes = total_out_after - total_out_before;
+    if ((file == NULL) || (buf == NULL))
+        return UNZ_PARAMERROR;
+    s = (unz64_internal*)file;
+    if (!s->current_file_ok)
+        return UNZ_PARAMERROR;
+    if (buf_size < SIZESEEKINDEXHEADER)
+        return UNZ_BADZIPFILE;
 
-            s->pfile_in_zip_read->total_out_64 += out_bytes;
-            s->pfile_in_zip_read->rest_read_uncompressed -= out_bytes;
-            s->pfile_in_zip_read->crc32 =
-                crc32(s->pfile_in_zip_read->crc32, buf_before, (uint32_t)out_bytes);
+    if (unzReadValueFromMemoryAndMove(&p, 4) != SEEKINDEXMAGIC)
+        err = UNZ_BADZIPFILE;
+    if (unzReadValueFromMemoryAndMove(&p, 4) != s->cur_file_info.crc)
+        err = UNZ_BADZIPFILE;
+    if (unzReadValueFromMemoryAndMove(&p, 8) != s->cur_file_info.compressed_size)
+        err = UNZ_BADZIPFILE;
+    if (unzReadValueFromMemoryAndMove(&p, 8) != s->cur_file_info.uncompressed_size)
+        err = UNZ_BADZIPFILE;
+    spacing = unzReadValueFromMemoryAndMove(&p, 8);
+    number_point = unzReadValueFromMemoryAndMove(&p, 4);
+    if ((err == UNZ_OK) && ((spacing == 0) || (number_point > (uint64_t)(end - p) / SIZESEEKPOINTHEADER)))
+        err = UNZ_BADZIPFILE;
+    if (err != UNZ_OK)
+        return err;
 
-            read += (uint32_t)out_bytes;
+    if (number_point > 0)
+    {
+        points = (unz_seek_point*)ALLOC((size_t)number_point * sizeof(unz_seek_point));
+        if (points == NULL)
+            return UNZ_INTERNALERROR;
+    }
 
-            s->pfile_in_zip_read->stream.next_in = s->pfile_in_zip_read->astream.src_ptr;
-            s->pfile_in_zip_read->stream.avail_in = s->pfile_in_zip_read->astream.src_size;
-            s->pfile_in_zip_read->stream.next_out = s->pfile_in_zip_read->astream.dst_ptr;
-            s->pfile_in_zip_read->stream.avail_out = s->pfile_in_zip_read->astream.dst_size;
+    for (i = 0; (err == UNZ_OK) && (i < number_point); i += 1)
+    {
+        point = &points[i];
+        point->window = NULL;
+        if ((uint64_t)(end - p) < SIZESEEKPOINTHEADER)
+        {
+            err = UNZ_BADZIPFILE;
+            break;
+        }
+        point->uncompressed_pos = unzReadValueFromMemoryAndMove(&p, 8);
+        point->compressed_pos = unzReadValueFromMemoryAndMove(&p, 8);
+        point->bits = (uint8_t)unzReadValueFromMemoryAndMove(&p, 1);
+        point->window_size = (uint16_t)unzReadValueFromMemoryAndMove(&p, 2);
+
+        if ((point->uncompressed_pos <= last_pos) || (point->uncompressed_pos > s->cur_file_info.uncompressed_size) ||
+            (point->compressed_pos == 0) || (point->compressed_pos > s->cur_file_info.compressed_size) ||
+            (point->bits > 7) || (point->window_size > UNZ_SEEKWINDOWSIZE) ||
+            ((uint64_t)(end - p) < point->window_size))
+        {
+            err = UNZ_BADZIPFILE;
+            break;
+        }
+        last_pos = point->uncompressed_pos;
 
-            if (status == COMPRESSION_STATUS_END)
-                return (read == 0) ? UNZ_EOF : read;
-            if (status == COMPRESSION_STATUS_ERROR)
-                return Z_DATA_ERROR;
-            return read;
+        point->window = (uint8_t*)ALLOC(UNZ_SEEKWINDOWSIZE);
+        if (point->window == NULL)
+        {
+            err = UNZ_INTERNALERROR;
+            break;
         }
-#else
-        else
+        memcpy(point->window, p, point->window_size);
+        p += point->window_size;
+    }
+
+    if (err == UNZ_OK)
+    {
+        index = unzGetFileSeekIndex(s, spacing);
+        if (index == NULL)
+            err = UNZ_INTERNALERROR;
+    }
+    if (err != UNZ_OK)
+    {
+        while (i > 0)
         {
-            uint64_t total_out_before = 0;
-            uint64_t total_out_after = 0;
-            uint64_t out_bytes = 0;
-            const uint8_t *buf_before = NULL;
-            int flush = Z_SYNC_FLUSH;
+            i -= 1;
+            TRYFREE(points[i].window);
+        }
+        TRYFREE(points);
+        return err;
+    }
 
-            total_out_before = s->pfile_in_zip_read->stream.total_out;
-            buf_before = s->pfile_in_zip_read->stream.next_out;
+    /* Replace the points in place, an opened file may be adding points to this index */
+    for (i = 0; i < index->number_point; i += 1)
+        TRYFREE(index->points[i].window);
+    TRYFREE(index->points);
+    index->spacing = spacing;
+    index->points = points;
+    index->number_point = number_point;
+    index->size_points = number_point;
+    return UNZ_OK;
+}
 
-            /*
-            if ((pfile_in_zip_read_info->rest_read_uncompressed ==
-                     pfile_in_zip_read_info->stream.avail_out) &&
-                (pfile_in_zip_read_info->rest_read_compressed == 0))
-                flush = Z_FINISH;
-            */
-            err = inflate(&s->pfile_in_zip_read->stream, flush);
+/* unz_stream_entry64_internal contain what was read of a file from its local header and data, the central
+   directory is checked against it at the end of the stream */
+typedef struct unz_stream_entry64_internal_s
+{
+    uint64_t offset_curfile;            /* position of the local header in the stream */
+    uint64_t compressed_size;
+    uint64_t uncompressed_size;
+    uint64_t name_pos;                  /* position of the file name in names */
+    uint32_t crc;
+    uint16_t size_filename;
+} unz_stream_entry64_internal;
+
+/* unz_stream_internal contain internal information about a zipfile read from start to end */
+typedef struct
+{
+    zlib_filefunc64_32_def z_filefunc;
+    voidpf filestream;                  /* io structure of the zipfile, only read from */
+
+    uint8_t *read_buffer;               /* data read from the stream */
+    uint32_t read_buffer_size;
+    uint32_t read_pos;                  /* position of the first byte not used yet in read_buffer */
+    uint32_t read_end;                  /* end of the data in read_buffer */
+    uint64_t pos_in_stream;             /* position in the stream of read_buffer[read_pos] */
+    int      end_of_stream;             /* nothing more can be read from the stream */
+
+    int      state;                     /* UNZ_STREAM_STATE_* */
+    unz_file_info64 cur_file_info;      /* public info about the current file, sizes and crc are updated
+                                           from the data descriptor once the file is read */
+    unz_file_info64_internal cur_file_info_internal;
+    char    *cur_filename;              /* null terminated name of the current file */
+    uint8_t *cur_extrafield;            /* local extra field of the current file */
+    int      cur_zip64;                 /* sizes in the data descriptor use 8 bytes */
+    int      cur_size_known;            /* sizes are in the local header */
 
-            if ((err >= 0) && (s->pfile_in_zip_read->stream.msg != NULL))
-                err = Z_DATA_ERROR;
+    z_stream stream;                    /* zLib stream structure for inflate */
+    uint8_t  stream_initialised;
+    uint8_t  inflate_initialised;       /* stream holds an inflate state kept between files */
+    uint16_t compression_method;
+    uint64_t rest_read_compressed;      /* bytes of data left when the size is known */
+    uint64_t total_in;                  /* bytes of data used, without encryption header and trailer */
+    uint64_t total_out;
+    uint32_t crc32;
+    int      data_error;                /* UNZ_CRCERROR when the authentication code is wrong */
+    uint32_t size_encryption;           /* bytes of encryption header and trailer */
+    uint8_t *plain_buffer;              /* decrypted data, the encrypted data stays in read_buffer */
+    uint32_t plain_size;                /* size of the data decrypted in plain_buffer */
+    uint32_t plain_read_pos;            /* position in read_buffer of the data decrypted in plain_buffer */
+#ifndef NOUNCRYPT
+    uint32_t keys[3];                   /* keys defining the pseudo-random sequence */
+    const z_crc_t *pcrc_32_tab;
+#endif
+#ifdef HAVE_AES
+    fcrypt_ctx aes_ctx;
+    hmac_ctx aes_auth_ctx;              /* authentication before the data in plain_buffer was decrypted */
+#endif
 
-            total_out_after = s->pfile_in_zip_read->stream.total_out;
-            out_bytes = total_out_after - total_out_before;
+    unz_stream_entry64_internal *entries;
+    uint64_t number_entry;
+    uint64_t size_entries;              /* number of entries allocated */
+    char    *names;                     /* file names of the entries, one after the other */
+    uint64_t size_names;
+    uint64_t size_names_allocated;
+    unz_global_info64 gi;               /* filled from the end of central directory */
+} unz_stream_internal;
+
+#define UNZ_STREAM_STATE_START          (0)
+#define UNZ_STREAM_STATE_HEADER         (1)     /* local header read */
+#define UNZ_STREAM_STATE_OPENED         (2)     /* reading the data of the current file */
+#define UNZ_STREAM_STATE_DATA_END       (3)     /* data of the current file read */
+#define UNZ_STREAM_STATE_END            (4)     /* central directory read */
+
+/* Make at least size bytes available at read_pos, less only at the end of the stream */
+static int unzStreamFill(unz_stream_internal *s, uint32_t size)
+{
+    uint32_t bytes_read = 0;
 
-            s->pfile_in_zip_read->total_out_64 += out_bytes;
-            s->pfile_in_zip_read->rest_read_uncompressed -= out_bytes;
-            s->pfile_in_zip_read->crc32 =
-                (uint32_t)crc32(s->pfile_in_zip_read->crc32,buf_before, (uint32_t)out_bytes);
+    if (size > s->read_buffer_size)
+        return UNZ_INTERNALERROR;
+    if (s->read_end - s->read_pos >= size)
+        return UNZ_OK;
 
-            read += (uint32_t)out_bytes;
+    if (s->read_buffer_size - s->read_pos < size)
+    {
+        memmove(s->read_buffer, s->read_buffer + s->read_pos, s->read_end - s->read_pos);
+        s->read_end -= s->read_pos;
+        s->read_pos = 0;
+    }
 
-            if (err == Z_STREAM_END)
-                return (read == 0) ? UNZ_EOF : read;
-            if (err != Z_OK)
-                break;
+    while ((s->read_end - s->read_pos < size) && (!s->end_of_stream))
+    {
+        bytes_read = ZREAD64(s->z_filefunc, s->filestream, s->read_buffer + s->read_end,
+            s->read_buffer_size - s->read_end);
+        if (bytes_read == 0)
+        {
+            if (ZERROR64(s->z_filefunc, s->filestream))
+                return UNZ_ERRNO;
+            s->end_of_stream = 1;
         }
-#endif
+        s->read_end += bytes_read;
     }
-    while (s->pfile_in_zip_read->stream.avail_out > 0);
+    return UNZ_OK;
+}
 
-    if (err == Z_OK)
-        return read;
-    return err;
+static void unzStreamSkipBuffered(unz_stream_internal *s, uint32_t size)
+{
+    s->read_pos += size;
+    s->pos_in_stream += size;
 }
 
-extern int ZEXPORT unzGetLocalExtrafield(unzFile file, voidp buf, uint32_t len)
+/* Read or skip (buf == NULL) size bytes of the stream */
+static int unzStreamReadBytes(unz_stream_internal *s, uint8_t *buf, uint64_t size)
 {
-    unz64_internal *s = NULL;
-    uint64_t size_to_read = 0;
-    uint32_t read_now = 0;
+    uint32_t bytes_to_copy = 0;
+    int err = UNZ_OK;
 
-    if (file == NULL)
-        return UNZ_PARAMERROR;
-    s = (unz64_internal*)file;
-    if (s->pfile_in_zip_read == NULL)
-        return UNZ_PARAMERROR;
+    while (size > 0)
+    {
+        if (s->read_pos == s->read_end)
+        {
+            err = unzStreamFill(s, 1);
+            if (err != UNZ_OK)
+                return err;
+            if (s->read_pos == s->read_end)
+                return UNZ_BADZIPFILE;
+        }
+        bytes_to_copy = s->read_end - s->read_pos;
+        if (bytes_to_copy > size)
+            bytes_to_copy = (uint32_t)size;
+        if (buf != NULL)
+        {
+            memcpy(buf, s->read_buffer + s->read_pos, bytes_to_copy);
+            buf += bytes_to_copy;
+        }
+        unzStreamSkipBuffered(s, bytes_to_copy);
+        size -= bytes_to_copy;
+    }
+    return UNZ_OK;
+}
 
-    size_to_read = s->pfile_in_zip_read->size_local_extrafield - s->pfile_in_zip_read->pos_local_extrafield;
+/* Check if p holds a data descriptor for the sizes, with or without its signature, and store its size */
+static int unzStreamMatchDataDescriptor(const unz_stream_internal *s, const uint8_t *p, uint32_t avail,
+    int with_magic, uint64_t compressed_size, uint64_t uncompressed_size, uint32_t *descriptor_size)
+{
+    uint32_t size_magic = (with_magic) ? 4 : 0;
+    uint32_t size_len = 0;
+    int i = 0;
 
-    if (buf == NULL)
-        return (int)size_to_read;
+    *descriptor_size = 0;
+    if (with_magic && ((avail < 4) || (unzReadValueFromMemory(p, 4) != DISKHEADERMAGIC)))
+        return 0;
 
-    if (len > size_to_read)
-        read_now = (uint32_t)size_to_read;
-    else
-        read_now = len;
+    /* Try the size of the sizes the local header tells first */
+    for (i = 0; i < 2; i += 1)
+    {
+        size_len = ((i == 0) == (s->cur_zip64 != 0)) ? 8 : 4;
+        if (avail < size_magic + 4 + size_len * 2)
+            continue;
+        if ((unzReadValueFromMemory(p + size_magic + 4, size_len) == compressed_size) &&
+            (unzReadValueFromMemory(p + size_magic + 4 + size_len, size_len) == uncompressed_size))
+        {
+            *descriptor_size = size_magic + 4 + size_len * 2;
+            return 1;
+        }
+    }
+    return 0;
+}
 
-    if (read_now == 0)
-        return 0;
+static int unzStreamReadDataDescriptor(unz_stream_internal *s, uint64_t compressed_size, uint64_t uncompressed_size)
+{
+    const uint8_t *p = NULL;
+    uint32_t descriptor_size = 0;
+    uint32_t avail = 0;
+    int with_magic = 0;
+    int err = UNZ_OK;
 
-    if (ZSEEK64(s->pfile_in_zip_read->z_filefunc, s->pfile_in_zip_read->filestream,
-        s->pfile_in_zip_read->offset_local_extrafield + s->pfile_in_zip_read->pos_local_extrafield,
-        ZLIB_FILEFUNC_SEEK_SET) != 0)
-        return UNZ_ERRNO;
+    err = unzStreamFill(s, SIZEDATADESCRIPTOR64);
+    if (err != UNZ_OK)
+        return err;
 
-    if (ZREAD64(s->pfile_in_zip_read->z_filefunc, s->pfile_in_zip_read->filestream, buf, read_now) != read_now)
-        return UNZ_ERRNO;
+    p = s->read_buffer + s->read_pos;
+    avail = s->read_end - s->read_pos;
+    /* The signature is optional */
+    for (with_magic = 1; with_magic >= 0; with_magic -= 1)
+    {
+        if (unzStreamMatchDataDescriptor(s, p, avail, with_magic, compressed_size, uncompressed_size, &descriptor_size))
+            break;
+    }
+    if (descriptor_size == 0)
+        return UNZ_BADZIPFILE;
 
-    return (int)read_now;
+    s->cur_file_info.crc = (uint32_t)unzReadValueFromMemory(p + (with_magic ? 4 : 0), 4);
+    unzStreamSkipBuffered(s, descriptor_size);
+    return UNZ_OK;
 }
 
-extern int ZEXPORT unzCloseCurrentFile(unzFile file)
+/* Check the trailer and data descriptor after the data of the current file and record it */
+static int unzStreamEndCurrentFile(unz_stream_internal *s)
 {
-    unz64_internal *s = NULL;
-    file_in_zip64_read_info_s *pfile_in_zip_read_info = NULL;
+    unz_stream_entry64_internal *entry = NULL;
+    uint64_t compressed_size = s->total_in + s->size_encryption;
     int err = UNZ_OK;
 
-    if (file == NULL)
-        return UNZ_PARAMERROR;
-    s = (unz64_internal*)file;
-    pfile_in_zip_read_info = s->pfile_in_zip_read;
-    if (pfile_in_zip_read_info == NULL)
-        return UNZ_PARAMERROR;
-
 #ifdef HAVE_AES
     if (s->cur_file_info.compression_method == AES_METHOD)
     {
         unsigned char authcode[AES_AUTHCODESIZE];
         unsigned char rauthcode[AES_AUTHCODESIZE];
 
-        if (ZREAD64(s->z_filefunc, s->filestream, authcode, AES_AUTHCODESIZE) != AES_AUTHCODESIZE)
-            return UNZ_ERRNO;
-
-        if (fcrypt_end(rauthcode, &s->pfile_in_zip_read->aes_ctx) != AES_AUTHCODESIZE)
-            err = UNZ_CRCERROR;
-        if (memcmp(authcode, rauthcode, AES_AUTHCODESIZE) != 0)
-            err = UNZ_CRCERROR;
+        err = unzStreamReadBytes(s, authcode, AES_AUTHCODESIZE);
+        if (err != UNZ_OK)
+            return err;
+        if ((fcrypt_end(rauthcode, &s->aes_ctx) != AES_AUTHCODESIZE) ||
+            (memcmp(authcode, rauthcode, AES_AUTHCODESIZE) != 0))
+            s->data_error = UNZ_CRCERROR;
     }
-    /* AES zip version AE-1 will expect a valid crc as well */
-    if ((s->cur_file_info.compression_method != AES_METHOD) ||
-        (s->cur_file_info_internal.aes_version == 0x0001))
 #endif
+
+    if ((s->cur_file_info.flag & 8) != 0)
     {
-        if ((pfile_in_zip_read_info->rest_read_uncompressed == 0) &&
-            (!pfile_in_zip_read_info->raw))
+        err = unzStreamReadDataDescriptor(s, compressed_size, s->total_out);
+        if (err != UNZ_OK)
+            return err;
+    }
+
+    s->cur_file_info.compressed_size = compressed_size;
+    s->cur_file_info.uncompressed_size = s->total_out;
+    entry = &s->entries[s->number_entry - 1];
+    entry->compressed_size = compressed_size;
+    entry->uncompressed_size = s->total_out;
+    entry->crc = s->cur_file_info.crc;
+
+    s->state = UNZ_STREAM_STATE_DATA_END;
+    return UNZ_OK;
+}
+
+static int unzStreamAddEntry(unz_stream_internal *s)
+{
+    unz_stream_entry64_internal *entries = NULL;
+    unz_stream_entry64_internal *entry = NULL;
+    char *names = NULL;
+    uint64_t size_entries = 0;
+    uint64_t size_names = 0;
+
+    if (s->number_entry == s->size_entries)
+    {
+        size_entries = (s->size_entries == 0) ? 64 : s->size_entries * 2;
+        entries = (unz_stream_entry64_internal*)ALLOC((size_t)size_entries * sizeof(unz_stream_entry64_internal));
+        if (entries == NULL)
+            return UNZ_INTERNALERROR;
+        if (s->number_entry > 0)
+            memcpy(entries, s->entries, (size_t)s->number_entry * sizeof(unz_stream_entry64_internal));
+        TRYFREE(s->entries);
+        s->entries = entries;
+        s->size_entries = size_entries;
+    }
+    if (s->size_names + s->cur_file_info.size_filename > s->size_names_allocated)
+    {
+        size_names = (s->size_names_allocated == 0) ? 4096 : s->size_names_allocated * 2;
+        while (size_names < s->size_names + s->cur_file_info.size_filename)
+            size_names *= 2;
+        names = (char*)ALLOC((size_t)size_names);
+        if (names == NULL)
+            return UNZ_INTERNALERROR;
+        if (s->size_names > 0)
+            memcpy(names, s->names, (size_t)s->size_names);
+        TRYFREE(s->names);
+        s->names = names;
+        s->size_names_allocated = size_names;
+    }
+
+    entry = &s->entries[s->number_entry];
+    entry->offset_curfile = s->cur_file_info_internal.offset_curfile;
+    entry->compressed_size = s->cur_file_info.compressed_size;
+    entry->uncompressed_size = s->cur_file_info.uncompressed_size;
+    entry->crc = s->cur_file_info.crc;
+    entry->name_pos = s->size_names;
+    entry->size_filename = s->cur_file_info.size_filename;
+    memcpy(s->names + s->size_names, s->cur_filename, s->cur_file_info.size_filename);
+    s->size_names += s->cur_file_info.size_filename;
+    s->number_entry += 1;
+    return UNZ_OK;
+}
+
+static int unzStreamReadLocalHeader(unz_stream_internal *s)
+{
+    const uint8_t *p = NULL;
+    const uint8_t *extra = NULL;
+    uint32_t extra_pos = 0;
+    uint16_t extra_header_id = 0;
+    uint16_t extra_data_size = 0;
+    int err = UNZ_OK;
+
+    memset(&s->cur_file_info, 0, sizeof(s->cur_file_info));
+    memset(&s->cur_file_info_internal, 0, sizeof(s->cur_file_info_internal));
+    s->cur_file_info_internal.offset_curfile = s->pos_in_stream;
+
+    err = unzStreamFill(s, SIZEZIPLOCALHEADER);
+    if (err != UNZ_OK)
+        return err;
+    if (s->read_end - s->read_pos < SIZEZIPLOCALHEADER)
+        return UNZ_BADZIPFILE;
+
+    p = s->read_buffer + s->read_pos + 4;
+    s->cur_file_info.version_needed = (uint16_t)unzReadValueFromMemoryAndMove(&p, 2);
+    s->cur_file_info.flag = (uint16_t)unzReadValueFromMemoryAndMove(&p, 2);
+    s->cur_file_info.compression_method = (uint16_t)unzReadValueFromMemoryAndMove(&p, 2);
+    s->cur_file_info.dos_date = (uint32_t)unzReadValueFromMemoryAndMove(&p, 4);
+    s->cur_file_info.crc = (uint32_t)unzReadValueFromMemoryAndMove(&p, 4);
+    s->cur_file_info.compressed_size = unzReadValueFromMemoryAndMove(&p, 4);
+    s->cur_file_info.uncompressed_size = unzReadValueFromMemoryAndMove(&p, 4);
+    s->cur_file_info.size_filename = (uint16_t)unzReadValueFromMemoryAndMove(&p, 2);
+    s->cur_file_info.size_file_extra = (uint16_t)unzReadValueFromMemoryAndMove(&p, 2);
+    unzStreamSkipBuffered(s, SIZEZIPLOCALHEADER);
+
+    err = unzStreamReadBytes(s, (uint8_t*)s->cur_filename, s->cur_file_info.size_filename);
+    if (err == UNZ_OK)
+        err = unzStreamReadBytes(s, s->cur_extrafield, s->cur_file_info.size_file_extra);
+    if (err != UNZ_OK)
+        return err;
+    s->cur_filename[s->cur_file_info.size_filename] = 0;
+
+    /* Zip64 sizes of the local header come with both sizes, the data descriptor uses 8 bytes sizes with them */
+    s->cur_zip64 = (s->cur_file_info.version_needed >= 45);
+    extra = s->cur_extrafield;
+    while (extra_pos + 4 <= s->cur_file_info.size_file_extra)
+    {
+        p = extra + extra_pos;
+        extra_header_id = (uint16_t)unzReadValueFromMemoryAndMove(&p, 2);
+        extra_data_size = (uint16_t)unzReadValueFromMemoryAndMove(&p, 2);
+
+        if (extra_pos + 4 + extra_data_size > s->cur_file_info.size_file_extra)
+            return UNZ_BADZIPFILE;
+
+        if ((extra_header_id == 0x0001) && (extra_data_size >= 16))
         {
-            if (pfile_in_zip_read_info->crc32 != pfile_in_zip_read_info->crc32_expected)
-                err = UNZ_CRCERROR;
+            s->cur_zip64 = 1;
+            s->cur_file_info.uncompressed_size = unzReadValueFromMemoryAndMove(&p, 8);
+            s->cur_file_info.compressed_size = unzReadValueFromMemoryAndMove(&p, 8);
         }
+#ifdef HAVE_AES
+        else if (extra_header_id == 0x9901)
+        {
+            if ((extra_data_size < 7) || (p[2] != 'A') || (p[3] != 'E'))
+                return UNZ_BADZIPFILE;
+            s->cur_file_info_internal.aes_version = (uint16_t)unzReadValueFromMemory(p, 2);
+            s->cur_file_info_internal.aes_encryption_mode = (uint8_t)unzReadValueFromMemory(p + 4, 1);
+            s->cur_file_info_internal.aes_compression_method = (uint16_t)unzReadValueFromMemory(p + 5, 2);
+        }
+#endif
+        extra_pos += 4 + extra_data_size;
     }
 
-    TRYFREE(pfile_in_zip_read_info->read_buffer);
-    pfile_in_zip_read_info->read_buffer = NULL;
-    if (pfile_in_zip_read_info->stream_initialised == Z_DEFLATED)
+    /* Sizes can be in the local header even with a data descriptor */
+    s->cur_size_known = ((s->cur_file_info.flag & 8) == 0);
+    if ((!s->cur_size_known) && (s->cur_file_info.compressed_size != 0) &&
+        (s->cur_file_info.compressed_size != UINT32_MAX))
+        s->cur_size_known = 1;
+    if (!s->cur_size_known)
     {
-#ifdef HAVE_APPLE_COMPRESSION
-        if (compression_stream_destroy)
-            compression_stream_destroy(&pfile_in_zip_read_info->astream);
-#else
-        inflateEnd(&pfile_in_zip_read_info->stream);
-#endif
-        
+        s->cur_file_info.crc = 0;
+        s->cur_file_info.compressed_size = 0;
+        s->cur_file_info.uncompressed_size = 0;
     }
-#ifdef HAVE_BZIP2
-    else if (pfile_in_zip_read_info->stream_initialised == Z_BZIP2ED)
-        BZ2_bzDecompressEnd(&pfile_in_zip_read_info->bstream);
-#endif
 
-    pfile_in_zip_read_info->stream_initialised = 0;
-    TRYFREE(pfile_in_zip_read_info);
+    err = unzStreamAddEntry(s);
+    if (err != UNZ_OK)
+        return err;
+    s->state = UNZ_STREAM_STATE_HEADER;
+    return UNZ_OK;
+}
 
-    s->pfile_in_zip_read = NULL;
+/* Skip the lookup index written by zipSetLookupIndex in front of the central directory */
+static int unzStreamSkipLookupIndex(unz_stream_internal *s)
+{
+    uint8_t header[SIZELOOKUPINDEXHEADER];
+    const uint8_t *p = NULL;
+    uint64_t number_entry = 0;
+    uint64_t slot_count = 0;
+    uint64_t index_size = 0;
+    uint32_t pad = 0;
+    int err = UNZ_OK;
 
-    return err;
+    err = unzStreamReadBytes(s, header, SIZELOOKUPINDEXHEADER);
+    if (err != UNZ_OK)
+        return err;
+    p = header + 4;
+    if (unzReadValueFromMemoryAndMove(&p, 2) != LOOKUPINDEXVERSION)
+        return UNZ_BADZIPFILE;
+    if (unzReadValueFromMemoryAndMove(&p, 2) != SIZELOOKUPINDEXENTRY)
+        return UNZ_BADZIPFILE;
+    number_entry = unzReadValueFromMemoryAndMove(&p, 8);
+    p += 8 + 8; /* offset and size of the central directory */
+    slot_count = unzReadValueFromMemoryAndMove(&p, 8);
+    p += 8 + 8; /* size and modification time of the zipfile */
+    pad = (uint32_t)unzReadValueFromMemoryAndMove(&p, 4);
+    /* The index describes the files read before it, its size comes from the counts as in unzLoadLookupIndex */
+    if ((number_entry != s->number_entry) || (slot_count <= number_entry) ||
+        ((slot_count & (slot_count - 1)) != 0) || (slot_count > UINT32_MAX) || (pad >= 8))
+        return UNZ_BADZIPFILE;
+
+    index_size = unzLookupIndexSize(number_entry, slot_count, pad);
+    err = unzStreamReadBytes(s, NULL, index_size - SIZELOOKUPINDEXHEADER - SIZELOOKUPLOCATOR);
+    if (err == UNZ_OK)
+        err = unzStreamReadBytes(s, header, SIZELOOKUPLOCATOR);
+    if (err != UNZ_OK)
+        return err;
+    p = header;
+    if (unzReadValueFromMemoryAndMove(&p, 4) != LOOKUPLOCATORMAGIC)
+        return UNZ_BADZIPFILE;
+    p += 4;
+    if (unzReadValueFromMemoryAndMove(&p, 8) != index_size)
+        return UNZ_BADZIPFILE;
+    return UNZ_OK;
 }
 
-extern int ZEXPORT unzGoToFirstFile2(unzFile file, unz_file_info64 *pfile_info, char *filename,
-    uint16_t filename_size, void *extrafield, uint16_t extrafield_size, char *comment, uint16_t comment_size)
+/* Read the central directory and check it describes the files read before it */
+static int unzStreamReadCentralDir(unz_stream_internal *s)
 {
-    unz64_internal *s = NULL;
+    unz_entry64_internal entry;
+    unz_stream_entry64_internal *local = NULL;
+    uint8_t *header = NULL;
+    const uint8_t *p = NULL;
+    uint64_t offset_central_dir = s->pos_in_stream;
+    uint64_t number_entry = 0;
+    uint64_t number_entry_CD = 0;
+    uint64_t offset_central_dir_CD = 0;
+    uint32_t header_size = 0;
+    uint32_t variable_size = 0;
+    uint32_t magic = 0;
+    int is_zip64 = 0;
     int err = UNZ_OK;
 
-    if (file == NULL)
-        return UNZ_PARAMERROR;
-    s = (unz64_internal*)file;
+    header = (uint8_t*)ALLOC(SIZECENTRALDIRITEM + 3 * UINT16_MAX);
+    if (header == NULL)
+        return UNZ_INTERNALERROR;
 
-    if (s->gi.number_entry == 0)
-        return UNZ_END_OF_LIST_OF_FILE;
+    while (err == UNZ_OK)
+    {
+        err = unzStreamFill(s, 4);
+        if ((err == UNZ_OK) && (s->read_end - s->read_pos < 4))
+            err = UNZ_BADZIPFILE;
+        if (err != UNZ_OK)
+            break;
+        magic = (uint32_t)unzReadValueFromMemory(s->read_buffer + s->read_pos, 4);
+        if (magic != CENTRALHEADERMAGIC)
+            break;
 
-    s->pos_in_central_dir = s->offset_central_dir;
-    s->num_file = 0;
+        err = unzStreamReadBytes(s, header, SIZECENTRALDIRITEM);
+        if (err != UNZ_OK)
+            break;
+        variable_size = (uint32_t)unzReadValueFromMemory(header + 28, 2) + (uint32_t)unzReadValueFromMemory(header + 30, 2) +
+            (uint32_t)unzReadValueFromMemory(header + 32, 2);
+        err = unzStreamReadBytes(s, header + SIZECENTRALDIRITEM, variable_size);
+        if (err == UNZ_OK)
+            err = unzDecodeCentralDirHeader(header, SIZECENTRALDIRITEM + variable_size, &entry, &header_size);
+        if (err != UNZ_OK)
+            break;
 
-    err = unzGetCurrentFileInfoInternal(file, &s->cur_file_info, &s->cur_file_info_internal,
-            filename, filename_size, extrafield, extrafield_size, comment,comment_size);
+        if (number_entry >= s->number_entry)
+        {
+            err = UNZ_BADZIPFILE;
+            break;
+        }
+        local = &s->entries[number_entry];
+        if ((entry.offset_curfile != local->offset_curfile) ||
+            (entry.compressed_size != local->compressed_size) ||
+            (entry.uncompressed_size != local->uncompressed_size) ||
+            (entry.crc != local->crc) || (entry.size_filename != local->size_filename) ||
+            (memcmp(header + SIZECENTRALDIRITEM, s->names + local->name_pos, local->size_filename) != 0))
+            err = UNZ_BADZIPFILE;
+        number_entry += 1;
+    }
 
-    s->current_file_ok = (err == UNZ_OK);
-    if ((err == UNZ_OK) && (pfile_info != NULL))
-        memcpy(pfile_info, &s->cur_file_info, sizeof(unz_file_info64));
+    if ((err == UNZ_OK) && (magic == ZIP64ENDHEADERMAGIC))
+    {
+        /* Zip64 end of central directory record followed by its locator */
+        is_zip64 = 1;
+        err = unzStreamReadBytes(s, header, SIZECENTRALDIREND64);
+        if (err == UNZ_OK)
+        {
+            p = header + 12 + 2 + 2 + 4 + 4 + 8;
+            number_entry_CD = unzReadValueFromMemoryAndMove(&p, 8);
+            p += 8; /* size of the central directory */
+            offset_central_dir_CD = unzReadValueFromMemoryAndMove(&p, 8);
+            /* Skip the zip64 extensible data sector */
+            err = unzStreamReadBytes(s, NULL, unzReadValueFromMemory(header + 4, 8) + 12 - SIZECENTRALDIREND64);
+        }
+        if (err == UNZ_OK)
+            err = unzStreamReadBytes(s, header, SIZECENTRALHEADERLOCATOR);
+        if ((err == UNZ_OK) && (unzReadValueFromMemory(header, 4) != ZIP64ENDLOCHEADERMAGIC))
+            err = UNZ_BADZIPFILE;
+        if (err == UNZ_OK)
+        {
+            err = unzStreamFill(s, 4);
+            if ((err == UNZ_OK) && (s->read_end - s->read_pos < 4))
+                err = UNZ_BADZIPFILE;
+        }
+        if (err == UNZ_OK)
+            magic = (uint32_t)unzReadValueFromMemory(s->read_buffer + s->read_pos, 4);
+    }
+
+    if ((err == UNZ_OK) && (magic != ENDHEADERMAGIC))
+        err = UNZ_BADZIPFILE;
+    if (err == UNZ_OK)
+        err = unzStreamReadBytes(s, header, SIZECENTRALDIREND);
+    if (err == UNZ_OK)
+    {
+        p = header + 4 + 2 + 2 + 2;
+        if (!is_zip64)
+            number_entry_CD = unzReadValueFromMemory(p, 2);
+        p += 2 + 4;
+        if (!is_zip64)
+            offset_central_dir_CD = unzReadValueFromMemory(p, 4);
+        p += 4;
+        s->gi.size_comment = (uint16_t)unzReadValueFromMemory(p, 2);
+        s->gi.number_entry = number_entry_CD;
+        s->gi.number_disk_with_CD = 0;
+
+        if ((number_entry != s->number_entry) || (number_entry_CD != number_entry) ||
+            (offset_central_dir_CD != offset_central_dir))
+            err = UNZ_BADZIPFILE;
+    }
+    if (err == UNZ_OK)
+        err = unzStreamReadBytes(s, NULL, s->gi.size_comment);
 
+    TRYFREE(header);
     return err;
 }
 
-extern int ZEXPORT unzGoToFirstFile(unzFile file)
+extern unzStream ZEXPORT unzStreamOpen(const void *path, zlib_filefunc64_def *pzlib_filefunc_def)
 {
-    return unzGoToFirstFile2(file, NULL, NULL, 0, NULL, 0, NULL, 0);
+    unz_stream_internal *s = NULL;
+
+    s = (unz_stream_internal*)ALLOC(sizeof(unz_stream_internal));
+    if (s == NULL)
+        return NULL;
+    memset(s, 0, sizeof(unz_stream_internal));
+
+    if (pzlib_filefunc_def == NULL)
+        fill_fopen64_filefunc(&s->z_filefunc.zfile_func64);
+    else
+        s->z_filefunc.zfile_func64 = *pzlib_filefunc_def;
+    s->z_filefunc.zseek32_file = NULL;
+    s->z_filefunc.ztell32_file = NULL;
+
+    s->read_buffer_size = UNZ_BUFSIZE;
+    s->read_buffer = (uint8_t*)ALLOC(s->read_buffer_size);
+    s->cur_filename = (char*)ALLOC(UINT16_MAX + 1);
+    s->cur_extrafield = (uint8_t*)ALLOC(UINT16_MAX);
+    if ((s->read_buffer != NULL) && (s->cur_filename != NULL) && (s->cur_extrafield != NULL))
+        s->filestream = ZOPEN64(s->z_filefunc, path, ZLIB_FILEFUNC_MODE_READ | ZLIB_FILEFUNC_MODE_EXISTING);
+    if (s->filestream == NULL)
+    {
+        TRYFREE(s->read_buffer);
+        TRYFREE(s->cur_filename);
+        TRYFREE(s->cur_extrafield);
+        TRYFREE(s);
+        return NULL;
+    }
+    return (unzStream)s;
 }
 
-extern int ZEXPORT unzGoToNextFile2(unzFile file, unz_file_info64 *pfile_info, char *filename,
-    uint16_t filename_size, void *extrafield, uint16_t extrafield_size, char *comment, uint16_t comment_size)
+extern int ZEXPORT unzStreamOpenCurrentFile(unzStream stream, const char *password)
 {
-    unz64_internal *s = NULL;
+    unz_stream_internal *s = NULL;
     int err = UNZ_OK;
 
-    if (file == NULL)
+    if (stream == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz_stream_internal*)stream;
+    if (s->state != UNZ_STREAM_STATE_HEADER)
         return UNZ_PARAMERROR;
-    s = (unz64_internal*)file;
 
-    if (!s->current_file_ok)
-        return UNZ_END_OF_LIST_OF_FILE;
-    if (s->gi.number_entry != UINT16_MAX)    /* 2^16 files overflow hack */
+    s->compression_method = s->cur_file_info.compression_method;
+#ifdef HAVE_AES
+    if (s->compression_method == AES_METHOD)
+        s->compression_method = s->cur_file_info_internal.aes_compression_method;
+#endif
+    if ((s->compression_method != 0) && (s->compression_method != Z_DEFLATED))
+        return UNZ_BADZIPFILE;
+    if (((s->cur_file_info.flag & 1) != 0) && (password == NULL))
+        return UNZ_PARAMERROR;
+
+    s->rest_read_compressed = s->cur_file_info.compressed_size;
+    s->total_in = 0;
+    s->total_out = 0;
+    s->crc32 = 0;
+    s->data_error = UNZ_OK;
+    s->size_encryption = 0;
+    s->plain_size = 0;
+    s->plain_read_pos = 0;
+
+#ifndef NOUNCRYPT
+    if ((s->cur_file_info.flag & 1) != 0)
     {
-        if (s->num_file+1 == s->gi.number_entry)
-            return UNZ_END_OF_LIST_OF_FILE;
-    }
+        if (s->plain_buffer == NULL)
+            s->plain_buffer = (uint8_t*)ALLOC(s->read_buffer_size);
+        if (s->plain_buffer == NULL)
+            return UNZ_INTERNALERROR;
+#ifdef HAVE_AES
+        if (s->cur_file_info.compression_method == AES_METHOD)
+        {
+            unsigned char passverify_archive[AES_PWVERIFYSIZE];
+            unsigned char passverify_password[AES_PWVERIFYSIZE];
+            unsigned char salt_value[AES_MAXSALTLENGTH];
+            uint32_t salt_length = 0;
 
-    s->pos_in_central_dir += SIZECENTRALDIRITEM + s->cur_file_info.size_filename +
-            s->cur_file_info.size_file_extra + s->cur_file_info.size_file_comment;
-    s->num_file += 1;
+            if ((s->cur_file_info_internal.aes_encryption_mode < 1) ||
+                (s->cur_file_info_internal.aes_encryption_mode > 3))
+                return UNZ_INTERNALERROR;
 
-    err = unzGetCurrentFileInfoInternal(file, &s->cur_file_info, &s->cur_file_info_internal,
-            filename, filename_size, extrafield,extrafield_size, comment, comment_size);
+            salt_length = SALT_LENGTH(s->cur_file_info_internal.aes_encryption_mode);
+            err = unzStreamReadBytes(s, salt_value, salt_length);
+            if (err == UNZ_OK)
+                err = unzStreamReadBytes(s, passverify_archive, AES_PWVERIFYSIZE);
+            if (err != UNZ_OK)
+                return err;
 
-    s->current_file_ok = (err == UNZ_OK);
-    if ((err == UNZ_OK) && (pfile_info != NULL))
-        memcpy(pfile_info, &s->cur_file_info, sizeof(unz_file_info64));
+            fcrypt_init(s->cur_file_info_internal.aes_encryption_mode, (uint8_t *)password,
+                (uint32_t)strlen(password), salt_value, passverify_password, &s->aes_ctx);
 
-    return err;
+            if (memcmp(passverify_archive, passverify_password, AES_PWVERIFYSIZE) != 0)
+                return UNZ_BADPASSWORD;
+
+            s->size_encryption = salt_length + AES_PWVERIFYSIZE + AES_AUTHCODESIZE;
+        }
+        else
+#endif
+        {
+            uint8_t source[12];
+            uint8_t verify = 0;
+            int i;
+
+            s->pcrc_32_tab = (const z_crc_t*)get_crc_table();
+            init_keys(password, s->keys, s->pcrc_32_tab);
+
+            err = unzStreamReadBytes(s, source, 12);
+            if (err != UNZ_OK)
+                return err;
+            for (i = 0; i < 12; i++)
+                zdecode(s->keys, s->pcrc_32_tab, source[i]);
+
+            /* Last byte of the header is the high byte of the crc, or of the time with a data descriptor */
+            verify = (uint8_t)(s->cur_file_info.crc >> 24);
+            if ((s->cur_file_info.flag & 8) != 0)
+                verify = (uint8_t)(s->cur_file_info.dos_date >> 8);
+            if (source[11] != verify)
+                return UNZ_BADPASSWORD;
+
+            s->size_encryption = 12;
+        }
+        if (s->cur_size_known)
+        {
+            if (s->rest_read_compressed < s->size_encryption)
+                return UNZ_BADZIPFILE;
+            s->rest_read_compressed -= s->size_encryption;
+        }
+    }
+#else
+    if ((s->cur_file_info.flag & 1) != 0)
+        return UNZ_PARAMERROR;
+#endif
+
+    s->stream.next_in = NULL;
+    s->stream.avail_in = 0;
+    if (s->compression_method == Z_DEFLATED)
+    {
+        if (s->inflate_initialised)
+        {
+            if (inflateReset(&s->stream) != Z_OK)
+                return UNZ_INTERNALERROR;
+        }
+        else
+        {
+            s->stream.zalloc = (alloc_func)0;
+            s->stream.zfree = (free_func)0;
+            s->stream.opaque = (voidpf)s;
+            if (inflateInit2(&s->stream, -MAX_WBITS) != Z_OK)
+                return UNZ_INTERNALERROR;
+            s->inflate_initialised = 1;
+        }
+        s->stream_initialised = Z_DEFLATED;
+    }
+
+    s->state = UNZ_STREAM_STATE_OPENED;
+    return UNZ_OK;
 }
 
-extern int ZEXPORT unzGoToNextFile(unzFile file)
+static void unzStreamDecrypt(unz_stream_internal *s, uint8_t *buf, uint32_t size)
 {
-    return unzGoToNextFile2(file, NULL, NULL, 0, NULL, 0, NULL, 0);
+#ifndef NOUNCRYPT
+    uint32_t i = 0;
+
+#ifdef HAVE_AES
+    if (s->cur_file_info.compression_method == AES_METHOD)
+    {
+        fcrypt_decrypt(buf, size, &s->aes_ctx);
+        return;
+    }
+#endif
+    for (i = 0; i < size; i++)
+        buf[i] = zdecode(s->keys, s->pcrc_32_tab, buf[i]);
+#endif
 }
 
-extern int ZEXPORT unzLocateFile(unzFile file, const char *filename, unzFileNameComparer filename_compare_func)
+/* Read stored data whose size is only known from the data descriptor that follows it */
+static int unzStreamReadStoredUntilDescriptor(unz_stream_internal *s, uint8_t *buf, uint32_t len, uint32_t *read)
 {
-    unz64_internal *s = NULL;
-    unz_file_info64 cur_file_info_saved;
-    unz_file_info64_internal cur_file_info_internal_saved;
-    uint64_t num_file_saved = 0;
-    uint64_t pos_in_central_dir_saved = 0;
-    char current_filename[UNZ_MAXFILENAMEINZIP+1];
+    const uint8_t *p = NULL;
+    const uint8_t *candidate = NULL;
+    uint32_t size_trailer = 0;
+    uint32_t descriptor_size = 0;
+    uint32_t avail = 0;
+    uint32_t copy = 0;
+    uint32_t crc = 0;
     int err = UNZ_OK;
 
-    if (file == NULL)
-        return UNZ_PARAMERROR;
-    if (strlen(filename) >= UNZ_MAXFILENAMEINZIP)
-        return UNZ_PARAMERROR;
-    s = (unz64_internal*)file;
-    if (!s->current_file_ok)
-        return UNZ_END_OF_LIST_OF_FILE;
-
-    /* Save the current state */
-    num_file_saved = s->num_file;
-    pos_in_central_dir_saved = s->pos_in_central_dir;
-    cur_file_info_saved = s->cur_file_info;
-    cur_file_info_internal_saved = s->cur_file_info_internal;
+    *read = 0;
+#ifdef HAVE_AES
+    /* Authentication code is between the data and the descriptor */
+    if (s->cur_file_info.compression_method == AES_METHOD)
+        size_trailer = AES_AUTHCODESIZE;
+#endif
 
-    err = unzGoToFirstFile2(file, NULL, current_filename, sizeof(current_filename)-1, NULL, 0, NULL, 0);
+    err = unzStreamFill(s, size_trailer + SIZEDATADESCRIPTOR64);
+    if (err != UNZ_OK)
+        return err;
+    p = s->read_buffer + s->read_pos;
+    avail = s->read_end - s->read_pos;
 
-    while (err == UNZ_OK)
+    /* Data ends where the descriptor matches the data read so far, AE-2 does not store the crc */
+    if ((avail > size_trailer) && unzStreamMatchDataDescriptor(s, p + size_trailer, avail - size_trailer, 1,
+            s->total_in + s->size_encryption, s->total_out, &descriptor_size))
     {
-        if (filename_compare_func != NULL)
-            err = filename_compare_func(file, current_filename, filename);
-        else
-            err = strcmp(current_filename, filename);
-        if (err == 0)
-            return UNZ_OK;
-        err = unzGoToNextFile2(file, NULL, current_filename, sizeof(current_filename)-1, NULL, 0, NULL, 0);
+        crc = (uint32_t)unzReadValueFromMemory(p + size_trailer + 4, 4);
+        if ((crc == s->crc32) || ((size_trailer > 0) && (crc == 0)))
+            return UNZ_END_OF_LIST_OF_FILE;
     }
 
-    /* We failed, so restore the state of the 'current file' to where we were. */
-    s->num_file = num_file_saved;
-    s->pos_in_central_dir = pos_in_central_dir_saved;
-    s->cur_file_info = cur_file_info_saved;
-    s->cur_file_info_internal = cur_file_info_internal_saved;
-    return err;
-}
+    /* Stream ends before the data descriptor */
+    if (avail <= size_trailer + 3)
+        return UNZ_BADZIPFILE;
 
-extern int ZEXPORT unzGetFilePos(unzFile file, unz_file_pos *file_pos)
-{
-    unz64_file_pos file_pos64;
-    int err = unzGetFilePos64(file, &file_pos64);
-    if (err == UNZ_OK)
+    /* Keep what could be the start of the trailer and signature for the next read */
+    copy = avail - (size_trailer + 3);
+    for (candidate = p + size_trailer + 1; candidate < p + avail - 3; candidate += 1)
     {
-        file_pos->pos_in_zip_directory = (uint32_t)file_pos64.pos_in_zip_directory;
-        file_pos->num_of_file = (uint32_t)file_pos64.num_of_file;
+        if ((candidate[0] == 0x50) && (unzReadValueFromMemory(candidate, 4) == DISKHEADERMAGIC))
+        {
+            copy = (uint32_t)(candidate - p) - size_trailer;
+            break;
+        }
     }
-    return err;
+    if (copy > len)
+        copy = len;
+
+    memcpy(buf, p, copy);
+    if ((s->cur_file_info.flag & 1) != 0)
+        unzStreamDecrypt(s, buf, copy);
+    unzStreamSkipBuffered(s, copy);
+    s->total_in += copy;
+    *read = copy;
+    return UNZ_OK;
 }
 
-extern int ZEXPORT unzGoToFilePos(unzFile file, unz_file_pos *file_pos)
+extern int ZEXPORT unzStreamReadCurrentFile(unzStream stream, voidp buf, uint32_t len)
 {
-    unz64_file_pos file_pos64;
-    if (file_pos == NULL)
+    unz_stream_internal *s = NULL;
+    uint32_t read = 0;
+    uint32_t copy = 0;
+    uint32_t avail_in_before = 0;
+    uint32_t bytes_used = 0;
+    uint64_t total_out_before = 0;
+    int encrypted = 0;
+    int data_end = 0;
+    int err = UNZ_OK;
+
+    if (stream == NULL)
         return UNZ_PARAMERROR;
-    file_pos64.pos_in_zip_directory = file_pos->pos_in_zip_directory;
-    file_pos64.num_of_file = file_pos->num_of_file;
-    return unzGoToFilePos64(file, &file_pos64);
-}
+    s = (unz_stream_internal*)stream;
+    if (s->state == UNZ_STREAM_STATE_DATA_END)
+        return UNZ_EOF;
+    if (s->state != UNZ_STREAM_STATE_OPENED)
+        return UNZ_PARAMERROR;
+    if (len > INT32_MAX)
+        len = INT32_MAX;
 
-extern int ZEXPORT unzGetFilePos64(unzFile file, unz64_file_pos *file_pos)
-{
-    unz64_internal *s = NULL;
+    encrypted = ((s->cur_file_info.flag & 1) != 0);
+    s->stream.next_out = (uint8_t*)buf;
+    s->stream.avail_out = len;
 
-    if (file == NULL || file_pos == NULL)
-        return UNZ_PARAMERROR;
-    s = (unz64_internal*)file;
-    if (!s->current_file_ok)
-        return UNZ_END_OF_LIST_OF_FILE;
+    while ((s->stream.avail_out > 0) && (!data_end))
+    {
+        if (s->compression_method == 0)
+        {
+            if (s->cur_size_known)
+            {
+                if (s->rest_read_compressed == 0)
+                {
+                    data_end = 1;
+                    break;
+                }
+                err = unzStreamFill(s, 1);
+                if ((err == UNZ_OK) && (s->read_pos == s->read_end))
+                    err = UNZ_BADZIPFILE;
+                if (err != UNZ_OK)
+                    return err;
+
+                copy = s->read_end - s->read_pos;
+                if (copy > s->stream.avail_out)
+                    copy = s->stream.avail_out;
+                if (copy > s->rest_read_compressed)
+                    copy = (uint32_t)s->rest_read_compressed;
+
+                memcpy(s->stream.next_out, s->read_buffer + s->read_pos, copy);
+                if (encrypted)
+                    unzStreamDecrypt(s, s->stream.next_out, copy);
+                unzStreamSkipBuffered(s, copy);
+                s->total_in += copy;
+                s->rest_read_compressed -= copy;
+            }
+            else
+            {
+                err = unzStreamReadStoredUntilDescriptor(s, s->stream.next_out, s->stream.avail_out, &copy);
+                if (err == UNZ_END_OF_LIST_OF_FILE)
+                {
+                    data_end = 1;
+                    break;
+                }
+                if (err != UNZ_OK)
+                    return err;
+            }
 
-    file_pos->pos_in_zip_directory  = s->pos_in_central_dir;
-    file_pos->num_of_file = s->num_file;
-    return UNZ_OK;
-}
+            s->crc32 = crc32_fast(s->crc32, s->stream.next_out, copy);
+            s->total_out += copy;
+            s->stream.next_out += copy;
+            s->stream.avail_out -= copy;
+            read += copy;
+            continue;
+        }
 
-extern int ZEXPORT unzGoToFilePos64(unzFile file, const unz64_file_pos *file_pos)
-{
-    unz64_internal *s = NULL;
-    int err = UNZ_OK;
+        if (s->stream.avail_in == 0)
+        {
+            if (s->cur_size_known && (s->rest_read_compressed == 0))
+                return Z_DATA_ERROR;
+            err = unzStreamFill(s, 1);
+            if ((err == UNZ_OK) && (s->read_pos == s->read_end))
+                err = UNZ_BADZIPFILE;
+            if (err != UNZ_OK)
+                return err;
 
-    if (file == NULL || file_pos == NULL)
-        return UNZ_PARAMERROR;
-    s = (unz64_internal*)file;
+            copy = s->read_end - s->read_pos;
+            if (s->cur_size_known && (copy > s->rest_read_compressed))
+                copy = (uint32_t)s->rest_read_compressed;
 
-    /* Jump to the right spot */
-    s->pos_in_central_dir = file_pos->pos_in_zip_directory;
-    s->num_file = file_pos->num_of_file;
+            if (encrypted)
+            {
+                /* Keep the encrypted data in read_buffer, what is not used by inflate is put back */
+#ifdef HAVE_AES
+                s->aes_auth_ctx = s->aes_ctx.auth_ctx[0];
+#endif
+                memcpy(s->plain_buffer, s->read_buffer + s->read_pos, copy);
+                unzStreamDecrypt(s, s->plain_buffer, copy);
+                s->plain_size = copy;
+                s->plain_read_pos = s->read_pos;
+                unzStreamSkipBuffered(s, copy);
+                s->stream.next_in = s->plain_buffer;
+            }
+            else
+            {
+                s->stream.next_in = s->read_buffer + s->read_pos;
+            }
+            s->stream.avail_in = copy;
+        }
 
-    /* Set the current file */
-    err = unzGetCurrentFileInfoInternal(file, &s->cur_file_info, &s->cur_file_info_internal, NULL, 0, NULL, 0, NULL, 0);
-    /* Return results */
-    s->current_file_ok = (err == UNZ_OK);
-    return err;
-}
+        avail_in_before = s->stream.avail_in;
+        total_out_before = s->stream.total_out;
 
-extern int32_t ZEXPORT unzGetOffset(unzFile file)
-{
-    uint64_t offset64 = 0;
+        err = inflate(&s->stream, Z_SYNC_FLUSH);
+        if ((err >= 0) && (s->stream.msg != NULL))
+            err = Z_DATA_ERROR;
 
-    if (file == NULL)
-        return UNZ_PARAMERROR;
-    offset64 = unzGetOffset64(file);
-    return (int32_t)offset64;
-}
+        bytes_used = avail_in_before - s->stream.avail_in;
+        if (!encrypted)
+            unzStreamSkipBuffered(s, bytes_used);
+        s->total_in += bytes_used;
+        if (s->cur_size_known)
+            s->rest_read_compressed -= bytes_used;
 
-extern int64_t ZEXPORT unzGetOffset64(unzFile file)
-{
-    unz64_internal *s = NULL;
+        copy = (uint32_t)(s->stream.total_out - total_out_before);
+        s->crc32 = crc32_fast(s->crc32, s->stream.next_out - copy, copy);
+        s->total_out += copy;
+        read += copy;
 
-    if (file == NULL)
-        return UNZ_PARAMERROR;
-    s = (unz64_internal*)file;
-    if (!s->current_file_ok)
-        return 0;
-    if (s->gi.number_entry != 0 && s->gi.number_entry != UINT16_MAX)
+        if (err == Z_STREAM_END)
+        {
+            if (encrypted && (s->stream.avail_in > 0))
+            {
+                /* Data after the end of the deflate stream was decrypted, put it back */
+                bytes_used = s->plain_size - s->stream.avail_in;
+                s->read_pos = s->plain_read_pos + bytes_used;
+                s->pos_in_stream -= s->stream.avail_in;
+#ifdef HAVE_AES
+                if (s->cur_file_info.compression_method == AES_METHOD)
+                {
+                    s->aes_ctx.auth_ctx[0] = s->aes_auth_ctx;
+                    hmac_sha_data(s->read_buffer + s->plain_read_pos, bytes_used, s->aes_ctx.auth_ctx);
+                }
+#endif
+            }
+            s->stream.avail_in = 0;
+            /* Skip what is left of the data when the size is known */
+            if (s->cur_size_known)
+            {
+                err = unzStreamReadBytes(s, NULL, s->rest_read_compressed);
+                if (err != UNZ_OK)
+                    return err;
+                s->total_in += s->rest_read_compressed;
+                s->rest_read_compressed = 0;
+            }
+            data_end = 1;
+            break;
+        }
+        if (err != Z_OK)
+            return err;
+    }
+
+    if (data_end)
     {
-        if (s->num_file == s->gi.number_entry)
-            return 0;
+        err = unzStreamEndCurrentFile(s);
+        if (err != UNZ_OK)
+            return err;
     }
-    return s->pos_in_central_dir;
+    return (int)read;
 }
 
-extern int ZEXPORT unzSetOffset(unzFile file, uint32_t pos)
+/* Skip the rest of the current file, its data has to be read when its size is unknown */
+static int unzStreamSkipCurrentFile(unz_stream_internal *s)
 {
-    return unzSetOffset64(file, pos);
+    uint8_t *buf = NULL;
+    int bytes_read = 0;
+    int err = UNZ_OK;
+
+    if ((s->state == UNZ_STREAM_STATE_HEADER) && (s->cur_size_known))
+    {
+        err = unzStreamReadBytes(s, NULL, s->cur_file_info.compressed_size);
+        if ((err == UNZ_OK) && ((s->cur_file_info.flag & 8) != 0))
+        {
+            err = unzStreamReadDataDescriptor(s, s->cur_file_info.compressed_size,
+                s->cur_file_info.uncompressed_size);
+            s->entries[s->number_entry - 1].crc = s->cur_file_info.crc;
+        }
+        if (err == UNZ_OK)
+            s->state = UNZ_STREAM_STATE_DATA_END;
+        return err;
+    }
+    if (s->state == UNZ_STREAM_STATE_HEADER)
+    {
+        /* Encrypted file must be opened with its password to find its end */
+        err = unzStreamOpenCurrentFile((unzStream)s, NULL);
+        if (err != UNZ_OK)
+            return err;
+    }
+    if (s->state == UNZ_STREAM_STATE_OPENED)
+    {
+        buf = (uint8_t*)ALLOC(UNZ_BUFSIZE);
+        if (buf == NULL)
+            return UNZ_INTERNALERROR;
+        do
+        {
+            bytes_read = unzStreamReadCurrentFile((unzStream)s, buf, UNZ_BUFSIZE);
+        }
+        while (bytes_read > 0);
+        TRYFREE(buf);
+        if (bytes_read < 0)
+            return bytes_read;
+    }
+    /* The inflate state is reset for the next file */
+    s->stream_initialised = 0;
+    return UNZ_OK;
 }
 
-extern int ZEXPORT unzSetOffset64(unzFile file, uint64_t pos)
+extern int ZEXPORT unzStreamCloseCurrentFile(unzStream stream)
 {
-    unz64_internal *s = NULL;
+    unz_stream_internal *s = NULL;
     int err = UNZ_OK;
 
-    if (file == NULL)
+    if (stream == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz_stream_internal*)stream;
+    if ((s->state != UNZ_STREAM_STATE_OPENED) && (s->state != UNZ_STREAM_STATE_DATA_END))
         return UNZ_PARAMERROR;
-    s = (unz64_internal*)file;
-    s->pos_in_central_dir = pos;
-    s->num_file = s->gi.number_entry; /* hack */
 
-    err = unzGetCurrentFileInfoInternal(file, &s->cur_file_info, &s->cur_file_info_internal, NULL, 0, NULL, 0, NULL, 0);
+    /* Data left has to be read to get to the next file */
+    err = unzStreamSkipCurrentFile(s);
+    if (err != UNZ_OK)
+        return err;
 
-    s->current_file_ok = (err == UNZ_OK);
+    err = s->data_error;
+#ifdef HAVE_AES
+    /* AE-2 does not store the crc */
+    if ((s->cur_file_info.compression_method != AES_METHOD) || (s->cur_file_info_internal.aes_version == 0x0001))
+#endif
+    {
+        if ((err == UNZ_OK) && (s->crc32 != s->cur_file_info.crc))
+            err = UNZ_CRCERROR;
+    }
     return err;
 }
 
-extern int32_t ZEXPORT unzTell(unzFile file)
+extern int ZEXPORT unzStreamGoToNextFile(unzStream stream)
 {
-    unz64_internal *s = NULL;
-    if (file == NULL)
-        return UNZ_PARAMERROR;
-    s = (unz64_internal*)file;
-    if (s->pfile_in_zip_read == NULL)
-        return UNZ_PARAMERROR;
-    return (int32_t)s->pfile_in_zip_read->stream.total_out;
-}
+    unz_stream_internal *s = NULL;
+    uint32_t magic = 0;
+    int err = UNZ_OK;
 
-extern int64_t ZEXPORT unzTell64(unzFile file)
-{
-    unz64_internal *s = NULL;
-    if (file == NULL)
+    if (stream == NULL)
         return UNZ_PARAMERROR;
-    s = (unz64_internal*)file;
-    if (s->pfile_in_zip_read == NULL)
-        return UNZ_PARAMERROR;
-    return s->pfile_in_zip_read->total_out_64;
-}
-
-extern int ZEXPORT unzSeek(unzFile file, uint32_t offset, int origin)
-{
-    return unzSeek64(file, offset, origin);
-}
+    s = (unz_stream_internal*)stream;
+    if (s->state == UNZ_STREAM_STATE_END)
+        return UNZ_END_OF_LIST_OF_FILE;
 
-extern int ZEXPORT unzSeek64(unzFile file, uint64_t offset, int origin)
-{
-    unz64_internal *s = NULL;
-    uint64_t stream_pos_begin = 0;
-    uint64_t stream_pos_end = 0;
-    uint64_t position = 0;
-    int is_within_buffer = 0;
+    if ((s->state == UNZ_STREAM_STATE_HEADER) || (s->state == UNZ_STREAM_STATE_OPENED))
+    {
+        err = unzStreamSkipCurrentFile(s);
+        if (err != UNZ_OK)
+            return err;
+    }
 
-    if (file == NULL)
-        return UNZ_PARAMERROR;
-    s = (unz64_internal*)file;
+    for (;;)
+    {
+        err = unzStreamFill(s, 4);
+        if ((err == UNZ_OK) && (s->read_end - s->read_pos < 4))
+            err = UNZ_BADZIPFILE;
+        if (err != UNZ_OK)
+            return err;
+
+        magic = (uint32_t)unzReadValueFromMemory(s->read_buffer + s->read_pos, 4);
+        if (magic == LOCALHEADERMAGIC)
+            return unzStreamReadLocalHeader(s);
+        /* Spanned zipfile starts with the signature of a data descriptor */
+        if ((magic == DISKHEADERMAGIC) && (s->pos_in_stream == 0))
+        {
+            unzStreamSkipBuffered(s, 4);
+            continue;
+        }
+        /* The central directory starts after the lookup index */
+        if (magic == LOOKUPINDEXMAGIC)
+        {
+            err = unzStreamSkipLookupIndex(s);
+            if (err != UNZ_OK)
+                return err;
+            continue;
+        }
+        if ((magic != CENTRALHEADERMAGIC) && (magic != ZIP64ENDHEADERMAGIC) && (magic != ENDHEADERMAGIC))
+            return UNZ_BADZIPFILE;
 
-    if (s->pfile_in_zip_read == NULL)
-        return UNZ_ERRNO;
-    if (s->pfile_in_zip_read->compression_method != 0)
-        return UNZ_ERRNO;
+        err = unzStreamReadCentralDir(s);
+        if (err != UNZ_OK)
+            return err;
+        s->state = UNZ_STREAM_STATE_END;
+        return UNZ_END_OF_LIST_OF_FILE;
+    }
+}
 
-    if (origin == SEEK_SET)
-        position = offset;
-    else if (origin == SEEK_CUR)
-        position = s->pfile_in_zip_read->total_out_64 + offset;
-    else if (origin == SEEK_END)
-        position = s->cur_file_info.compressed_size + offset;
-    else
-        return UNZ_PARAMERROR;
+extern int ZEXPORT unzStreamGetCurrentFileInfo64(unzStream stream, unz_file_info64 *pfile_info, char *filename,
+    uint16_t filename_size, void *extrafield, uint16_t extrafield_size)
+{
+    unz_stream_internal *s = NULL;
+    uint16_t bytes_to_copy = 0;
 
-    if (position > s->cur_file_info.compressed_size)
+    if (stream == NULL)
         return UNZ_PARAMERROR;
+    s = (unz_stream_internal*)stream;
+    if ((s->state == UNZ_STREAM_STATE_START) || (s->state == UNZ_STREAM_STATE_END))
+        return UNZ_END_OF_LIST_OF_FILE;
 
-    stream_pos_end = s->pfile_in_zip_read->pos_in_zipfile;
-    stream_pos_begin = stream_pos_end;
-
-    if (stream_pos_begin > UNZ_BUFSIZE)
-        stream_pos_begin -= UNZ_BUFSIZE;
-    else
-        stream_pos_begin = 0;
-
-    is_within_buffer = 
-        (s->pfile_in_zip_read->stream.avail_in != 0) &&
-        (s->pfile_in_zip_read->rest_read_compressed != 0 || s->cur_file_info.compressed_size < UNZ_BUFSIZE) &&
-        (position >= stream_pos_begin && position < stream_pos_end);
+    if (pfile_info != NULL)
+        *pfile_info = s->cur_file_info;
 
-    if (is_within_buffer)
+    if (filename != NULL)
     {
-        s->pfile_in_zip_read->stream.next_in += position - s->pfile_in_zip_read->total_out_64;
-        s->pfile_in_zip_read->stream.avail_in = (uInt)(stream_pos_end - position);
+        bytes_to_copy = filename_size;
+        if (s->cur_file_info.size_filename < filename_size)
+        {
+            *(filename + s->cur_file_info.size_filename) = 0;
+            bytes_to_copy = s->cur_file_info.size_filename;
+        }
+        memcpy(filename, s->cur_filename, bytes_to_copy);
     }
-    else
-    {
-        s->pfile_in_zip_read->stream.avail_in = 0;
-        s->pfile_in_zip_read->stream.next_in = 0;
 
-        s->pfile_in_zip_read->pos_in_zipfile = s->pfile_in_zip_read->offset_local_extrafield + position;
-        s->pfile_in_zip_read->rest_read_compressed = s->cur_file_info.compressed_size - position;
+    if (extrafield != NULL)
+    {
+        bytes_to_copy = extrafield_size;
+        if (s->cur_file_info.size_file_extra < extrafield_size)
+            bytes_to_copy = s->cur_file_info.size_file_extra;
+        memcpy(extrafield, s->cur_extrafield, bytes_to_copy);
     }
+    return UNZ_OK;
+}
 
-    s->pfile_in_zip_read->rest_read_uncompressed -= (position - s->pfile_in_zip_read->total_out_64);
-    s->pfile_in_zip_read->stream.total_out = (uint32_t)position;
-    s->pfile_in_zip_read->total_out_64 = position;
+extern int ZEXPORT unzStreamGetGlobalInfo64(unzStream stream, unz_global_info64 *pglobal_info)
+{
+    unz_stream_internal *s = NULL;
 
+    if (stream == NULL)
+        return UNZ_PARAMERROR;
+    s = (unz_stream_internal*)stream;
+    if (s->state != UNZ_STREAM_STATE_END)
+        return UNZ_PARAMERROR;
+    *pglobal_info = s->gi;
     return UNZ_OK;
 }
 
-extern int ZEXPORT unzEndOfFile(unzFile file)
+extern int ZEXPORT unzStreamClose(unzStream stream)
 {
-    unz64_internal *s = NULL;
-    if (file == NULL)
-        return UNZ_PARAMERROR;
-    s = (unz64_internal*)file;
-    if (s->pfile_in_zip_read == NULL)
+    unz_stream_internal *s = NULL;
+
+    if (stream == NULL)
         return UNZ_PARAMERROR;
-    if (s->pfile_in_zip_read->rest_read_uncompressed == 0)
-        return 1;
-    return 0;
+    s = (unz_stream_internal*)stream;
+
+    if (s->inflate_initialised)
+        inflateEnd(&s->stream);
+    ZCLOSE64(s->z_filefunc, s->filestream);
+
+    TRYFREE(s->read_buffer);
+    TRYFREE(s->plain_buffer);
+    TRYFREE(s->cur_filename);
+    TRYFREE(s->cur_extrafield);
+    TRYFREE(s->entries);
+    TRYFREE(s->names);
+    TRYFREE(s);
+    return UNZ_OK;
 }
@@ -46,8 +46,14 @@ extern "C" {
     from (void*) without cast */
 typedef struct TagunzFile__ { int unused; } unz_file__;
 typedef unz_file__ *unzFile;
+typedef struct TagunzStream__ { int unused; } unz_stream__;
+typedef unz_stream__ *unzStream;
+typedef struct TagunzReadPool__ { int unused; } unz_read_pool__;
+typedef unz_read_pool__ *unzReadPool;
 #else
 typedef voidp unzFile;
+typedef voidp unzStream;
+typedef voidp unzReadPool;
 #endif
 
 #define UNZ_OK                          (0)
@@ -60,6 +66,28 @@ typedef voidp unzFile;
 #define UNZ_CRCERROR                    (-105)
 #define UNZ_BADPASSWORD                 (-106)
 
+#define UNZ_CASE_SENSITIVE              (1)
+#define UNZ_CASE_INSENSITIVE            (2)
+
+/* unz_entry_info64 is a compact record of a file filled by unzGetAllFileInfo64 */
+typedef struct unz_entry_info64_s
+{
+    uint64_t compressed_size;
+    uint64_t uncompressed_size;
+    uint64_t disk_offset;           /* offset of the local header */
+    const char *filename;           /* null terminated, points into the strings given */
+    const uint8_t *extrafield;      /* points into the strings given, NULL when size_file_extra is 0 */
+    uint32_t dos_date;
+    uint32_t crc;
+    uint32_t external_fa;
+    uint32_t disk_num_start;
+    uint16_t version;
+    uint16_t flag;
+    uint16_t compression_method;
+    uint16_t size_filename;
+    uint16_t size_file_extra;
+    uint16_t internal_fa;
+} unz_entry_info64;
 
 /***************************************************************************/
 /* Opening and close a zip file */
@@ -81,6 +109,35 @@ extern unzFile ZEXPORT unzOpen2(const char *path, zlib_filefunc_def *pzlib_filef
 /* Open a Zip file, like unzOpen, but provide a set of file low level API for read/write operations */
 extern unzFile ZEXPORT unzOpen2_64(const void *path, zlib_filefunc64_def *pzlib_filefunc_def);
 /* Open a Zip file, like unz64Open, but provide a set of file low level API for read/write 64-bit operations */
+extern unzFile ZEXPORT unzOpen3(const void *path, zlib_filefunc64_def *pzlib_filefunc_def, uint32_t read_buffer_size);
+/* Same as unzOpen2_64 but sets the size of the buffer used for compressed data of each opened file,
+   0 for the default. pzlib_filefunc_def can be NULL to use the default file functions */
+extern unzFile ZEXPORT unzOpenWithLookupIndex(const void *path, zlib_filefunc64_def *pzlib_filefunc_def,
+    const void *index_path);
+/* Same as unzOpen2_64 but takes the entry table, file name hash and sorted order from the lookup index
+   saved in index_path by unzSaveLookupIndex instead of decoding the central directory, which is only read
+   once file names, extra fields or comments are needed. index_path is opened with the same file functions
+   as path and read at once, its tables are used as they are. The index is ignored when the size, modification
+   time or central directory of the zipfile changed since it was saved, and on big endian hosts.
+   pzlib_filefunc_def can be NULL to use the default file functions.
+
+   Zipfiles written with zipSetLookupIndex carry their own index in front of the central directory, every
+   open function uses it without index_path */
+
+extern int ZEXPORT unzSaveLookupIndex(unzFile file, const void *path, const void *index_path);
+/* Save the lookup index of the zipfile opened from path in index_path, written with the default file
+   functions, so later opens with unzOpenWithLookupIndex skip decoding its central directory.
+
+   return UNZ_OK if no error */
+
+extern int ZEXPORT unzBuildLookupIndex(const void *central_dir, uint64_t size_central_dir,
+    uint64_t offset_index, void *buf, uint64_t buf_size, uint64_t *index_size);
+/* Build the lookup index of a central directory of size_central_dir bytes, to be written at offset_index
+   immediately in front of it. index_size receives the size of the index, which depends on offset_index, buf
+   can be NULL to only get it.
+
+   return UNZ_OK if no error
+   return UNZ_PARAMERROR if buf_size is smaller than the index */
 
 extern int ZEXPORT unzClose(unzFile file);
 /* Close a ZipFile opened with unzOpen. If there is files inside the .Zip opened with unzOpenCurrentFile,
@@ -88,6 +145,50 @@ extern int ZEXPORT unzClose(unzFile file);
 
    return UNZ_OK if there is no error */
 
+extern int ZEXPORT unzSetFileFuncExt(unzFile file, const zlib_filefunc64_ext_def *pzlib_filefunc_ext_def);
+/* Give the optional io functions that go with the file functions the ZipFile was opened with, like
+   fill_mmap_filefunc64_ext for fill_mmap_filefunc64, or NULL to stop using them. ZipFiles opened with the
+   default file functions use positional reads and hints already. No file must be open.
+
+   return UNZ_OK if no error */
+
+extern unzFile ZEXPORT unzOpenClone(unzFile file);
+/* Open another handle on a ZipFile that shares its central directory, so each thread can read files
+   with its own handle. The io functions must provide positional reads (see unzSetFileFuncExt) that are
+   safe to call from several threads and the zip file must not span disks. Clones MUST be closed with
+   unzClose before the ZipFile they were made from, which must not be used while they read.
+
+   return NULL if the ZipFile cannot be cloned */
+
+extern unzReadPool ZEXPORT unzCreateReadPool(uint32_t max_states);
+/* Create a pool of read states, the read buffer and inflate state used for an opened file. Each ZipFile
+   keeps the state of the last file it closed and reuses it for the next one, when it is closed its state
+   goes to its pool so a ZipFile opened later can take it. max_states is the number of states the pool
+   keeps, 0 for the default. The pool can be shared by ZipFiles used from several threads.
+
+   return NULL if there is not enough memory */
+
+extern int ZEXPORT unzSetReadPool(unzFile file, unzReadPool pool);
+/* Take read states from the pool and give them back to it, NULL to stop using a pool. Clones opened
+   afterwards use the same pool.
+
+   return UNZ_OK if no error */
+
+extern int ZEXPORT unzDeleteReadPool(unzReadPool pool);
+/* Free the pool and the read states in it, the ZipFiles that use it MUST be closed before.
+
+   return UNZ_OK if no error */
+
+extern int ZEXPORT unzSetPrefetch(unzFile file, uint32_t file_count, int drop_read);
+/* Hint the io functions about the parts of the zipfile that are read next. When files are opened in order
+   the zipfile is advised as read sequentially and the data of the next file_count files as needed soon,
+   otherwise it is advised as read randomly and only the data of the opened file as needed. With drop_read
+   the data of files read to the end in order is advised as not needed anymore, so extracting a large
+   zipfile does not push other data out of the system cache. file_count 0 stops the hints. The defaults are
+   UNZ_PREFETCHCOUNT files and drop_read set.
+
+   return UNZ_OK if no error */
+
 extern int ZEXPORT unzGetGlobalInfo(unzFile file, unz_global_info *pglobal_info);
 extern int ZEXPORT unzGetGlobalInfo64(unzFile file, unz_global_info64 *pglobal_info);
 /* Write info about the ZipFile in the *pglobal_info structure.
@@ -134,7 +235,17 @@ extern int ZEXPORT unzReadCurrentFile(unzFile file, voidp buf, uint32_t len);
 
    return the number of byte copied if somes bytes are copied
    return 0 if the end of file was reached
-   return <0 with error code if there is an error (UNZ_ERRNO for IO error, or zLib error for uncompress error) */
+   return <0 with error code if there is an error (UNZ_ERRNO for IO error, or zLib error for uncompress error)
+
+   NOTE: len is capped to INT32_MAX so the number of bytes copied fits the return value */
+
+extern int ZEXPORT unzReadCurrentFile64(unzFile file, voidp buf, uint64_t len, uint64_t *bytes_read);
+/* Same as unzReadCurrentFile but for buffers of any size, the number of bytes copied is stored in
+   *bytes_read, which is 0 when the end of file was reached. Stored data is read straight into buf
+   when len is larger than the internal buffer
+
+   return UNZ_OK if no error
+   return <0 with error code if there is an error, *bytes_read has the bytes copied before it */
 
 extern int ZEXPORT unzGetCurrentFileInfo(unzFile file, unz_file_info *pfile_info, char *filename, 
     uint16_t filename_size, void *extrafield, uint16_t extrafield_size, char *comment, uint16_t comment_size);
@@ -150,6 +261,16 @@ extern int ZEXPORT unzGetCurrentFileInfo64(unzFile file, unz_file_info64 *pfile_
    comment if != NULL, the comment string of the file will be copied in to
    comment_size is the size of the comment buffer */
 
+extern int ZEXPORT unzGetAllFileInfo64(unzFile file, uint64_t first, uint64_t count, unz_entry_info64 *entries,
+    char *strings, uint64_t strings_size, uint64_t *strings_needed);
+/* Get the info of count files from the file number first in one call, count is reduced to the number of
+   files after first. The names and the central directory extra fields are copied into strings one after
+   the other, the names are null terminated. strings_needed receives the size of strings needed, entries
+   can be NULL to only get it. The current file does not change.
+
+   return UNZ_OK if no error
+   return UNZ_PARAMERROR if first is after the last file or strings_size is too small */
+
 extern int ZEXPORT unzGetLocalExtrafield(unzFile file, voidp buf, uint32_t len);
 /* Read extra field from the current file (opened by unzOpenCurrentFile)
    This is the local-header version of the extra field (sometimes, there is
@@ -160,6 +281,48 @@ extern int ZEXPORT unzGetLocalExtrafield(unzFile file, voidp buf, uint32_t len);
 
    return number of bytes copied in buf, or (if <0) the error code */
 
+extern int ZEXPORT unzGetCurrentFileSpan(unzFile file, uint64_t *offset, uint64_t *length, const void **data);
+/* Get where the contents of the current file are stored, for a stored (method 0) file that is not encrypted
+   the bytes in the zipfile are the file contents. The local header is checked first, a file opened with
+   unzOpenCurrentFile is closed.
+
+   offset receives the absolute position of the contents in the zipfile and length their size
+   data if != NULL receives a pointer to the contents when the io functions keep the zipfile in memory
+     (see fill_mmap_filefunc64_ext and fill_memory_filefunc64_ext), NULL otherwise
+   the crc of the contents is in the file info, it is not checked
+
+   return UNZ_OK if no error
+   return UNZ_PARAMERROR if the file is compressed, encrypted or in a spanned zipfile */
+
+extern int ZEXPORT unzCheckCurrentFileHeaders(unzFile file);
+/* Check that the local header of the current file agrees with the central directory on the compression
+   method, crc, sizes and file name, and so does its data descriptor when it has one. The data is not read,
+   see unzVerifyAll to check it too. A file opened with unzOpenCurrentFile is closed first.
+
+   return UNZ_OK if the headers agree
+   return UNZ_BADZIPFILE if they do not */
+
+typedef int (*unzDecompressFunction)(void *dest, uint64_t dest_size, const void *source, uint64_t source_size,
+    uint64_t *dest_written, void *user_data);
+
+extern int ZEXPORT unzSetDecompressFunction(unzFile file, unzDecompressFunction decompress, void *user_data);
+/* Replace the function unzReadEntryToBuffer uses to decompress a whole deflated file. It gets all of the raw
+   deflate data and a buffer of the uncompressed size, stores the number of bytes written in dest_written and
+   returns UNZ_OK or an error. NULL restores zlib inflate, or libcompression with HAVE_APPLE_COMPRESSION.
+
+   return UNZ_OK if no error */
+
+extern int ZEXPORT unzReadEntryToBuffer(unzFile file, const char *password, void *buf, uint64_t buf_size,
+    uint64_t *bytes_read);
+/* Read the whole current file into buf, which has to hold its uncompressed size. The compressed data is read
+   in one io, or used in place when the zipfile can be mapped, and decompressed in one call. Encrypted files
+   and other compression methods are read through unzOpenCurrentFilePassword and unzReadCurrentFile64. The
+   file does not stay opened and the crc is checked.
+
+   return UNZ_OK if no error
+   return UNZ_PARAMERROR if buf_size is smaller than the uncompressed size
+   return UNZ_CRCERROR if the data does not match its crc */
+
 extern int ZEXPORT unzCloseCurrentFile(unzFile file);
 /* Close the file in zip opened with unzOpenCurrentFile
 
@@ -205,6 +368,38 @@ extern int ZEXPORT unzLocateFile(unzFile file, const char *filename, unzFileName
    return UNZ_OK if the file is found (it becomes the current file)
    return UNZ_END_OF_LIST_OF_FILE if the file is not found */
 
+extern int ZEXPORT unzLocateFile2(unzFile file, const char *filename, int case_sensitivity);
+/* Locate the file filename in the zipfile with a hash index of the file names, the index is built on the
+   first lookup and kept until the zipfile is closed. unzLocateFile uses it when no comparison function is given.
+
+   case_sensitivity is UNZ_CASE_SENSITIVE or UNZ_CASE_INSENSITIVE (ascii letters only)
+
+   return UNZ_OK if the file is found (it becomes the current file)
+   return UNZ_END_OF_LIST_OF_FILE if the file is not found */
+
+typedef int (*unzChildIteratorFunction)(unzFile file, const char *name, uint16_t size_name, uint64_t sorted_pos,
+    void *user_data);
+
+extern int ZEXPORT unzLocatePrefix(unzFile file, const char *prefix, uint64_t *first, uint64_t *count);
+/* Find the files whose name starts with prefix. The file names are sorted in byte order in a table built on
+   the first call, the matching files are at positions first to first + count - 1 of that table.
+
+   return UNZ_OK if no error, count is 0 if no file matches */
+
+extern int ZEXPORT unzGoToSortedFile(unzFile file, uint64_t sorted_pos);
+/* Set the current file of the zipfile to the file at sorted_pos in the sorted file name table.
+
+   return UNZ_OK if no error
+   return UNZ_PARAMERROR if sorted_pos is past the end of the table */
+
+extern int ZEXPORT unzListDirectory(unzFile file, const char *directory, unzChildIteratorFunction func, void *user_data);
+/* Call func for every direct child of directory, in sorted order. directory must end with a slash, or be
+   empty for the root of the zipfile. name is the child name relative to directory (not null terminated),
+   subdirectories end with a slash and are reported once even if they have no file of their own, sorted_pos
+   is then the position of the first file inside them. The listing stops if func returns non zero.
+
+   return UNZ_OK if no error, or the value returned by func */
+
 /***************************************************************************/
 /* Raw access to zip file */
 
@@ -240,11 +435,89 @@ extern int64_t ZEXPORT unzTell64(unzFile file);
 
 extern int ZEXPORT unzSeek(unzFile file, uint32_t offset, int origin);
 extern int ZEXPORT unzSeek64(unzFile file, uint64_t offset, int origin);
-/* Seek within the uncompressed data if compression method is storage */
+/* Seek within the uncompressed data if compression method is storage or deflate. Deflated data is
+   decompressed from the closest point of the seek index of the file (see unzSetSeekIndexSpacing), or from
+   the start when going back without one. Encrypted files can only seek forward. The crc is not checked
+   when the file is closed if data was skipped */
+
+extern int ZEXPORT unzSetSeekIndexSpacing(unzFile file, uint64_t spacing);
+/* Record a seek index for the deflated files opened afterwards that are not encrypted. A point is added
+   about every spacing bytes of uncompressed data as the file is read or seeked forward, each point keeps
+   32 KB of uncompressed data. The indexes are kept until the zipfile is closed. 0 stops recording new ones
+
+   return UNZ_OK if no error */
+
+extern int ZEXPORT unzGetSeekIndex(unzFile file, void *buf, uint64_t buf_size, uint64_t *index_size);
+/* Serialize the seek index of the current file so it can be given to unzSetSeekIndex after the zipfile is
+   opened again. index_size receives the size needed, buf can be NULL to only get it
+
+   return UNZ_OK if no error
+   return UNZ_PARAMERROR if the current file has no seek index or buf_size is too small */
+
+extern int ZEXPORT unzSetSeekIndex(unzFile file, const void *buf, uint64_t buf_size);
+/* Replace the seek index of the current file with one serialized by unzGetSeekIndex, it is used from the
+   next time the file is opened, or right away if it was opened while recording its index
+
+   return UNZ_OK if no error
+   return UNZ_BADZIPFILE if the index is invalid or was made for another file */
 
 extern int ZEXPORT unzEndOfFile(unzFile file);
 /* return 1 if the end of file was reached, 0 elsewhere */
 
+/***************************************************************************/
+/* Streaming read of a zipfile */
+
+extern unzStream ZEXPORT unzStreamOpen(const void *path, zlib_filefunc64_def *pzlib_filefunc_def);
+/* Open a zipfile to read it once from start to end, like from a pipe or a socket. Only the open, read,
+   error and close functions of pzlib_filefunc_def are used, it can be NULL for the default functions
+   ("/dev/stdin" can be given as path). The files are read from their local headers, the central
+   directory is read at the end and checked against them.
+
+   return NULL if the zipfile cannot be opened */
+
+extern int ZEXPORT unzStreamClose(unzStream stream);
+/* Close a zipfile opened with unzStreamOpen, the current file is closed if needed
+
+   return UNZ_OK if no error */
+
+extern int ZEXPORT unzStreamGoToNextFile(unzStream stream);
+/* Go to the first file on the first call, then to the next one. The rest of the current file is
+   skipped, encrypted files whose sizes are only in their data descriptor have to be opened with their
+   password to be skipped.
+
+   return UNZ_OK if no error
+   return UNZ_END_OF_LIST_OF_FILE when the central directory was read and matches the files
+   return UNZ_BADZIPFILE if the zipfile is invalid or the central directory does not match the files */
+
+extern int ZEXPORT unzStreamGetCurrentFileInfo64(unzStream stream, unz_file_info64 *pfile_info, char *filename,
+    uint16_t filename_size, void *extrafield, uint16_t extrafield_size);
+/* Get info about the current file from its local header, see unzGetCurrentFileInfo64. When the data
+   descriptor has the sizes and the crc they are 0 until the data of the file is read. The extra field is
+   the local one. */
+
+extern int ZEXPORT unzStreamGetGlobalInfo64(unzStream stream, unz_global_info64 *pglobal_info);
+/* Get the global info once unzStreamGoToNextFile has returned UNZ_END_OF_LIST_OF_FILE
+
+   return UNZ_OK if no error */
+
+extern int ZEXPORT unzStreamOpenCurrentFile(unzStream stream, const char *password);
+/* Open the current file for reading, password is NULL if it is not encrypted
+
+   return UNZ_OK if no error
+   return UNZ_BADPASSWORD if the password does not match the file */
+
+extern int ZEXPORT unzStreamReadCurrentFile(unzStream stream, voidp buf, uint32_t len);
+/* Read bytes from the current file, see unzReadCurrentFile
+
+   return the number of bytes copied if some bytes are copied
+   return 0 if the end of file was reached
+   return <0 with error code if there is an error */
+
+extern int ZEXPORT unzStreamCloseCurrentFile(unzStream stream);
+/* Close the current file, what was not read is read to find its end
+
+   return UNZ_CRCERROR if the crc or the authentication code of the file read is not good */
+
 /***************************************************************************/
 
 #ifdef __cplusplus
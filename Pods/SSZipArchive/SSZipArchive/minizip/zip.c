@@ -21,8 +21,13 @@
 #include <string.h>
 #include <errno.h>
 
+#include <pthread.h>
+#include <unistd.h>
+
 #include "zlib.h"
 #include "zip.h"
+#include "unzip.h"
+#include "crc32fast.h"
 
 #ifdef HAVE_AES
 #  define AES_METHOD          (99)
@@ -44,7 +49,7 @@
 #  include "crypt.h"
 #endif
 
-#define SIZEDATA_INDATABLOCK        (4096-(4*4))
+#define ZIP_CENTRALDIRMINSIZE       (64 * 1024)
 
 #define DISKHEADERMAGIC             (0x08074b50)
 #define LOCALHEADERMAGIC            (0x04034b50)
@@ -61,10 +66,9 @@
 #define SIZECENTRALHEADERLOCATOR    (0x14) /* 20 */
 #define SIZECENTRALDIRITEM          (0x2e)
 #define SIZEZIPLOCALHEADER          (0x1e)
-
-#ifndef BUFREADCOMMENT
-#  define BUFREADCOMMENT            (0x400)
-#endif
+#define SIZECENTRALDIREND           (0x16)
+/* End of the zipfile read at once, the end of central directory record with the longest comment */
+#define SIZEZIPTAIL                 (UINT16_MAX + SIZECENTRALDIREND)
 #ifndef VERSIONMADEBY
 #  define VERSIONMADEBY             (0x0) /* platform dependent */
 #endif
@@ -73,6 +77,17 @@
 #  define Z_BUFSIZE                 (UINT16_MAX)
 #endif
 
+#ifndef ZIP_DEFLATEBLOCKSIZE
+#  define ZIP_DEFLATEBLOCKSIZE      (128 * 1024)
+#endif
+#ifndef ZIP_DEFLATEMAXTHREADS
+#  define ZIP_DEFLATEMAXTHREADS     (64)
+#endif
+/* Largest deflate window, the dictionary each block is compressed with */
+#define ZIP_DEFLATEDICTSIZE         (32 * 1024)
+/* Size of the pieces zipWriteInFileInZip64 passes to zipWriteInFileInZip */
+#define ZIP_WRITEPIECESIZE          (1024 * 1024 * 1024)
+
 #ifndef ALLOC
 #  define ALLOC(size) (malloc(size))
 #endif
@@ -93,20 +108,48 @@
 
 const char zip_copyright[] = " zip 1.01 Copyright 1998-2004 Gilles Vollant - http://www.winimage.com/zLibDll";
 
-typedef struct linkedlist_datablock_internal_s
+typedef struct zip_central_dir_s
+{
+    uint8_t     *data;                  /* records of the closed files, followed by the one of the open file */
+    uint64_t    size;                   /* size of the records of the closed files */
+    uint64_t    capacity;
+} zip_central_dir;
+
+typedef struct zip_deflate_job_s
 {
-    struct linkedlist_datablock_internal_s *next_datablock;
-    uint32_t    avail_in_this_block;
-    uint32_t    filled_in_this_block;
-    uint32_t    unused; /* for future use and alignment */
-    uint8_t     data[SIZEDATA_INDATABLOCK];
-} linkedlist_datablock_internal;
-
-typedef struct linkedlist_data_s
+    uint8_t *in;                    /* uncompressed block, filled by the writing thread */
+    uint32_t in_size;
+    uint8_t *out;                   /* deflated block, ends on a byte boundary */
+    uint32_t out_size;
+    uint8_t dictionary[ZIP_DEFLATEDICTSIZE];  /* end of the block before in the same file */
+    uint32_t dictionary_size;
+    uint32_t crc32;                 /* crc of in */
+    int      level;                 /* parameters of the deflate state */
+    int      window_bits;
+    int      mem_level;
+    int      strategy;
+    int      last;                  /* last block of the file, finishes the deflate stream */
+    int      done;
+    int      err;
+} zip_deflate_job;
+
+typedef struct zip_deflate_pool_s
 {
-    linkedlist_datablock_internal *first_block;
-    linkedlist_datablock_internal *last_block;
-} linkedlist_data;
+    pthread_mutex_t mutex;          /* protects the job states and the counters */
+    pthread_cond_t job_queued;
+    pthread_cond_t job_done;
+    pthread_t threads[ZIP_DEFLATEMAXTHREADS];
+    uint32_t thread_count;
+    zip_deflate_job *jobs;          /* ring of jobs in the order of the blocks */
+    uint32_t job_count;
+    uint32_t block_size;
+    uint64_t next_fill;             /* job filled by the writing thread */
+    uint64_t next_run;              /* next queued job a worker takes */
+    uint64_t next_write;            /* next job written to the zipfile */
+    uint8_t dictionary[ZIP_DEFLATEDICTSIZE];  /* end of the last block queued */
+    uint32_t dictionary_size;
+    int shutdown;
+} zip_deflate_pool;
 
 typedef struct
 {
@@ -120,22 +163,31 @@ typedef struct
 #ifdef HAVE_AES
     fcrypt_ctx aes_ctx;
     prng_ctx aes_rng[1];
+    int      aes_rng_initialised;   /* aes_rng is seeded once and makes the salt of every file */
 #endif
     int      stream_initialised;    /* 1 is stream is initialized */
+    int      deflate_initialised;   /* stream holds a deflate state kept between files */
+    int      deflate_level;         /* parameters of the deflate state */
+    int      deflate_window_bits;
+    int      deflate_mem_level;
+    int      deflate_strategy;
     uint32_t pos_in_buffered_data;  /* last written byte in buffered_data */
 
     uint64_t pos_local_header;      /* offset of the local header of the file currently writing */
-    char    *central_header;        /* central header data for the current file */
+    char    *central_header;        /* central header of the current file, in the room after central_dir */
     uint16_t size_centralextra;
     uint16_t size_centralheader;    /* size of the central header for cur file */
     uint16_t size_centralextrafree; /* Extra bytes allocated to the central header but that are not used */
     uint16_t size_comment;
     uint16_t flag;                  /* flag of the file currently writing */
+    int      parallel_deflate;      /* blocks are deflated by the threads of deflate_pool */
+    uint64_t deflate_first_job;     /* job of deflate_pool with the first block of the file */
 
     uint16_t method;                /* compression method written to file.*/
     uint16_t compression_method;    /* compression method to use */
     int      raw;                   /* 1 for directly writing raw data */
-    uint8_t  buffered_data[Z_BUFSIZE];  /* buffer contain compressed data to be writ*/
+    uint8_t *buffered_data;         /* buffer contain compressed data to be writ*/
+    uint32_t buffered_data_size;    /* size of buffered_data */
     uint32_t dos_date;
     uint32_t crc32;
     int      zip64;                 /* add ZIP64 extended information in the extra field */
@@ -153,7 +205,7 @@ typedef struct
     zlib_filefunc64_32_def z_filefunc;
     voidpf filestream;              /* io structure of the zipfile */
     voidpf filestream_with_CD;      /* io structure of the zipfile with the central dir */
-    linkedlist_data central_dir;    /* datablock with central dir in construction*/
+    zip_central_dir central_dir;    /* central dir in construction */
     int in_opened_file_inzip;       /* 1 if a file in the zip is currently writ.*/
     int append;                     /* append mode */
     curfile64_info ci;              /* info on the file currently writing */
@@ -163,101 +215,46 @@ typedef struct
     uint64_t disk_size;             /* size of each disk */
     uint32_t number_disk;           /* number of the current disk, used for spanning ZIP */
     uint32_t number_disk_with_CD;   /* number the the disk with central dir, used for spanning ZIP */
+    int lookup_index;               /* write a lookup index in front of the central dir */
+    uint32_t deflate_threads;       /* threads used to deflate a file, 1 to deflate on the writing thread */
+    uint32_t deflate_block_size;
+    zip_deflate_pool *deflate_pool; /* created for the first file deflated with threads */
 #ifndef NO_ADDFILEINEXISTINGZIP
     char *globalcomment;
 #endif
 } zip64_internal;
 
-/* Allocate a new data block */
-static linkedlist_datablock_internal *allocate_new_datablock(void)
+/* Make room for size bytes after the records of the central directory, the room is returned */
+static uint8_t *zipCentralDirReserve(zip_central_dir *cd, uint64_t size)
 {
-    linkedlist_datablock_internal *ldi = NULL;
-
-    ldi = (linkedlist_datablock_internal*)ALLOC(sizeof(linkedlist_datablock_internal));
-
-    if (ldi != NULL)
-    {
-        ldi->next_datablock = NULL;
-        ldi->filled_in_this_block = 0;
-        ldi->avail_in_this_block = SIZEDATA_INDATABLOCK;
-    }
-    return ldi;
-}
-
-/* Free data block in linked list */
-static void free_datablock(linkedlist_datablock_internal *ldi)
-{
-    while (ldi != NULL)
-    {
-        linkedlist_datablock_internal *ldinext = ldi->next_datablock;
-        TRYFREE(ldi);
-        ldi = ldinext;
-    }
-}
-
-/* Initialize linked list */
-static void init_linkedlist(linkedlist_data *ll)
-{
-    ll->first_block = ll->last_block = NULL;
-}
+    uint8_t *data = NULL;
+    uint64_t capacity = cd->capacity;
+
+    if (cd->size + size <= cd->capacity)
+        return cd->data + cd->size;
+
+    /* Doubling keeps the number of copies low for millions of files */
+    if (capacity < ZIP_CENTRALDIRMINSIZE)
+        capacity = ZIP_CENTRALDIRMINSIZE;
+    while (capacity < cd->size + size)
+        capacity *= 2;
+    if (capacity > (size_t)-1)
+        return NULL;
 
-/* Free entire linked list and all data blocks */
-static void free_linkedlist(linkedlist_data *ll)
-{
-    free_datablock(ll->first_block);
-    ll->first_block = ll->last_block = NULL;
+    data = (uint8_t*)realloc(cd->data, (size_t)capacity);
+    if (data == NULL)
+        return NULL;
+    cd->data = data;
+    cd->capacity = capacity;
+    return cd->data + cd->size;
 }
 
-/* Add data to linked list data block */
-static int add_data_in_datablock(linkedlist_data *ll, const void *buf, uint32_t len)
+static void zipCentralDirFree(zip_central_dir *cd)
 {
-    linkedlist_datablock_internal *ldi = NULL;
-    const unsigned char *from_copy = NULL;
-
-    if (ll == NULL)
-        return ZIP_INTERNALERROR;
-
-    if (ll->last_block == NULL)
-    {
-        ll->first_block = ll->last_block = allocate_new_datablock();
-        if (ll->first_block == NULL)
-            return ZIP_INTERNALERROR;
-    }
-
-    ldi = ll->last_block;
-    from_copy = (unsigned char*)buf;
-
-    while (len > 0)
-    {
-        uint32_t copy_this = 0;
-        uint32_t i = 0;
-        unsigned char *to_copy = NULL;
-
-        if (ldi->avail_in_this_block == 0)
-        {
-            ldi->next_datablock = allocate_new_datablock();
-            if (ldi->next_datablock == NULL)
-                return ZIP_INTERNALERROR;
-            ldi = ldi->next_datablock ;
-            ll->last_block = ldi;
-        }
-
-        if (ldi->avail_in_this_block < len)
-            copy_this = ldi->avail_in_this_block;
-        else
-            copy_this = len;
-
-        to_copy = &(ldi->data[ldi->filled_in_this_block]);
-
-        for (i = 0; i < copy_this; i++)
-            *(to_copy+i) = *(from_copy+i);
-
-        ldi->filled_in_this_block += copy_this;
-        ldi->avail_in_this_block -= copy_this;
-        from_copy += copy_this;
-        len -= copy_this;
-    }
-    return ZIP_OK;
+    TRYFREE(cd->data);
+    cd->data = NULL;
+    cd->size = 0;
+    cd->capacity = 0;
 }
 
 /* Inputs a long in LSB order to the given file: nbByte == 1, 2 ,4 or 8 (byte, short or long, uint64_t) */
@@ -500,61 +497,71 @@ static int zipGoToNextDisk(zipFile file)
     return err;
 }
 
-/* Locate the Central directory of a zipfile (at the end, just before the global comment) */
+/* Locate the Central directory of a zipfile (at the end, just before the global comment). The end of the
+   zipfile is read at once and scanned backwards 8 bytes at a time for the first byte of the signature */
 static uint64_t zipSearchCentralDir(const zlib_filefunc64_32_def *pzlib_filefunc_def, voidpf filestream)
 {
-    unsigned char *buf = NULL;
+    uint8_t *buf = NULL;
     uint64_t file_size = 0;
-    uint64_t back_read = 4;
-    uint64_t max_back = UINT16_MAX; /* maximum size of global comment */
     uint64_t pos_found = 0;
-    uint32_t read_size = 0;
+    uint64_t word = 0;
+    uint64_t match = 0;
+    uint32_t read_size = SIZEZIPTAIL;
     uint64_t read_pos = 0;
+    uint32_t end = 0;
+    uint32_t start = 0;
     uint32_t i = 0;
 
-    buf = (unsigned char*)ALLOC(BUFREADCOMMENT+4);
+    if (ZSEEK64(*pzlib_filefunc_def, filestream, 0, ZLIB_FILEFUNC_SEEK_END) != 0)
+        return 0;
+
+    file_size = ZTELL64(*pzlib_filefunc_def, filestream);
+    if ((file_size == UINT64_MAX) || (file_size < SIZECENTRALDIREND))
+        return 0;
+    if (read_size > file_size)
+        read_size = (uint32_t)file_size;
+    read_pos = file_size - read_size;
+
+    buf = (uint8_t*)ALLOC(read_size);
     if (buf == NULL)
         return 0;
 
-    if (ZSEEK64(*pzlib_filefunc_def, filestream, 0, ZLIB_FILEFUNC_SEEK_END) != 0)
+    if ((ZSEEK64(*pzlib_filefunc_def, filestream, read_pos, ZLIB_FILEFUNC_SEEK_SET) != 0) ||
+        (ZREAD64(*pzlib_filefunc_def, filestream, buf, read_size) != read_size))
     {
         TRYFREE(buf);
         return 0;
     }
 
-    file_size = ZTELL64(*pzlib_filefunc_def, filestream);
-
-    if (max_back > file_size)
-        max_back = file_size;
-
-    while (back_read < max_back)
+    /* Positions before end have room for the record after them */
+    end = read_size - SIZECENTRALDIREND + 1;
+    while ((end > 0) && (pos_found == 0))
     {
-        if (back_read + BUFREADCOMMENT > max_back)
-            back_read = max_back;
-        else
-            back_read += BUFREADCOMMENT;
-
-        read_pos = file_size-back_read;
-        read_size = ((BUFREADCOMMENT+4) < (file_size - read_pos)) ?
-                     (BUFREADCOMMENT+4) : (uint32_t)(file_size - read_pos);
-
-        if (ZSEEK64(*pzlib_filefunc_def, filestream, read_pos, ZLIB_FILEFUNC_SEEK_SET) != 0)
-            break;
-        if (ZREAD64(*pzlib_filefunc_def, filestream, buf, read_size) != read_size)
-            break;
-
-        for (i = read_size-3; (i--) > 0;)
-            if ((*(buf+i)) == (ENDHEADERMAGIC & 0xff) &&
-                (*(buf+i+1)) == (ENDHEADERMAGIC >> 8 & 0xff) &&
-                (*(buf+i+2)) == (ENDHEADERMAGIC >> 16 & 0xff) &&
-                (*(buf+i+3)) == (ENDHEADERMAGIC >> 24 & 0xff))
+        start = 0;
+        if (end >= 8)
+        {
+            start = end - 8;
+            memcpy(&word, buf + start, 8);
+            /* Bytes equal to the first byte of the signature become zero and set their high bit in match,
+               a byte above one of them can set it as well so matches are checked below */
+            word ^= 0x0101010101010101ULL * (ENDHEADERMAGIC & 0xff);
+            match = (word - 0x0101010101010101ULL) & ~word & 0x8080808080808080ULL;
+            if (match == 0)
+            {
+                end = start;
+                continue;
+            }
+        }
+        for (i = end; (i--) > start;)
+        {
+            if (((uint32_t)buf[i] | ((uint32_t)buf[i + 1] << 8) | ((uint32_t)buf[i + 2] << 16) |
+                ((uint32_t)buf[i + 3] << 24)) == ENDHEADERMAGIC)
             {
-                pos_found = read_pos+i;
+                pos_found = read_pos + i;
                 break;
             }
-
-        if (pos_found != 0)
-            break;
+        }
+        end = start;
     }
     TRYFREE(buf);
     return pos_found;
@@ -598,7 +605,7 @@ static uint64_t zipSearchCentralDir64(const zlib_filefunc64_32_def *pzlib_filefu
 }
 
 extern zipFile ZEXPORT zipOpen4(const void *path, int append, uint64_t disk_size, const char **globalcomment,
-    zlib_filefunc64_32_def *pzlib_filefunc64_32_def)
+    zlib_filefunc64_32_def *pzlib_filefunc64_32_def, uint32_t write_buffer_size)
 {
     zip64_internal ziinit;
     zip64_internal *zi = NULL;
@@ -613,8 +620,7 @@ extern zipFile ZEXPORT zipOpen4(const void *path, int append, uint64_t disk_size
     uint16_t value16 = 0;
     uint32_t value32 = 0;
     uint16_t size_comment = 0;
-    size_t buf_size = SIZEDATA_INDATABLOCK;
-    void *buf_read = NULL;
+    uint8_t *central_dir = NULL;
 #endif
     int err = ZIP_OK;
     int mode = 0;
@@ -652,14 +658,30 @@ extern zipFile ZEXPORT zipOpen4(const void *path, int append, uint64_t disk_size
     ziinit.disk_size = disk_size;
     ziinit.in_opened_file_inzip = 0;
     ziinit.ci.stream_initialised = 0;
+    ziinit.ci.deflate_initialised = 0;
+#ifdef HAVE_AES
+    ziinit.ci.aes_rng_initialised = 0;
+#endif
     ziinit.number_entry = 0;
     ziinit.add_position_when_writting_offset = 0;
-    init_linkedlist(&(ziinit.central_dir));
+    ziinit.lookup_index = 0;
+    ziinit.deflate_threads = 1;
+    ziinit.deflate_block_size = ZIP_DEFLATEBLOCKSIZE;
+    ziinit.deflate_pool = NULL;
+    ziinit.ci.parallel_deflate = 0;
+    memset(&ziinit.central_dir, 0, sizeof(ziinit.central_dir));
+
+    ziinit.ci.buffered_data_size = write_buffer_size;
+    if (ziinit.ci.buffered_data_size == 0)
+        ziinit.ci.buffered_data_size = Z_BUFSIZE;
+    ziinit.ci.buffered_data = (uint8_t*)ALLOC(ziinit.ci.buffered_data_size);
 
     zi = (zip64_internal*)ALLOC(sizeof(zip64_internal));
-    if (zi == NULL)
+    if ((zi == NULL) || (ziinit.ci.buffered_data == NULL))
     {
         ZCLOSE64(ziinit.z_filefunc,ziinit.filestream);
+        TRYFREE(ziinit.ci.buffered_data);
+        TRYFREE(zi);
         return NULL;
     }
 
@@ -791,6 +813,7 @@ extern zipFile ZEXPORT zipOpen4(const void *path, int append, uint64_t disk_size
         {
             ZCLOSE64(ziinit.z_filefunc, ziinit.filestream);
             TRYFREE(ziinit.globalcomment);
+            TRYFREE(ziinit.ci.buffered_data);
             TRYFREE(zi);
             return NULL;
         }
@@ -798,30 +821,30 @@ extern zipFile ZEXPORT zipOpen4(const void *path, int append, uint64_t disk_size
         byte_before_the_zipfile = central_pos - (offset_central_dir+size_central_dir);
         ziinit.add_position_when_writting_offset = byte_before_the_zipfile;
 
-        /* Store central directory in memory */
+        /* Store central directory in memory, read straight into the room for it */
         size_central_dir_to_read = size_central_dir;
-        buf_size = SIZEDATA_INDATABLOCK;
-        buf_read = (void*)ALLOC(buf_size);
+        central_dir = zipCentralDirReserve(&ziinit.central_dir, size_central_dir);
+        if (central_dir == NULL)
+            err = ZIP_INTERNALERROR;
 
-        if (ZSEEK64(ziinit.z_filefunc, ziinit.filestream,
-                offset_central_dir + byte_before_the_zipfile, ZLIB_FILEFUNC_SEEK_SET) != 0)
+        if ((err == ZIP_OK) && (ZSEEK64(ziinit.z_filefunc, ziinit.filestream,
+                offset_central_dir + byte_before_the_zipfile, ZLIB_FILEFUNC_SEEK_SET) != 0))
             err = ZIP_ERRNO;
 
         while ((size_central_dir_to_read > 0) && (err == ZIP_OK))
         {
-            uint64_t read_this = SIZEDATA_INDATABLOCK;
+            uint32_t read_this = UINT32_MAX;
             if (read_this > size_central_dir_to_read)
-                read_this = size_central_dir_to_read;
+                read_this = (uint32_t)size_central_dir_to_read;
 
-            if (ZREAD64(ziinit.z_filefunc, ziinit.filestream, buf_read, (uint32_t)read_this) != read_this)
+            if (ZREAD64(ziinit.z_filefunc, ziinit.filestream, central_dir, read_this) != read_this)
                 err = ZIP_ERRNO;
 
-            if (err == ZIP_OK)
-                err = add_data_in_datablock(&ziinit.central_dir, buf_read, (uint32_t)read_this);
-
+            central_dir += read_this;
             size_central_dir_to_read -= read_this;
         }
-        TRYFREE(buf_read);
+        if (err == ZIP_OK)
+            ziinit.central_dir.size = size_central_dir;
 
         ziinit.number_entry = number_entry_CD;
 
@@ -839,6 +862,8 @@ extern zipFile ZEXPORT zipOpen4(const void *path, int append, uint64_t disk_size
 #ifndef NO_ADDFILEINEXISTINGZIP
         TRYFREE(ziinit.globalcomment);
 #endif
+        zipCentralDirFree(&ziinit.central_dir);
+        TRYFREE(ziinit.ci.buffered_data);
         TRYFREE(zi);
         return NULL;
     }
@@ -855,9 +880,9 @@ extern zipFile ZEXPORT zipOpen2(const char *path, int append, const char **globa
     {
         zlib_filefunc64_32_def zlib_filefunc64_32_def_fill;
         fill_zlib_filefunc64_32_def_from_filefunc32(&zlib_filefunc64_32_def_fill,pzlib_filefunc32_def);
-        return zipOpen4(path, append, 0, globalcomment, &zlib_filefunc64_32_def_fill);
+        return zipOpen4(path, append, 0, globalcomment, &zlib_filefunc64_32_def_fill, 0);
     }
-    return zipOpen4(path, append, 0, globalcomment, NULL);
+    return zipOpen4(path, append, 0, globalcomment, NULL, 0);
 }
 
 extern zipFile ZEXPORT zipOpen2_64(const void *path, int append, const char **globalcomment,
@@ -869,9 +894,9 @@ extern zipFile ZEXPORT zipOpen2_64(const void *path, int append, const char **gl
         zlib_filefunc64_32_def_fill.zfile_func64 = *pzlib_filefunc_def;
         zlib_filefunc64_32_def_fill.ztell32_file = NULL;
         zlib_filefunc64_32_def_fill.zseek32_file = NULL;
-        return zipOpen4(path, append, 0, globalcomment, &zlib_filefunc64_32_def_fill);
+        return zipOpen4(path, append, 0, globalcomment, &zlib_filefunc64_32_def_fill, 0);
     }
-    return zipOpen4(path, append, 0, globalcomment, NULL);
+    return zipOpen4(path, append, 0, globalcomment, NULL, 0);
 }
 
 extern zipFile ZEXPORT zipOpen3(const char *path, int append, uint64_t disk_size, const char **globalcomment,
@@ -881,9 +906,9 @@ extern zipFile ZEXPORT zipOpen3(const char *path, int append, uint64_t disk_size
     {
         zlib_filefunc64_32_def zlib_filefunc64_32_def_fill;
         fill_zlib_filefunc64_32_def_from_filefunc32(&zlib_filefunc64_32_def_fill,pzlib_filefunc32_def);
-        return zipOpen4(path, append, disk_size, globalcomment, &zlib_filefunc64_32_def_fill);
+        return zipOpen4(path, append, disk_size, globalcomment, &zlib_filefunc64_32_def_fill, 0);
     }
-    return zipOpen4(path, append, disk_size, globalcomment, NULL);
+    return zipOpen4(path, append, disk_size, globalcomment, NULL, 0);
 }
 
 extern zipFile ZEXPORT zipOpen3_64(const void *path, int append, uint64_t disk_size, const char **globalcomment,
@@ -895,9 +920,23 @@ extern zipFile ZEXPORT zipOpen3_64(const void *path, int append, uint64_t disk_s
         zlib_filefunc64_32_def_fill.zfile_func64 = *pzlib_filefunc_def;
         zlib_filefunc64_32_def_fill.ztell32_file = NULL;
         zlib_filefunc64_32_def_fill.zseek32_file = NULL;
-        return zipOpen4(path, append, disk_size, globalcomment, &zlib_filefunc64_32_def_fill);
+        return zipOpen4(path, append, disk_size, globalcomment, &zlib_filefunc64_32_def_fill, 0);
     }
-    return zipOpen4(path, append, disk_size, globalcomment, NULL);
+    return zipOpen4(path, append, disk_size, globalcomment, NULL, 0);
+}
+
+extern zipFile ZEXPORT zipOpen5(const void *path, int append, uint64_t disk_size, const char **globalcomment,
+    zlib_filefunc64_def *pzlib_filefunc_def, uint32_t write_buffer_size)
+{
+    if (pzlib_filefunc_def != NULL)
+    {
+        zlib_filefunc64_32_def zlib_filefunc64_32_def_fill;
+        zlib_filefunc64_32_def_fill.zfile_func64 = *pzlib_filefunc_def;
+        zlib_filefunc64_32_def_fill.ztell32_file = NULL;
+        zlib_filefunc64_32_def_fill.zseek32_file = NULL;
+        return zipOpen4(path, append, disk_size, globalcomment, &zlib_filefunc64_32_def_fill, write_buffer_size);
+    }
+    return zipOpen4(path, append, disk_size, globalcomment, NULL, write_buffer_size);
 }
 
 extern zipFile ZEXPORT zipOpen(const char *path, int append)
@@ -910,6 +949,210 @@ extern zipFile ZEXPORT zipOpen64(const void *path, int append)
     return zipOpen3(path, append, 0, NULL, NULL);
 }
 
+#ifndef HAVE_APPLE_COMPRESSION
+/* Get the deflate state of the zipfile ready for a new file. It is reset when the window and memory level are
+   the same as for the last file, only allocated again when they change */
+static int zipPrepareDeflate(zip64_internal *zi, int level, int windowBits, int memLevel, int strategy)
+{
+    int err = Z_OK;
+
+    if (zi->ci.deflate_initialised)
+    {
+        if ((zi->ci.deflate_window_bits == windowBits) && (zi->ci.deflate_mem_level == memLevel))
+        {
+            err = deflateReset(&zi->ci.stream);
+            if ((err == Z_OK) && ((zi->ci.deflate_level != level) || (zi->ci.deflate_strategy != strategy)))
+                err = deflateParams(&zi->ci.stream, level, strategy);
+            if (err == Z_OK)
+            {
+                zi->ci.deflate_level = level;
+                zi->ci.deflate_strategy = strategy;
+                return Z_OK;
+            }
+        }
+        deflateEnd(&zi->ci.stream);
+        zi->ci.deflate_initialised = 0;
+    }
+
+    zi->ci.stream.zalloc = (alloc_func)0;
+    zi->ci.stream.zfree = (free_func)0;
+    zi->ci.stream.opaque = (voidpf)zi;
+
+    err = deflateInit2(&zi->ci.stream, level, Z_DEFLATED, windowBits, memLevel, strategy);
+    if (err == Z_OK)
+    {
+        zi->ci.deflate_initialised = 1;
+        zi->ci.deflate_level = level;
+        zi->ci.deflate_window_bits = windowBits;
+        zi->ci.deflate_mem_level = memLevel;
+        zi->ci.deflate_strategy = strategy;
+    }
+    return err;
+}
+#endif
+
+/* Deflate queued blocks until the pool is deleted. Each block is deflated with the end of the block before
+   it as dictionary and ends on a byte boundary, so the blocks put one after the other are one deflate stream */
+static void *zipDeflateWorker(void *arg)
+{
+    zip_deflate_pool *pool = (zip_deflate_pool*)arg;
+    zip_deflate_job *job = NULL;
+    z_stream stream;
+    int stream_initialised = 0;
+    int level = 0;
+    int window_bits = 0;
+    int mem_level = 0;
+    int strategy = 0;
+    int err = Z_OK;
+
+    memset(&stream, 0, sizeof(stream));
+
+    for (;;)
+    {
+        pthread_mutex_lock(&pool->mutex);
+        while ((!pool->shutdown) && (pool->next_run == pool->next_fill))
+            pthread_cond_wait(&pool->job_queued, &pool->mutex);
+        if (pool->next_run == pool->next_fill)
+        {
+            pthread_mutex_unlock(&pool->mutex);
+            break;
+        }
+        job = &pool->jobs[pool->next_run % pool->job_count];
+        pool->next_run += 1;
+        pthread_mutex_unlock(&pool->mutex);
+
+        err = Z_OK;
+        if ((stream_initialised) && ((job->level != level) || (job->window_bits != window_bits) ||
+            (job->mem_level != mem_level) || (job->strategy != strategy)))
+        {
+            deflateEnd(&stream);
+            stream_initialised = 0;
+        }
+        if (!stream_initialised)
+        {
+            err = deflateInit2(&stream, job->level, Z_DEFLATED, job->window_bits, job->mem_level, job->strategy);
+            stream_initialised = (err == Z_OK);
+            level = job->level;
+            window_bits = job->window_bits;
+            mem_level = job->mem_level;
+            strategy = job->strategy;
+        }
+        else
+        {
+            err = deflateReset(&stream);
+        }
+
+        if ((err == Z_OK) && (job->dictionary_size > 0))
+            err = deflateSetDictionary(&stream, job->dictionary, job->dictionary_size);
+        if (err == Z_OK)
+        {
+            stream.next_in = job->in;
+            stream.avail_in = job->in_size;
+            stream.next_out = job->out;
+            stream.avail_out = job->out_size;
+            err = deflate(&stream, (job->last) ? Z_FINISH : Z_SYNC_FLUSH);
+            if ((job->last) && (err == Z_STREAM_END))
+                err = Z_OK;
+            else if ((job->last) || (stream.avail_in > 0) || (stream.avail_out == 0))
+                err = Z_BUF_ERROR;
+        }
+        job->crc32 = crc32_fast(0, job->in, job->in_size);
+
+        pthread_mutex_lock(&pool->mutex);
+        job->out_size -= stream.avail_out;
+        job->err = (err == Z_OK) ? ZIP_OK : ZIP_INTERNALERROR;
+        job->done = 1;
+        pthread_cond_broadcast(&pool->job_done);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+
+    if (stream_initialised)
+        deflateEnd(&stream);
+    return NULL;
+}
+
+static void zipDeflateDeletePool(zip_deflate_pool *pool)
+{
+    uint32_t i = 0;
+
+    if (pool == NULL)
+        return;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->job_queued);
+    pthread_mutex_unlock(&pool->mutex);
+    for (i = 0; i < pool->thread_count; i += 1)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_cond_destroy(&pool->job_done);
+    pthread_cond_destroy(&pool->job_queued);
+    pthread_mutex_destroy(&pool->mutex);
+    for (i = 0; i < pool->job_count; i += 1)
+    {
+        TRYFREE(pool->jobs[i].in);
+        TRYFREE(pool->jobs[i].out);
+    }
+    TRYFREE(pool->jobs);
+    TRYFREE(pool);
+}
+
+/* Start the deflate threads, two jobs for each one so blocks are filled and written while others deflate */
+static zip_deflate_pool *zipDeflateCreatePool(uint32_t thread_count, uint32_t block_size)
+{
+    zip_deflate_pool *pool = NULL;
+    uint32_t out_size = 0;
+    uint32_t i = 0;
+
+    pool = (zip_deflate_pool*)ALLOC(sizeof(zip_deflate_pool));
+    if (pool == NULL)
+        return NULL;
+    memset(pool, 0, sizeof(zip_deflate_pool));
+
+    pool->block_size = block_size;
+    pool->job_count = thread_count * 2;
+    pool->jobs = (zip_deflate_job*)ALLOC(pool->job_count * sizeof(zip_deflate_job));
+    if (pool->jobs == NULL)
+    {
+        TRYFREE(pool);
+        return NULL;
+    }
+    memset(pool->jobs, 0, pool->job_count * sizeof(zip_deflate_job));
+
+    /* Bound of deflate with stored blocks, and the empty block of the sync flush */
+    out_size = block_size + (block_size >> 3) + (block_size >> 6) + 64;
+    if ((pthread_mutex_init(&pool->mutex, NULL) != 0) || (pthread_cond_init(&pool->job_queued, NULL) != 0) ||
+        (pthread_cond_init(&pool->job_done, NULL) != 0))
+    {
+        TRYFREE(pool->jobs);
+        TRYFREE(pool);
+        return NULL;
+    }
+    for (i = 0; i < pool->job_count; i += 1)
+    {
+        pool->jobs[i].in = (uint8_t*)ALLOC(block_size);
+        pool->jobs[i].out = (uint8_t*)ALLOC(out_size);
+        if ((pool->jobs[i].in == NULL) || (pool->jobs[i].out == NULL))
+        {
+            zipDeflateDeletePool(pool);
+            return NULL;
+        }
+    }
+
+    for (i = 0; i < thread_count; i += 1)
+    {
+        if (pthread_create(&pool->threads[i], NULL, zipDeflateWorker, pool) != 0)
+            break;
+        pool->thread_count += 1;
+    }
+    if (pool->thread_count == 0)
+    {
+        zipDeflateDeletePool(pool);
+        return NULL;
+    }
+    return pool;
+}
+
 extern int ZEXPORT zipOpenNewFileInZip_internal(zipFile file,
                                                 const char *filename,
                                                 const zip_fileinfo *zipfi,
@@ -935,7 +1178,6 @@ extern int ZEXPORT zipOpenNewFileInZip_internal(zipFile file,
     uint64_t size_needed = 0;
     uint16_t size_filename = 0;
     uint16_t size_comment = 0;
-    uint16_t i = 0;
     unsigned char *central_dir = NULL;
     int err = ZIP_OK;
 
@@ -1032,7 +1274,11 @@ extern int ZEXPORT zipOpenNewFileInZip_internal(zipFile file,
     if (zi->ci.method == AES_METHOD)
         zi->ci.size_centralextrafree += 11; /* Extra space reserved for AES extra info */
 #endif
-    zi->ci.central_header = (char*)ALLOC((uint32_t)zi->ci.size_centralheader + zi->ci.size_centralextrafree + size_comment);
+    /* The record is built where it ends up in the central directory, it counts once the file is closed */
+    zi->ci.central_header = (char*)zipCentralDirReserve(&zi->central_dir,
+        (uint64_t)zi->ci.size_centralheader + zi->ci.size_centralextrafree + size_comment);
+    if (zi->ci.central_header == NULL)
+        return ZIP_INTERNALERROR;
     zi->ci.number_disk = zi->number_disk;
 
     /* Write central directory header */
@@ -1068,19 +1314,13 @@ extern int ZEXPORT zipOpenNewFileInZip_internal(zipFile file,
         zipWriteValueToMemoryAndMove(&central_dir,
             (uint32_t)(zi->ci.pos_local_header - zi->add_position_when_writting_offset), 4);
 
-    for (i = 0; i < size_filename; i++)
-        zi->ci.central_header[SIZECENTRALHEADER+i] = filename[i];
-    for (i = 0; i < size_extrafield_global; i++)
-        zi->ci.central_header[SIZECENTRALHEADER+size_filename+i] =
-            ((const char*)extrafield_global)[i];
+    memcpy(zi->ci.central_header + SIZECENTRALHEADER, filename, size_filename);
+    if (size_extrafield_global > 0)
+        memcpy(zi->ci.central_header + SIZECENTRALHEADER + size_filename, extrafield_global, size_extrafield_global);
 
     /* Store comment at the end for later repositioning */
-    for (i = 0; i < size_comment; i++)
-        zi->ci.central_header[zi->ci.size_centralheader+
-            zi->ci.size_centralextrafree+i] = comment[i];
-
-    if (zi->ci.central_header == NULL)
-        return ZIP_INTERNALERROR;
+    if (size_comment > 0)
+        memcpy(zi->ci.central_header + zi->ci.size_centralheader + zi->ci.size_centralextrafree, comment, size_comment);
 
     /* Write the local header */
     if (err == ZIP_OK)
@@ -1160,7 +1400,7 @@ extern int ZEXPORT zipOpenNewFileInZip_internal(zipFile file,
 
 #ifdef HAVE_BZIP2
     zi->ci.bstream.avail_in = (uint16_t)0;
-    zi->ci.bstream.avail_out = (uint16_t)Z_BUFSIZE;
+    zi->ci.bstream.avail_out = zi->ci.buffered_data_size;
     zi->ci.bstream.next_out = (char*)zi->ci.buffered_data;
     zi->ci.bstream.total_in_hi32 = 0;
     zi->ci.bstream.total_in_lo32 = 0;
@@ -1169,7 +1409,7 @@ extern int ZEXPORT zipOpenNewFileInZip_internal(zipFile file,
 #endif
 
     zi->ci.stream.avail_in = (uint16_t)0;
-    zi->ci.stream.avail_out = Z_BUFSIZE;
+    zi->ci.stream.avail_out = zi->ci.buffered_data_size;
     zi->ci.stream.next_out = zi->ci.buffered_data;
     zi->ci.stream.total_in = 0;
     zi->ci.stream.total_out = 0;
@@ -1179,10 +1419,6 @@ extern int ZEXPORT zipOpenNewFileInZip_internal(zipFile file,
     {
         if (method == Z_DEFLATED)
         {
-            zi->ci.stream.zalloc = (alloc_func)0;
-            zi->ci.stream.zfree = (free_func)0;
-            zi->ci.stream.opaque = (voidpf)zi;
-
             if (windowBits > 0)
                 windowBits = -windowBits;
 
@@ -1193,10 +1429,26 @@ extern int ZEXPORT zipOpenNewFileInZip_internal(zipFile file,
             else
                 err = Z_OK;
 #else
-            err = deflateInit2(&zi->ci.stream, level, Z_DEFLATED, windowBits, memLevel, strategy);
+            err = zipPrepareDeflate(zi, level, windowBits, memLevel, strategy);
 #endif
             if (err == Z_OK)
                 zi->ci.stream_initialised = Z_DEFLATED;
+
+            /* Blocks are deflated by zlib on the threads, the stream above takes files smaller than a block */
+            if ((err == Z_OK) && (zi->deflate_threads != 1))
+            {
+                if (zi->deflate_pool == NULL)
+                    zi->deflate_pool = zipDeflateCreatePool(zi->deflate_threads, zi->deflate_block_size);
+                if (zi->deflate_pool != NULL)
+                {
+                    zi->ci.parallel_deflate = 1;
+                    zi->ci.deflate_first_job = zi->deflate_pool->next_fill;
+                    zi->ci.deflate_level = level;
+                    zi->ci.deflate_window_bits = windowBits;
+                    zi->ci.deflate_mem_level = memLevel;
+                    zi->ci.deflate_strategy = strategy;
+                }
+            }
         }
         else if (method == Z_BZIP2ED)
         {
@@ -1213,7 +1465,8 @@ extern int ZEXPORT zipOpenNewFileInZip_internal(zipFile file,
     }
 
 #ifndef NOCRYPT
-    if ((err == Z_OK) && (password != NULL))
+    /* Data already encrypted starts with its own encryption header */
+    if ((err == Z_OK) && (password != NULL) && (raw != ZIP_RAW_ENCRYPTED))
     {
 #ifdef HAVE_AES
         if (zi->ci.method == AES_METHOD)
@@ -1227,9 +1480,13 @@ extern int ZEXPORT zipOpenNewFileInZip_internal(zipFile file,
 
             saltlength = SALT_LENGTH(AES_ENCRYPTIONMODE);
 
-            prng_init(cryptrand, zi->ci.aes_rng);
+            /* Each file has its own salt so the key is derived again, only the generator is kept */
+            if (!zi->ci.aes_rng_initialised)
+            {
+                prng_init(cryptrand, zi->ci.aes_rng);
+                zi->ci.aes_rng_initialised = 1;
+            }
             prng_rand(saltvalue, saltlength, zi->ci.aes_rng);
-            prng_end(zi->ci.aes_rng);
 
             fcrypt_init(AES_ENCRYPTIONMODE, (uint8_t *)password, (uint32_t)strlen(password), saltvalue, passverify, &zi->ci.aes_ctx);
 
@@ -1371,7 +1628,7 @@ static int zipFlushWriteBuffer(zip64_internal *zi)
     uint32_t max_write = 0;
     int err = ZIP_OK;
 
-    if ((zi->ci.flag & 1) != 0)
+    if (((zi->ci.flag & 1) != 0) && (zi->ci.raw != ZIP_RAW_ENCRYPTED))
     {
 #ifndef NOCRYPT
 #ifdef HAVE_AES
@@ -1445,6 +1702,150 @@ static int zipFlushWriteBuffer(zip64_internal *zi)
     return err;
 }
 
+/* Write the deflated blocks in order until job until is written */
+static int zipDeflateWriteJobs(zip64_internal *zi, uint64_t until)
+{
+    zip_deflate_pool *pool = zi->deflate_pool;
+    zip_deflate_job *job = NULL;
+    uint32_t pos = 0;
+    uint32_t copy_this = 0;
+    int err = ZIP_OK;
+
+    while (pool->next_write < until)
+    {
+        job = &pool->jobs[pool->next_write % pool->job_count];
+        pthread_mutex_lock(&pool->mutex);
+        while (!job->done)
+            pthread_cond_wait(&pool->job_done, &pool->mutex);
+        pthread_mutex_unlock(&pool->mutex);
+
+        /* Written through the write buffer to be encrypted and split between disks like any other data */
+        if ((err == ZIP_OK) && (job->err != ZIP_OK))
+            err = job->err;
+        for (pos = 0; (err == ZIP_OK) && (pos < job->out_size); pos += copy_this)
+        {
+            copy_this = zi->ci.buffered_data_size - zi->ci.pos_in_buffered_data;
+            if (copy_this > job->out_size - pos)
+                copy_this = job->out_size - pos;
+            memcpy(zi->ci.buffered_data + zi->ci.pos_in_buffered_data, job->out + pos, copy_this);
+            zi->ci.pos_in_buffered_data += copy_this;
+            if (zi->ci.pos_in_buffered_data == zi->ci.buffered_data_size)
+                err = zipFlushWriteBuffer(zi);
+        }
+        zi->ci.crc32 = crc32_fast_combine(zi->ci.crc32, job->crc32, job->in_size);
+        zi->ci.total_uncompressed += job->in_size;
+
+        job->in_size = 0;
+        job->done = 0;
+        pool->next_write += 1;
+    }
+    return err;
+}
+
+/* Queue the block being filled and make the next job free to be filled */
+static int zipDeflateQueueJob(zip64_internal *zi, int last)
+{
+    zip_deflate_pool *pool = zi->deflate_pool;
+    zip_deflate_job *job = &pool->jobs[pool->next_fill % pool->job_count];
+    uint32_t dictionary_size = (uint32_t)1 << -zi->ci.deflate_window_bits;
+
+    job->level = zi->ci.deflate_level;
+    job->window_bits = zi->ci.deflate_window_bits;
+    job->mem_level = zi->ci.deflate_mem_level;
+    job->strategy = zi->ci.deflate_strategy;
+    job->last = last;
+    job->out_size = pool->block_size + (pool->block_size >> 3) + (pool->block_size >> 6) + 64;
+    job->dictionary_size = 0;
+    if (pool->next_fill != zi->ci.deflate_first_job)
+    {
+        job->dictionary_size = pool->dictionary_size;
+        memcpy(job->dictionary, pool->dictionary, pool->dictionary_size);
+    }
+
+    /* Blocks before the last one are full and larger than the window */
+    if (!last)
+    {
+        if (dictionary_size > ZIP_DEFLATEDICTSIZE)
+            dictionary_size = ZIP_DEFLATEDICTSIZE;
+        pool->dictionary_size = dictionary_size;
+        memcpy(pool->dictionary, job->in + job->in_size - dictionary_size, dictionary_size);
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->next_fill += 1;
+    pthread_cond_signal(&pool->job_queued);
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (pool->next_fill - pool->next_write >= pool->job_count)
+        return zipDeflateWriteJobs(zi, pool->next_fill - pool->job_count + 1);
+    return ZIP_OK;
+}
+
+static int zipDeflateWrite(zip64_internal *zi, const uint8_t *buf, uint32_t len)
+{
+    zip_deflate_pool *pool = zi->deflate_pool;
+    zip_deflate_job *job = NULL;
+    uint32_t copy_this = 0;
+    int err = ZIP_OK;
+
+    while ((err == ZIP_OK) && (len > 0))
+    {
+        job = &pool->jobs[pool->next_fill % pool->job_count];
+        copy_this = pool->block_size - job->in_size;
+        if (copy_this > len)
+            copy_this = len;
+        memcpy(job->in + job->in_size, buf, copy_this);
+        job->in_size += copy_this;
+        buf += copy_this;
+        len -= copy_this;
+
+        if (job->in_size == pool->block_size)
+            err = zipDeflateQueueJob(zi, 0);
+    }
+    return err;
+}
+
+/* Write data stored as it is straight to the zipfile after what is in the write buffer */
+static int zipWriteDirect(zip64_internal *zi, const uint8_t *buf, uint32_t len)
+{
+    int err = ZIP_OK;
+
+    if (zi->ci.pos_in_buffered_data > 0)
+    {
+        err = zipFlushWriteBuffer(zi);
+        zi->ci.stream.avail_out = zi->ci.buffered_data_size;
+        zi->ci.stream.next_out = zi->ci.buffered_data;
+        if (err != ZIP_OK)
+            return err;
+    }
+
+    zi->ci.crc32 = crc32_fast(zi->ci.crc32, buf, len);
+    if (ZWRITE64(zi->z_filefunc, zi->filestream, buf, len) != len)
+        return ZIP_ERRNO;
+
+    zi->ci.total_compressed += len;
+    zi->ci.total_uncompressed += len;
+    return ZIP_OK;
+}
+
+extern int ZEXPORT zipWriteInFileInZip64(zipFile file, const void *buf, uint64_t len)
+{
+    const uint8_t *pos = (const uint8_t*)buf;
+    uint32_t write = 0;
+    int err = ZIP_OK;
+
+    while ((err == ZIP_OK) && (len > 0))
+    {
+        write = ZIP_WRITEPIECESIZE;
+        if (write > len)
+            write = (uint32_t)len;
+        err = zipWriteInFileInZip(file, pos, write);
+        pos += write;
+        len -= write;
+    }
+    return err;
+}
+
 extern int ZEXPORT zipWriteInFileInZip(zipFile file, const void *buf, uint32_t len)
 {
     zip64_internal *zi = NULL;
@@ -1457,7 +1858,18 @@ extern int ZEXPORT zipWriteInFileInZip(zipFile file, const void *buf, uint32_t l
     if (zi->in_opened_file_inzip == 0)
         return ZIP_PARAMERROR;
 
-    zi->ci.crc32 = (uint32_t)crc32(zi->ci.crc32, buf, len);
+    if (zi->ci.parallel_deflate)
+        return zipDeflateWrite(zi, (const uint8_t*)buf, len);
+
+    /* Writes of at least a buffer of data copied as it is are not worth copying, unless they are encrypted here
+       or split between disks */
+    if (((zi->ci.compression_method == 0) || (zi->ci.raw)) && (len >= zi->ci.buffered_data_size) &&
+        (((zi->ci.flag & 1) == 0) || (zi->ci.raw == ZIP_RAW_ENCRYPTED)) && (zi->disk_size == 0))
+        return zipWriteDirect(zi, (const uint8_t*)buf, len);
+
+    /* Stored data is checksummed as it is copied to the write buffer */
+    if ((zi->ci.compression_method != 0) || (zi->ci.raw))
+        zi->ci.crc32 = crc32_fast(zi->ci.crc32, buf, len);
 
 #ifdef HAVE_BZIP2
     if ((zi->ci.compression_method == Z_BZIP2ED) && (!zi->ci.raw))
@@ -1472,7 +1884,7 @@ extern int ZEXPORT zipWriteInFileInZip(zipFile file, const void *buf, uint32_t l
             {
                 err = zipFlushWriteBuffer(zi);
                 
-                zi->ci.bstream.avail_out = (uint16_t)Z_BUFSIZE;
+                zi->ci.bstream.avail_out = zi->ci.buffered_data_size;
                 zi->ci.bstream.next_out = (char*)zi->ci.buffered_data;
             }
             else
@@ -1482,7 +1894,7 @@ extern int ZEXPORT zipWriteInFileInZip(zipFile file, const void *buf, uint32_t l
 
                 err = BZ2_bzCompress(&zi->ci.bstream, BZ_RUN);
 
-                zi->ci.pos_in_buffered_data += (uint16_t)(zi->ci.bstream.total_out_lo32 - total_out_before_lo);
+                zi->ci.pos_in_buffered_data += (uint32_t)(zi->ci.bstream.total_out_lo32 - total_out_before_lo);
             }
         }
 
@@ -1501,7 +1913,7 @@ extern int ZEXPORT zipWriteInFileInZip(zipFile file, const void *buf, uint32_t l
             {
                 err = zipFlushWriteBuffer(zi);
                 
-                zi->ci.stream.avail_out = Z_BUFSIZE;
+                zi->ci.stream.avail_out = zi->ci.buffered_data_size;
                 zi->ci.stream.next_out = zi->ci.buffered_data;
             }
 
@@ -1544,15 +1956,15 @@ extern int ZEXPORT zipWriteInFileInZip(zipFile file, const void *buf, uint32_t l
             else
             {
                 uint32_t copy_this = 0;
-                uint32_t i = 0;
                 if (zi->ci.stream.avail_in < zi->ci.stream.avail_out)
                     copy_this = zi->ci.stream.avail_in;
                 else
                     copy_this = zi->ci.stream.avail_out;
 
-                for (i = 0; i < copy_this; i++)
-                    *(((char*)zi->ci.stream.next_out)+i) =
-                        *(((const char*)zi->ci.stream.next_in)+i);
+                if ((zi->ci.compression_method == 0) && (!zi->ci.raw))
+                    zi->ci.crc32 = crc32_fast_copy(zi->ci.crc32, zi->ci.stream.next_out, zi->ci.stream.next_in, copy_this);
+                else
+                    memcpy(zi->ci.stream.next_out, zi->ci.stream.next_in, copy_this);
 
                 zi->ci.stream.avail_in -= copy_this;
                 zi->ci.stream.avail_out -= copy_this;
@@ -1571,8 +1983,12 @@ extern int ZEXPORT zipWriteInFileInZip(zipFile file, const void *buf, uint32_t l
 extern int ZEXPORT zipCloseFileInZipRaw64(zipFile file, uint64_t uncompressed_size, uint32_t crc32)
 {
     zip64_internal *zi = NULL;
+    zip_deflate_pool *pool = NULL;
+    zip_deflate_job *job = NULL;
+    uint32_t in_size = 0;
+    int parallel_deflated = 0;
+    int written = ZIP_OK;
     uint16_t extra_data_size = 0;
-    uint32_t i = 0;
     unsigned char *extra_info = NULL;
     int err = ZIP_OK;
 
@@ -1584,7 +2000,30 @@ extern int ZEXPORT zipCloseFileInZipRaw64(zipFile file, uint64_t uncompressed_si
         return ZIP_PARAMERROR;
     zi->ci.stream.avail_in = 0;
 
-    if (!zi->ci.raw)
+    if (zi->ci.parallel_deflate)
+    {
+        pool = zi->deflate_pool;
+        job = &pool->jobs[pool->next_fill % pool->job_count];
+        zi->ci.parallel_deflate = 0;
+
+        if (pool->next_fill == zi->ci.deflate_first_job)
+        {
+            /* Files not larger than a block gain nothing from threads and are deflated here */
+            in_size = job->in_size;
+            job->in_size = 0;
+            err = zipWriteInFileInZip(file, job->in, in_size);
+        }
+        else
+        {
+            err = zipDeflateQueueJob(zi, 1);
+            written = zipDeflateWriteJobs(zi, pool->next_fill);
+            if (err == ZIP_OK)
+                err = written;
+            parallel_deflated = 1;
+        }
+    }
+
+    if ((!zi->ci.raw) && (!parallel_deflated) && (err == ZIP_OK))
     {
         if (zi->ci.compression_method == Z_DEFLATED)
         {
@@ -1596,7 +2035,7 @@ extern int ZEXPORT zipCloseFileInZipRaw64(zipFile file, uint64_t uncompressed_si
                 {
                     err = zipFlushWriteBuffer(zi);
 
-                    zi->ci.stream.avail_out = Z_BUFSIZE;
+                    zi->ci.stream.avail_out = zi->ci.buffered_data_size;
                     zi->ci.stream.next_out = zi->ci.buffered_data;
                 }
                 
@@ -1614,7 +2053,7 @@ extern int ZEXPORT zipCloseFileInZipRaw64(zipFile file, uint64_t uncompressed_si
                 compression_status status = 0;
                 status = compression_stream_process(&zi->ci.astream, COMPRESSION_STREAM_FINALIZE);
 
-                uint32_t total_out_after = Z_BUFSIZE - zi->ci.astream.dst_size;
+                uint32_t total_out_after = zi->ci.buffered_data_size - zi->ci.astream.dst_size;
 
                 zi->ci.stream.next_in = zi->ci.astream.src_ptr;
                 zi->ci.stream.avail_in = zi->ci.astream.src_size;
@@ -1635,7 +2074,7 @@ extern int ZEXPORT zipCloseFileInZipRaw64(zipFile file, uint64_t uncompressed_si
 #else
                 total_out_before = (uint32_t)zi->ci.stream.total_out;
                 err = deflate(&zi->ci.stream, Z_FINISH);
-                zi->ci.pos_in_buffered_data += (uint16_t)(zi->ci.stream.total_out - total_out_before);
+                zi->ci.pos_in_buffered_data += (uint32_t)(zi->ci.stream.total_out - total_out_before);
 #endif
             }
         }
@@ -1651,7 +2090,7 @@ extern int ZEXPORT zipCloseFileInZipRaw64(zipFile file, uint64_t uncompressed_si
                 {
                     err = zipFlushWriteBuffer(zi);
                     
-                    zi->ci.bstream.avail_out = (uint16_t)Z_BUFSIZE;
+                    zi->ci.bstream.avail_out = zi->ci.buffered_data_size;
                     zi->ci.bstream.next_out = (char*)zi->ci.buffered_data;
                 }
                 
@@ -1659,7 +2098,7 @@ extern int ZEXPORT zipCloseFileInZipRaw64(zipFile file, uint64_t uncompressed_si
                 err = BZ2_bzCompress(&zi->ci.bstream, BZ_FINISH);
                 if (err == BZ_STREAM_END)
                     err = Z_STREAM_END;
-                zi->ci.pos_in_buffered_data += (uint16_t)(zi->ci.bstream.total_out_lo32 - total_out_before);
+                zi->ci.pos_in_buffered_data += (uint32_t)(zi->ci.bstream.total_out_lo32 - total_out_before);
             }
 
             if (err == BZ_FINISH_OK)
@@ -1677,7 +2116,7 @@ extern int ZEXPORT zipCloseFileInZipRaw64(zipFile file, uint64_t uncompressed_si
     }
 
 #ifdef HAVE_AES
-    if (zi->ci.method == AES_METHOD)
+    if ((zi->ci.method == AES_METHOD) && (zi->ci.raw != ZIP_RAW_ENCRYPTED))
     {
         unsigned char authcode[AES_AUTHCODESIZE];
 
@@ -1695,9 +2134,8 @@ extern int ZEXPORT zipCloseFileInZipRaw64(zipFile file, uint64_t uncompressed_si
             int tmp_err = 0;
 #ifdef HAVE_APPLE_COMPRESSION
             tmp_err = compression_stream_destroy(&zi->ci.astream);
-#else
-            tmp_err = deflateEnd(&zi->ci.stream);
 #endif
+            /* The deflate state is kept and reset for the next file */
             if (err == ZIP_OK)
                 err = tmp_err;
             zi->ci.stream_initialised = 0;
@@ -1810,15 +2248,15 @@ extern int ZEXPORT zipCloseFileInZipRaw64(zipFile file, uint64_t uncompressed_si
     }
 #endif
     /* Restore comment to correct position */
-    for (i = 0; i < zi->ci.size_comment; i++)
-        zi->ci.central_header[zi->ci.size_centralheader+i] =
-            zi->ci.central_header[zi->ci.size_centralheader+zi->ci.size_centralextrafree+i];
+    if (zi->ci.size_comment > 0)
+        memmove(zi->ci.central_header + zi->ci.size_centralheader,
+            zi->ci.central_header + zi->ci.size_centralheader + zi->ci.size_centralextrafree, zi->ci.size_comment);
     zi->ci.size_centralheader += zi->ci.size_comment;
 
+    /* The record is already in place, it only needs to be counted */
     if (err == ZIP_OK)
-        err = add_data_in_datablock(&zi->central_dir, zi->ci.central_header, zi->ci.size_centralheader);
-
-    free(zi->ci.central_header);
+        zi->central_dir.size += zi->ci.size_centralheader;
+    zi->ci.central_header = NULL;
 
     zi->number_entry++;
     zi->in_opened_file_inzip = 0;
@@ -1836,6 +2274,78 @@ extern int ZEXPORT zipCloseFileInZip(zipFile file)
     return zipCloseFileInZipRaw(file, 0, 0);
 }
 
+extern int ZEXPORT zipSetLookupIndex(zipFile file, int lookup_index)
+{
+    zip64_internal *zi = NULL;
+
+    if (file == NULL)
+        return ZIP_PARAMERROR;
+    zi = (zip64_internal*)file;
+    zi->lookup_index = lookup_index;
+    return ZIP_OK;
+}
+
+extern int ZEXPORT zipSetDeflateThreads(zipFile file, uint32_t thread_count, uint32_t block_size)
+{
+    zip64_internal *zi = NULL;
+    long online = 0;
+
+    if (file == NULL)
+        return ZIP_PARAMERROR;
+    zi = (zip64_internal*)file;
+    if ((zi->in_opened_file_inzip) && (zi->ci.parallel_deflate))
+        return ZIP_PARAMERROR;
+
+    if (thread_count == 0)
+    {
+        online = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = (online > 0) ? (uint32_t)online : 1;
+    }
+    if (thread_count > ZIP_DEFLATEMAXTHREADS)
+        thread_count = ZIP_DEFLATEMAXTHREADS;
+    if (block_size == 0)
+        block_size = ZIP_DEFLATEBLOCKSIZE;
+    /* Blocks are larger than the dictionary taken from their end */
+    if (block_size < ZIP_DEFLATEDICTSIZE * 2)
+        block_size = ZIP_DEFLATEDICTSIZE * 2;
+
+    /* The threads are started again with the new settings for the next file */
+    zipDeflateDeletePool(zi->deflate_pool);
+    zi->deflate_pool = NULL;
+    zi->deflate_threads = thread_count;
+    zi->deflate_block_size = block_size;
+    return ZIP_OK;
+}
+
+/* Write the lookup index of the central directory in front of it, the zipfile is usable without it */
+static int zipWriteLookupIndex(zip64_internal *zi, uint64_t *centraldir_pos_inzip)
+{
+    const uint8_t *central_dir = zi->central_dir.data;
+    uint8_t *index = NULL;
+    uint64_t size_centraldir = zi->central_dir.size;
+    uint64_t offset_index = 0;
+    uint64_t index_size = 0;
+    int err = ZIP_OK;
+
+    if (size_centraldir == 0)
+        return ZIP_OK;
+
+    /* The central directory moves after the index, which records where it starts */
+    offset_index = *centraldir_pos_inzip - zi->add_position_when_writting_offset;
+    if (unzBuildLookupIndex(central_dir, size_centraldir, offset_index, NULL, 0, &index_size) == UNZ_OK)
+        index = (uint8_t*)ALLOC((size_t)index_size);
+    if ((index != NULL) && (unzBuildLookupIndex(central_dir, size_centraldir, offset_index,
+            index, index_size, &index_size) == UNZ_OK))
+    {
+        if (ZWRITE64(zi->z_filefunc, zi->filestream, index, (uint32_t)index_size) != index_size)
+            err = ZIP_ERRNO;
+        *centraldir_pos_inzip += index_size;
+    }
+
+    TRYFREE(index);
+    return err;
+}
+
 extern int ZEXPORT zipClose(zipFile file, const char *global_comment)
 {
     return zipClose_64(file, global_comment);
@@ -1849,11 +2359,12 @@ extern int ZEXPORT zipClose_64(zipFile file, const char *global_comment)
 extern int ZEXPORT zipClose2_64(zipFile file, const char *global_comment, uint16_t version_madeby)
 {
     zip64_internal *zi = NULL;
-    uint32_t size_centraldir = 0;
+    uint64_t size_centraldir = 0;
     uint16_t size_global_comment = 0;
     uint64_t centraldir_pos_inzip = 0;
     uint64_t pos = 0;
     uint64_t cd_pos = 0;
+    uint64_t cd_written = 0;
     uint32_t write = 0;
     int err = ZIP_OK;
 
@@ -1881,29 +2392,28 @@ extern int ZEXPORT zipClose2_64(zipFile file, const char *global_comment, uint16
 
     centraldir_pos_inzip = ZTELL64(zi->z_filefunc, zi->filestream);
 
-    if (err == ZIP_OK)
-    {
-        linkedlist_datablock_internal *ldi = zi->central_dir.first_block;
-        while (ldi != NULL)
-        {
-            if ((err == ZIP_OK) && (ldi->filled_in_this_block > 0))
-            {
-                write = ZWRITE64(zi->z_filefunc, zi->filestream, ldi->data, ldi->filled_in_this_block);
-                if (write != ldi->filled_in_this_block)
-                    err = ZIP_ERRNO;
-            }
+    /* Spanned zipfiles could split the index from the central directory */
+    if ((err == ZIP_OK) && (zi->lookup_index) && (zi->disk_size == 0))
+        err = zipWriteLookupIndex(zi, &centraldir_pos_inzip);
 
-            size_centraldir += ldi->filled_in_this_block;
-            ldi = ldi->next_datablock;
-        }
+    /* The central directory is written in one piece, the only split is at the 4 GB size of a write */
+    size_centraldir = zi->central_dir.size;
+    while ((err == ZIP_OK) && (cd_written < size_centraldir))
+    {
+        write = UINT32_MAX;
+        if (write > size_centraldir - cd_written)
+            write = (uint32_t)(size_centraldir - cd_written);
+        if (ZWRITE64(zi->z_filefunc, zi->filestream, zi->central_dir.data + cd_written, write) != write)
+            err = ZIP_ERRNO;
+        cd_written += write;
     }
 
-    free_linkedlist(&(zi->central_dir));
+    zipCentralDirFree(&zi->central_dir);
 
     pos = centraldir_pos_inzip - zi->add_position_when_writting_offset;
 
     /* Write the ZIP64 central directory header */
-    if (pos >= UINT32_MAX || zi->number_entry > UINT32_MAX)
+    if (pos >= UINT32_MAX || zi->number_entry >= UINT16_MAX || size_centraldir >= UINT32_MAX)
     {
         uint64_t zip64_eocd_pos_inzip = ZTELL64(zi->z_filefunc, zi->filestream);
         uint32_t zip64_datasize = 44;
@@ -1987,7 +2497,12 @@ extern int ZEXPORT zipClose2_64(zipFile file, const char *global_comment, uint16
     }
     /* Size of the central directory */
     if (err == ZIP_OK)
-        err = zipWriteValue(&zi->z_filefunc, zi->filestream, size_centraldir, 4);
+    {
+        if (size_centraldir >= UINT32_MAX)
+            err = zipWriteValue(&zi->z_filefunc, zi->filestream, UINT32_MAX, 4); /* use value in ZIP64 record */
+        else
+            err = zipWriteValue(&zi->z_filefunc, zi->filestream, size_centraldir, 4);
+    }
     /* Offset of start of central directory with respect to the starting disk number */
     if (err == ZIP_OK)
     {
@@ -2013,9 +2528,17 @@ extern int ZEXPORT zipClose2_64(zipFile file, const char *global_comment, uint16
     if ((ZCLOSE64(zi->z_filefunc, zi->filestream) != 0) && (err == ZIP_OK))
         err = ZIP_ERRNO;
 
+    if (zi->ci.deflate_initialised)
+        deflateEnd(&zi->ci.stream);
+    zipDeflateDeletePool(zi->deflate_pool);
+#ifdef HAVE_AES
+    if (zi->ci.aes_rng_initialised)
+        prng_end(zi->ci.aes_rng);
+#endif
 #ifndef NO_ADDFILEINEXISTINGZIP
     TRYFREE(zi->globalcomment);
 #endif
+    TRYFREE(zi->ci.buffered_data);
     TRYFREE(zi);
 
     return err;
@@ -72,6 +72,10 @@ typedef struct
 #define APPEND_STATUS_CREATEAFTER   (1)
 #define APPEND_STATUS_ADDINZIP      (2)
 
+/* raw value for compressed data already encrypted with the password, from its encryption header (the salt
+   and password verifier with AES) to its end (the authentication code with AES) */
+#define ZIP_RAW_ENCRYPTED           (2)
+
 /***************************************************************************/
 /* Writing a zip file */
 
@@ -107,6 +111,11 @@ extern zipFile ZEXPORT zipOpen3(const char *path, int append, uint64_t disk_size
 extern zipFile ZEXPORT zipOpen3_64(const void *path, int append, uint64_t disk_size, 
     const char **globalcomment, zlib_filefunc64_def *pzlib_filefunc_def);
 
+extern zipFile ZEXPORT zipOpen5(const void *path, int append, uint64_t disk_size,
+    const char **globalcomment, zlib_filefunc64_def *pzlib_filefunc_def, uint32_t write_buffer_size);
+/* Same as zipOpen3_64 but sets the size of the buffer compressed data is gathered in before it is written,
+   0 for the default. pzlib_filefunc_def can be NULL to use the default file functions */
+
 extern int ZEXPORT zipOpenNewFileInZip(zipFile file, const char *filename, const zip_fileinfo *zipfi,
     const void *extrafield_local, uint16_t size_extrafield_local, const void *extrafield_global, 
     uint16_t size_extrafield_global, const char *comment, uint16_t method, int level);
@@ -187,7 +196,11 @@ extern int ZEXPORT zipOpenNewFileInZip5(zipFile file,
 /* Allowing optional aes */
 
 extern int ZEXPORT zipWriteInFileInZip(zipFile file, const void *buf, uint32_t len);
-/* Write data in the zipfile */
+/* Write data in the zipfile. Stored or raw data of at least the size of the write buffer is written straight
+   to the zipfile, unless it is encrypted or the zipfile is spanned */
+
+extern int ZEXPORT zipWriteInFileInZip64(zipFile file, const void *buf, uint64_t len);
+/* Same as zipWriteInFileInZip for data of any size */
 
 extern int ZEXPORT zipCloseFileInZip(zipFile file);
 /* Close the current file in the zipfile */
@@ -195,7 +208,25 @@ extern int ZEXPORT zipCloseFileInZip(zipFile file);
 extern int ZEXPORT zipCloseFileInZipRaw(zipFile file, uint32_t uncompressed_size, uint32_t crc32);
 extern int ZEXPORT zipCloseFileInZipRaw64(zipFile file, uint64_t uncompressed_size, uint32_t crc32);
 /* Close the current file in the zipfile, for file opened with parameter raw=1 in zipOpenNewFileInZip2
-   where raw is compressed data. Parameters uncompressed_size and crc32 are value for the uncompressed data. */
+   where raw is compressed data. Parameters uncompressed_size and crc32 are value for the uncompressed data.
+   Files opened with raw=ZIP_RAW_ENCRYPTED and a password are marked encrypted but written as they are. */
+
+extern int ZEXPORT zipSetLookupIndex(zipFile file, int lookup_index);
+/* Write a lookup index of the entry table, file name hash and sorted order in front of the central directory
+   when the zipfile is closed, so unzOpen takes them from it instead of decoding the central directory. The
+   index is a block no entry refers to, other zip tools skip it. Files added later with APPEND_STATUS_ADDINZIP
+   are written after it and leave it unused, it is not written for spanned zipfiles.
+
+   return ZIP_OK if no error */
+
+extern int ZEXPORT zipSetDeflateThreads(zipFile file, uint32_t thread_count, uint32_t block_size);
+/* Deflate the files written after this call in blocks of block_size bytes on thread_count threads, with
+   thread_count 0 for one thread per online processor and 1 to deflate on the writing thread as by default.
+   Each block uses the end of the previous one as dictionary and ends on a byte boundary, so the file is one
+   deflate stream slightly larger than when deflated on one thread. Files not larger than a block are deflated
+   on the writing thread. block_size 0 is 128 KB, blocks are at least 64 KB.
+
+   return ZIP_OK if no error */
 
 extern int ZEXPORT zipClose(zipFile file, const char *global_comment);
 /* Close the zipfile */
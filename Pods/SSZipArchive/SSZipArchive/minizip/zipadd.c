@@ -0,0 +1,891 @@
+/* zipadd.c -- Add many files to a .zip using several threads
+   part of the MiniZip project
+
+   This program is distributed under the terms of the same license as zlib.
+   See the accompanying LICENSE file for the full text of the license.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <errno.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "zlib.h"
+#include "zip.h"
+#include "crc32fast.h"
+#include "minishared.h"
+
+#ifdef HAVE_AES
+#  define AES_PWVERIFYSIZE    (2)
+#  define AES_AUTHCODESIZE    (10)
+#  define AES_MAXSALTLENGTH   (16)
+#  define AES_ENCRYPTIONMODE  (0x03)
+
+#  include "aes/aes.h"
+#  include "aes/fileenc.h"
+#  include "aes/prng.h"
+#endif
+
+#ifndef NOCRYPT
+#  include "crypt.h"
+#endif
+
+#include "zipadd.h"
+
+#ifndef ZIPADD_BUFSIZE
+#  define ZIPADD_BUFSIZE (256 * 1024)
+#endif
+#ifndef ZIPADD_CHUNKSIZE
+#  define ZIPADD_CHUNKSIZE (256 * 1024)
+#endif
+#ifndef ZIPADD_MEMORYLIMIT
+#  define ZIPADD_MEMORYLIMIT (64 * 1024 * 1024)
+#endif
+#ifndef ZIPADD_MAXTHREADS
+#  define ZIPADD_MAXTHREADS (64)
+#endif
+#ifndef ZIPADD_TEMPDIR
+#  define ZIPADD_TEMPDIR "/tmp"
+#endif
+
+/* Defaults of the compression policy */
+#ifndef ZIPADD_STOREBELOW
+#  define ZIPADD_STOREBELOW (128)
+#endif
+#ifndef ZIPADD_SAMPLESIZE
+#  define ZIPADD_SAMPLESIZE (64 * 1024)
+#endif
+#ifndef ZIPADD_MINSAVING
+#  define ZIPADD_MINSAVING (5)
+#endif
+
+/* January 1st 1980, for files without a date */
+#define ZIPADD_DEFAULTDATE (0x00210000)
+
+#ifndef ALLOC
+#  define ALLOC(size) (malloc(size))
+#endif
+#ifndef TRYFREE
+#  define TRYFREE(p) {if (p) free(p);}
+#endif
+
+/* Formats that are compressed already */
+static const char *const zip_add_default_extensions[] = {
+    "jpg", "jpeg", "png", "gif", "webp", "heic", "heif",
+    "mp3", "m4a", "aac", "ogg", "opus", "flac",
+    "mp4", "m4v", "mov", "mkv", "webm", "avi",
+    "zip", "gz", "tgz", "bz2", "xz", "7z", "rar", "zst", "lz4",
+    "jar", "apk", "ipa", "docx", "xlsx", "pptx", "woff", "woff2",
+    NULL
+};
+
+/***************************************************************************/
+
+typedef struct zip_add_chunk_s
+{
+    struct zip_add_chunk_s *next;
+    uint32_t size;
+    uint8_t data[ZIPADD_CHUNKSIZE];
+} zip_add_chunk;
+
+typedef struct zip_add_task_s
+{
+    const zip_add_entry *entry;
+    uint32_t dos_date;
+    zip_add_chunk *first_chunk;         /* compressed data held in memory */
+    zip_add_chunk *last_chunk;
+    FILE *spill;                        /* compressed data after the chunks once memory_limit is reached */
+    uint64_t compressed_size;           /* including the encryption header and authentication code */
+    uint64_t uncompressed_size;
+    uint32_t crc32;
+    uint64_t read_pos;                  /* position in buf of entries without a path */
+    uint16_t method;                    /* method and level chosen for the file */
+    int level;
+    int decision;
+    int err;
+    int done;                           /* set by the worker, cleared by the writer */
+} zip_add_task;
+
+typedef struct zip_add_s
+{
+    pthread_mutex_t mutex;              /* protects everything below */
+    pthread_cond_t task_done;
+    pthread_cond_t task_written;
+    const zip_add_options *options;
+    const zip_add_entry *entries;
+
+    zip_add_task *tasks;                /* ring of the files between the writer and the workers */
+    uint32_t window;
+    uint64_t task_count;
+    uint64_t next_task;
+    uint64_t next_write;
+
+    uint64_t memory_limit;
+    uint64_t memory_used;
+    int stop;                           /* the writer failed, the workers take no more files */
+} zip_add;
+
+typedef struct zip_add_worker_s
+{
+    zip_add *add;
+    pthread_t thread;
+    z_stream stream;
+    int stream_initialised;
+    int level;
+    z_stream sample_stream;             /* fast deflate of the samples of the compression policy */
+    int sample_stream_initialised;
+    uint8_t *in_buf;
+    uint8_t *out_buf;
+#ifdef HAVE_AES
+    prng_ctx rng[1];
+    int rng_initialised;
+#endif
+} zip_add_worker;
+
+/***************************************************************************/
+
+/* Open an anonymous spill file, tmpfile() is not allowed in the shared directory of sandboxed apps */
+static FILE *zipAddOpenSpill(const zip_add_options *options)
+{
+    const char *temp_dir = options->temp_dir;
+    char *path = NULL;
+    FILE *spill = NULL;
+    size_t path_size = 0;
+    int fd = -1;
+#ifdef __APPLE__
+    char user_temp_dir[1024];
+#endif
+
+    if (temp_dir == NULL)
+        temp_dir = getenv("TMPDIR");
+#ifdef __APPLE__
+    if ((temp_dir == NULL) && (confstr(_CS_DARWIN_USER_TEMP_DIR, user_temp_dir, sizeof(user_temp_dir)) > 0) &&
+        (strlen(user_temp_dir) + 1 < sizeof(user_temp_dir)))
+        temp_dir = user_temp_dir;
+#endif
+    if ((temp_dir == NULL) || (*temp_dir == 0))
+        temp_dir = ZIPADD_TEMPDIR;
+
+    path_size = strlen(temp_dir) + 16;
+    path = (char*)ALLOC(path_size);
+    if (path == NULL)
+        return NULL;
+    snprintf(path, path_size, "%s/zipadd.XXXXXX", temp_dir);
+
+    fd = mkstemp(path);
+    if (fd != -1)
+    {
+        unlink(path);
+        spill = fdopen(fd, "w+b");
+        if (spill == NULL)
+            close(fd);
+    }
+    TRYFREE(path);
+    return spill;
+}
+
+/* Keep compressed data in chunks while the memory limit allows it, the rest of the file is spilled */
+static int zipAddAppend(zip_add *add, zip_add_task *task, const uint8_t *buf, uint32_t len)
+{
+    zip_add_chunk *chunk = NULL;
+    uint32_t copy_this = 0;
+    int allowed = 0;
+
+    task->compressed_size += len;
+    while ((len > 0) && (task->spill == NULL))
+    {
+        chunk = task->last_chunk;
+        if ((chunk == NULL) || (chunk->size == ZIPADD_CHUNKSIZE))
+        {
+            pthread_mutex_lock(&add->mutex);
+            allowed = (add->memory_used + ZIPADD_CHUNKSIZE <= add->memory_limit);
+            if (allowed)
+                add->memory_used += ZIPADD_CHUNKSIZE;
+            pthread_mutex_unlock(&add->mutex);
+
+            chunk = NULL;
+            if (allowed)
+            {
+                chunk = (zip_add_chunk*)ALLOC(sizeof(zip_add_chunk));
+                if (chunk == NULL)
+                {
+                    pthread_mutex_lock(&add->mutex);
+                    add->memory_used -= ZIPADD_CHUNKSIZE;
+                    pthread_mutex_unlock(&add->mutex);
+                }
+            }
+            if (chunk == NULL)
+            {
+                task->spill = zipAddOpenSpill(add->options);
+                if (task->spill == NULL)
+                    return ZIP_ERRNO;
+                break;
+            }
+
+            chunk->next = NULL;
+            chunk->size = 0;
+            if (task->last_chunk != NULL)
+                task->last_chunk->next = chunk;
+            else
+                task->first_chunk = chunk;
+            task->last_chunk = chunk;
+        }
+
+        copy_this = ZIPADD_CHUNKSIZE - chunk->size;
+        if (copy_this > len)
+            copy_this = len;
+        memcpy(chunk->data + chunk->size, buf, copy_this);
+        chunk->size += copy_this;
+        buf += copy_this;
+        len -= copy_this;
+    }
+
+    if ((len > 0) && (fwrite(buf, 1, len, task->spill) != len))
+        return ZIP_ERRNO;
+    return ZIP_OK;
+}
+
+static void zipAddFreeTask(zip_add *add, zip_add_task *task)
+{
+    zip_add_chunk *chunk = task->first_chunk;
+    zip_add_chunk *next = NULL;
+    uint64_t freed = 0;
+
+    while (chunk != NULL)
+    {
+        next = chunk->next;
+        TRYFREE(chunk);
+        freed += ZIPADD_CHUNKSIZE;
+        chunk = next;
+    }
+    task->first_chunk = NULL;
+    task->last_chunk = NULL;
+    if (task->spill != NULL)
+        fclose(task->spill);
+    task->spill = NULL;
+
+    pthread_mutex_lock(&add->mutex);
+    add->memory_used -= freed;
+    pthread_mutex_unlock(&add->mutex);
+}
+
+static int zipAddPrepareDeflate(zip_add_worker *worker, int level)
+{
+    int err = Z_OK;
+
+    /* Reset gives the same output as a new stream, so reusing it does not depend on the files before */
+    if ((worker->stream_initialised) && (worker->level == level))
+        return deflateReset(&worker->stream);
+    if (worker->stream_initialised)
+        deflateEnd(&worker->stream);
+    worker->stream_initialised = 0;
+
+    memset(&worker->stream, 0, sizeof(worker->stream));
+    err = deflateInit2(&worker->stream, level, Z_DEFLATED, -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+    if (err == Z_OK)
+    {
+        worker->stream_initialised = 1;
+        worker->level = level;
+    }
+    return err;
+}
+
+/* Read the next block of the file, from fin or from buf when the entry has no path */
+static int zipAddRead(zip_add_worker *worker, zip_add_task *task, FILE *fin, const uint8_t **in, uint32_t *in_size)
+{
+    const zip_add_entry *entry = task->entry;
+    uint64_t buf_left = 0;
+
+    *in_size = 0;
+    if (fin != NULL)
+    {
+        *in = worker->in_buf;
+        *in_size = (uint32_t)fread(worker->in_buf, 1, ZIPADD_BUFSIZE, fin);
+        if (ferror(fin))
+            return ZIP_ERRNO;
+    }
+    else if ((entry->path == NULL) && (entry->buf != NULL))
+    {
+        buf_left = entry->size - task->read_pos;
+        *in = (const uint8_t*)entry->buf + task->read_pos;
+        *in_size = (buf_left > ZIPADD_BUFSIZE) ? ZIPADD_BUFSIZE : (uint32_t)buf_left;
+    }
+    task->read_pos += *in_size;
+    return ZIP_OK;
+}
+
+static int zipAddHasExtension(const char *filename, const char *const *extensions)
+{
+    const char *extension = NULL;
+    const char *p = NULL;
+    size_t len = 0;
+    size_t i = 0;
+
+    for (p = filename; (p != NULL) && (*p != 0); p += 1)
+    {
+        if (*p == '.')
+            extension = p + 1;
+        else if ((*p == '/') || (*p == '\\'))
+            extension = NULL;
+    }
+    if ((extension == NULL) || (*extension == 0))
+        return 0;
+    len = strlen(extension);
+
+    for (; *extensions != NULL; extensions += 1)
+    {
+        if (strlen(*extensions) != len)
+            continue;
+        for (i = 0; i < len; i += 1)
+        {
+            if (tolower((unsigned char)extension[i]) != tolower((unsigned char)(*extensions)[i]))
+                break;
+        }
+        if (i == len)
+            return 1;
+    }
+    return 0;
+}
+
+/* Choose the method and level of a file to deflate from its name, its size and how well its first block
+   deflates. known_size is UINT64_MAX when the first block is not the whole file */
+static int zipAddChooseMethod(zip_add_worker *worker, zip_add_task *task, const uint8_t *in, uint32_t in_size,
+    uint64_t known_size)
+{
+    const zip_add_policy *policy = worker->add->options->policy;
+    const char *const *extensions = zip_add_default_extensions;
+    uint64_t store_below = ZIPADD_STOREBELOW;
+    uint32_t sample_size = ZIPADD_SAMPLESIZE;
+    uint32_t min_saving = ZIPADD_MINSAVING;
+    uint32_t saving = 0;
+    uint32_t out_size = 0;
+    int err = Z_OK;
+
+    task->method = task->entry->method;
+    task->level = task->entry->level;
+    task->decision = ZIP_ADD_AS_ENTRY;
+    if ((policy == NULL) || (task->method != Z_DEFLATED))
+        return ZIP_OK;
+
+    if (policy->store_below > 0)
+        store_below = policy->store_below;
+    if (policy->store_extensions != NULL)
+        extensions = policy->store_extensions;
+    if (policy->sample_size > 0)
+        sample_size = policy->sample_size;
+    if (policy->min_saving > 0)
+        min_saving = policy->min_saving;
+
+    task->method = 0;
+    task->level = 0;
+    if (known_size < store_below)
+    {
+        task->decision = ZIP_ADD_STORED_SMALL;
+        return ZIP_OK;
+    }
+    if ((task->entry->filename != NULL) && (zipAddHasExtension(task->entry->filename, extensions)))
+    {
+        task->decision = ZIP_ADD_STORED_EXTENSION;
+        return ZIP_OK;
+    }
+
+    /* The fastest level tells compressed data apart from the rest at little cost */
+    if (in_size > sample_size)
+        in_size = sample_size;
+    if (worker->sample_stream_initialised)
+        err = deflateReset(&worker->sample_stream);
+    else
+    {
+        err = deflateInit2(&worker->sample_stream, Z_BEST_SPEED, Z_DEFLATED, -MAX_WBITS, DEF_MEM_LEVEL,
+            Z_DEFAULT_STRATEGY);
+        worker->sample_stream_initialised = (err == Z_OK);
+    }
+    if (err == Z_OK)
+    {
+        worker->sample_stream.next_in = (Bytef*)in;
+        worker->sample_stream.avail_in = in_size;
+        worker->sample_stream.next_out = worker->out_buf;
+        worker->sample_stream.avail_out = ZIPADD_BUFSIZE;
+        err = deflate(&worker->sample_stream, Z_FINISH);
+        if (err == Z_STREAM_END)
+            err = Z_OK;
+    }
+    if (err != Z_OK)
+        return ZIP_INTERNALERROR;
+
+    out_size = ZIPADD_BUFSIZE - worker->sample_stream.avail_out;
+    if (out_size < in_size)
+        saving = (uint32_t)(((uint64_t)(in_size - out_size) * 100) / in_size);
+    if (saving < min_saving)
+    {
+        task->decision = ZIP_ADD_STORED_SAMPLE;
+        return ZIP_OK;
+    }
+
+    task->method = Z_DEFLATED;
+    task->level = task->entry->level;
+    task->decision = ZIP_ADD_DEFLATED_SAMPLE;
+    if (saving < policy->fast_saving)
+    {
+        task->level = Z_BEST_SPEED;
+        task->decision = ZIP_ADD_DEFLATED_FAST;
+    }
+    return ZIP_OK;
+}
+
+/* Compress and encrypt the file of the task into its chunks and spill file */
+static int zipAddCompressEntry(zip_add_worker *worker, zip_add_task *task)
+{
+    zip_add *add = worker->add;
+    const zip_add_entry *entry = task->entry;
+    const char *password = add->options->password;
+    const uint8_t *in = worker->in_buf;
+    uint64_t known_size = UINT64_MAX;
+    FILE *fin = NULL;
+    size_t filename_len = 0;
+    uint32_t in_size = 0;
+    uint32_t out_size = 0;
+    uint32_t i = 0;
+    int is_directory = 0;
+    int flush = Z_NO_FLUSH;
+    int err = ZIP_OK;
+#ifndef NOCRYPT
+    uint8_t buf_head[RAND_HEAD_LEN];
+    uint32_t keys[3];
+    const z_crc_t *pcrc_32_tab = NULL;
+    uint32_t size_head = 0;
+    uint8_t t = 0;
+#endif
+#ifdef HAVE_AES
+    fcrypt_ctx aes_ctx;
+    uint8_t saltvalue[AES_MAXSALTLENGTH];
+    uint8_t passverify[AES_PWVERIFYSIZE];
+    uint8_t authcode[AES_AUTHCODESIZE];
+#endif
+
+    if ((entry->method != 0) && (entry->method != Z_DEFLATED))
+        return ZIP_PARAMERROR;
+#ifdef NOCRYPT
+    if (password != NULL)
+        return ZIP_PARAMERROR;
+#endif
+
+    if (entry->filename != NULL)
+        filename_len = strlen(entry->filename);
+    is_directory = (filename_len > 0) &&
+        ((entry->filename[filename_len - 1] == '/') || (entry->filename[filename_len - 1] == '\\'));
+
+    task->dos_date = entry->file_info.dos_date;
+    if ((task->dos_date == 0) && (entry->path != NULL))
+    {
+        /* get_file_date uses localtime which is not reentrant */
+        pthread_mutex_lock(&add->mutex);
+        get_file_date(entry->path, &task->dos_date);
+        pthread_mutex_unlock(&add->mutex);
+    }
+    if (task->dos_date == 0)
+        task->dos_date = ZIPADD_DEFAULTDATE;
+
+    if ((entry->path != NULL) && (!is_directory))
+    {
+        fin = fopen64(entry->path, "rb");
+        if (fin == NULL)
+            return ZIP_ERRNO;
+    }
+
+    /* The first block is read before the method is chosen as it is the sample of the compression policy */
+    err = zipAddRead(worker, task, fin, &in, &in_size);
+    if (err == ZIP_OK)
+    {
+        if (fin == NULL)
+            known_size = ((entry->path == NULL) && (entry->buf != NULL)) ? entry->size : 0;
+        else if (in_size < ZIPADD_BUFSIZE)
+            known_size = in_size;
+        err = zipAddChooseMethod(worker, task, in, in_size, known_size);
+    }
+    if (err != ZIP_OK)
+    {
+        if (fin != NULL)
+            fclose(fin);
+        return err;
+    }
+
+#ifndef NOCRYPT
+    if (password != NULL)
+    {
+#ifdef HAVE_AES
+        if (add->options->aes)
+        {
+            /* Each worker has its own generator, salts only need to differ */
+            if (!worker->rng_initialised)
+            {
+                prng_init(cryptrand, worker->rng);
+                worker->rng_initialised = 1;
+            }
+            prng_rand(saltvalue, SALT_LENGTH(AES_ENCRYPTIONMODE), worker->rng);
+            fcrypt_init(AES_ENCRYPTIONMODE, (const uint8_t*)password, (uint32_t)strlen(password), saltvalue,
+                passverify, &aes_ctx);
+            err = zipAddAppend(add, task, saltvalue, SALT_LENGTH(AES_ENCRYPTIONMODE));
+            if (err == ZIP_OK)
+                err = zipAddAppend(add, task, passverify, AES_PWVERIFYSIZE);
+        }
+        else
+#endif
+        {
+            /* zip.c writes a data descriptor, the header is checked with the high bytes of the time */
+            pcrc_32_tab = get_crc_table();
+            size_head = crypthead(password, buf_head, RAND_HEAD_LEN, keys, pcrc_32_tab,
+                (uint8_t)((task->dos_date >> 16) & 0xff), (uint8_t)((task->dos_date >> 8) & 0xff));
+            err = zipAddAppend(add, task, buf_head, size_head);
+        }
+    }
+#endif
+
+    if ((err == ZIP_OK) && (task->method == Z_DEFLATED))
+    {
+        if (zipAddPrepareDeflate(worker, task->level) != Z_OK)
+            err = ZIP_INTERNALERROR;
+    }
+
+    while ((err == ZIP_OK) && (flush != Z_FINISH))
+    {
+        if (in_size == 0)
+            flush = Z_FINISH;
+
+        task->crc32 = crc32_fast(task->crc32, in, in_size);
+        task->uncompressed_size += in_size;
+
+        if (task->method == Z_DEFLATED)
+        {
+            worker->stream.next_in = (Bytef*)in;
+            worker->stream.avail_in = in_size;
+        }
+
+        do
+        {
+            if (task->method == Z_DEFLATED)
+            {
+                worker->stream.next_out = worker->out_buf;
+                worker->stream.avail_out = ZIPADD_BUFSIZE;
+                if (deflate(&worker->stream, flush) == Z_STREAM_ERROR)
+                {
+                    err = ZIP_INTERNALERROR;
+                    break;
+                }
+                out_size = ZIPADD_BUFSIZE - worker->stream.avail_out;
+            }
+            else if (password != NULL)
+            {
+                memcpy(worker->out_buf, in, in_size);
+                out_size = in_size;
+            }
+            else
+            {
+                /* Stored files without encryption are kept as they are read */
+                err = zipAddAppend(add, task, in, in_size);
+                break;
+            }
+
+#ifndef NOCRYPT
+            if (password != NULL)
+            {
+#ifdef HAVE_AES
+                if (add->options->aes)
+                    fcrypt_encrypt(worker->out_buf, out_size, &aes_ctx);
+                else
+#endif
+                {
+                    for (i = 0; i < out_size; i += 1)
+                        worker->out_buf[i] = (uint8_t)zencode(keys, pcrc_32_tab, worker->out_buf[i], t);
+                }
+            }
+#endif
+            err = zipAddAppend(add, task, worker->out_buf, out_size);
+        }
+        while ((err == ZIP_OK) && (task->method == Z_DEFLATED) && (worker->stream.avail_out == 0));
+
+        if ((err == ZIP_OK) && (flush != Z_FINISH))
+            err = zipAddRead(worker, task, fin, &in, &in_size);
+    }
+
+#ifdef HAVE_AES
+    if ((password != NULL) && (add->options->aes))
+    {
+        fcrypt_end(authcode, &aes_ctx);
+        if (err == ZIP_OK)
+            err = zipAddAppend(add, task, authcode, AES_AUTHCODESIZE);
+    }
+#endif
+
+    if (fin != NULL)
+        fclose(fin);
+    return err;
+}
+
+/* Write the compressed file of the task to the zipfile with the raw write functions */
+static int zipAddWriteEntry(zipFile file, zip_add *add, zip_add_task *task, uint8_t *buf)
+{
+    const zip_add_entry *entry = task->entry;
+    const zip_add_chunk *chunk = NULL;
+    zip_fileinfo file_info = entry->file_info;
+    int raw = 1;
+    int zip64 = 0;
+    size_t read = 0;
+    int err = ZIP_OK;
+    int err_close = ZIP_OK;
+
+    file_info.dos_date = task->dos_date;
+    if (add->options->password != NULL)
+        raw = ZIP_RAW_ENCRYPTED;
+    zip64 = (task->uncompressed_size >= UINT32_MAX) || (task->compressed_size >= UINT32_MAX);
+
+    err = zipOpenNewFileInZip5(file, entry->filename, &file_info, NULL, 0, NULL, 0, NULL, 0, zip64,
+        task->method, task->level, raw, -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY,
+        add->options->password, add->options->aes);
+    if (err != ZIP_OK)
+        return err;
+
+    for (chunk = task->first_chunk; (err == ZIP_OK) && (chunk != NULL); chunk = chunk->next)
+        err = zipWriteInFileInZip(file, chunk->data, chunk->size);
+
+    if ((err == ZIP_OK) && (task->spill != NULL))
+    {
+        rewind(task->spill);
+        while (err == ZIP_OK)
+        {
+            read = fread(buf, 1, ZIPADD_BUFSIZE, task->spill);
+            if (read == 0)
+                break;
+            err = zipWriteInFileInZip(file, buf, (uint32_t)read);
+        }
+        if ((err == ZIP_OK) && (ferror(task->spill)))
+            err = ZIP_ERRNO;
+    }
+
+    err_close = zipCloseFileInZipRaw64(file, task->uncompressed_size, task->crc32);
+    if (err == ZIP_OK)
+        err = err_close;
+    return err;
+}
+
+/* Take the next file unless the writer is a window of files behind */
+static zip_add_task *zipAddNextTask(zip_add *add)
+{
+    zip_add_task *task = NULL;
+
+    pthread_mutex_lock(&add->mutex);
+    while ((!add->stop) && (add->next_task < add->task_count) &&
+        (add->next_task >= add->next_write + add->window))
+        pthread_cond_wait(&add->task_written, &add->mutex);
+    if ((!add->stop) && (add->next_task < add->task_count))
+    {
+        task = &add->tasks[add->next_task % add->window];
+        task->entry = &add->entries[add->next_task];
+        add->next_task += 1;
+    }
+    pthread_mutex_unlock(&add->mutex);
+    return task;
+}
+
+static void *zipAddWorker(void *arg)
+{
+    zip_add_worker *worker = (zip_add_worker*)arg;
+    zip_add *add = worker->add;
+    zip_add_task *task = NULL;
+    int err = ZIP_OK;
+
+    for (;;)
+    {
+        task = zipAddNextTask(add);
+        if (task == NULL)
+            break;
+
+        err = zipAddCompressEntry(worker, task);
+
+        pthread_mutex_lock(&add->mutex);
+        task->err = err;
+        task->done = 1;
+        pthread_cond_broadcast(&add->task_done);
+        pthread_mutex_unlock(&add->mutex);
+    }
+    return NULL;
+}
+
+static uint32_t zipAddThreadCount(const zip_add_options *options, uint64_t task_count)
+{
+    uint32_t thread_count = options->thread_count;
+    long online = 0;
+
+    if (thread_count == 0)
+    {
+        online = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = (online > 0) ? (uint32_t)online : 1;
+    }
+    if (thread_count > ZIPADD_MAXTHREADS)
+        thread_count = ZIPADD_MAXTHREADS;
+    if ((uint64_t)thread_count > task_count)
+        thread_count = (uint32_t)task_count;
+    if (thread_count == 0)
+        thread_count = 1;
+    return thread_count;
+}
+
+/***************************************************************************/
+
+extern int ZEXPORT zipAddAll(zipFile file, const zip_add_entry *entries, uint64_t entry_count,
+    const zip_add_options *options, zip_add_result *results, uint64_t *error_entry)
+{
+    zip_add_options default_options;
+    zip_add add;
+    zip_add_worker workers[ZIPADD_MAXTHREADS];
+    zip_add_task *task = NULL;
+    uint8_t *write_buf = NULL;
+    uint64_t bytes_done = 0;
+    uint64_t i = 0;
+    uint32_t thread_count = 0;
+    uint32_t started = 0;
+    uint32_t j = 0;
+    int err = ZIP_OK;
+
+    if (error_entry != NULL)
+        *error_entry = UINT64_MAX;
+    if ((file == NULL) || ((entries == NULL) && (entry_count > 0)))
+        return ZIP_PARAMERROR;
+    if (entry_count == 0)
+        return ZIP_OK;
+    if (options == NULL)
+    {
+        memset(&default_options, 0, sizeof(default_options));
+        options = &default_options;
+    }
+
+    memset(&add, 0, sizeof(add));
+    memset(workers, 0, sizeof(workers));
+    add.options = options;
+    add.entries = entries;
+    add.task_count = entry_count;
+    add.memory_limit = (options->memory_limit > 0) ? options->memory_limit : ZIPADD_MEMORYLIMIT;
+
+    thread_count = zipAddThreadCount(options, entry_count);
+    /* Enough files in flight to keep every thread busy while the writer waits for the slowest */
+    add.window = thread_count * 2;
+
+    add.tasks = (zip_add_task*)ALLOC(add.window * sizeof(zip_add_task));
+    write_buf = (uint8_t*)ALLOC(ZIPADD_BUFSIZE);
+    if ((add.tasks == NULL) || (write_buf == NULL))
+    {
+        TRYFREE(add.tasks);
+        TRYFREE(write_buf);
+        return ZIP_INTERNALERROR;
+    }
+    memset(add.tasks, 0, add.window * sizeof(zip_add_task));
+
+    if ((pthread_mutex_init(&add.mutex, NULL) != 0) || (pthread_cond_init(&add.task_done, NULL) != 0) ||
+        (pthread_cond_init(&add.task_written, NULL) != 0))
+    {
+        TRYFREE(add.tasks);
+        TRYFREE(write_buf);
+        return ZIP_INTERNALERROR;
+    }
+
+    for (j = 0; j < thread_count; j += 1)
+    {
+        workers[j].add = &add;
+        workers[j].in_buf = (uint8_t*)ALLOC(ZIPADD_BUFSIZE);
+        workers[j].out_buf = (uint8_t*)ALLOC(ZIPADD_BUFSIZE);
+        if ((workers[j].in_buf == NULL) || (workers[j].out_buf == NULL))
+        {
+            /* Carry on with the threads already running */
+            if (j == 0)
+                err = ZIP_INTERNALERROR;
+            break;
+        }
+        /* A single worker compresses on the calling thread between writes */
+        if (thread_count == 1)
+            break;
+        if (pthread_create(&workers[j].thread, NULL, zipAddWorker, &workers[j]) != 0)
+            break;
+        started += 1;
+    }
+
+    for (i = 0; (err == ZIP_OK) && (i < entry_count); i += 1)
+    {
+        task = &add.tasks[i % add.window];
+        if (started == 0)
+        {
+            zipAddNextTask(&add);
+            task->err = zipAddCompressEntry(&workers[0], task);
+            task->done = 1;
+        }
+
+        pthread_mutex_lock(&add.mutex);
+        while (!task->done)
+            pthread_cond_wait(&add.task_done, &add.mutex);
+        pthread_mutex_unlock(&add.mutex);
+
+        err = task->err;
+        if (err == ZIP_OK)
+            err = zipAddWriteEntry(file, &add, task, write_buf);
+        bytes_done += task->uncompressed_size;
+        if (results != NULL)
+        {
+            results[i].error = err;
+            results[i].decision = task->decision;
+            results[i].method = task->method;
+            results[i].level = task->level;
+            results[i].uncompressed_size = task->uncompressed_size;
+            results[i].compressed_size = task->compressed_size;
+        }
+        zipAddFreeTask(&add, task);
+
+        pthread_mutex_lock(&add.mutex);
+        memset(task, 0, sizeof(zip_add_task));
+        add.next_write += 1;
+        if (err != ZIP_OK)
+            add.stop = 1;
+        pthread_cond_broadcast(&add.task_written);
+        pthread_mutex_unlock(&add.mutex);
+
+        if (err != ZIP_OK)
+        {
+            if (error_entry != NULL)
+                *error_entry = i;
+            break;
+        }
+        if (options->progress != NULL)
+            options->progress(bytes_done, i + 1, entry_count, options->user_data);
+    }
+
+    for (j = 0; j < started; j += 1)
+        pthread_join(workers[j].thread, NULL);
+
+    /* Files compressed after the one that failed are not written */
+    for (j = 0; j < add.window; j += 1)
+        zipAddFreeTask(&add, &add.tasks[j]);
+    for (j = 0; j < thread_count; j += 1)
+    {
+        if (workers[j].stream_initialised)
+            deflateEnd(&workers[j].stream);
+        if (workers[j].sample_stream_initialised)
+            deflateEnd(&workers[j].sample_stream);
+#ifdef HAVE_AES
+        if (workers[j].rng_initialised)
+            prng_end(workers[j].rng);
+#endif
+        TRYFREE(workers[j].in_buf);
+        TRYFREE(workers[j].out_buf);
+    }
+
+    pthread_cond_destroy(&add.task_written);
+    pthread_cond_destroy(&add.task_done);
+    pthread_mutex_destroy(&add.mutex);
+    TRYFREE(add.tasks);
+    TRYFREE(write_buf);
+    return err;
+}
@@ -0,0 +1,102 @@
+/* zipadd.h -- Add many files to a .zip using several threads
+   part of the MiniZip project
+
+   This program is distributed under the terms of the same license as zlib.
+   See the accompanying LICENSE file for the full text of the license.
+*/
+
+#ifndef _ZIPADD_H
+#define _ZIPADD_H
+
+#include <stdint.h>
+
+#include "zip.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***************************************************************************/
+
+/* Decisions of the compression policy */
+#define ZIP_ADD_AS_ENTRY                (0) /* method and level of the entry, without a policy or to store */
+#define ZIP_ADD_STORED_SMALL            (1) /* smaller than store_below */
+#define ZIP_ADD_STORED_EXTENSION        (2) /* name ends with one of store_extensions */
+#define ZIP_ADD_STORED_SAMPLE           (3) /* the sample shrank by less than min_saving */
+#define ZIP_ADD_DEFLATED_SAMPLE         (4) /* deflated at the level of the entry */
+#define ZIP_ADD_DEFLATED_FAST           (5) /* the sample shrank by less than fast_saving, deflated at level 1 */
+
+typedef void (*zipAddProgressFunction)(uint64_t bytes_done, uint64_t files_done, uint64_t files_total,
+    void *user_data);
+
+typedef struct zip_add_entry_s
+{
+    const char *filename;               /* name of the file in the zipfile, directories end with a slash */
+    const char *path;                   /* file the data is read from, or NULL to take it from buf */
+    const void *buf;                    /* data of the file when path is NULL */
+    uint64_t size;                      /* size of buf */
+    zip_fileinfo file_info;             /* dos_date 0 takes the date of path */
+    uint16_t method;                    /* 0 to store, Z_DEFLATED to deflate */
+    int level;                          /* deflate level, can be Z_DEFAULT_COMPRESSION */
+} zip_add_entry;
+
+typedef struct zip_add_policy_s
+{
+    uint64_t store_below;               /* files smaller than this are stored, 0 for the default of 128 bytes */
+    const char *const *store_extensions; /* extensions of files stored without sampling, case insensitive and
+                                           ending with NULL, NULL for the default list of compressed formats */
+    uint32_t sample_size;               /* bytes deflated on trial, 0 for 64 KB, 256 KB at most */
+    uint32_t min_saving;                /* percentage the sample must shrink by to deflate, 0 for 5 */
+    uint32_t fast_saving;               /* percentage below which level 1 is used instead, 0 to keep the level */
+} zip_add_policy;
+
+typedef struct zip_add_result_s
+{
+    int error;                          /* ZIP_OK if the file was added */
+    int decision;                       /* one of ZIP_ADD_AS_ENTRY..ZIP_ADD_DEFLATED_FAST */
+    uint16_t method;                    /* method and level the file was written with */
+    int level;
+    uint64_t uncompressed_size;
+    uint64_t compressed_size;           /* including the encryption header and authentication code */
+} zip_add_result;
+
+typedef struct zip_add_options_s
+{
+    uint32_t thread_count;              /* number of worker threads, 0 for one per online processor */
+    uint64_t memory_limit;              /* compressed data held in memory, 0 for the default of 64 MB */
+    const char *password;               /* password to encrypt the files with or NULL */
+    int aes;                            /* encrypt with AES instead of the traditional PKWARE encryption */
+    const zip_add_policy *policy;       /* chooses the method of the entries to deflate, NULL to keep it */
+    zipAddProgressFunction progress;    /* called after each file is written, on the calling thread, or NULL */
+    void *user_data;                    /* passed to progress */
+    const char *temp_dir;               /* directory of the temporary files, NULL for the default */
+} zip_add_options;
+
+/***************************************************************************/
+
+extern int ZEXPORT zipAddAll(zipFile file, const zip_add_entry *entries, uint64_t entry_count,
+    const zip_add_options *options, zip_add_result *results, uint64_t *error_entry);
+/* Add the entries to the zipfile in the order of the array. The worker threads compress and encrypt the
+   files at the same time, the calling thread writes each finished file as raw data (see ZIP_RAW_ENCRYPTED).
+   Compressed data past memory_limit goes to temporary files in temp_dir, or else in $TMPDIR or the
+   temporary directory of the user, and the workers stay a few files ahead of the writer at most. The zipfile is the same whatever the number of threads, except for the random
+   encryption headers.
+
+   With a policy, entries to deflate are stored when they are small, have the extension of a compressed
+   format or when the first sample_size bytes barely shrink with a fast deflate. Entries to store are
+   always stored. The choice only depends on the data, so it is the same whatever the number of threads.
+
+   options can be NULL for the defaults. buf of each entry must stay valid until the function returns.
+   results can be NULL, otherwise it receives the result of each entry written or that failed, and must
+   have room for entry_count results.
+
+   return ZIP_OK if there is no error, otherwise the error of the first entry that failed, whose number is
+   stored in error_entry if it is not NULL. The entries before it are in the zipfile. */
+
+/***************************************************************************/
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ZIPADD_H */